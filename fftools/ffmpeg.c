@@ -157,6 +157,8 @@ int         nb_output_files   = 0;
 FilterGraph **filtergraphs;
 int        nb_filtergraphs;
 
+AVBufferArena *frame_arena;
+
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -166,6 +168,24 @@ static int restore_tty;
 
 #if HAVE_THREADS
 static void free_input_threads(void);
+static void free_encoder_threads(void);
+static void free_stage_threads(void);
+/* output stream of every frame submitted to an encoder thread, oldest first */
+static AVFifoBuffer *encode_order;
+
+/* decoder and filter threads, see init_stage_threads() */
+static int stage_threads;
+static pthread_t main_thread;
+static pthread_t filter_thread;
+static AVThreadMessageQueue *filter_queue;
+static int filter_error;
+/* output and filtergraph state, shared by the main and the filter thread */
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static int state_locked;
+/* decoding progress and error counters */
+static pthread_mutex_t decode_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t decode_cond = PTHREAD_COND_INITIALIZER;
+static int nb_packets_queued, nb_packets_filtered;
 #endif
 
 /* sub2video hack:
@@ -489,6 +509,17 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
 
+#if HAVE_THREADS
+    if (stage_threads && !pthread_equal(pthread_self(), main_thread)) {
+        /* a decoder or the filter thread failed, everything below is still
+         * in use by the other threads */
+        term_exit();
+        return;
+    }
+    free_stage_threads();
+    free_encoder_threads();
+#endif
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
         avfilter_graph_free(&fg->graph);
@@ -620,6 +651,8 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&output_streams);
     av_freep(&output_files);
 
+    av_buffer_arena_uninit(&frame_arena);
+
     uninit_opts();
 
     avformat_network_deinit();
@@ -908,6 +941,302 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
+static void encoded_audio_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+
+    av_packet_rescale_ts(pkt, enc->time_base, ost->mux_timebase);
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "encoder -> type:audio "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base));
+    }
+
+    output_packet(of, pkt, ost, 0);
+}
+
+static void encoded_video_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt,
+                                 int64_t sync_opts)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base));
+    }
+
+    if (pkt->pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
+        pkt->pts = sync_opts;
+
+    av_packet_rescale_ts(pkt, enc->time_base, ost->mux_timebase);
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
+            "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+            av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &ost->mux_timebase),
+            av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &ost->mux_timebase));
+    }
+
+    output_packet(of, pkt, ost, 0);
+}
+
+#if HAVE_THREADS
+/*
+ * With -thread_pipeline every encoder runs in its own thread. The main thread
+ * submits frames and later collects the resulting packets, always in the
+ * order of the output streams and of the submitted frames, so that the muxers
+ * see exactly the same sequence of packets as with serial encoding.
+ */
+typedef struct EncodeJob {
+    AVFrame *frame;
+    int64_t sync_opts;      /* ost->sync_opts when the frame was submitted */
+    int first;              /* first frame of a do_video_out() call */
+} EncodeJob;
+
+typedef struct EncodeResult {
+    AVPacket pkt;
+    char *stats_out;        /* copy of the two-pass stats for this packet */
+    int64_t sync_opts;
+    int first;              /* first result of a job with EncodeJob.first set */
+    int frame_done;         /* all packets of the submitted frame were sent */
+    int ret;
+} EncodeResult;
+
+static void encode_job_free(void *msg)
+{
+    EncodeJob *job = msg;
+    av_frame_free(&job->frame);
+}
+
+static void encode_result_free(void *msg)
+{
+    EncodeResult *res = msg;
+    av_packet_unref(&res->pkt);
+    av_freep(&res->stats_out);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    AVCodecContext *enc = ost->enc_ctx;
+    EncodeJob job;
+
+    while (av_thread_message_queue_recv(ost->enc_in_queue, &job, 0) >= 0) {
+        EncodeResult res;
+        int first = job.first;
+        int ret = avcodec_send_frame(enc, job.frame);
+
+        av_frame_free(&job.frame);
+
+        while (ret >= 0) {
+            memset(&res, 0, sizeof(res));
+            av_init_packet(&res.pkt);
+            ret = avcodec_receive_packet(enc, &res.pkt);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = 0;
+                break;
+            }
+            if (ret < 0)
+                break;
+
+            if (ost->logfile && enc->stats_out &&
+                !(res.stats_out = av_strdup(enc->stats_out))) {
+                av_packet_unref(&res.pkt);
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            res.sync_opts = job.sync_opts;
+            res.first     = first;
+            first         = 0;
+            if (av_thread_message_queue_send(ost->enc_out_queue, &res, 0) < 0) {
+                encode_result_free(&res);
+                return NULL;
+            }
+        }
+
+        memset(&res, 0, sizeof(res));
+        res.first      = first;
+        res.frame_done = 1;
+        res.ret        = ret;
+        if (av_thread_message_queue_send(ost->enc_out_queue, &res, 0) < 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static void free_encoder_thread(OutputStream *ost)
+{
+    if (!ost->enc_in_queue)
+        return;
+
+    av_log(NULL, AV_LOG_VERBOSE, "Output stream #%d:%d: up to %d frame(s) "
+           "were being encoded while the next ones were decoded and filtered\n",
+           ost->file_index, ost->index, ost->enc_max_in_flight);
+
+    av_thread_message_flush(ost->enc_in_queue);
+    av_thread_message_queue_set_err_recv(ost->enc_in_queue, AVERROR_EOF);
+    av_thread_message_queue_set_err_send(ost->enc_out_queue, AVERROR_EOF);
+    pthread_join(ost->enc_thread, NULL);
+
+    av_thread_message_queue_free(&ost->enc_in_queue);
+    av_thread_message_queue_free(&ost->enc_out_queue);
+    ost->enc_pending = 0;
+}
+
+static void free_encoder_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i])
+            free_encoder_thread(output_streams[i]);
+    av_fifo_freep(&encode_order);
+}
+
+static int init_encoder_thread(OutputStream *ost)
+{
+    int ret;
+
+    if (!encode_order &&
+        !(encode_order = av_fifo_alloc(16 * sizeof(OutputStream *))))
+        return AVERROR(ENOMEM);
+
+    if ((ret = av_thread_message_queue_alloc(&ost->enc_in_queue, 8,
+                                             sizeof(EncodeJob))) < 0 ||
+        (ret = av_thread_message_queue_alloc(&ost->enc_out_queue, 8,
+                                             sizeof(EncodeResult))) < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(ost->enc_in_queue, encode_job_free);
+    av_thread_message_queue_set_free_func(ost->enc_out_queue, encode_result_free);
+
+    if ((ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    av_thread_message_queue_free(&ost->enc_in_queue);
+    av_thread_message_queue_free(&ost->enc_out_queue);
+    return ret;
+}
+
+/**
+ * Write the packets of the oldest frame submitted to the encoder thread of
+ * ost. Return 1 once all of them are written, 0 if the frame is still being
+ * encoded and block is 0.
+ */
+static int collect_encoder_frame(OutputStream *ost, int block)
+{
+    OutputFile *of = output_files[ost->file_index];
+    int video = ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO;
+    EncodeResult res;
+    int ret;
+
+    for (;;) {
+        ret = av_thread_message_queue_recv(ost->enc_out_queue, &res,
+                                           block ? 0 : AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        if (ret >= 0)
+            ret = res.ret;
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "%s encoding failed\n", video ? "Video" : "Audio");
+            exit_program(1);
+        }
+
+        if (res.first)
+            ost->enc_frame_size = 0;
+
+        if (res.frame_done) {
+            ost->enc_pending--;
+            if (video && vstats_filename && ost->enc_frame_size)
+                do_video_stats(ost, ost->enc_frame_size);
+            return 1;
+        }
+
+        if (video) {
+            ost->enc_frame_size = res.pkt.size;
+            encoded_video_packet(of, ost, &res.pkt, res.sync_opts);
+
+            /* if two pass, output log */
+            if (res.stats_out)
+                fprintf(ost->logfile, "%s", res.stats_out);
+            av_freep(&res.stats_out);
+        } else
+            encoded_audio_packet(of, ost, &res.pkt);
+    }
+}
+
+/**
+ * Write the output of the encoder threads in the order the frames were
+ * submitted, so that the muxers see the packets in the same order as with
+ * serial encoding.
+ *
+ * If block is 0, stop at the first frame that is still being encoded.
+ * Otherwise wait until ost has at most max_pending frames left in flight,
+ * or until all frames are written if ost is NULL.
+ */
+static void collect_encoder_outputs(int block, OutputStream *ost, int max_pending)
+{
+    OutputStream *head;
+
+    while (encode_order && av_fifo_size(encode_order)) {
+        if (ost && ost->enc_pending <= max_pending)
+            break;
+        av_fifo_generic_peek(encode_order, &head, sizeof(head), NULL);
+        if (!collect_encoder_frame(head, block))
+            break;
+        av_fifo_drain(encode_order, sizeof(head));
+    }
+}
+
+static void submit_encoder_frame(OutputStream *ost, AVFrame *frame, int first)
+{
+    EncodeJob job = { NULL, ost->sync_opts, first };
+    int ret;
+
+    if (!ost->enc_in_queue && init_encoder_thread(ost) < 0)
+        exit_program(1);
+
+    job.frame = av_frame_clone(frame);
+    if (!job.frame) {
+        av_log(NULL, AV_LOG_FATAL, "Could not allocate frame\n");
+        exit_program(1);
+    }
+
+    if (av_fifo_space(encode_order) < sizeof(ost) &&
+        av_fifo_realloc2(encode_order, 2 * av_fifo_size(encode_order)) < 0) {
+        av_frame_free(&job.frame);
+        av_log(NULL, AV_LOG_FATAL, "Could not allocate the encoder queue\n");
+        exit_program(1);
+    }
+
+    ret = av_thread_message_queue_send(ost->enc_in_queue, &job,
+                                       AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret == AVERROR(EAGAIN)) {
+        /* the encoder is lagging behind: wait until it is done with one
+         * frame, writing the output of all frames submitted before it */
+        collect_encoder_outputs(1, ost, ost->enc_pending - 1);
+        ret = av_thread_message_queue_send(ost->enc_in_queue, &job, 0);
+    }
+    if (ret < 0) {
+        av_frame_free(&job.frame);
+        av_log(NULL, AV_LOG_FATAL, "Unable to send frame to the encoder thread: %s\n",
+               av_err2str(ret));
+        exit_program(1);
+    }
+    av_fifo_generic_write(encode_order, &ost, sizeof(ost), NULL);
+    ost->enc_pending++;
+}
+#endif
+
 static void do_audio_out(OutputFile *of, OutputStream *ost,
                          AVFrame *frame)
 {
@@ -937,6 +1266,13 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
+#if HAVE_THREADS
+    if (thread_pipeline) {
+        submit_encoder_frame(ost, frame, 1);
+        return;
+    }
+#endif
+
     ret = avcodec_send_frame(enc, frame);
     if (ret < 0)
         goto error;
@@ -950,16 +1286,7 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
 
         update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
 
-        av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
-
-        if (debug_ts) {
-            av_log(NULL, AV_LOG_INFO, "encoder -> type:audio "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                   av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
-                   av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
-        }
-
-        output_packet(of, &pkt, ost, 0);
+        encoded_audio_packet(of, ost, &pkt);
     }
 
     return;
@@ -1286,6 +1613,17 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+#if HAVE_THREADS
+        if (thread_pipeline) {
+            submit_encoder_frame(ost, in_picture, !i);
+            // Make sure Closed Captions will not be duplicated
+            av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
+            ost->sync_opts++;
+            ost->frame_number++;
+            continue;
+        }
+#endif
+
         ret = avcodec_send_frame(enc, in_picture);
         if (ret < 0)
             goto error;
@@ -1300,27 +1638,8 @@ static void do_video_out(OutputFile *of,
             if (ret < 0)
                 goto error;
 
-            if (debug_ts) {
-                av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
-                       "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                       av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
-                       av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
-            }
-
-            if (pkt.pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
-                pkt.pts = ost->sync_opts;
-
-            av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
-
-            if (debug_ts) {
-                av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
-                    "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                    av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &ost->mux_timebase),
-                    av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &ost->mux_timebase));
-            }
-
             frame_size = pkt.size;
-            output_packet(of, &pkt, ost, 0);
+            encoded_video_packet(of, ost, &pkt, ost->sync_opts);
 
             /* if two pass, output log */
             if (ost->logfile && enc->stats_out) {
@@ -1493,8 +1812,16 @@ static int reap_filters(int flush)
 
             switch (av_buffersink_get_type(filter)) {
             case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
+                if (!ost->frame_aspect_ratio.num &&
+                    (enc->sample_aspect_ratio.num != filtered_frame->sample_aspect_ratio.num ||
+                     enc->sample_aspect_ratio.den != filtered_frame->sample_aspect_ratio.den)) {
+#if HAVE_THREADS
+                    /* the encoder thread may be using the context */
+                    if (ost->enc_in_queue)
+                        collect_encoder_outputs(1, ost, 0);
+#endif
                     enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
+                }
 
                 if (debug_ts) {
                     av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
@@ -1523,6 +1850,18 @@ static int reap_filters(int flush)
         }
     }
 
+#if HAVE_THREADS
+    /* write what is already encoded, the rest keeps being encoded while the
+     * next frames are decoded and filtered; with the filter thread the main
+     * thread does this */
+    if (!stage_threads)
+        collect_encoder_outputs(0, NULL, 0);
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        ost->enc_max_in_flight = FFMAX(ost->enc_max_in_flight, ost->enc_pending);
+    }
+#endif
+
     return 0;
 }
 
@@ -1991,13 +2330,19 @@ static int check_output_constraints(InputStream *ist, OutputStream *ost)
     return 1;
 }
 
-static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *pkt)
+/**
+ * Stream copy pkt to ost. If steal is set and the packet is reference counted,
+ * its reference is moved to the output packet instead of creating a new one;
+ * pkt must not be used afterwards then.
+ */
+static void do_streamcopy(InputStream *ist, OutputStream *ost, AVPacket *pkt,
+                          int steal)
 {
     OutputFile *of = output_files[ost->file_index];
     InputFile   *f = input_files [ist->file_index];
     int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
     int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->mux_timebase);
-    AVPacket opkt;
+    AVPacket opkt, ipkt;
 
     // EOF: flush output bitstream filters.
     if (!pkt) {
@@ -2042,8 +2387,14 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
     if (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
         ost->sync_opts++;
 
-    if (av_packet_ref(&opkt, pkt) < 0)
+    if (steal && pkt->buf) {
+        /* keep the input properties around for the timestamp computations */
+        ipkt = *pkt;
+        av_packet_move_ref(&opkt, pkt);
+        pkt = &ipkt;
+    } else if (av_packet_ref(&opkt, pkt) < 0) {
         exit_program(1);
+    }
 
     if (pkt->pts != AV_NOPTS_VALUE)
         opkt.pts = av_rescale_q(pkt->pts, ist->st->time_base, ost->mux_timebase) - ost_tb_start_time;
@@ -2090,8 +2441,15 @@ int guess_input_channel_layout(InputStream *ist)
 
 static void check_decode_result(InputStream *ist, int *got_output, int ret)
 {
-    if (*got_output || ret<0)
+    if (*got_output || ret<0) {
+#if HAVE_THREADS
+        pthread_mutex_lock(&decode_lock);
+#endif
         decode_error_stat[ret<0] ++;
+#if HAVE_THREADS
+        pthread_mutex_unlock(&decode_lock);
+#endif
+    }
 
     if (ret < 0 && exit_on_error)
         exit_program(1);
@@ -2185,7 +2543,17 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
         }
     }
 
+#if HAVE_THREADS
+    /* only the filter thread sends frames while it runs, and it is the only
+     * user of the graph: let the main thread write packets meanwhile */
+    if (stage_threads)
+        pthread_mutex_unlock(&state_lock);
+#endif
     ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, AV_BUFFERSRC_FLAG_PUSH);
+#if HAVE_THREADS
+    if (stage_threads)
+        pthread_mutex_lock(&state_lock);
+#endif
     if (ret < 0) {
         if (ret != AVERROR_EOF)
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -2245,7 +2613,8 @@ static int decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, AVPacke
     return 0;
 }
 
-static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
+static int push_frame_to_filters(InputStream *ist, AVFrame *decoded_frame,
+                                 AVFrame *filter_frame)
 {
     int i, ret;
     AVFrame *f;
@@ -2253,7 +2622,7 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
     av_assert1(ist->nb_filters > 0); /* ensure ret is initialized */
     for (i = 0; i < ist->nb_filters; i++) {
         if (i < ist->nb_filters - 1) {
-            f = ist->filter_frame;
+            f = filter_frame;
             ret = av_frame_ref(f, decoded_frame);
             if (ret < 0)
                 break;
@@ -2271,6 +2640,40 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
     return ret;
 }
 
+#if HAVE_THREADS
+/* a demuxed packet on its way through a decoder thread to the filter thread */
+typedef struct DecodedPacket {
+    AVPacket pkt;
+    InputStream *ist;
+    AVFifoBuffer *frames;   /* AVFrame* decoded from pkt */
+    int done;               /* decoding finished, protected by decode_lock */
+} DecodedPacket;
+
+static int queue_decoded_frame(DecodedPacket *dp, AVFrame *decoded_frame)
+{
+    AVFrame *f;
+
+    if (av_fifo_space(dp->frames) < sizeof(f) &&
+        av_fifo_grow(dp->frames, sizeof(f)) < 0)
+        return AVERROR(ENOMEM);
+    if (!(f = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(f, decoded_frame);
+    av_fifo_generic_write(dp->frames, &f, sizeof(f), NULL);
+    return 0;
+}
+#endif
+
+static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
+{
+#if HAVE_THREADS
+    /* on a decoder thread, the filter thread picks the frame up later */
+    if (ist->dec_packet)
+        return queue_decoded_frame(ist->dec_packet, decoded_frame);
+#endif
+    return push_frame_to_filters(ist, decoded_frame, ist->filter_frame);
+}
+
 static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
                         int *decode_failed)
 {
@@ -2559,9 +2962,9 @@ static int send_filter_eof(InputStream *ist)
 }
 
 /* pkt = NULL means EOF (needed to flush decoder buffers) */
-static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
+static int process_input_packet(InputStream *ist, AVPacket *pkt, int no_eof)
 {
-    int ret = 0, i;
+    int ret = 0, i, j;
     int repeating = 0;
     int eof_reached = 0;
 
@@ -2732,15 +3135,300 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
 
-        if (!check_output_constraints(ist, ost) || ost->encoding_needed)
+        /* test encoding_needed first, decoder threads must not look at the
+         * state of the encoded streams */
+        if (ost->encoding_needed || !check_output_constraints(ist, ost))
             continue;
 
-        do_streamcopy(ist, ost, pkt);
+        /* the last copy can take over the reference of the input packet */
+        for (j = i + 1; j < nb_output_streams; j++)
+            if (!output_streams[j]->encoding_needed &&
+                check_output_constraints(ist, output_streams[j]))
+                break;
+
+        do_streamcopy(ist, ost, pkt, j == nb_output_streams);
     }
 
     return !eof_reached;
 }
 
+#if HAVE_THREADS
+/*
+ * With -thread_pipeline, if a single input file is read and all of its
+ * streams are decoded and sent through simple filtergraphs, every input
+ * stream gets a decoder thread and the filtergraphs run on a filter thread.
+ * The main thread sends each demuxed packet both to the decoder thread of its
+ * stream and to the filter thread, which waits for the frames decoded from it
+ * and feeds them to the filters, in demuxing order. The filtered frames go to
+ * the encoder threads, and the main thread writes the encoded packets.
+ *
+ * The main thread holds state_lock except while it waits for another stage,
+ * the filter thread takes it for everything but running the graphs.
+ */
+static void release_state(void)
+{
+    if (state_locked) {
+        state_locked = 0;
+        pthread_mutex_unlock(&state_lock);
+    }
+}
+
+static void acquire_state(void)
+{
+    if (stage_threads && !state_locked) {
+        pthread_mutex_lock(&state_lock);
+        state_locked = 1;
+    }
+}
+
+static void decoded_packet_free(DecodedPacket **pdp)
+{
+    DecodedPacket *dp = *pdp;
+    AVFrame *frame;
+
+    if (!dp)
+        return;
+    while (dp->frames && av_fifo_size(dp->frames)) {
+        av_fifo_generic_read(dp->frames, &frame, sizeof(frame), NULL);
+        av_frame_free(&frame);
+    }
+    av_fifo_freep(&dp->frames);
+    av_packet_unref(&dp->pkt);
+    av_freep(pdp);
+}
+
+static void decoded_packet_msg_free(void *msg)
+{
+    decoded_packet_free(msg);
+}
+
+static void decoded_packet_done(DecodedPacket *dp)
+{
+    InputStream *ist = dp->ist;
+
+    pthread_mutex_lock(&decode_lock);
+    dp->done = 1;
+    ist->dec_done++;
+    pthread_cond_broadcast(&decode_cond);
+    pthread_mutex_unlock(&decode_lock);
+}
+
+static void *decoder_thread(void *arg)
+{
+    InputStream *ist = arg;
+    DecodedPacket *dp;
+
+    while (av_thread_message_queue_recv(ist->dec_queue, &dp, 0) >= 0) {
+        ist->dec_packet = dp;
+        process_input_packet(ist, &dp->pkt, 0);
+        ist->dec_packet = NULL;
+        av_packet_unref(&dp->pkt);
+
+        /* dp belongs to the filter thread from now on */
+        decoded_packet_done(dp);
+    }
+
+    return NULL;
+}
+
+static void *filter_thread_main(void *arg)
+{
+    AVFrame *filter_frame = av_frame_alloc();
+    DecodedPacket *dp;
+    int ret = filter_frame ? 0 : AVERROR(ENOMEM);
+
+    while (av_thread_message_queue_recv(filter_queue, &dp, 0) >= 0) {
+        AVFrame *frame;
+
+        pthread_mutex_lock(&decode_lock);
+        while (!dp->done)
+            pthread_cond_wait(&decode_cond, &decode_lock);
+        pthread_mutex_unlock(&decode_lock);
+
+        /* after an error, only drop the packets until the main thread stops */
+        if (ret >= 0) {
+            pthread_mutex_lock(&state_lock);
+            while (ret >= 0 && av_fifo_size(dp->frames)) {
+                av_fifo_generic_read(dp->frames, &frame, sizeof(frame), NULL);
+                ret = push_frame_to_filters(dp->ist, frame, filter_frame);
+                av_frame_unref(filter_frame);
+                av_frame_free(&frame);
+            }
+            if (ret >= 0)
+                ret = reap_filters(0);
+            pthread_mutex_unlock(&state_lock);
+            if (ret < 0)
+                av_log(NULL, AV_LOG_FATAL, "Error while processing the decoded "
+                       "data for stream #%d:%d\n", dp->ist->file_index, dp->ist->st->index);
+        }
+        decoded_packet_free(&dp);
+
+        pthread_mutex_lock(&decode_lock);
+        if (ret < 0)
+            filter_error = ret;
+        nb_packets_filtered++;
+        pthread_cond_broadcast(&decode_cond);
+        pthread_mutex_unlock(&decode_lock);
+    }
+
+    av_frame_free(&filter_frame);
+    return NULL;
+}
+
+/**
+ * Wait until the decoder thread of ist is done with all the packets sent to
+ * it, or if ist is NULL, until the filter thread is done with all packets.
+ */
+static void wait_stage_threads(InputStream *ist)
+{
+    pthread_mutex_lock(&decode_lock);
+    if (ist ? ist->dec_done < ist->dec_sent :
+              nb_packets_filtered < nb_packets_queued) {
+        release_state();
+        while (ist ? ist->dec_done < ist->dec_sent :
+                     nb_packets_filtered < nb_packets_queued)
+            pthread_cond_wait(&decode_cond, &decode_lock);
+    }
+    pthread_mutex_unlock(&decode_lock);
+    acquire_state();
+}
+
+/* the filter thread leaves exiting on errors to the main thread */
+static void check_filter_error(void)
+{
+    int ret;
+
+    pthread_mutex_lock(&decode_lock);
+    ret = filter_error;
+    pthread_mutex_unlock(&decode_lock);
+    if (ret < 0)
+        exit_program(1);
+}
+
+static int send_to_decoder_thread(InputStream *ist, AVPacket *pkt)
+{
+    DecodedPacket *dp = av_mallocz(sizeof(*dp));
+    int ret;
+
+    if (!dp || !(dp->frames = av_fifo_alloc(4 * sizeof(AVFrame *)))) {
+        av_free(dp);
+        av_packet_unref(pkt);
+        return AVERROR(ENOMEM);
+    }
+    dp->ist = ist;
+    av_packet_move_ref(&dp->pkt, pkt);
+
+    /* the filter thread may need the state to make room in its queue */
+    release_state();
+    ret = av_thread_message_queue_send(filter_queue, &dp, 0);
+    if (ret < 0) {
+        decoded_packet_free(&dp);
+        acquire_state();
+        return ret;
+    }
+    ist->dec_sent++;
+    pthread_mutex_lock(&decode_lock);
+    nb_packets_queued++;
+    pthread_mutex_unlock(&decode_lock);
+
+    ret = av_thread_message_queue_send(ist->dec_queue, &dp, 0);
+    if (ret < 0)
+        decoded_packet_done(dp); /* let the filter thread drop it */
+    acquire_state();
+    return ret;
+}
+
+static void free_stage_threads(void)
+{
+    int i;
+
+    if (!stage_threads)
+        return;
+    release_state();
+
+    /* the filter thread finishes the queued packets first, so the decoder
+     * threads must keep running until it is done */
+    if (filter_queue) {
+        av_thread_message_queue_set_err_recv(filter_queue, AVERROR_EOF);
+        pthread_join(filter_thread, NULL);
+        av_thread_message_queue_free(&filter_queue);
+    }
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (!ist->dec_queue)
+            continue;
+        av_thread_message_queue_set_err_recv(ist->dec_queue, AVERROR_EOF);
+        pthread_join(ist->dec_thread, NULL);
+        av_thread_message_queue_free(&ist->dec_queue);
+    }
+    stage_threads = 0;
+}
+
+static int init_stage_threads(void)
+{
+    int i, ret;
+
+    if (!thread_pipeline || nb_input_files != 1 || input_files[0]->loop ||
+        input_files[0]->rate_emu || do_benchmark_all)
+        return 0;
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (ist->discard)
+            continue;
+        if (!ist->decoding_needed || !ist->nb_filters ||
+            ist->hwaccel_id != HWACCEL_NONE ||
+            (ist->dec_ctx->codec_type != AVMEDIA_TYPE_AUDIO &&
+             ist->dec_ctx->codec_type != AVMEDIA_TYPE_VIDEO))
+            return 0;
+    }
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (ost->stream_copy || !ost->filter ||
+            !filtergraph_is_simple(ost->filter->graph))
+            return 0;
+    }
+
+    main_thread   = pthread_self();
+    stage_threads = 1;
+    acquire_state();
+
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+
+        if (ist->discard)
+            continue;
+        if ((ret = av_thread_message_queue_alloc(&ist->dec_queue, 1,
+                                                 sizeof(DecodedPacket *))) < 0)
+            goto fail;
+        if ((ret = pthread_create(&ist->dec_thread, NULL, decoder_thread, ist))) {
+            av_thread_message_queue_free(&ist->dec_queue);
+            goto fail_thread;
+        }
+    }
+
+    if ((ret = av_thread_message_queue_alloc(&filter_queue, 8,
+                                             sizeof(DecodedPacket *))) < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(filter_queue, decoded_packet_msg_free);
+    if ((ret = pthread_create(&filter_thread, NULL, filter_thread_main, NULL))) {
+        av_thread_message_queue_free(&filter_queue);
+        goto fail_thread;
+    }
+
+    av_log(NULL, AV_LOG_VERBOSE, "Decoding and filtering in separate threads\n");
+    return 0;
+fail_thread:
+    av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+    ret = AVERROR(ret);
+fail:
+    free_stage_threads();
+    return ret;
+}
+#endif
+
 static void print_sdp(void)
 {
     char sdp[16384];
@@ -2899,6 +3587,7 @@ static int init_input_stream(int ist_index, char *error, int error_len)
         ist->dec_ctx->get_format            = get_format;
         ist->dec_ctx->get_buffer2           = get_buffer;
         ist->dec_ctx->thread_safe_callbacks = 1;
+        ist->dec_ctx->frame_arena           = frame_arena;
 
         av_opt_set_int(ist->dec_ctx, "refcounted_frames", 1, 0);
         if (ist->dec_ctx->codec_id == AV_CODEC_ID_DVB_SUBTITLE &&
@@ -3658,6 +4347,16 @@ static int transcode_init(void)
     InputStream *ist;
     char error[1024] = {0};
 
+    /* decoders and filtergraphs allocate their frames from one arena, so that
+     * buffers freed by one of them can be reused by all the others; like the
+     * default pools of the decoders, do not hide memory poisoning */
+    if (use_frame_arena) {
+        frame_arena = av_buffer_arena_init(CONFIG_MEMORY_POISONING ? NULL :
+                                           av_buffer_allocz);
+        if (!frame_arena)
+            return AVERROR(ENOMEM);
+    }
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
         for (j = 0; j < fg->nb_outputs; j++) {
@@ -3906,6 +4605,11 @@ static int check_keyboard_interaction(int64_t cur_time)
         key = -1;
     if (key == 'q')
         return AVERROR_EXIT;
+#if HAVE_THREADS
+    /* the commands below use the filtergraphs and the decoders */
+    if (stage_threads && (key == 'c' || key == 'C' || key == 'd' || key == 'D'))
+        wait_stage_threads(NULL);
+#endif
     if (key == '+') av_log_set_level(av_log_get_level()+10);
     if (key == '-') av_log_set_level(av_log_get_level()-10);
     if (key == 's') qp_hist     ^= 1;
@@ -4080,7 +4784,7 @@ static int init_input_thread(int i)
     int ret;
     InputFile *f = input_files[i];
 
-    if (nb_input_files == 1)
+    if (nb_input_files == 1 && !thread_pipeline)
         return 0;
 
     if (f->ctx->pb ? !f->ctx->pb->seekable :
@@ -4114,6 +4818,16 @@ static int init_input_threads(void)
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
+    if (stage_threads) {
+        /* nothing else to do until the next packet arrives, let the filter
+         * thread have the state meanwhile */
+        int ret;
+
+        release_state();
+        ret = av_thread_message_queue_recv(f->in_thread_queue, pkt, 0);
+        acquire_state();
+        return ret;
+    }
     return av_thread_message_queue_recv(f->in_thread_queue, pkt,
                                         f->non_blocking ?
                                         AV_THREAD_MESSAGE_NONBLOCK : 0);
@@ -4134,7 +4848,7 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     }
 
 #if HAVE_THREADS
-    if (nb_input_files > 1)
+    if (nb_input_files > 1 || thread_pipeline)
         return get_input_packet_mt(f, pkt);
 #endif
     return av_read_frame(f->ctx, pkt);
@@ -4291,6 +5005,11 @@ static int process_input(int file_index)
         }
     }
     if (ret < 0) {
+#if HAVE_THREADS
+        /* decode the rest serially, the flushing is not worth a thread */
+        free_stage_threads();
+        check_filter_error();
+#endif
         if (ret != AVERROR_EOF) {
             print_error(is->url, ret);
             if (exit_on_error)
@@ -4340,6 +5059,12 @@ static int process_input(int file_index)
     if (ist->discard)
         goto discard_packet;
 
+#if HAVE_THREADS
+    /* the timestamp checks below use the state of the previous packet */
+    if (stage_threads)
+        wait_stage_threads(ist);
+#endif
+
     if (pkt.flags & AV_PKT_FLAG_CORRUPT) {
         av_log(NULL, exit_on_error ? AV_LOG_FATAL : AV_LOG_WARNING,
                "%s: corrupt input packet in stream %d\n", is->url, pkt.stream_index);
@@ -4505,6 +5230,10 @@ static int process_input(int file_index)
 
     sub2video_heartbeat(ist, pkt.pts);
 
+#if HAVE_THREADS
+    if (stage_threads)
+        return send_to_decoder_thread(ist, &pkt);
+#endif
     process_input_packet(ist, &pkt, 0);
 
 discard_packet:
@@ -4583,6 +5312,20 @@ static int transcode_step(void)
         return AVERROR_EOF;
     }
 
+#if HAVE_THREADS
+    if (stage_threads) {
+        /* the filter thread does the rest */
+        check_filter_error();
+        ret = process_input(0);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        if (ret < 0)
+            return ret == AVERROR_EOF ? 0 : ret;
+        collect_encoder_outputs(0, NULL, 0);
+        return 0;
+    }
+#endif
+
     if (ost->filter && !ost->filter->graph->graph) {
         if (ifilter_has_all_input_formats(ost->filter->graph)) {
             ret = configure_filtergraph(ost->filter->graph);
@@ -4663,6 +5406,8 @@ static int transcode(void)
 #if HAVE_THREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_stage_threads()) < 0)
+        goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -4689,6 +5434,8 @@ static int transcode(void)
         print_report(0, timer_start, cur_time);
     }
 #if HAVE_THREADS
+    free_stage_threads();
+    check_filter_error();
     free_input_threads();
 #endif
 
@@ -4699,6 +5446,10 @@ static int transcode(void)
             process_input_packet(ist, NULL, 0);
         }
     }
+#if HAVE_THREADS
+    collect_encoder_outputs(1, NULL, 0);
+    free_encoder_threads();
+#endif
     flush_encoders();
 
     term_exit();
@@ -388,6 +388,15 @@ typedef struct InputStream {
     int nb_dts_buffer;
 
     int got_output;
+
+#if HAVE_THREADS
+    /* decoding offloaded to a separate thread, see -thread_pipeline */
+    AVThreadMessageQueue *dec_queue;    /* packets sent to the decoder thread */
+    pthread_t dec_thread;
+    int dec_sent;               /* packets sent to the decoder thread */
+    int dec_done;               /* packets decoded, protected by decode_lock */
+    struct DecodedPacket *dec_packet;   /* packet being decoded by the thread */
+#endif
 } InputStream;
 
 typedef struct InputFile {
@@ -549,6 +558,16 @@ typedef struct OutputStream {
 
     /* frame encode sum of squared error values */
     int64_t error[4];
+
+#if HAVE_THREADS
+    /* encoding offloaded to a separate thread, see -thread_pipeline */
+    AVThreadMessageQueue *enc_in_queue;  /* frames sent to the encoder thread */
+    AVThreadMessageQueue *enc_out_queue; /* packets returned by the encoder thread */
+    pthread_t enc_thread;
+    int enc_pending;            /* frames submitted but not collected yet */
+    int enc_frame_size;         /* size of the last collected packet, for -vstats */
+    int enc_max_in_flight;      /* most frames still being encoded after a reap_filters() pass */
+#endif
 } OutputStream;
 
 typedef struct OutputFile {
@@ -609,6 +628,9 @@ extern char *videotoolbox_pixfmt;
 
 extern int filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int filter_complex_parallel;
+extern int thread_pipeline;
+extern int use_frame_arena;
 extern int vstats_version;
 
 extern const AVIOInterruptCB int_cb;
@@ -616,6 +638,7 @@ extern const AVIOInterruptCB int_cb;
 extern const OptionDef options[];
 extern const HWAccel hwaccels[];
 extern AVBufferRef *hw_device_ctx;
+extern AVBufferArena *frame_arena;
 #if CONFIG_QSV
 extern char *qsv_device;
 #endif
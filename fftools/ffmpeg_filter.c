@@ -1011,6 +1011,7 @@ int configure_filtergraph(FilterGraph *fg)
     cleanup_filtergraph(fg);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->frame_arena = frame_arena;
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -1050,6 +1051,8 @@ int configure_filtergraph(FilterGraph *fg)
             av_opt_set(fg->graph, "threads", e->value, 0);
     } else {
         fg->graph->nb_threads = filter_complex_nbthreads;
+        if (filter_complex_parallel)
+            fg->graph->thread_type |= AVFILTER_THREAD_GRAPH;
     }
 
     if ((ret = avfilter_graph_parse2(fg->graph, graph_desc, &inputs, &outputs)) < 0)
@@ -110,6 +110,9 @@ int frame_bits_per_raw_sample = 0;
 float max_error_rate  = 2.0/3;
 int filter_nbthreads = 0;
 int filter_complex_nbthreads = 0;
+int filter_complex_parallel = 0;
+int thread_pipeline = 0;
+int use_frame_arena = 1;
 int vstats_version = 2;
 
 
@@ -3523,6 +3526,8 @@ const OptionDef options[] = {
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_threads", HAS_ARG | OPT_INT,                   { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "filter_complex_parallel", OPT_BOOL | OPT_EXPERT,              { &filter_complex_parallel },
+        "run independent branches of -filter_complex graphs in parallel" },
     { "lavfi",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_script", HAS_ARG | OPT_EXPERT,                 { .func_arg = opt_filter_complex_script },
@@ -3550,6 +3555,10 @@ const OptionDef options[] = {
     { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
                                                                      { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "thread_pipeline", OPT_BOOL | OPT_EXPERT,                      { &thread_pipeline },
+        "run demuxing and each encoder in separate threads" },
+    { "frame_arena",    OPT_BOOL | OPT_EXPERT,                       { &use_frame_arena },
+        "share frame buffers between all decoders and filtergraphs" },
     { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
 
@@ -40,6 +40,7 @@
 #include "libavutil/log.h"
 #include "libavutil/pixfmt.h"
 #include "libavutil/rational.h"
+#include "libavutil/threadpool.h"
 
 #include "version.h"
 
@@ -3397,6 +3398,34 @@ typedef struct AVCodecContext {
      * - encoding: set by user
      */
     int64_t max_samples;
+
+    /**
+     * Thread pool to take the frame and slice threads of this context from,
+     * instead of creating them. The same pool may be shared by any number of
+     * codec contexts. If the pool cannot provide thread_count threads, fewer
+     * threads are used.
+     *
+     * The pool is not owned by the context and must outlive it.
+     *
+     * - decoding: Set by user before avcodec_open2().
+     * - encoding: Set by user before avcodec_open2().
+     */
+    AVThreadPool *thread_pool;
+
+    /**
+     * Arena avcodec_default_get_buffer2() takes the buffers of decoded frames
+     * from, instead of pools private to this context. The same arena may be
+     * shared by any number of codec contexts and filter graphs (see
+     * AVFilterGraph.frame_arena), so that buffers released by one of them are
+     * reused by the others. Frames allocated with a hardware frames context
+     * are not affected.
+     *
+     * The arena is not owned by the context and must outlive it.
+     *
+     * - decoding: Set by user before avcodec_open2().
+     * - encoding: unused
+     */
+    AVBufferArena *frame_arena;
 } AVCodecContext;
 
 #if FF_API_CODEC_GET_SET
@@ -1550,8 +1550,10 @@ static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
         for (i = 0; i < 4; i++) {
             av_buffer_pool_uninit(&pool->pools[i]);
             pool->linesize[i] = linesize[i];
-            if (size[i]) {
-                pool->pools[i] = av_buffer_pool_init(size[i] + 16 + STRIDE_ALIGN - 1,
+            pool->sizes[i]    = size[i] ? size[i] + 16 + STRIDE_ALIGN - 1 : 0;
+            /* the buffers come from the arena, only their sizes are needed */
+            if (size[i] && !avctx->frame_arena) {
+                pool->pools[i] = av_buffer_pool_init(pool->sizes[i],
                                                      CONFIG_MEMORY_POISONING ?
                                                         NULL :
                                                         av_buffer_allocz);
@@ -1581,11 +1583,14 @@ static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
                                          frame->nb_samples, frame->format, 0);
         if (ret < 0)
             goto fail;
+        pool->sizes[0] = pool->linesize[0];
 
-        pool->pools[0] = av_buffer_pool_init(pool->linesize[0], NULL);
-        if (!pool->pools[0]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+        if (!avctx->frame_arena) {
+            pool->pools[0] = av_buffer_pool_init(pool->linesize[0], NULL);
+            if (!pool->pools[0]) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
         }
 
         pool->format     = frame->format;
@@ -1598,14 +1603,23 @@ static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
     }
     return 0;
 fail:
-    for (i = 0; i < 4; i++)
+    for (i = 0; i < 4; i++) {
         av_buffer_pool_uninit(&pool->pools[i]);
+        pool->sizes[i] = 0;
+    }
     pool->format = -1;
     pool->planes = pool->channels = pool->samples = 0;
     pool->width  = pool->height = 0;
     return ret;
 }
 
+static AVBufferRef *frame_pool_get(AVCodecContext *avctx, FramePool *pool, int i)
+{
+    if (avctx->frame_arena)
+        return av_buffer_arena_get(avctx->frame_arena, pool->sizes[i]);
+    return av_buffer_pool_get(pool->pools[i]);
+}
+
 static int audio_get_buffer(AVCodecContext *avctx, AVFrame *frame)
 {
     FramePool *pool = avctx->internal->pool;
@@ -1630,13 +1644,13 @@ static int audio_get_buffer(AVCodecContext *avctx, AVFrame *frame)
     }
 
     for (i = 0; i < FFMIN(planes, AV_NUM_DATA_POINTERS); i++) {
-        frame->buf[i] = av_buffer_pool_get(pool->pools[0]);
+        frame->buf[i] = frame_pool_get(avctx, pool, 0);
         if (!frame->buf[i])
             goto fail;
         frame->extended_data[i] = frame->data[i] = frame->buf[i]->data;
     }
     for (i = 0; i < frame->nb_extended_buf; i++) {
-        frame->extended_buf[i] = av_buffer_pool_get(pool->pools[0]);
+        frame->extended_buf[i] = frame_pool_get(avctx, pool, 0);
         if (!frame->extended_buf[i])
             goto fail;
         frame->extended_data[i + AV_NUM_DATA_POINTERS] = frame->extended_buf[i]->data;
@@ -1672,10 +1686,10 @@ static int video_get_buffer(AVCodecContext *s, AVFrame *pic)
     memset(pic->data, 0, sizeof(pic->data));
     pic->extended_data = pic->data;
 
-    for (i = 0; i < 4 && pool->pools[i]; i++) {
+    for (i = 0; i < 4 && pool->sizes[i]; i++) {
         pic->linesize[i] = pool->linesize[i];
 
-        pic->buf[i] = av_buffer_pool_get(pool->pools[i]);
+        pic->buf[i] = frame_pool_get(s, pool, i);
         if (!pic->buf[i])
             goto fail;
 
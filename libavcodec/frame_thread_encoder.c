@@ -29,6 +29,7 @@
 #include "libavutil/thread.h"
 #include "avcodec.h"
 #include "internal.h"
+#include "mpegvideoenc.h"
 #include "thread.h"
 
 #define MAX_THREADS 64
@@ -39,6 +40,7 @@ typedef struct{
     void *outdata;
     int64_t return_code;
     unsigned index;
+    int frame_number;
 } Task;
 
 typedef struct{
@@ -55,6 +57,13 @@ typedef struct{
 
     unsigned task_index;
     unsigned finished_task_index;
+    int frame_number;
+
+    /* the tasks are mpegvideo jobs rather than frames, see
+     * ff_mpv_encode_pipeline_supported() */
+    int mpegvideo_pipeline;
+    pthread_mutex_t progress_mutex;
+    pthread_cond_t progress_cond;
 
     pthread_t worker[MAX_THREADS];
     atomic_int exit;
@@ -84,13 +93,28 @@ static void * attribute_align_arg worker(void *v){
         }
         av_fifo_generic_read(c->task_fifo, &task, sizeof(task), NULL);
         pthread_mutex_unlock(&c->task_fifo_mutex);
-        frame = task.indata;
 
-        ret = avcodec_encode_video2(avctx, pkt, frame, &got_packet);
-        pthread_mutex_lock(&c->buffer_mutex);
-        av_frame_unref(frame);
-        pthread_mutex_unlock(&c->buffer_mutex);
-        av_frame_free(&frame);
+#if CONFIG_MPEGVIDEOENC
+        if (c->mpegvideo_pipeline) {
+            MPVEncodeJob *job = task.indata;
+
+            ret = ff_mpv_encode_job(avctx, pkt, job, &got_packet);
+            pthread_mutex_lock(&c->buffer_mutex);
+            ff_mpv_free_job(avctx, &job);
+            pthread_mutex_unlock(&c->buffer_mutex);
+        } else
+#endif
+        {
+            frame = task.indata;
+
+            /* number the frame as it would be numbered without threading */
+            avctx->frame_number = task.frame_number;
+            ret = avcodec_encode_video2(avctx, pkt, frame, &got_packet);
+            pthread_mutex_lock(&c->buffer_mutex);
+            av_frame_unref(frame);
+            pthread_mutex_unlock(&c->buffer_mutex);
+            av_frame_free(&frame);
+        }
         if(got_packet) {
             int ret2 = av_packet_make_refcounted(pkt);
             if (ret >= 0 && ret2 < 0)
@@ -114,15 +138,58 @@ end:
     return NULL;
 }
 
+/**
+ * The mpegvideo based encoders carry no state from one frame to the next
+ * if all frames are I-frames coded with a constant quantizer and without
+ * encoding delay, so they can be frame threaded like intra-only codecs.
+ */
+static int mpegvideo_frames_independent(AVCodecContext *avctx)
+{
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_MPEG2VIDEO:
+        /* without low delay, a frame is output only with the next one */
+        if (!(avctx->flags & AV_CODEC_FLAG_LOW_DELAY))
+            return 0;
+    case AV_CODEC_ID_MPEG4:
+        /* the time base is only reset by the GOP header */
+        if (avctx->workaround_bugs & FF_BUG_MS)
+            return 0;
+    case AV_CODEC_ID_H263P:
+        break;
+    default:
+        return 0;
+    }
+
+    return avctx->gop_size <= 1 && !avctx->max_b_frames &&
+           (avctx->flags & AV_CODEC_FLAG_QSCALE) &&
+           !(avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2));
+}
+
+static int mpegvideo_pipeline_supported(AVCodecContext *avctx)
+{
+#if CONFIG_MPEGVIDEOENC
+    return ff_mpv_encode_pipeline_supported(avctx);
+#else
+    return 0;
+#endif
+}
+
 int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
     int i=0;
+    int mpegvideo_pipeline = 0;
     ThreadContext *c;
 
 
-    if(   !(avctx->thread_type & FF_THREAD_FRAME)
-       || !(avctx->codec->capabilities & AV_CODEC_CAP_INTRA_ONLY))
+    if (!(avctx->thread_type & FF_THREAD_FRAME))
         return 0;
 
+    if (!(avctx->codec->capabilities & AV_CODEC_CAP_INTRA_ONLY ||
+          mpegvideo_frames_independent(avctx))) {
+        if (!mpegvideo_pipeline_supported(avctx))
+            return 0;
+        mpegvideo_pipeline = 1;
+    }
+
     if(   !avctx->thread_count
        && avctx->codec_id == AV_CODEC_ID_MJPEG
        && !(avctx->flags & AV_CODEC_FLAG_QSCALE)) {
@@ -179,6 +246,7 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
         return AVERROR(ENOMEM);
 
     c->parent_avctx = avctx;
+    c->mpegvideo_pipeline = mpegvideo_pipeline;
 
     c->task_fifo = av_fifo_alloc_array(BUFFER_SIZE, sizeof(Task));
     if(!c->task_fifo)
@@ -187,8 +255,10 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
     pthread_mutex_init(&c->task_fifo_mutex, NULL);
     pthread_mutex_init(&c->finished_task_mutex, NULL);
     pthread_mutex_init(&c->buffer_mutex, NULL);
+    pthread_mutex_init(&c->progress_mutex, NULL);
     pthread_cond_init(&c->task_fifo_cond, NULL);
     pthread_cond_init(&c->finished_task_cond, NULL);
+    pthread_cond_init(&c->progress_cond, NULL);
     atomic_init(&c->exit, 0);
 
     for(i=0; i<avctx->thread_count ; i++){
@@ -256,6 +326,13 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
         Task task;
         AVFrame *frame;
         av_fifo_generic_read(c->task_fifo, &task, sizeof(task), NULL);
+#if CONFIG_MPEGVIDEOENC
+        if (c->mpegvideo_pipeline) {
+            MPVEncodeJob *job = task.indata;
+            ff_mpv_free_job(avctx, &job);
+            continue;
+        }
+#endif
         frame = task.indata;
         av_frame_free(&frame);
         task.indata = NULL;
@@ -272,8 +349,10 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
     pthread_mutex_destroy(&c->task_fifo_mutex);
     pthread_mutex_destroy(&c->finished_task_mutex);
     pthread_mutex_destroy(&c->buffer_mutex);
+    pthread_mutex_destroy(&c->progress_mutex);
     pthread_cond_destroy(&c->task_fifo_cond);
     pthread_cond_destroy(&c->finished_task_cond);
+    pthread_cond_destroy(&c->progress_cond);
     av_fifo_freep(&c->task_fifo);
     av_freep(&avctx->internal->frame_thread_encoder);
 }
@@ -285,6 +364,19 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
 
     av_assert1(!*got_packet_ptr);
 
+    task.indata = NULL;
+#if CONFIG_MPEGVIDEOENC
+    if (c->mpegvideo_pipeline) {
+        MPVEncodeJob *job;
+
+        /* pictures are reordered and referenced by the parent context; the
+         * frame threads only code them */
+        ret = ff_mpv_encode_schedule(avctx, frame, &job);
+        if (ret < 0)
+            return ret;
+        task.indata = job;
+    } else
+#endif
     if(frame){
         AVFrame *new = av_frame_alloc();
         if(!new)
@@ -294,9 +386,12 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
             av_frame_free(&new);
             return ret;
         }
+        task.indata = (void*)new;
+    }
 
+    if (task.indata) {
         task.index = c->task_index;
-        task.indata = (void*)new;
+        task.frame_number = c->frame_number++;
         pthread_mutex_lock(&c->task_fifo_mutex);
         av_fifo_generic_write(c->task_fifo, &task, sizeof(task), NULL);
         pthread_cond_signal(&c->task_fifo_cond);
@@ -326,3 +421,31 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
 
     return task.return_code;
 }
+
+void ff_frame_thread_encoder_report_progress(AVCodecContext *avctx,
+                                             atomic_int *progress, int n)
+{
+    ThreadContext *c = avctx->internal->frame_thread_encoder;
+
+    if (!progress || atomic_load_explicit(progress, memory_order_relaxed) >= n)
+        return;
+
+    pthread_mutex_lock(&c->progress_mutex);
+    atomic_store_explicit(progress, n, memory_order_release);
+    pthread_cond_broadcast(&c->progress_cond);
+    pthread_mutex_unlock(&c->progress_mutex);
+}
+
+void ff_frame_thread_encoder_await_progress(AVCodecContext *avctx,
+                                            atomic_int *progress, int n)
+{
+    ThreadContext *c = avctx->internal->frame_thread_encoder;
+
+    if (!progress || atomic_load_explicit(progress, memory_order_acquire) >= n)
+        return;
+
+    pthread_mutex_lock(&c->progress_mutex);
+    while (atomic_load_explicit(progress, memory_order_relaxed) < n)
+        pthread_cond_wait(&c->progress_cond, &c->progress_mutex);
+    pthread_mutex_unlock(&c->progress_mutex);
+}
@@ -21,10 +21,30 @@
 #ifndef AVCODEC_FRAME_THREAD_ENCODER_H
 #define AVCODEC_FRAME_THREAD_ENCODER_H
 
+#include <stdatomic.h>
+
 #include "avcodec.h"
 
 int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options);
 void ff_frame_thread_encoder_free(AVCodecContext *avctx);
 int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVFrame *frame, int *got_packet_ptr);
 
+/**
+ * Set *progress to n, at least, and wake the frame threads waiting for it.
+ * Does nothing if progress is NULL.
+ *
+ * @param avctx the context of the calling frame thread
+ */
+void ff_frame_thread_encoder_report_progress(AVCodecContext *avctx,
+                                             atomic_int *progress, int n);
+
+/**
+ * Wait until *progress is at least n.
+ * Does nothing if progress is NULL.
+ *
+ * @param avctx the context of the calling frame thread
+ */
+void ff_frame_thread_encoder_await_progress(AVCodecContext *avctx,
+                                            atomic_int *progress, int n);
+
 #endif /* AVCODEC_FRAME_THREAD_ENCODER_H */
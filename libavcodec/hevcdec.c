@@ -1740,7 +1740,7 @@ static void chroma_mc_bi(HEVCContext *s, uint8_t *dst0, ptrdiff_t dststride, AVF
 static void hevc_await_progress(HEVCContext *s, HEVCFrame *ref,
                                 const Mv *mv, int y0, int height)
 {
-    if (s->threads_type == FF_THREAD_FRAME ) {
+    if (s->threads_type & FF_THREAD_FRAME) {
         int y = FFMAX(0, (mv->y >> 2) + y0 + height + 9);
 
         ff_thread_await_progress(&ref->tf, y, 0);
@@ -2556,6 +2556,36 @@ error:
     return ret;
 }
 
+#if HAVE_THREADS
+/**
+ * Row job used when WPP runs inside a frame thread. Rows finish out of
+ * order, so the frame progress is only reported once all rows above have
+ * run their loop filters.
+ */
+static int hls_decode_entry_wpp_hybrid(AVCodecContext *avctxt, void *input_ctb_row,
+                                       int job, int self_id)
+{
+    HEVCContext *s  = avctxt->priv_data;
+    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
+    int ctb_row     = ((int *)input_ctb_row)[job];
+    int y_ctb       = (s->sh.slice_ctb_addr_rs / s->ps.sps->ctb_width + ctb_row) * ctb_size;
+    int ret         = hls_decode_entry_wpp(avctxt, input_ctb_row, job, self_id);
+
+    pthread_mutex_lock(&s->wpp_progress_mutex);
+    while (s->wpp_rows_done < ctb_row)
+        pthread_cond_wait(&s->wpp_progress_cond, &s->wpp_progress_mutex);
+    s->wpp_rows_done = ctb_row + 1;
+    pthread_cond_broadcast(&s->wpp_progress_cond);
+    pthread_mutex_unlock(&s->wpp_progress_mutex);
+
+    // the bottom of the row is final only after the next row is filtered
+    ff_thread_report_progress(&s->ref->tf, y_ctb + ctb_size >= s->ps.sps->height ?
+                              INT_MAX : y_ctb - ctb_size, 0);
+
+    return ret;
+}
+#endif
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
@@ -2628,6 +2658,9 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     }
     s->data = data;
 
+    if (s->threads_type == FF_THREAD_FRAME)
+        s->threads_type |= FF_THREAD_SLICE;
+
     for (i = 1; i < s->threads_number; i++) {
         s->sList[i]->HEVClc->first_qp_group = 1;
         s->sList[i]->HEVClc->qp_y = s->sList[0]->HEVClc->qp_y;
@@ -2643,6 +2676,14 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         ret[i] = 0;
     }
 
+#if HAVE_THREADS
+    if (s->threads_type & FF_THREAD_FRAME) {
+        s->wpp_rows_done = 0;
+        if (s->ps.pps->entropy_coding_sync_enabled_flag)
+            s->avctx->execute2(s->avctx, hls_decode_entry_wpp_hybrid, arg, ret, s->sh.num_entry_point_offsets + 1);
+        s->threads_type = FF_THREAD_FRAME;
+    } else
+#endif
     if (s->ps.pps->entropy_coding_sync_enabled_flag)
         s->avctx->execute2(s->avctx, hls_decode_entry_wpp, arg, ret, s->sh.num_entry_point_offsets + 1);
 
@@ -3323,6 +3364,14 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
     av_freep(&s->sh.offset);
     av_freep(&s->sh.size);
 
+#if HAVE_THREADS
+    if (avctx->internal->hybrid_thread_ctx) {
+        ff_slice_thread_free_hybrid(avctx);
+        pthread_mutex_destroy(&s->wpp_progress_mutex);
+        pthread_cond_destroy(&s->wpp_progress_cond);
+    }
+#endif
+
     for (i = 1; i < s->threads_number; i++) {
         HEVCLocalContext *lc = s->HEVClcList[i];
         if (lc) {
@@ -3455,7 +3504,6 @@ static int hevc_update_thread_context(AVCodecContext *dst,
     s->is_nalff        = s0->is_nalff;
     s->nal_length_size = s0->nal_length_size;
 
-    s->threads_number      = s0->threads_number;
     s->threads_type        = s0->threads_type;
 
     if (s0->eos) {
@@ -3478,6 +3526,30 @@ static int hevc_update_thread_context(AVCodecContext *dst,
 
     return 0;
 }
+
+/**
+ * Decode the rows of WPP slices with a slice thread pool private to this
+ * frame thread.
+ */
+static av_cold int hevc_init_wpp_threads(AVCodecContext *avctx)
+{
+    HEVCContext *s = avctx->priv_data;
+    int ret;
+
+    s->threads_number = 1;
+    if (s->wpp_threads <= 1)
+        return 0;
+
+    ret = ff_slice_thread_init_hybrid(avctx, s->wpp_threads);
+    if (ret <= 1)
+        return FFMIN(ret, 0);
+
+    s->threads_number = ret;
+    pthread_mutex_init(&s->wpp_progress_mutex, NULL);
+    pthread_cond_init(&s->wpp_progress_cond, NULL);
+
+    return 0;
+}
 #endif
 
 static av_cold int hevc_decode_init(AVCodecContext *avctx)
@@ -3502,6 +3574,16 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     else
         s->threads_number = 1;
 
+#if HAVE_THREADS
+    if (avctx->active_thread_type & FF_THREAD_FRAME) {
+        ret = hevc_init_wpp_threads(avctx);
+        if (ret < 0) {
+            hevc_decode_free(avctx);
+            return ret;
+        }
+    }
+#endif
+
     if (avctx->extradata_size > 0 && avctx->extradata) {
         ret = hevc_decode_extradata(s, avctx->extradata, avctx->extradata_size, 1);
         if (ret < 0) {
@@ -3522,15 +3604,17 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
 static av_cold int hevc_init_thread_copy(AVCodecContext *avctx)
 {
     HEVCContext *s = avctx->priv_data;
+    int wpp_threads = s->wpp_threads;
     int ret;
 
     memset(s, 0, sizeof(*s));
+    s->wpp_threads = wpp_threads;
 
     ret = hevc_init_context(avctx);
     if (ret < 0)
         return ret;
 
-    return 0;
+    return hevc_init_wpp_threads(avctx);
 }
 #endif
 
@@ -3551,6 +3635,8 @@ static const AVOption options[] = {
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
     { "strict-displaywin", "stricly apply default display window size", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
+    { "wpp_threads", "Number of threads decoding WPP rows within each frame thread", OFFSET(wpp_threads),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, MAX_NB_THREADS, PAR },
     { NULL },
 };
 
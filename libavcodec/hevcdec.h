@@ -27,6 +27,7 @@
 
 #include "libavutil/buffer.h"
 #include "libavutil/md5.h"
+#include "libavutil/thread.h"
 
 #include "avcodec.h"
 #include "bswapdsp.h"
@@ -389,6 +390,10 @@ typedef struct HEVCContext {
     HEVCLocalContext    *HEVClcList[MAX_NB_THREADS];
     HEVCLocalContext    *HEVClc;
 
+    /**
+     * FF_THREAD_FRAME | FF_THREAD_SLICE while the rows of a WPP slice are
+     * decoded by the slice thread pool of a frame thread.
+     */
     uint8_t             threads_type;
     uint8_t             threads_number;
 
@@ -471,6 +476,13 @@ typedef struct HEVCContext {
     int enable_parallel_tiles;
     atomic_int wpp_err;
 
+    int wpp_threads;            ///< WPP threads per frame thread
+    int wpp_rows_done;          ///< rows of the current WPP slice finished in order
+#if HAVE_THREADS
+    pthread_mutex_t wpp_progress_mutex;
+    pthread_cond_t  wpp_progress_cond;
+#endif
+
     const uint8_t *data;
 
     H2645Packet pkt;
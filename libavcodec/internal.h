@@ -117,6 +117,7 @@ typedef struct FramePool {
     int width, height;
     int stride_align[AV_NUM_DATA_POINTERS];
     int linesize[4];
+    int sizes[4];
     int planes;
     int channels;
     int samples;
@@ -168,6 +169,12 @@ typedef struct AVCodecInternal {
 
     void *thread_ctx;
 
+    /**
+     * Slice thread pool owned by a frame thread worker context,
+     * see ff_slice_thread_init_hybrid().
+     */
+    void *hybrid_thread_ctx;
+
     DecodeSimpleContext ds;
     DecodeFilterContext filter;
 
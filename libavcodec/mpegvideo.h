@@ -582,6 +582,10 @@ typedef struct MpegEncContext {
     int noise_reduction;
 
     int intra_penalty;
+
+    /* frame threaded coding of P- and B-frames, see ff_mpv_encode_schedule() */
+    AVBufferRef *prev_progress;    ///< progress of the picture coded before
+    AVBufferRef *prev_b_progress;  ///< progress of the B-frame coded before
 } MpegEncContext;
 
 /* mpegvideo_enc common options */
@@ -41,10 +41,12 @@
 #include "libavutil/timer.h"
 #include "avcodec.h"
 #include "dct.h"
+#include "frame_thread_encoder.h"
 #include "idctdsp.h"
 #include "mpeg12.h"
 #include "mpegvideo.h"
 #include "mpegvideodata.h"
+#include "mpegvideoenc.h"
 #include "h261.h"
 #include "h263.h"
 #include "h263data.h"
@@ -1084,6 +1086,9 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
     ff_free_picture_tables(&s->new_picture);
     ff_mpeg_unref_picture(s->avctx, &s->new_picture);
 
+    av_buffer_unref(&s->prev_progress);
+    av_buffer_unref(&s->prev_b_progress);
+
     av_freep(&s->avctx->stats_out);
     av_freep(&s->ac_stats);
 
@@ -1141,6 +1146,11 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src,
 
 static int alloc_picture(MpegEncContext *s, Picture *pic, int shared)
 {
+    /* the frame threads may still use the tables of the previous picture of
+     * the slot */
+    if (s->avctx->active_thread_type & FF_THREAD_FRAME)
+        ff_free_picture_tables(pic);
+
     return ff_alloc_picture(s->avctx, pic, &s->me, &s->sc, shared, 1,
                             s->chroma_x_shift, s->chroma_y_shift, s->out_format,
                             s->mb_stride, s->mb_width, s->mb_height, s->b8_stride,
@@ -1673,34 +1683,225 @@ no_output_pic:
     return 0;
 }
 
-static void frame_end(MpegEncContext *s)
+/**
+ * The motion estimation state of a slice context that carries over from one
+ * picture to the next: the map is only cleared when the map generation wraps
+ * around and the B-frame search starts with the penalty factors of the last
+ * search.
+ */
+typedef struct MPVMotionEstState {
+    uint32_t map[ME_MAP_SIZE];
+    uint32_t score_map[ME_MAP_SIZE];
+    unsigned map_generation;
+    int penalty_factor;
+    int sub_penalty_factor;
+    int mb_penalty_factor;
+} MPVMotionEstState;
+
+/**
+ * The progress of a picture coded by a frame thread, shared with the frame
+ * threads coding the pictures after it through Picture.tf.progress.
+ */
+typedef struct MPVFrameProgress {
+    atomic_int rows;        ///< the last MB row that is coded and extended
+    atomic_int state_set;   ///< whether the state below is set
+
+    /* the state the next picture in coded order starts from */
+    int pict_type;
+    int no_rounding;
+    int f_code, b_code;
+    int qscale;
+    unsigned int lambda, lambda2;
+    int last_time_base, time_base;
+    int64_t time, last_non_b_time;
+    uint16_t pp_time, pb_time;
+    int gop_picture_number;
+
+    /* picture_in_gop_number of the parent context after picking the
+     * picture, in case the frame thread changes it into an I-frame */
+    int picture_in_gop_number;
+
+    /* followed by the MPVMotionEstState of each slice context */
+} MPVFrameProgress;
+
+static MPVFrameProgress *picture_progress(const Picture *pic)
 {
-    if (s->unrestricted_mv &&
-        s->current_picture.reference &&
-        !s->intra_only) {
-        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(s->avctx->pix_fmt);
-        int hshift = desc->log2_chroma_w;
-        int vshift = desc->log2_chroma_h;
-        s->mpvencdsp.draw_edges(s->current_picture.f->data[0],
-                                s->current_picture.f->linesize[0],
-                                s->h_edge_pos, s->v_edge_pos,
-                                EDGE_WIDTH, EDGE_WIDTH,
-                                EDGE_TOP | EDGE_BOTTOM);
-        s->mpvencdsp.draw_edges(s->current_picture.f->data[1],
-                                s->current_picture.f->linesize[1],
-                                s->h_edge_pos >> hshift,
-                                s->v_edge_pos >> vshift,
-                                EDGE_WIDTH >> hshift,
-                                EDGE_WIDTH >> vshift,
-                                EDGE_TOP | EDGE_BOTTOM);
-        s->mpvencdsp.draw_edges(s->current_picture.f->data[2],
-                                s->current_picture.f->linesize[2],
+    return pic->tf.progress ? (MPVFrameProgress *)pic->tf.progress->data : NULL;
+}
+
+static MPVMotionEstState *motion_est_state(const MPVFrameProgress *p, int i)
+{
+    return (MPVMotionEstState *)(p + 1) + i;
+}
+
+static void report_progress(MpegEncContext *s, atomic_int *progress, int n)
+{
+    if (CONFIG_FRAME_THREAD_ENCODER)
+        ff_frame_thread_encoder_report_progress(s->avctx, progress, n);
+}
+
+static void await_progress(MpegEncContext *s, atomic_int *progress, int n)
+{
+    if (CONFIG_FRAME_THREAD_ENCODER)
+        ff_frame_thread_encoder_await_progress(s->avctx, progress, n);
+}
+
+static void save_state(MPVFrameProgress *p, const MpegEncContext *s)
+{
+    p->pict_type          = s->pict_type;
+    p->no_rounding        = s->no_rounding;
+    p->f_code             = s->f_code;
+    p->b_code             = s->b_code;
+    p->qscale             = s->qscale;
+    p->lambda             = s->lambda;
+    p->lambda2            = s->lambda2;
+    p->last_time_base     = s->last_time_base;
+    p->time_base          = s->time_base;
+    p->time               = s->time;
+    p->last_non_b_time    = s->last_non_b_time;
+    p->pp_time            = s->pp_time;
+    p->pb_time            = s->pb_time;
+    p->gop_picture_number = s->gop_picture_number;
+
+    for (int i = 0; i < s->slice_context_count; i++) {
+        const MotionEstContext *c = &s->thread_context[i]->me;
+        MPVMotionEstState      *me = motion_est_state(p, i);
+
+        memcpy(me->map,       c->map,       sizeof(me->map));
+        memcpy(me->score_map, c->score_map, sizeof(me->score_map));
+        me->map_generation     = c->map_generation;
+        me->penalty_factor     = c->penalty_factor;
+        me->sub_penalty_factor = c->sub_penalty_factor;
+        me->mb_penalty_factor  = c->mb_penalty_factor;
+    }
+}
+
+static void load_state(MpegEncContext *s, const MPVFrameProgress *p)
+{
+    s->no_rounding        = p->no_rounding;
+    s->f_code             = p->f_code;
+    s->b_code             = p->b_code;
+    s->lambda             = p->lambda;
+    s->lambda2            = p->lambda2;
+    s->last_time_base     = p->last_time_base;
+    s->time_base          = p->time_base;
+    s->time               = p->time;
+    s->last_non_b_time    = p->last_non_b_time;
+    s->pp_time            = p->pp_time;
+    s->pb_time            = p->pb_time;
+    s->gop_picture_number = p->gop_picture_number;
+    ff_set_qscale(s, p->qscale);
+
+    for (int i = 0; i < s->slice_context_count; i++) {
+        MotionEstContext        *c   = &s->thread_context[i]->me;
+        const MPVMotionEstState *me = motion_est_state(p, i);
+
+        memcpy(c->map,       me->map,       sizeof(me->map));
+        memcpy(c->score_map, me->score_map, sizeof(me->score_map));
+        c->map_generation     = me->map_generation;
+        c->penalty_factor     = me->penalty_factor;
+        c->sub_penalty_factor = me->sub_penalty_factor;
+        c->mb_penalty_factor  = me->mb_penalty_factor;
+    }
+}
+
+static AVBufferRef *alloc_progress(const MpegEncContext *s)
+{
+    AVBufferRef *buf = av_buffer_allocz(sizeof(MPVFrameProgress) +
+                                        s->slice_context_count * sizeof(MPVMotionEstState));
+    MPVFrameProgress *p;
+
+    if (!buf)
+        return NULL;
+
+    p = (MPVFrameProgress *)buf->data;
+    atomic_init(&p->rows, -1);
+    atomic_init(&p->state_set, 0);
+    return buf;
+}
+
+/**
+ * Publish the state the next picture in coded order starts from.
+ */
+static void publish_state(MpegEncContext *s, MPVFrameProgress *p)
+{
+    if (!p || atomic_load_explicit(&p->state_set, memory_order_relaxed))
+        return;
+
+    save_state(p, s);
+    report_progress(s, &p->state_set, 1);
+}
+
+static void await_rows(MpegEncContext *s, const Picture *pic, int mb_y)
+{
+    MPVFrameProgress *p = picture_progress(pic);
+
+    if (p)
+        await_progress(s, &p->rows, mb_y);
+}
+
+/* whether encode_thread() extends and reports the rows of the current
+ * picture as it codes them, which it does if it codes the whole picture */
+static int reports_rows(const MpegEncContext *s)
+{
+    return s->slice_context_count == 1 && s->current_picture.tf.progress;
+}
+
+/**
+ * Extend the MB rows mb_y to mb_end - 1 of the current picture into its
+ * edges, for unrestricted motion vectors.
+ */
+static void extend_edges(MpegEncContext *s, int mb_y, int mb_end)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(s->avctx->pix_fmt);
+    int y     = 16 * mb_y;
+    int end   = FFMIN(16 * mb_end, s->v_edge_pos);
+    int sides = (mb_y                ? 0 : EDGE_TOP) |
+                (mb_end < s->mb_height ? 0 : EDGE_BOTTOM);
+    int i;
+
+    if (y >= end)
+        return;
+
+    for (i = 0; i < 3; i++) {
+        int hshift = i ? desc->log2_chroma_w : 0;
+        int vshift = i ? desc->log2_chroma_h : 0;
+        int top    = y >> vshift;
+
+        s->mpvencdsp.draw_edges(s->current_picture.f->data[i] +
+                                top * s->current_picture.f->linesize[i],
+                                s->current_picture.f->linesize[i],
                                 s->h_edge_pos >> hshift,
-                                s->v_edge_pos >> vshift,
+                                (end >> vshift) - top,
                                 EDGE_WIDTH >> hshift,
                                 EDGE_WIDTH >> vshift,
-                                EDGE_TOP | EDGE_BOTTOM);
+                                sides);
     }
+}
+
+/**
+ * Hand on the MB rows mb_y to mb_end - 1 of the current picture to the
+ * frame threads referencing it.
+ */
+static void report_rows(MpegEncContext *s, int mb_y, int mb_end)
+{
+    MPVFrameProgress *p = picture_progress(&s->current_picture);
+
+    if (s->unrestricted_mv &&
+        s->current_picture.reference &&
+        !s->intra_only)
+        extend_edges(s, mb_y, mb_end);
+
+    report_progress(s, &p->rows, mb_end - 1);
+}
+
+static void frame_end(MpegEncContext *s)
+{
+    if (s->unrestricted_mv &&
+        s->current_picture.reference &&
+        !s->intra_only &&
+        !reports_rows(s))
+        extend_edges(s, 0, s->mb_height);
 
     emms_c();
 
@@ -1744,31 +1945,19 @@ static void update_noise_reduction(MpegEncContext *s)
     }
 }
 
-static int frame_start(MpegEncContext *s)
+/**
+ * Set up the context for coding the current picture from the last and next
+ * picture.
+ */
+static int frame_setup(MpegEncContext *s)
 {
     int ret;
 
-    /* mark & release old frames */
-    if (s->pict_type != AV_PICTURE_TYPE_B && s->last_picture_ptr &&
-        s->last_picture_ptr != s->next_picture_ptr &&
-        s->last_picture_ptr->f->buf[0]) {
-        ff_mpeg_unref_picture(s->avctx, s->last_picture_ptr);
-    }
-
-    s->current_picture_ptr->f->pict_type = s->pict_type;
-    s->current_picture_ptr->f->key_frame = s->pict_type == AV_PICTURE_TYPE_I;
-
     ff_mpeg_unref_picture(s->avctx, &s->current_picture);
     if ((ret = ff_mpeg_ref_picture(s->avctx, &s->current_picture,
                                    s->current_picture_ptr)) < 0)
         return ret;
 
-    if (s->pict_type != AV_PICTURE_TYPE_B) {
-        s->last_picture_ptr = s->next_picture_ptr;
-        if (!s->droppable)
-            s->next_picture_ptr = s->current_picture_ptr;
-    }
-
     if (s->last_picture_ptr) {
         ff_mpeg_unref_picture(s->avctx, &s->last_picture);
         if (s->last_picture_ptr->f->buf[0] &&
@@ -1816,17 +2005,273 @@ static int frame_start(MpegEncContext *s)
     return 0;
 }
 
-int ff_mpv_encode_picture(AVCodecContext *avctx, AVPacket *pkt,
-                          const AVFrame *pic_arg, int *got_packet)
+static int frame_start(MpegEncContext *s)
+{
+    /* mark & release old frames */
+    if (s->pict_type != AV_PICTURE_TYPE_B && s->last_picture_ptr &&
+        s->last_picture_ptr != s->next_picture_ptr &&
+        s->last_picture_ptr->f->buf[0]) {
+        ff_mpeg_unref_picture(s->avctx, s->last_picture_ptr);
+    }
+
+    s->current_picture_ptr->f->pict_type = s->pict_type;
+    s->current_picture_ptr->f->key_frame = s->pict_type == AV_PICTURE_TYPE_I;
+
+    if (s->pict_type != AV_PICTURE_TYPE_B) {
+        s->last_picture_ptr = s->next_picture_ptr;
+        if (!s->droppable)
+            s->next_picture_ptr = s->current_picture_ptr;
+    }
+
+    return frame_setup(s);
+}
+
+/**
+ * Code the picture set up by frame_start() into pkt.
+ */
+static int encode_new_picture(AVCodecContext *avctx, AVPacket *pkt)
 {
     MpegEncContext *s = avctx->priv_data;
     int i, stuffing_count, ret;
     int context_count = s->slice_context_count;
+    int growing_buffer = context_count == 1 && !pkt->data && !s->data_partitioning;
+    int pkt_size = growing_buffer ? FFMAX(s->mb_width*s->mb_height*64+10000, avctx->internal->byte_buffer_size) - AV_INPUT_BUFFER_PADDING_SIZE
+                                          :
+                                          s->mb_width*s->mb_height*(MAX_MB_BYTES+100)+10000;
+    if ((ret = ff_alloc_packet2(avctx, pkt, pkt_size, 0)) < 0)
+        return ret;
+    if (s->mb_info) {
+        s->mb_info_ptr = av_packet_new_side_data(pkt,
+                             AV_PKT_DATA_H263_MB_INFO,
+                             s->mb_width*s->mb_height*12);
+        s->prev_mb_info = s->last_mb_info = s->mb_info_size = 0;
+    }
+
+    for (i = 0; i < context_count; i++) {
+        int start_y = s->thread_context[i]->start_mb_y;
+        int   end_y = s->thread_context[i]->  end_mb_y;
+        int h       = s->mb_height;
+        uint8_t *start = pkt->data + (size_t)(((int64_t) pkt->size) * start_y / h);
+        uint8_t *end   = pkt->data + (size_t)(((int64_t) pkt->size) *   end_y / h);
+
+        init_put_bits(&s->thread_context[i]->pb, start, end - start);
+    }
+
+vbv_retry:
+    ret = encode_picture(s, s->picture_number);
+    if (growing_buffer) {
+        av_assert0(s->pb.buf == avctx->internal->byte_buffer);
+        pkt->data = s->pb.buf;
+        pkt->size = avctx->internal->byte_buffer_size;
+    }
+    if (ret < 0)
+        return -1;
+
+#if FF_API_STAT_BITS
+FF_DISABLE_DEPRECATION_WARNINGS
+    avctx->header_bits = s->header_bits;
+    avctx->mv_bits     = s->mv_bits;
+    avctx->misc_bits   = s->misc_bits;
+    avctx->i_tex_bits  = s->i_tex_bits;
+    avctx->p_tex_bits  = s->p_tex_bits;
+    avctx->i_count     = s->i_count;
+    // FIXME f/b_count in avctx
+    avctx->p_count     = s->mb_num - s->i_count - s->skip_count;
+    avctx->skip_count  = s->skip_count;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+
+    frame_end(s);
+
+    if (CONFIG_MJPEG_ENCODER && s->out_format == FMT_MJPEG)
+        ff_mjpeg_encode_picture_trailer(&s->pb, s->header_bits);
+
+    if (avctx->rc_buffer_size) {
+        RateControlContext *rcc = &s->rc_context;
+        int max_size = FFMAX(rcc->buffer_index * avctx->rc_max_available_vbv_use, rcc->buffer_index - 500);
+        int hq = (s->avctx->mb_decision == FF_MB_DECISION_RD || s->avctx->trellis);
+        int min_step = hq ? 1 : (1<<(FF_LAMBDA_SHIFT + 7))/139;
+
+        if (put_bits_count(&s->pb) > max_size &&
+            s->lambda < s->lmax) {
+            s->next_lambda = FFMAX(s->lambda + min_step, s->lambda *
+                                   (s->qscale + 1) / s->qscale);
+            if (s->adaptive_quant) {
+                int i;
+                for (i = 0; i < s->mb_height * s->mb_stride; i++)
+                    s->lambda_table[i] =
+                        FFMAX(s->lambda_table[i] + min_step,
+                              s->lambda_table[i] * (s->qscale + 1) /
+                              s->qscale);
+            }
+            s->mb_skipped = 0;        // done in frame_start()
+            // done in encode_picture() so we must undo it
+            if (s->pict_type == AV_PICTURE_TYPE_P) {
+                if (s->flipflop_rounding          ||
+                    s->codec_id == AV_CODEC_ID_H263P ||
+                    s->codec_id == AV_CODEC_ID_MPEG4)
+                    s->no_rounding ^= 1;
+            }
+            if (s->pict_type != AV_PICTURE_TYPE_B) {
+                s->time_base       = s->last_time_base;
+                s->last_non_b_time = s->time - s->pp_time;
+            }
+            for (i = 0; i < context_count; i++) {
+                PutBitContext *pb = &s->thread_context[i]->pb;
+                init_put_bits(pb, pb->buf, pb->buf_end - pb->buf);
+            }
+            s->vbv_ignore_qmax = 1;
+            av_log(s->avctx, AV_LOG_VERBOSE, "reencoding frame due to VBV\n");
+            goto vbv_retry;
+        }
+
+        av_assert0(s->avctx->rc_max_rate);
+    }
+
+    if (s->avctx->flags & AV_CODEC_FLAG_PASS1)
+        ff_write_pass1_stats(s);
+
+    for (i = 0; i < 4; i++) {
+        s->current_picture_ptr->encoding_error[i] = s->current_picture.encoding_error[i];
+        avctx->error[i] += s->current_picture_ptr->encoding_error[i];
+    }
+    ff_side_data_set_encoder_stats(pkt, s->current_picture.f->quality,
+                                   s->current_picture_ptr->encoding_error,
+                                   (s->avctx->flags&AV_CODEC_FLAG_PSNR) ? 4 : 0,
+                                   s->pict_type);
+
+    if (s->avctx->flags & AV_CODEC_FLAG_PASS1)
+        assert(put_bits_count(&s->pb) == s->header_bits + s->mv_bits +
+                                         s->misc_bits + s->i_tex_bits +
+                                         s->p_tex_bits);
+    flush_put_bits(&s->pb);
+    s->frame_bits  = put_bits_count(&s->pb);
+
+    stuffing_count = ff_vbv_update(s, s->frame_bits);
+    s->stuffing_bits = 8*stuffing_count;
+    if (stuffing_count) {
+        if (s->pb.buf_end - s->pb.buf - (put_bits_count(&s->pb) >> 3) <
+                stuffing_count + 50) {
+            av_log(s->avctx, AV_LOG_ERROR, "stuffing too large\n");
+            return -1;
+        }
+
+        switch (s->codec_id) {
+        case AV_CODEC_ID_MPEG1VIDEO:
+        case AV_CODEC_ID_MPEG2VIDEO:
+            while (stuffing_count--) {
+                put_bits(&s->pb, 8, 0);
+            }
+        break;
+        case AV_CODEC_ID_MPEG4:
+            put_bits(&s->pb, 16, 0);
+            put_bits(&s->pb, 16, 0x1C3);
+            stuffing_count -= 4;
+            while (stuffing_count--) {
+                put_bits(&s->pb, 8, 0xFF);
+            }
+        break;
+        default:
+            av_log(s->avctx, AV_LOG_ERROR, "vbv buffer overflow\n");
+        }
+        flush_put_bits(&s->pb);
+        s->frame_bits  = put_bits_count(&s->pb);
+    }
+
+    /* update MPEG-1/2 vbv_delay for CBR */
+    if (s->avctx->rc_max_rate                          &&
+        s->avctx->rc_min_rate == s->avctx->rc_max_rate &&
+        s->out_format == FMT_MPEG1                     &&
+        90000LL * (avctx->rc_buffer_size - 1) <=
+            s->avctx->rc_max_rate * 0xFFFFLL) {
+        AVCPBProperties *props;
+        size_t props_size;
+
+        int vbv_delay, min_delay;
+        double inbits  = s->avctx->rc_max_rate *
+                         av_q2d(s->avctx->time_base);
+        int    minbits = s->frame_bits - 8 *
+                         (s->vbv_delay_ptr - s->pb.buf - 1);
+        double bits    = s->rc_context.buffer_index + minbits - inbits;
+
+        if (bits < 0)
+            av_log(s->avctx, AV_LOG_ERROR,
+                   "Internal error, negative bits\n");
+
+        av_assert1(s->repeat_first_field == 0);
+
+        vbv_delay = bits * 90000 / s->avctx->rc_max_rate;
+        min_delay = (minbits * 90000LL + s->avctx->rc_max_rate - 1) /
+                    s->avctx->rc_max_rate;
+
+        vbv_delay = FFMAX(vbv_delay, min_delay);
+
+        av_assert0(vbv_delay < 0xFFFF);
+
+        s->vbv_delay_ptr[0] &= 0xF8;
+        s->vbv_delay_ptr[0] |= vbv_delay >> 13;
+        s->vbv_delay_ptr[1]  = vbv_delay >> 5;
+        s->vbv_delay_ptr[2] &= 0x07;
+        s->vbv_delay_ptr[2] |= vbv_delay << 3;
+
+        props = av_cpb_properties_alloc(&props_size);
+        if (!props)
+            return AVERROR(ENOMEM);
+        props->vbv_delay = vbv_delay * 300;
+
+        ret = av_packet_add_side_data(pkt, AV_PKT_DATA_CPB_PROPERTIES,
+                                      (uint8_t*)props, props_size);
+        if (ret < 0) {
+            av_freep(&props);
+            return ret;
+        }
+
+#if FF_API_VBV_DELAY
+FF_DISABLE_DEPRECATION_WARNINGS
+        avctx->vbv_delay     = vbv_delay * 300;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+    }
+    s->total_bits     += s->frame_bits;
+#if FF_API_STAT_BITS
+FF_DISABLE_DEPRECATION_WARNINGS
+    avctx->frame_bits  = s->frame_bits;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+
+
+    pkt->pts = s->current_picture.f->pts;
+    if (!s->low_delay && s->pict_type != AV_PICTURE_TYPE_B) {
+        if (!s->current_picture.f->coded_picture_number)
+            pkt->dts = pkt->pts - s->dts_delta;
+        else
+            pkt->dts = s->reordered_pts;
+        s->reordered_pts = pkt->pts;
+    } else
+        pkt->dts = pkt->pts;
+    if (s->current_picture.f->key_frame)
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    if (s->mb_info)
+        av_packet_shrink_side_data(pkt, AV_PKT_DATA_H263_MB_INFO, s->mb_info_size);
+
+    return 0;
+}
+
+int ff_mpv_encode_picture(AVCodecContext *avctx, AVPacket *pkt,
+                          const AVFrame *pic_arg, int *got_packet)
+{
+    MpegEncContext *s = avctx->priv_data;
+    int i, ret;
 
     s->vbv_ignore_qmax = 0;
 
     s->picture_in_gop_number++;
 
+    /* With frame threading, consecutive frames are coded by different
+     * contexts; number them as a single context would. */
+    if (pic_arg && avctx->internal->frame_thread_encoder)
+        s->input_picture_number = s->coded_picture_number = avctx->frame_number;
+
     if (load_input_picture(s, pic_arg) < 0)
         return -1;
 
@@ -1836,232 +2281,262 @@ int ff_mpv_encode_picture(AVCodecContext *avctx, AVPacket *pkt,
 
     /* output? */
     if (s->new_picture.f->data[0]) {
-        int growing_buffer = context_count == 1 && !pkt->data && !s->data_partitioning;
-        int pkt_size = growing_buffer ? FFMAX(s->mb_width*s->mb_height*64+10000, avctx->internal->byte_buffer_size) - AV_INPUT_BUFFER_PADDING_SIZE
-                                              :
-                                              s->mb_width*s->mb_height*(MAX_MB_BYTES+100)+10000;
-        if ((ret = ff_alloc_packet2(avctx, pkt, pkt_size, 0)) < 0)
-            return ret;
-        if (s->mb_info) {
-            s->mb_info_ptr = av_packet_new_side_data(pkt,
-                                 AV_PKT_DATA_H263_MB_INFO,
-                                 s->mb_width*s->mb_height*12);
-            s->prev_mb_info = s->last_mb_info = s->mb_info_size = 0;
-        }
-
-        for (i = 0; i < context_count; i++) {
-            int start_y = s->thread_context[i]->start_mb_y;
-            int   end_y = s->thread_context[i]->  end_mb_y;
-            int h       = s->mb_height;
-            uint8_t *start = pkt->data + (size_t)(((int64_t) pkt->size) * start_y / h);
-            uint8_t *end   = pkt->data + (size_t)(((int64_t) pkt->size) *   end_y / h);
-
-            init_put_bits(&s->thread_context[i]->pb, start, end - start);
-        }
-
         s->pict_type = s->new_picture.f->pict_type;
         //emms_c();
         ret = frame_start(s);
         if (ret < 0)
             return ret;
-vbv_retry:
-        ret = encode_picture(s, s->picture_number);
-        if (growing_buffer) {
-            av_assert0(s->pb.buf == avctx->internal->byte_buffer);
-            pkt->data = s->pb.buf;
-            pkt->size = avctx->internal->byte_buffer_size;
-        }
+        ret = encode_new_picture(avctx, pkt);
         if (ret < 0)
-            return -1;
+            return ret;
+    } else {
+        s->frame_bits = 0;
+    }
 
-#if FF_API_STAT_BITS
+    /* release non-reference frames */
+    for (i = 0; i < MAX_PICTURE_COUNT; i++) {
+        if (!s->picture[i].reference)
+            ff_mpeg_unref_picture(s->avctx, &s->picture[i]);
+    }
+
+    av_assert1((s->frame_bits & 7) == 0);
+
+    pkt->size = s->frame_bits / 8;
+    *got_packet = !!pkt->size;
+    return 0;
+}
+
+struct MPVEncodeJob {
+    Picture new_picture;
+    Picture current_picture;
+    Picture last_picture;
+    Picture next_picture;
+    /* the pictures coded after this one, see reordered_input_picture */
+    Picture input_picture[MAX_B_FRAMES];
+
+    AVBufferRef *prev_progress;
+    AVBufferRef *prev_b_progress;
+
+    /* the MV tables of the parent context, which carry the vectors of a
+     * picture on to the motion search of the next one */
+    int16_t (*p_mv_table)[2];
+    int16_t (*b_forw_mv_table)[2];
+    int16_t (*b_back_mv_table)[2];
+    int16_t (*b_bidir_forw_mv_table)[2];
+    int16_t (*b_bidir_back_mv_table)[2];
+    int16_t (*b_direct_mv_table)[2];
+
+    int picture_number;
+    int64_t reordered_pts;
+    int64_t dts_delta;
+};
+
+int ff_mpv_encode_pipeline_supported(AVCodecContext *avctx)
+{
+    MpegEncContext *s = avctx->priv_data;
+    int b_frame_strategy, me_pre, noise_reduction;
+    int frame_skip_threshold, frame_skip_factor;
+
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_MPEG1VIDEO:
+    case AV_CODEC_ID_MPEG2VIDEO:
+    case AV_CODEC_ID_MPEG4:
+    case AV_CODEC_ID_H263P:
+        break;
+    default:
+        return 0;
+    }
+
+    b_frame_strategy     = s->b_frame_strategy;
+    me_pre               = s->me_pre;
+    noise_reduction      = s->noise_reduction;
+    frame_skip_threshold = s->frame_skip_threshold;
+    frame_skip_factor    = s->frame_skip_factor;
+#if FF_API_PRIVATE_OPT
 FF_DISABLE_DEPRECATION_WARNINGS
-        avctx->header_bits = s->header_bits;
-        avctx->mv_bits     = s->mv_bits;
-        avctx->misc_bits   = s->misc_bits;
-        avctx->i_tex_bits  = s->i_tex_bits;
-        avctx->p_tex_bits  = s->p_tex_bits;
-        avctx->i_count     = s->i_count;
-        // FIXME f/b_count in avctx
-        avctx->p_count     = s->mb_num - s->i_count - s->skip_count;
-        avctx->skip_count  = s->skip_count;
+    if (avctx->b_frame_strategy)
+        b_frame_strategy = avctx->b_frame_strategy;
+    if (avctx->pre_me)
+        me_pre = avctx->pre_me;
+    if (avctx->noise_reduction)
+        noise_reduction = avctx->noise_reduction;
+    if (avctx->frame_skip_threshold)
+        frame_skip_threshold = avctx->frame_skip_threshold;
+    if (avctx->frame_skip_factor)
+        frame_skip_factor = avctx->frame_skip_factor;
 FF_ENABLE_DEPRECATION_WARNINGS
 #endif
 
-        frame_end(s);
+    /* Rate control, QP RD, noise reduction and the frame type and skip
+     * decisions other than the scene change detection carry more state from
+     * a picture to the next one than the frame threads hand on; the field
+     * MV tables are not shared between them. */
+    return (avctx->flags & AV_CODEC_FLAG_QSCALE) &&
+           !(avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2 |
+                             AV_CODEC_FLAG_INTERLACED_ME)) &&
+           !avctx->rc_buffer_size && !avctx->rc_max_rate &&
+           !(s->mpv_flags & FF_MPV_FLAG_QP_RD) &&
+           !b_frame_strategy && !me_pre && !noise_reduction &&
+           !frame_skip_threshold && !frame_skip_factor;
+}
 
-        if (CONFIG_MJPEG_ENCODER && s->out_format == FMT_MJPEG)
-            ff_mjpeg_encode_picture_trailer(&s->pb, s->header_bits);
+static int ref_job_picture(AVCodecContext *avctx, Picture *dst, Picture *src)
+{
+    if (!src->f || !src->f->buf[0])
+        return 0;
+    if (!dst->f && !(dst->f = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    return ff_mpeg_ref_picture(avctx, dst, src);
+}
 
-        if (avctx->rc_buffer_size) {
-            RateControlContext *rcc = &s->rc_context;
-            int max_size = FFMAX(rcc->buffer_index * avctx->rc_max_available_vbv_use, rcc->buffer_index - 500);
-            int hq = (s->avctx->mb_decision == FF_MB_DECISION_RD || s->avctx->trellis);
-            int min_step = hq ? 1 : (1<<(FF_LAMBDA_SHIFT + 7))/139;
-
-            if (put_bits_count(&s->pb) > max_size &&
-                s->lambda < s->lmax) {
-                s->next_lambda = FFMAX(s->lambda + min_step, s->lambda *
-                                       (s->qscale + 1) / s->qscale);
-                if (s->adaptive_quant) {
-                    int i;
-                    for (i = 0; i < s->mb_height * s->mb_stride; i++)
-                        s->lambda_table[i] =
-                            FFMAX(s->lambda_table[i] + min_step,
-                                  s->lambda_table[i] * (s->qscale + 1) /
-                                  s->qscale);
-                }
-                s->mb_skipped = 0;        // done in frame_start()
-                // done in encode_picture() so we must undo it
-                if (s->pict_type == AV_PICTURE_TYPE_P) {
-                    if (s->flipflop_rounding          ||
-                        s->codec_id == AV_CODEC_ID_H263P ||
-                        s->codec_id == AV_CODEC_ID_MPEG4)
-                        s->no_rounding ^= 1;
-                }
-                if (s->pict_type != AV_PICTURE_TYPE_B) {
-                    s->time_base       = s->last_time_base;
-                    s->last_non_b_time = s->time - s->pp_time;
-                }
-                for (i = 0; i < context_count; i++) {
-                    PutBitContext *pb = &s->thread_context[i]->pb;
-                    init_put_bits(pb, pb->buf, pb->buf_end - pb->buf);
-                }
-                s->vbv_ignore_qmax = 1;
-                av_log(s->avctx, AV_LOG_VERBOSE, "reencoding frame due to VBV\n");
-                goto vbv_retry;
-            }
+static void unref_job_picture(AVCodecContext *avctx, Picture *pic)
+{
+    if (!pic->f)
+        return;
+    ff_mpeg_unref_picture(avctx, pic);
+    ff_free_picture_tables(pic);
+    av_frame_free(&pic->f);
+}
 
-            av_assert0(s->avctx->rc_max_rate);
-        }
+void ff_mpv_free_job(AVCodecContext *avctx, MPVEncodeJob **jobp)
+{
+    MPVEncodeJob *job = *jobp;
+    int i;
 
-        if (s->avctx->flags & AV_CODEC_FLAG_PASS1)
-            ff_write_pass1_stats(s);
+    if (!job)
+        return;
 
-        for (i = 0; i < 4; i++) {
-            s->current_picture_ptr->encoding_error[i] = s->current_picture.encoding_error[i];
-            avctx->error[i] += s->current_picture_ptr->encoding_error[i];
-        }
-        ff_side_data_set_encoder_stats(pkt, s->current_picture.f->quality,
-                                       s->current_picture_ptr->encoding_error,
-                                       (s->avctx->flags&AV_CODEC_FLAG_PSNR) ? 4 : 0,
-                                       s->pict_type);
-
-        if (s->avctx->flags & AV_CODEC_FLAG_PASS1)
-            assert(put_bits_count(&s->pb) == s->header_bits + s->mv_bits +
-                                             s->misc_bits + s->i_tex_bits +
-                                             s->p_tex_bits);
-        flush_put_bits(&s->pb);
-        s->frame_bits  = put_bits_count(&s->pb);
+    unref_job_picture(avctx, &job->new_picture);
+    unref_job_picture(avctx, &job->current_picture);
+    unref_job_picture(avctx, &job->last_picture);
+    unref_job_picture(avctx, &job->next_picture);
+    for (i = 0; i < FF_ARRAY_ELEMS(job->input_picture); i++)
+        unref_job_picture(avctx, &job->input_picture[i]);
+    av_buffer_unref(&job->prev_progress);
+    av_buffer_unref(&job->prev_b_progress);
+    av_freep(jobp);
+}
 
-        stuffing_count = ff_vbv_update(s, s->frame_bits);
-        s->stuffing_bits = 8*stuffing_count;
-        if (stuffing_count) {
-            if (s->pb.buf_end - s->pb.buf - (put_bits_count(&s->pb) >> 3) <
-                    stuffing_count + 50) {
-                av_log(s->avctx, AV_LOG_ERROR, "stuffing too large\n");
-                return -1;
-            }
+static int schedule_new_picture(AVCodecContext *avctx, MPVEncodeJob **jobp)
+{
+    MpegEncContext *s = avctx->priv_data;
+    AVBufferRef *progress;
+    MPVFrameProgress *p;
+    MPVEncodeJob *job;
+    int i, ret;
 
-            switch (s->codec_id) {
-            case AV_CODEC_ID_MPEG1VIDEO:
-            case AV_CODEC_ID_MPEG2VIDEO:
-                while (stuffing_count--) {
-                    put_bits(&s->pb, 8, 0);
-                }
-            break;
-            case AV_CODEC_ID_MPEG4:
-                put_bits(&s->pb, 16, 0);
-                put_bits(&s->pb, 16, 0x1C3);
-                stuffing_count -= 4;
-                while (stuffing_count--) {
-                    put_bits(&s->pb, 8, 0xFF);
-                }
-            break;
-            default:
-                av_log(s->avctx, AV_LOG_ERROR, "vbv buffer overflow\n");
-            }
-            flush_put_bits(&s->pb);
-            s->frame_bits  = put_bits_count(&s->pb);
-        }
+    if (!s->prev_progress) {
+        /* the first picture starts from the initial state */
+        if (!(s->prev_progress = alloc_progress(s)))
+            return AVERROR(ENOMEM);
+        p = (MPVFrameProgress *)s->prev_progress->data;
+        save_state(p, s);
+        atomic_init(&p->state_set, 1);
+        atomic_init(&p->rows, INT_MAX);
+    }
 
-        /* update MPEG-1/2 vbv_delay for CBR */
-        if (s->avctx->rc_max_rate                          &&
-            s->avctx->rc_min_rate == s->avctx->rc_max_rate &&
-            s->out_format == FMT_MPEG1                     &&
-            90000LL * (avctx->rc_buffer_size - 1) <=
-                s->avctx->rc_max_rate * 0xFFFFLL) {
-            AVCPBProperties *props;
-            size_t props_size;
-
-            int vbv_delay, min_delay;
-            double inbits  = s->avctx->rc_max_rate *
-                             av_q2d(s->avctx->time_base);
-            int    minbits = s->frame_bits - 8 *
-                             (s->vbv_delay_ptr - s->pb.buf - 1);
-            double bits    = s->rc_context.buffer_index + minbits - inbits;
-
-            if (bits < 0)
-                av_log(s->avctx, AV_LOG_ERROR,
-                       "Internal error, negative bits\n");
+    av_assert0(!s->current_picture_ptr->tf.progress);
+    if (!(s->current_picture_ptr->tf.progress = alloc_progress(s)))
+        return AVERROR(ENOMEM);
+    progress = s->current_picture_ptr->tf.progress;
+    p        = (MPVFrameProgress *)progress->data;
 
-            av_assert1(s->repeat_first_field == 0);
+    s->pict_type = s->new_picture.f->pict_type;
+    ret = frame_start(s);
+    if (ret < 0)
+        return ret;
 
-            vbv_delay = bits * 90000 / s->avctx->rc_max_rate;
-            min_delay = (minbits * 90000LL + s->avctx->rc_max_rate - 1) /
-                        s->avctx->rc_max_rate;
+    job = av_mallocz(sizeof(*job));
+    if (!job)
+        return AVERROR(ENOMEM);
 
-            vbv_delay = FFMAX(vbv_delay, min_delay);
+    if ((ret = ref_job_picture(avctx, &job->new_picture,     &s->new_picture))     < 0 ||
+        (ret = ref_job_picture(avctx, &job->current_picture, &s->current_picture)) < 0 ||
+        (ret = ref_job_picture(avctx, &job->last_picture,    &s->last_picture))    < 0 ||
+        (ret = ref_job_picture(avctx, &job->next_picture,    &s->next_picture))    < 0)
+        goto fail;
+    for (i = 0; i < s->max_b_frames && s->reordered_input_picture[i + 1]; i++) {
+        ret = ref_job_picture(avctx, &job->input_picture[i],
+                              s->reordered_input_picture[i + 1]);
+        if (ret < 0)
+            goto fail;
+    }
 
-            av_assert0(vbv_delay < 0xFFFF);
+    job->prev_progress = s->prev_progress;
+    s->prev_progress   = av_buffer_ref(progress);
+    if (!s->prev_progress) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if (s->pict_type == AV_PICTURE_TYPE_B) {
+        job->prev_b_progress = s->prev_b_progress;
+        s->prev_b_progress   = av_buffer_ref(progress);
+        if (!s->prev_b_progress) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
 
-            s->vbv_delay_ptr[0] &= 0xF8;
-            s->vbv_delay_ptr[0] |= vbv_delay >> 13;
-            s->vbv_delay_ptr[1]  = vbv_delay >> 5;
-            s->vbv_delay_ptr[2] &= 0x07;
-            s->vbv_delay_ptr[2] |= vbv_delay << 3;
+    job->p_mv_table            = s->p_mv_table;
+    job->b_forw_mv_table       = s->b_forw_mv_table;
+    job->b_back_mv_table       = s->b_back_mv_table;
+    job->b_bidir_forw_mv_table = s->b_bidir_forw_mv_table;
+    job->b_bidir_back_mv_table = s->b_bidir_back_mv_table;
+    job->b_direct_mv_table     = s->b_direct_mv_table;
+    job->picture_number        = s->picture_number;
+    job->reordered_pts         = s->reordered_pts;
+    job->dts_delta             = s->dts_delta;
+
+    /* update the context as coding the picture would */
+    if (s->pict_type == AV_PICTURE_TYPE_I)
+        s->picture_in_gop_number = 0;
+    p->picture_in_gop_number = s->picture_in_gop_number;
+    if (!s->low_delay && s->pict_type != AV_PICTURE_TYPE_B)
+        s->reordered_pts = s->current_picture.f->pts;
+
+    *jobp = job;
+    return 0;
+fail:
+    ff_mpv_free_job(avctx, &job);
+    return ret;
+}
 
-            props = av_cpb_properties_alloc(&props_size);
-            if (!props)
-                return AVERROR(ENOMEM);
-            props->vbv_delay = vbv_delay * 300;
+int ff_mpv_encode_schedule(AVCodecContext *avctx, const AVFrame *pic_arg,
+                           MPVEncodeJob **jobp)
+{
+    MpegEncContext *s = avctx->priv_data;
+    int i, ret;
 
-            ret = av_packet_add_side_data(pkt, AV_PKT_DATA_CPB_PROPERTIES,
-                                          (uint8_t*)props, props_size);
-            if (ret < 0) {
-                av_freep(&props);
-                return ret;
-            }
+    *jobp = NULL;
 
-#if FF_API_VBV_DELAY
-FF_DISABLE_DEPRECATION_WARNINGS
-            avctx->vbv_delay     = vbv_delay * 300;
-FF_ENABLE_DEPRECATION_WARNINGS
-#endif
+    s->picture_in_gop_number++;
+
+    if (load_input_picture(s, pic_arg) < 0)
+        return -1;
+
+    /* The scene change detection of the frame thread coding the last P-frame
+     * may have made it an I-frame, which starts the GOP of the pictures
+     * picked after it; select_input_picture() picks the next one now if no
+     * reordered pictures are left after shifting them. */
+    if (!s->reordered_input_picture[1] && s->next_picture_ptr &&
+        s->next_picture_ptr->f->pict_type == AV_PICTURE_TYPE_P) {
+        MPVFrameProgress *p = picture_progress(s->next_picture_ptr);
+
+        await_progress(s, &p->state_set, 1);
+        if (p->pict_type == AV_PICTURE_TYPE_I) {
+            s->picture_in_gop_number -= p->picture_in_gop_number;
+            s->next_picture_ptr->f->pict_type = AV_PICTURE_TYPE_I;
+            s->next_picture_ptr->f->key_frame = 1;
         }
-        s->total_bits     += s->frame_bits;
-#if FF_API_STAT_BITS
-FF_DISABLE_DEPRECATION_WARNINGS
-        avctx->frame_bits  = s->frame_bits;
-FF_ENABLE_DEPRECATION_WARNINGS
-#endif
+    }
 
+    if (select_input_picture(s) < 0)
+        return -1;
 
-        pkt->pts = s->current_picture.f->pts;
-        if (!s->low_delay && s->pict_type != AV_PICTURE_TYPE_B) {
-            if (!s->current_picture.f->coded_picture_number)
-                pkt->dts = pkt->pts - s->dts_delta;
-            else
-                pkt->dts = s->reordered_pts;
-            s->reordered_pts = pkt->pts;
-        } else
-            pkt->dts = pkt->pts;
-        if (s->current_picture.f->key_frame)
-            pkt->flags |= AV_PKT_FLAG_KEY;
-        if (s->mb_info)
-            av_packet_shrink_side_data(pkt, AV_PKT_DATA_H263_MB_INFO, s->mb_info_size);
-    } else {
-        s->frame_bits = 0;
+    if (s->new_picture.f->data[0]) {
+        ret = schedule_new_picture(avctx, jobp);
+        if (ret < 0)
+            return ret;
     }
 
     /* release non-reference frames */
@@ -2070,6 +2545,80 @@ FF_ENABLE_DEPRECATION_WARNINGS
             ff_mpeg_unref_picture(s->avctx, &s->picture[i]);
     }
 
+    return 0;
+}
+
+int ff_mpv_encode_job(AVCodecContext *avctx, AVPacket *pkt,
+                      MPVEncodeJob *job, int *got_packet)
+{
+    MpegEncContext *s = avctx->priv_data;
+    MPVFrameProgress *prev = (MPVFrameProgress *)job->prev_progress->data;
+    MPVFrameProgress *p    = picture_progress(&job->current_picture);
+    int i, ret;
+
+    *got_packet = 0;
+    s->vbv_ignore_qmax = 0;
+
+    s->current_picture_ptr = &job->current_picture;
+    s->last_picture_ptr    = job->last_picture.f ? &job->last_picture : NULL;
+    s->next_picture_ptr    = job->next_picture.f ? &job->next_picture : NULL;
+    for (i = 0; i < s->max_b_frames; i++)
+        s->reordered_input_picture[i + 1] =
+            job->input_picture[i].f ? &job->input_picture[i] : NULL;
+    s->prev_b_progress = job->prev_b_progress;
+
+    s->p_mv_table            = job->p_mv_table;
+    s->b_forw_mv_table       = job->b_forw_mv_table;
+    s->b_back_mv_table       = job->b_back_mv_table;
+    s->b_bidir_forw_mv_table = job->b_bidir_forw_mv_table;
+    s->b_bidir_back_mv_table = job->b_bidir_back_mv_table;
+    s->b_direct_mv_table     = job->b_direct_mv_table;
+    s->picture_number        = job->picture_number;
+    s->reordered_pts         = job->reordered_pts;
+    s->dts_delta             = job->dts_delta;
+
+    s->linesize   = job->current_picture.f->linesize[0];
+    s->uvlinesize = job->current_picture.f->linesize[1];
+    if (!s->sc.edge_emu_buffer &&
+        (ret = ff_mpeg_framesize_alloc(avctx, &s->me, &s->sc, s->linesize)) < 0)
+        goto end;
+
+    ff_mpeg_unref_picture(avctx, &s->new_picture);
+    ret = ff_mpeg_ref_picture(avctx, &s->new_picture, &job->new_picture);
+    if (ret < 0)
+        goto end;
+
+    await_progress(s, &prev->state_set, 1);
+    load_state(s, prev);
+    /* encode_picture() hands the motion estimation context as set up for
+     * the picture coded before on to the slice contexts */
+    if ((ret = ff_init_me(s)) < 0)
+        goto end;
+
+    s->pict_type = s->new_picture.f->pict_type;
+    ret = frame_setup(s);
+    if (ret >= 0)
+        ret = encode_new_picture(avctx, pkt);
+
+end:
+    /* let the frame threads waiting for the picture go on, also on errors */
+    publish_state(s, p);
+    report_progress(s, &p->rows, INT_MAX);
+
+    ff_mpeg_unref_picture(avctx, &s->new_picture);
+    ff_mpeg_unref_picture(avctx, &s->current_picture);
+    ff_mpeg_unref_picture(avctx, &s->last_picture);
+    ff_mpeg_unref_picture(avctx, &s->next_picture);
+    s->current_picture_ptr = s->last_picture_ptr = s->next_picture_ptr = NULL;
+    for (i = 0; i < s->max_b_frames; i++)
+        s->reordered_input_picture[i + 1] = NULL;
+    s->prev_b_progress = NULL;
+
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+
     av_assert1((s->frame_bits & 7) == 0);
 
     pkt->size = s->frame_bits / 8;
@@ -2759,6 +3308,37 @@ static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
     return 0;
 }
 
+/**
+ * Wait for the frame threads coding the pictures the motion search of MB
+ * row mb_y reads from.
+ */
+static void await_references(MpegEncContext *s, int mb_y)
+{
+    int last_row = s->mb_height - 1;
+    int ref_y    = last_row;
+
+    /* motion vectors are limited to me_range, direct mode ones to 16 more,
+     * and subpel interpolation reads 3 more lines; the vectors of the
+     * rows below are predictors */
+    if (s->avctx->me_range)
+        ref_y = FFMIN(mb_y + FFMAX((s->avctx->me_range + 16 + 3 + 15) / 16,
+                                   s->avctx->last_predictor_count + 1),
+                      last_row);
+
+    await_rows(s, &s->last_picture, ref_y);
+    if (s->pict_type == AV_PICTURE_TYPE_B) {
+        MPVFrameProgress *p = s->prev_b_progress ?
+                              (MPVFrameProgress *)s->prev_b_progress->data : NULL;
+
+        await_rows(s, &s->next_picture, ref_y);
+        /* the B-frame MV tables are shared with the previous B-frame */
+        if (p)
+            await_progress(s, &p->rows,
+                           FFMIN(mb_y + s->avctx->last_predictor_count + 1,
+                                 last_row));
+    }
+}
+
 static int estimate_motion_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= *(void**)arg;
 
@@ -2767,6 +3347,7 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
     s->me.dia_size= s->avctx->dia_size;
     s->first_slice_line=1;
     for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
+        await_references(s, s->mb_y);
         s->mb_x=0; //for block init below
         ff_init_block_index(s);
         for(s->mb_x=0; s->mb_x < s->mb_width; s->mb_x++) {
@@ -2913,6 +3494,7 @@ static int encode_thread(AVCodecContext *c, void *arg){
     int mb_x, mb_y;
     int chr_h= 16>>s->chroma_y_shift;
     int i, j;
+    int report = reports_rows(s);
     MpegEncContext best_s = { 0 }, backup_s;
     uint8_t bit_buf[2][MAX_MB_BYTES];
     uint8_t bit_buf2[2][MAX_MB_BYTES];
@@ -2975,6 +3557,14 @@ static int encode_thread(AVCodecContext *c, void *arg){
         s->mb_x=0;
         s->mb_y= mb_y;
 
+        /* intra MBs reset the P-frame MV table, which the frame thread of the
+         * last picture may still read */
+        if (s->pict_type == AV_PICTURE_TYPE_I)
+            await_rows(s, &s->last_picture, mb_y);
+        /* the loop filter changes the row above the current one */
+        if (report && mb_y >= s->start_mb_y + 2)
+            report_rows(s, mb_y - 2, mb_y - 1);
+
         ff_set_qscale(s, s->qscale);
         ff_init_block_index(s);
 
@@ -2992,7 +3582,7 @@ static int encode_thread(AVCodecContext *c, void *arg){
                 av_log(s->avctx, AV_LOG_ERROR, "encoded frame too large\n");
                 return -1;
             }
-            if(s->data_partitioning){
+            if(s->partitioned_frame){
                 if(   s->pb2   .buf_end - s->pb2   .buf - (put_bits_count(&s->    pb2)>>3) < MAX_MB_BYTES
                    || s->tex_pb.buf_end - s->tex_pb.buf - (put_bits_count(&s->tex_pb )>>3) < MAX_MB_BYTES){
                     av_log(s->avctx, AV_LOG_ERROR, "encoded partitioned frame too large\n");
@@ -3543,6 +4133,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
     write_slice_end(s);
 
+    if (report)
+        report_rows(s, FFMAX(s->end_mb_y - 2, s->start_mb_y), s->end_mb_y);
+
 #if FF_API_RTP_CALLBACK
 FF_DISABLE_DEPRECATION_WARNINGS
     /* Send the last GOB if RTP */
@@ -3912,6 +4505,8 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     bits= put_bits_count(&s->pb);
     s->header_bits= bits - s->last_bits;
 
+    publish_state(s, picture_progress(&s->current_picture));
+
     for(i=1; i<context_count; i++){
         update_duplicate_context_after_me(s->thread_context[i], s);
     }
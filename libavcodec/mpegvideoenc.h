@@ -0,0 +1,55 @@
+/*
+ * Frame threaded coding of mpegvideo based P- and B-frames
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_MPEGVIDEOENC_H
+#define AVCODEC_MPEGVIDEOENC_H
+
+#include "avcodec.h"
+
+typedef struct MPVEncodeJob MPVEncodeJob;
+
+/**
+ * Check whether the frame threads can code P- and B-frames with the
+ * options of avctx, see ff_mpv_encode_schedule().
+ */
+int ff_mpv_encode_pipeline_supported(AVCodecContext *avctx);
+
+/**
+ * Pick the next picture to code like ff_mpv_encode_picture() does, in the
+ * context of the frame thread encoder, and hand it out as a job.
+ * The frame threads coding the jobs wait for the rows of the pictures they
+ * reference, and for the state left by the picture coded before.
+ *
+ * @param frame the next input frame, NULL to flush
+ * @param job   set to the job to code, or NULL if no picture is due yet
+ */
+int ff_mpv_encode_schedule(AVCodecContext *avctx, const AVFrame *frame,
+                           MPVEncodeJob **job);
+
+/**
+ * Code the picture of a job from ff_mpv_encode_schedule() in the context of
+ * a frame thread.
+ */
+int ff_mpv_encode_job(AVCodecContext *avctx, AVPacket *pkt,
+                      MPVEncodeJob *job, int *got_packet);
+
+void ff_mpv_free_job(AVCodecContext *avctx, MPVEncodeJob **job);
+
+#endif /* AVCODEC_MPEGVIDEOENC_H */
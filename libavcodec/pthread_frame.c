@@ -44,6 +44,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "libavutil/threadpool_internal.h"
 
 enum {
     ///< Set when the thread is awaiting a packet.
@@ -71,6 +72,7 @@ typedef struct PerThreadContext {
     struct FrameThreadContext *parent;
 
     pthread_t      thread;
+    AVThreadPoolWorker *pool_worker; ///< Set instead of thread when running on a thread pool.
     int            thread_init;
     pthread_cond_t input_cond;      ///< Used to wait for a new packet from the main thread.
     pthread_cond_t progress_cond;   ///< Used by child threads to wait for progress to change.
@@ -118,6 +120,9 @@ typedef struct FrameThreadContext {
     PerThreadContext *threads;     ///< The contexts for each thread.
     PerThreadContext *prev_thread; ///< The last thread submit_packet() was called on.
 
+    AVThreadPool *pool;            ///< Pool the threads are taken from, may be NULL.
+    int nb_reserved;               ///< Number of threads reserved from the pool.
+
     pthread_mutex_t buffer_mutex;  ///< Mutex used to protect get/release_buffer().
     /**
      * This lock is used for ensuring threads run in serial when hwaccel
@@ -672,8 +677,12 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
         pthread_cond_signal(&p->input_cond);
         pthread_mutex_unlock(&p->mutex);
 
-        if (p->thread_init)
-            pthread_join(p->thread, NULL);
+        if (p->thread_init) {
+            if (fctx->pool)
+                avpriv_thread_pool_join(fctx->pool, &p->pool_worker);
+            else
+                pthread_join(p->thread, NULL);
+        }
         p->thread_init=0;
 
         if (codec->close && p->avctx)
@@ -707,6 +716,9 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
         av_freep(&p->avctx);
     }
 
+    if (fctx->pool)
+        avpriv_thread_pool_release(fctx->pool, fctx->nb_reserved);
+
     av_freep(&fctx->threads);
     pthread_mutex_destroy(&fctx->buffer_mutex);
     pthread_mutex_destroy(&fctx->hwaccel_mutex);
@@ -756,6 +768,20 @@ int ff_frame_thread_init(AVCodecContext *avctx)
         return AVERROR(ENOMEM);
     }
 
+    if (avctx->thread_pool) {
+        fctx->pool        = avctx->thread_pool;
+        fctx->nb_reserved = avpriv_thread_pool_reserve(fctx->pool, thread_count);
+        if (fctx->nb_reserved <= 1) {
+            avpriv_thread_pool_release(fctx->pool, fctx->nb_reserved);
+            av_freep(&fctx->threads);
+            av_freep(&avctx->internal->thread_ctx);
+            avctx->thread_count       = 1;
+            avctx->active_thread_type = 0;
+            return 0;
+        }
+        thread_count = avctx->thread_count = fctx->nb_reserved;
+    }
+
     pthread_mutex_init(&fctx->buffer_mutex, NULL);
     pthread_mutex_init(&fctx->hwaccel_mutex, NULL);
     pthread_mutex_init(&fctx->async_mutex, NULL);
@@ -799,6 +825,7 @@ int ff_frame_thread_init(AVCodecContext *avctx)
         }
         *copy->internal = *src->internal;
         copy->internal->thread_ctx = p;
+        copy->internal->hybrid_thread_ctx = NULL;
         copy->internal->last_pkt_props = &p->avpkt;
 
         if (!i) {
@@ -825,7 +852,10 @@ int ff_frame_thread_init(AVCodecContext *avctx)
 
         atomic_init(&p->debug_threads, (copy->debug & FF_DEBUG_THREADS) != 0);
 
-        err = AVERROR(pthread_create(&p->thread, NULL, frame_worker_thread, p));
+        if (fctx->pool)
+            err = avpriv_thread_pool_start(fctx->pool, &p->pool_worker, frame_worker_thread, p);
+        else
+            err = AVERROR(pthread_create(&p->thread, NULL, frame_worker_thread, p));
         p->thread_init= !err;
         if(!p->thread_init)
             goto error;
@@ -886,7 +916,9 @@ static int thread_get_buffer_internal(AVCodecContext *avctx, ThreadFrame *f, int
 
     f->owner[0] = f->owner[1] = avctx;
 
-    if (!(avctx->active_thread_type & FF_THREAD_FRAME))
+    /* frame threaded encoders have no per thread context */
+    if (!(avctx->active_thread_type & FF_THREAD_FRAME) ||
+        av_codec_is_encoder(avctx->codec))
         return ff_get_buffer(avctx, f->f, flags);
 
     if (atomic_load(&p->state) != STATE_SETTING_UP &&
@@ -975,6 +1007,7 @@ void ff_thread_release_buffer(AVCodecContext *avctx, ThreadFrame *f)
     FrameThreadContext *fctx;
     AVFrame *dst, *tmp;
     int can_direct_free = !(avctx->active_thread_type & FF_THREAD_FRAME) ||
+                          av_codec_is_encoder(avctx->codec)             ||
                           THREAD_SAFE_CALLBACKS(avctx);
 
     if (!f->f || !f->f->buf[0])
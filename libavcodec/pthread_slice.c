@@ -56,16 +56,22 @@ typedef struct SliceThreadContext {
     pthread_mutex_t *progress_mutex;
 } SliceThreadContext;
 
+static SliceThreadContext *get_slice_ctx(AVCodecContext *avctx)
+{
+    AVCodecInternal *avci = avctx->internal;
+    return avci->hybrid_thread_ctx ? avci->hybrid_thread_ctx : avci->thread_ctx;
+}
+
 static void main_function(void *priv) {
     AVCodecContext *avctx = priv;
-    SliceThreadContext *c = avctx->internal->thread_ctx;
+    SliceThreadContext *c = get_slice_ctx(avctx);
     c->mainfunc(avctx);
 }
 
 static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
 {
     AVCodecContext *avctx = priv;
-    SliceThreadContext *c = avctx->internal->thread_ctx;
+    SliceThreadContext *c = get_slice_ctx(avctx);
     int ret;
 
     ret = c->func ? c->func(avctx, (char *)c->args + c->job_size * jobnr)
@@ -74,29 +80,36 @@ static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb
         c->rets[jobnr] = ret;
 }
 
-void ff_slice_thread_free(AVCodecContext *avctx)
+static void slice_thread_uninit(SliceThreadContext *c)
 {
-    SliceThreadContext *c = avctx->internal->thread_ctx;
     int i;
 
     avpriv_slicethread_free(&c->thread);
 
-    for (i = 0; i < c->thread_count; i++) {
-        pthread_mutex_destroy(&c->progress_mutex[i]);
-        pthread_cond_destroy(&c->progress_cond[i]);
+    if (c->progress_mutex) {
+        for (i = 0; i < c->thread_count; i++) {
+            pthread_mutex_destroy(&c->progress_mutex[i]);
+            pthread_cond_destroy(&c->progress_cond[i]);
+        }
     }
 
     av_freep(&c->entries);
     av_freep(&c->progress_mutex);
     av_freep(&c->progress_cond);
+}
+
+void ff_slice_thread_free(AVCodecContext *avctx)
+{
+    slice_thread_uninit(avctx->internal->thread_ctx);
     av_freep(&avctx->internal->thread_ctx);
 }
 
 static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
 {
-    SliceThreadContext *c = avctx->internal->thread_ctx;
+    SliceThreadContext *c = get_slice_ctx(avctx);
 
-    if (!(avctx->active_thread_type&FF_THREAD_SLICE) || avctx->thread_count <= 1)
+    if (!avctx->internal->hybrid_thread_ctx &&
+        (!(avctx->active_thread_type&FF_THREAD_SLICE) || avctx->thread_count <= 1))
         return avcodec_default_execute(avctx, func, arg, ret, job_count, job_size);
 
     if (job_count <= 0)
@@ -113,14 +126,14 @@ static int thread_execute(AVCodecContext *avctx, action_func* func, void *arg, i
 
 static int thread_execute2(AVCodecContext *avctx, action_func2* func2, void *arg, int *ret, int job_count)
 {
-    SliceThreadContext *c = avctx->internal->thread_ctx;
+    SliceThreadContext *c = get_slice_ctx(avctx);
     c->func2 = func2;
     return thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
 int ff_slice_thread_execute_with_mainfunc(AVCodecContext *avctx, action_func2* func2, main_func *mainfunc, void *arg, int *ret, int job_count)
 {
-    SliceThreadContext *c = avctx->internal->thread_ctx;
+    SliceThreadContext *c = get_slice_ctx(avctx);
     c->func2 = func2;
     c->mainfunc = mainfunc;
     return thread_execute(avctx, NULL, arg, ret, job_count, 0);
@@ -156,7 +169,8 @@ int ff_slice_thread_init(AVCodecContext *avctx)
 
     avctx->internal->thread_ctx = c = av_mallocz(sizeof(*c));
     mainfunc = avctx->codec->caps_internal & FF_CODEC_CAP_SLICE_THREAD_HAS_MF ? &main_function : NULL;
-    if (!c || (thread_count = avpriv_slicethread_create(&c->thread, avctx, worker_func, mainfunc, thread_count)) <= 1) {
+    if (!c || (thread_count = avpriv_slicethread_create_pool(&c->thread, avctx, worker_func, mainfunc,
+                                                             thread_count, avctx->thread_pool)) <= 1) {
         if (c)
             avpriv_slicethread_free(&c->thread);
         av_freep(&avctx->internal->thread_ctx);
@@ -171,9 +185,47 @@ int ff_slice_thread_init(AVCodecContext *avctx)
     return 0;
 }
 
+int ff_slice_thread_init_hybrid(AVCodecContext *avctx, int thread_count)
+{
+    SliceThreadContext *c;
+
+    if (!(avctx->active_thread_type & FF_THREAD_FRAME) || thread_count <= 1)
+        return 1;
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+
+    thread_count = avpriv_slicethread_create_pool(&c->thread, avctx, worker_func,
+                                                  avctx->codec->caps_internal & FF_CODEC_CAP_SLICE_THREAD_HAS_MF ?
+                                                  &main_function : NULL, thread_count, avctx->thread_pool);
+    if (thread_count <= 1) {
+        avpriv_slicethread_free(&c->thread);
+        av_free(c);
+        return thread_count == AVERROR(ENOMEM) ? thread_count : 1;
+    }
+    c->thread_count = thread_count;
+
+    avctx->internal->hybrid_thread_ctx = c;
+    avctx->execute  = thread_execute;
+    avctx->execute2 = thread_execute2;
+    return thread_count;
+}
+
+void ff_slice_thread_free_hybrid(AVCodecContext *avctx)
+{
+    if (!avctx->internal->hybrid_thread_ctx)
+        return;
+
+    slice_thread_uninit(avctx->internal->hybrid_thread_ctx);
+    av_freep(&avctx->internal->hybrid_thread_ctx);
+    avctx->execute  = avcodec_default_execute;
+    avctx->execute2 = avcodec_default_execute2;
+}
+
 void ff_thread_report_progress2(AVCodecContext *avctx, int field, int thread, int n)
 {
-    SliceThreadContext *p = avctx->internal->thread_ctx;
+    SliceThreadContext *p = get_slice_ctx(avctx);
     int *entries = p->entries;
 
     pthread_mutex_lock(&p->progress_mutex[thread]);
@@ -184,7 +236,7 @@ void ff_thread_report_progress2(AVCodecContext *avctx, int field, int thread, in
 
 void ff_thread_await_progress2(AVCodecContext *avctx, int field, int thread, int shift)
 {
-    SliceThreadContext *p  = avctx->internal->thread_ctx;
+    SliceThreadContext *p  = get_slice_ctx(avctx);
     int *entries      = p->entries;
 
     if (!entries || !field) return;
@@ -202,15 +254,18 @@ int ff_alloc_entries(AVCodecContext *avctx, int count)
 {
     int i;
 
-    if (avctx->active_thread_type & FF_THREAD_SLICE)  {
-        SliceThreadContext *p = avctx->internal->thread_ctx;
+    if (avctx->active_thread_type & FF_THREAD_SLICE ||
+        avctx->internal->hybrid_thread_ctx) {
+        SliceThreadContext *p = get_slice_ctx(avctx);
+        int thread_count = avctx->internal->hybrid_thread_ctx ? p->thread_count
+                                                              : avctx->thread_count;
 
         if (p->entries) {
-            av_assert0(p->thread_count == avctx->thread_count);
+            av_assert0(p->thread_count == thread_count);
             av_freep(&p->entries);
         }
 
-        p->thread_count  = avctx->thread_count;
+        p->thread_count  = thread_count;
         p->entries       = av_mallocz_array(count, sizeof(int));
 
         if (!p->progress_mutex) {
@@ -237,6 +292,6 @@ int ff_alloc_entries(AVCodecContext *avctx, int count)
 
 void ff_reset_entries(AVCodecContext *avctx)
 {
-    SliceThreadContext *p = avctx->internal->thread_ctx;
+    SliceThreadContext *p = get_slice_ctx(avctx);
     memset(p->entries, 0, p->entries_count * sizeof(int));
 }
@@ -141,4 +141,18 @@ void ff_reset_entries(AVCodecContext *avctx);
 void ff_thread_report_progress2(AVCodecContext *avctx, int field, int thread, int n);
 void ff_thread_await_progress2(AVCodecContext *avctx,  int field, int thread, int shift);
 
+/**
+ * Create a slice thread pool for a frame thread worker context, so that
+ * execute2() and the *_progress2() functions can be used within frame
+ * threading. Must be called from the codec init or init_thread_copy
+ * callbacks.
+ *
+ * @param avctx        the worker context
+ * @param thread_count requested number of slice threads
+ * @return the number of threads in the pool, 1 if no pool was created,
+ *         or a negative AVERROR code
+ */
+int ff_slice_thread_init_hybrid(AVCodecContext *avctx, int thread_count);
+void ff_slice_thread_free_hybrid(AVCodecContext *avctx);
+
 #endif /* AVCODEC_THREAD_H */
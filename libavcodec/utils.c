@@ -1896,6 +1896,15 @@ void ff_thread_report_progress2(AVCodecContext *avctx, int field, int thread, in
 {
 }
 
+int ff_slice_thread_init_hybrid(AVCodecContext *avctx, int thread_count)
+{
+    return 1;
+}
+
+void ff_slice_thread_free_hybrid(AVCodecContext *avctx)
+{
+}
+
 #endif
 
 int avcodec_is_open(AVCodecContext *s)
@@ -33,6 +33,7 @@
 #include "vp9data.h"
 #include "vp9dec.h"
 #include "libavutil/avassert.h"
+#include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 
 #define VP9_SYNCCODE 0x498342
@@ -41,7 +42,7 @@
 static void vp9_free_entries(AVCodecContext *avctx) {
     VP9Context *s = avctx->priv_data;
 
-    if (avctx->active_thread_type & FF_THREAD_SLICE)  {
+    if (s->slice_threading) {
         pthread_mutex_destroy(&s->progress_mutex);
         pthread_cond_destroy(&s->progress_cond);
         av_freep(&s->entries);
@@ -52,7 +53,7 @@ static int vp9_alloc_entries(AVCodecContext *avctx, int n) {
     VP9Context *s = avctx->priv_data;
     int i;
 
-    if (avctx->active_thread_type & FF_THREAD_SLICE)  {
+    if (s->slice_threading) {
         if (s->entries)
             av_freep(&s->entries);
 
@@ -241,7 +242,7 @@ static int update_size(AVCodecContext *avctx, int w, int h)
     s->sb_rows   = (h + 63) >> 6;
     s->cols      = (w + 7) >> 3;
     s->rows      = (h + 7) >> 3;
-    lflvl_len    = avctx->active_thread_type == FF_THREAD_SLICE ? s->sb_rows : 1;
+    lflvl_len    = s->slice_threading ? s->sb_rows : 1;
 
 #define assign(var, type, n) var = (type) p; p += s->sb_cols * (n) * sizeof(*var)
     av_freep(&s->intra_pred_data[0]);
@@ -772,11 +773,14 @@ static int decode_frame_header(AVCodecContext *avctx,
 
         s->s.h.tiling.tile_cols = 1 << s->s.h.tiling.log2_tile_cols;
         vp9_free_entries(avctx);
-        s->active_tile_cols = avctx->active_thread_type == FF_THREAD_SLICE ?
+        s->active_tile_cols = s->slice_threading ?
                               s->s.h.tiling.tile_cols : 1;
         vp9_alloc_entries(avctx, s->sb_rows);
         if (avctx->active_thread_type == FF_THREAD_SLICE) {
             n_range_coders = 4; // max_tile_rows
+        } else if (s->slice_threading) {
+            // two-pass frames are decoded by decode_tiles() using td[0]
+            n_range_coders = FFMAX(4, s->s.h.tiling.tile_cols);
         } else {
             n_range_coders = s->s.h.tiling.tile_cols;
         }
@@ -1219,6 +1223,7 @@ static av_cold int vp9_decode_free(AVCodecContext *avctx)
         av_frame_free(&s->next_refs[i].f);
     }
 
+    ff_slice_thread_free_hybrid(avctx);
     free_buffers(s);
     vp9_free_entries(avctx);
     av_freep(&s->td);
@@ -1463,6 +1468,9 @@ int loopfilter_proc(AVCodecContext *avctx)
                                      yoff, uvoff);
             }
         }
+
+        // only has an effect when running inside a frame thread
+        ff_thread_report_progress(&s->s.frames[CUR_FRAME].tf, i, 0);
     }
     return 0;
 }
@@ -1599,7 +1607,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
     }
 
 #if HAVE_THREADS
-    if (avctx->active_thread_type & FF_THREAD_SLICE) {
+    if (s->slice_threading) {
         for (i = 0; i < s->sb_rows; i++)
             atomic_store(&s->entries[i], 0);
     }
@@ -1617,7 +1625,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
 
 #if HAVE_THREADS
-        if (avctx->active_thread_type == FF_THREAD_SLICE) {
+        if (s->slice_threading && !s->pass) {
             int tile_row, tile_col;
 
             av_assert1(!s->pass);
@@ -1658,7 +1666,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
 
         // Sum all counts fields into td[0].counts for tile threading
-        if (avctx->active_thread_type == FF_THREAD_SLICE)
+        if (s->slice_threading && !s->pass)
             for (i = 1; i < s->s.h.tiling.tile_cols; i++)
                 for (j = 0; j < sizeof(s->td[i].counts) / sizeof(unsigned); j++)
                     ((unsigned *)&s->td[0].counts)[j] += ((unsigned *)&s->td[i].counts)[j];
@@ -1726,21 +1734,51 @@ static int init_frames(AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * Decode the tile columns of each frame with a slice thread pool private
+ * to the frame thread, on top of frame threading.
+ */
+static av_cold int init_tile_threads(AVCodecContext *avctx)
+{
+    VP9Context *s = avctx->priv_data;
+    int ret;
+
+    s->slice_threading = avctx->active_thread_type == FF_THREAD_SLICE;
+    if (!(avctx->active_thread_type & FF_THREAD_FRAME) || s->tile_threads <= 1)
+        return 0;
+
+    ret = ff_slice_thread_init_hybrid(avctx, s->tile_threads);
+    if (ret < 0)
+        return ret;
+    s->slice_threading = ret > 1;
+
+    return 0;
+}
+
 static av_cold int vp9_decode_init(AVCodecContext *avctx)
 {
     VP9Context *s = avctx->priv_data;
+    int ret;
 
     avctx->internal->allocate_progress = 1;
     s->last_bpp = 0;
     s->s.h.filter.sharpness = -1;
 
-    return init_frames(avctx);
+    ret = init_frames(avctx);
+    if (ret < 0)
+        return ret;
+
+    return init_tile_threads(avctx);
 }
 
 #if HAVE_THREADS
 static av_cold int vp9_decode_init_thread_copy(AVCodecContext *avctx)
 {
-    return init_frames(avctx);
+    int ret = init_frames(avctx);
+    if (ret < 0)
+        return ret;
+
+    return init_tile_threads(avctx);
 }
 
 static int vp9_decode_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
@@ -1789,6 +1827,22 @@ static int vp9_decode_update_thread_context(AVCodecContext *dst, const AVCodecCo
 }
 #endif
 
+#define OFFSET(x) offsetof(VP9Context, x)
+#define PAR (AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_VIDEO_PARAM)
+
+static const AVOption options[] = {
+    { "tile_threads", "Number of threads decoding tile columns within each frame thread", OFFSET(tile_threads),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, PAR },
+    { NULL },
+};
+
+static const AVClass vp9_decoder_class = {
+    .class_name = "VP9 decoder",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVCodec ff_vp9_decoder = {
     .name                  = "vp9",
     .long_name             = NULL_IF_CONFIG_SMALL("Google VP9"),
@@ -1805,6 +1859,7 @@ AVCodec ff_vp9_decoder = {
     .update_thread_context = ONLY_IF_THREADS_ENABLED(vp9_decode_update_thread_context),
     .profiles              = NULL_IF_CONFIG_SMALL(ff_vp9_profiles),
     .bsfs                  = "vp9_superframe_split",
+    .priv_class            = &vp9_decoder_class,
     .hw_configs            = (const AVCodecHWConfigInternal*[]) {
 #if CONFIG_VP9_DXVA2_HWACCEL
                                HWACCEL_DXVA2(vp9),
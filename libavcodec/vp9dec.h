@@ -97,6 +97,8 @@ typedef struct VP9Context {
     GetBitContext gb;
     VP56RangeCoder c;
     int pass, active_tile_cols;
+    int slice_threading;        ///< tile columns are decoded by slice threads
+    int tile_threads;           ///< tile threads per frame thread
 
 #if HAVE_THREADS
     pthread_mutex_t progress_mutex;
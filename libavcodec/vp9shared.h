@@ -157,6 +157,7 @@ typedef struct VP9BitstreamHeader {
 } VP9BitstreamHeader;
 
 typedef struct VP9SharedContext {
+    const AVClass *class;  // needed by private avoptions of the decoder
     VP9BitstreamHeader h;
 
     ThreadFrame refs[8];
@@ -52,6 +52,8 @@
 #define DURATION_SHORTEST 1
 #define DURATION_FIRST    2
 
+#define FRAME_BATCH_SIZE 64 /**< maximum number of frames taken from an input at once */
+
 
 typedef struct FrameInfo {
     int nb_samples;
@@ -422,37 +424,39 @@ static int activate(AVFilterContext *ctx)
 {
     AVFilterLink *outlink = ctx->outputs[0];
     MixContext *s = ctx->priv;
-    AVFrame *buf = NULL;
-    int i, ret;
+    AVFrame *bufs[FRAME_BATCH_SIZE];
+    int i, j, nb_bufs, ret;
 
     FF_FILTER_FORWARD_STATUS_BACK_ALL(outlink, ctx);
 
     for (i = 0; i < s->nb_inputs; i++) {
         AVFilterLink *inlink = ctx->inputs[i];
 
-        if ((ret = ff_inlink_consume_frame(ctx->inputs[i], &buf)) > 0) {
+        nb_bufs = ff_inlink_consume_frames(inlink, bufs, FRAME_BATCH_SIZE);
+        if (nb_bufs < 0)
+            return nb_bufs;
+
+        for (j = 0; j < nb_bufs; j++) {
+            AVFrame *buf = bufs[j];
+
+            ret = 0;
             if (i == 0) {
                 int64_t pts = av_rescale_q(buf->pts, inlink->time_base,
                                            outlink->time_base);
                 ret = frame_list_add_frame(s->frame_list, buf->nb_samples, pts);
-                if (ret < 0) {
-                    av_frame_free(&buf);
-                    return ret;
-                }
             }
-
-            ret = av_audio_fifo_write(s->fifos[i], (void **)buf->extended_data,
-                                      buf->nb_samples);
+            if (ret >= 0)
+                ret = av_audio_fifo_write(s->fifos[i], (void **)buf->extended_data,
+                                          buf->nb_samples);
+            if (ret >= 0)
+                ret = output_frame(outlink);
             if (ret < 0) {
-                av_frame_free(&buf);
+                while (j < nb_bufs)
+                    av_frame_free(&bufs[j++]);
                 return ret;
             }
 
-            av_frame_free(&buf);
-
-            ret = output_frame(outlink);
-            if (ret < 0)
-                return ret;
+            av_frame_free(&bufs[j]);
         }
     }
 
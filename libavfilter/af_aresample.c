@@ -154,6 +154,10 @@ static int config_output(AVFilterLink *outlink)
         av_opt_set_int(aresample->swr, "ich", inlink->channels, 0);
     if (!outlink->channel_layout)
         av_opt_set_int(aresample->swr, "och", outlink->channels, 0);
+    /* the resampler runs its own threads, so they are only used when the
+     * filter is explicitly given a thread count */
+    if (ctx->nb_threads > 0)
+        av_opt_set_int(aresample->swr, "threads", ctx->nb_threads, 0);
 
     ret = swr_init(aresample->swr);
     if (ret < 0)
@@ -350,4 +354,5 @@ AVFilter ff_af_aresample = {
     .priv_class    = &aresample_class,
     .inputs        = aresample_inputs,
     .outputs       = aresample_outputs,
+    .flags_internal = FF_FILTER_FLAG_FRAME_BATCH,
 };
@@ -458,4 +458,5 @@ AVFilter ff_af_pan = {
     .query_formats = query_formats,
     .inputs        = pan_inputs,
     .outputs       = pan_outputs,
+    .flags_internal = FF_FILTER_FLAG_FRAME_BATCH,
 };
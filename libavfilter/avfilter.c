@@ -190,14 +190,42 @@ int avfilter_link_get_channels(AVFilterLink *link)
 }
 #endif
 
-void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
+/**
+ * Lock the state that filters activated concurrently can share, see
+ * AVFilterGraphInternal.sched_lock.
+ */
+static void sched_lock(AVFilterContext *filter)
+{
+    AVFilterGraphInternal *gi = filter->graph ? filter->graph->internal : NULL;
+
+    if (gi && gi->thread_activate)
+        ff_mutex_lock(&gi->sched_lock);
+}
+
+static void sched_unlock(AVFilterContext *filter)
+{
+    AVFilterGraphInternal *gi = filter->graph ? filter->graph->internal : NULL;
+
+    if (gi && gi->thread_activate)
+        ff_mutex_unlock(&gi->sched_lock);
+}
+
+static void filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
     filter->ready = FFMAX(filter->ready, priority);
 }
 
+void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
+{
+    sched_lock(filter);
+    filter_set_ready(filter, priority);
+    sched_unlock(filter);
+}
+
 /**
  * Clear frame_blocked_in on all outputs.
  * This is necessary whenever something changes on input.
+ * Must be called with the scheduling lock held.
  */
 static void filter_unblock(AVFilterContext *filter)
 {
@@ -210,26 +238,30 @@ static void filter_unblock(AVFilterContext *filter)
 
 void ff_avfilter_link_set_in_status(AVFilterLink *link, int status, int64_t pts)
 {
-    if (link->status_in == status)
-        return;
-    av_assert0(!link->status_in);
-    link->status_in = status;
-    link->status_in_pts = pts;
-    link->frame_wanted_out = 0;
-    link->frame_blocked_in = 0;
-    filter_unblock(link->dst);
-    ff_filter_set_ready(link->dst, 200);
+    sched_lock(link->dst);
+    if (link->status_in != status) {
+        av_assert0(!link->status_in);
+        link->status_in = status;
+        link->status_in_pts = pts;
+        link->frame_wanted_out = 0;
+        link->frame_blocked_in = 0;
+        filter_unblock(link->dst);
+        filter_set_ready(link->dst, 200);
+    }
+    sched_unlock(link->dst);
 }
 
 void ff_avfilter_link_set_out_status(AVFilterLink *link, int status, int64_t pts)
 {
+    if (pts != AV_NOPTS_VALUE)
+        ff_update_link_current_pts(link, pts);
+    sched_lock(link->dst);
     av_assert0(!link->frame_wanted_out);
     av_assert0(!link->status_out);
     link->status_out = status;
-    if (pts != AV_NOPTS_VALUE)
-        ff_update_link_current_pts(link, pts);
     filter_unblock(link->dst);
-    ff_filter_set_ready(link->src, 200);
+    filter_set_ready(link->src, 200);
+    sched_unlock(link->dst);
 }
 
 void avfilter_link_set_closed(AVFilterLink *link, int closed)
@@ -424,8 +456,10 @@ int ff_request_frame(AVFilterLink *link)
             return link->status_out;
         }
     }
+    sched_lock(link->dst);
     link->frame_wanted_out = 1;
-    ff_filter_set_ready(link->src, 100);
+    filter_set_ready(link->src, 100);
+    sched_unlock(link->dst);
     return 0;
 }
 
@@ -453,7 +487,9 @@ static int ff_request_frame_to_filter(AVFilterLink *link)
 
     FF_TPRINTF_START(NULL, request_frame_to_filter); ff_tlog_link(NULL, link, 1);
     /* Assume the filter is blocked, let the method clear it if not */
+    sched_lock(link->src);
     link->frame_blocked_in = 1;
+    sched_unlock(link->src);
     if (link->srcpad->request_frame)
         ret = link->srcpad->request_frame(link);
     else if (link->src->inputs[0])
@@ -529,11 +565,14 @@ void ff_update_link_current_pts(AVFilterLink *link, int64_t pts)
 {
     if (pts == AV_NOPTS_VALUE)
         return;
+    /* TODO use duration */
+    if (link->graph && link->age_index >= 0) {
+        /* the heap compares the pts of all sink links, set it under its lock */
+        ff_avfilter_graph_update_heap(link->graph, link, pts);
+        return;
+    }
     link->current_pts = pts;
     link->current_pts_us = av_rescale_q(pts, link->time_base, AV_TIME_BASE_Q);
-    /* TODO use duration */
-    if (link->graph && link->age_index >= 0)
-        ff_avfilter_graph_update_heap(link->graph, link);
 }
 
 int avfilter_process_command(AVFilterContext *filter, const char *cmd, const char *arg, char *res, int res_len, int flags)
@@ -1107,9 +1146,11 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
         }
     }
 
+    sched_lock(link->dst);
     link->frame_blocked_in = link->frame_wanted_out = 0;
-    link->frame_count_in++;
     filter_unblock(link->dst);
+    sched_unlock(link->dst);
+    link->frame_count_in++;
     ret = ff_framequeue_add(&link->fifo, frame);
     if (ret < 0) {
         av_frame_free(&frame);
@@ -1190,28 +1231,46 @@ static int take_samples(AVFilterLink *link, unsigned min, unsigned max,
     return 0;
 }
 
+/* maximum number of frames passed to a FF_FILTER_FLAG_FRAME_BATCH filter
+   in one activation */
+#define FRAME_BATCH_MAX 64
+
 static int ff_filter_frame_to_filter(AVFilterLink *link)
 {
-    AVFrame *frame = NULL;
+    AVFrame *frames[FRAME_BATCH_MAX] = { NULL };
     AVFilterContext *dst = link->dst;
-    int ret;
+    int i, nb_frames, ret;
 
     av_assert1(ff_framequeue_queued_frames(&link->fifo));
-    ret = link->min_samples ?
-          ff_inlink_consume_samples(link, link->min_samples, link->max_samples, &frame) :
-          ff_inlink_consume_frame(link, &frame);
+    if (link->min_samples)
+        ret = ff_inlink_consume_samples(link, link->min_samples, link->max_samples, &frames[0]);
+    else if (dst->filter->flags_internal & FF_FILTER_FLAG_FRAME_BATCH)
+        ret = ff_inlink_consume_frames(link, frames, FRAME_BATCH_MAX);
+    else
+        ret = ff_inlink_consume_frame(link, &frames[0]);
     av_assert1(ret);
     if (ret < 0) {
-        av_assert1(!frame);
+        av_assert1(!frames[0]);
         return ret;
     }
+    nb_frames = ret;
     /* The filter will soon have received a new frame, that may allow it to
        produce one or more: unblock its outputs. */
+    sched_lock(dst);
     filter_unblock(dst);
+    sched_unlock(dst);
     /* AVFilterPad.filter_frame() expect frame_count_out to have the value
        before the frame; ff_filter_frame_framed() will re-increment it. */
-    link->frame_count_out--;
-    ret = ff_filter_frame_framed(link, frame);
+    link->frame_count_out -= nb_frames;
+    for (i = 0; i < nb_frames; i++) {
+        ret = ff_filter_frame_framed(link, frames[i]);
+        if (ret < 0)
+            break;
+    }
+    for (i++; i < nb_frames; i++) {
+        av_frame_free(&frames[i]);
+        link->frame_count_out++;
+    }
     if (ret < 0 && ret != link->status_out) {
         ff_avfilter_link_set_out_status(link, ret, AV_NOPTS_VALUE);
     } else {
@@ -1492,6 +1551,39 @@ int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe)
     return 1;
 }
 
+int ff_inlink_consume_frames(AVFilterLink *link, AVFrame **frames,
+                             unsigned max_frames)
+{
+    AVFilterContext *dst = link->dst;
+    unsigned nb_frames;
+    int ret;
+
+    if (!max_frames)
+        return 0;
+    ret = ff_inlink_consume_frame(link, &frames[0]);
+    if (ret <= 0)
+        return ret;
+
+    for (nb_frames = 1; nb_frames < max_frames; nb_frames++) {
+        AVFrame *frame;
+
+        if (!ff_framequeue_queued_frames(&link->fifo) || link->fifo.samples_skipped)
+            break;
+        frame = ff_framequeue_peek(&link->fifo, 0);
+        if (dst->command_queue &&
+            dst->command_queue->time <= frame->pts * av_q2d(link->time_base))
+            break;
+        if (dst->enable_str &&
+            (!ff_inlink_evaluate_timeline_at_frame(link, frame)) != dst->is_disabled)
+            break;
+
+        frames[nb_frames] = ff_framequeue_take(&link->fifo);
+        ff_update_link_current_pts(link, frame->pts);
+        link->frame_count_out++;
+    }
+    return nb_frames;
+}
+
 int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
                             AVFrame **rframe)
 {
@@ -1603,23 +1695,29 @@ void ff_inlink_request_frame(AVFilterLink *link)
 {
     av_assert1(!link->status_in);
     av_assert1(!link->status_out);
+    sched_lock(link->dst);
     link->frame_wanted_out = 1;
-    ff_filter_set_ready(link->src, 100);
+    filter_set_ready(link->src, 100);
+    sched_unlock(link->dst);
 }
 
 void ff_inlink_set_status(AVFilterLink *link, int status)
 {
     if (link->status_out)
         return;
+    sched_lock(link->dst);
     link->frame_wanted_out = 0;
     link->frame_blocked_in = 0;
+    sched_unlock(link->dst);
     ff_avfilter_link_set_out_status(link, status, AV_NOPTS_VALUE);
     while (ff_framequeue_queued_frames(&link->fifo)) {
            AVFrame *frame = ff_framequeue_take(&link->fifo);
            av_frame_free(&frame);
     }
+    sched_lock(link->dst);
     if (!link->status_in)
         link->status_in = status;
+    sched_unlock(link->dst);
 }
 
 int ff_outlink_get_status(AVFilterLink *link)
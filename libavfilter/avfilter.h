@@ -332,6 +332,13 @@ typedef struct AVFilter {
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Activate filters of the graph that are not directly connected to each
+ * other concurrently, e.g. the branches after a split. Only meaningful in
+ * AVFilterGraph.thread_type.
+ */
+#define AVFILTER_THREAD_GRAPH (1 << 1)
+
 typedef struct AVFilterInternal AVFilterInternal;
 
 /** An instance of a filter */
@@ -896,6 +903,18 @@ typedef struct AVFilterGraph {
 
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
 
+    /**
+     * Arena the frame buffers allocated by the filters of this graph are taken
+     * from. The same arena may be shared with other graphs and e.g. with
+     * AVCodecContext.frame_arena of the decoders feeding the graph, so that
+     * buffers released by one of them are reused by the others.
+     *
+     * If NULL, a private arena shared by all the links of this graph is used.
+     * The arena is not owned by the graph and must outlive it. May be set by
+     * the caller before configuring the graph.
+     */
+    AVBufferArena *frame_arena;
+
     /**
      * Private fields
      *
@@ -50,6 +50,7 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "graph", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_GRAPH }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads),
         AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, INT_MAX, F|V|A },
     {"scale_sws_opts"       , "default scale filter options"        , OFFSET(scale_sws_opts)        ,
@@ -96,9 +97,23 @@ AVFilterGraph *avfilter_graph_alloc(void)
     av_opt_set_defaults(ret);
     ff_framequeue_global_init(&ret->internal->frame_queues);
 
+    ret->internal->frame_arena = av_buffer_arena_init(av_buffer_allocz);
+    if (!ret->internal->frame_arena) {
+        av_freep(&ret->internal);
+        av_freep(&ret);
+        return NULL;
+    }
+
     return ret;
 }
 
+AVBufferArena *ff_filter_graph_frame_arena(AVFilterGraph *graph)
+{
+    if (!graph)
+        return NULL;
+    return graph->frame_arena ? graph->frame_arena : graph->internal->frame_arena;
+}
+
 void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
     int i, j;
@@ -135,6 +150,8 @@ void avfilter_graph_free(AVFilterGraph **graph)
     av_freep(&(*graph)->resample_lavr_opts);
 #endif
     av_freep(&(*graph)->filters);
+    av_freep(&(*graph)->internal->batch);
+    av_buffer_arena_uninit(&(*graph)->internal->frame_arena);
     av_freep(&(*graph)->internal);
     av_freep(graph);
 }
@@ -1390,10 +1407,17 @@ static void heap_bubble_down(AVFilterGraph *graph,
     link->age_index = index;
 }
 
-void ff_avfilter_graph_update_heap(AVFilterGraph *graph, AVFilterLink *link)
+void ff_avfilter_graph_update_heap(AVFilterGraph *graph, AVFilterLink *link,
+                                   int64_t pts)
 {
+    if (graph->internal->thread_activate)
+        ff_mutex_lock(&graph->internal->sched_lock);
+    link->current_pts    = pts;
+    link->current_pts_us = av_rescale_q(pts, link->time_base, AV_TIME_BASE_Q);
     heap_bubble_up  (graph, link, link->age_index);
     heap_bubble_down(graph, link, link->age_index);
+    if (graph->internal->thread_activate)
+        ff_mutex_unlock(&graph->internal->sched_lock);
 }
 
 int avfilter_graph_request_oldest(AVFilterGraph *graph)
@@ -1441,6 +1465,53 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+static int filters_linked(AVFilterContext *a, AVFilterContext *b)
+{
+    unsigned i;
+
+    for (i = 0; i < a->nb_inputs; i++)
+        if (a->inputs[i] && a->inputs[i]->src == b)
+            return 1;
+    for (i = 0; i < a->nb_outputs; i++)
+        if (a->outputs[i] && a->outputs[i]->dst == b)
+            return 1;
+    return 0;
+}
+
+/**
+ * Activate first together with the other ready filters that are neither
+ * connected to it nor to each other. Such filters only touch their own links
+ * while being activated, so they can run concurrently; the state they share
+ * is protected by sched_lock.
+ */
+static int run_parallel(AVFilterGraph *graph, AVFilterContext *first)
+{
+    AVFilterGraphInternal *gi = graph->internal;
+    unsigned i, j, nb_batch = 0;
+
+    av_fast_malloc(&gi->batch, &gi->batch_size,
+                   graph->nb_filters * sizeof(*gi->batch));
+    if (!gi->batch)
+        return ff_filter_activate(first);
+
+    gi->batch[nb_batch++] = first;
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        if (!filter->ready || filter == first)
+            continue;
+        for (j = 0; j < nb_batch; j++)
+            if (filters_linked(filter, gi->batch[j]))
+                break;
+        if (j == nb_batch)
+            gi->batch[nb_batch++] = filter;
+    }
+
+    if (nb_batch == 1)
+        return ff_filter_activate(first);
+    return gi->thread_activate(graph, gi->batch, nb_batch);
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
     AVFilterContext *filter;
@@ -1453,5 +1524,8 @@ int ff_filter_graph_run_once(AVFilterGraph *graph)
             filter = graph->filters[i];
     if (!filter->ready)
         return AVERROR(EAGAIN);
+    if (graph->internal->thread_activate &&
+        graph->thread_type & AVFILTER_THREAD_GRAPH)
+        return run_parallel(graph, filter);
     return ff_filter_activate(filter);
 }
@@ -115,6 +115,25 @@ int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe);
 int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
                             AVFrame **rframe);
 
+/**
+ * Take several frames from the link's FIFO and update the link's stats.
+ *
+ * The frames are taken as they were queued, like with repeated calls to
+ * ff_inlink_consume_frame(), but the batch stops before a frame for which a
+ * queued command becomes due or for which the timeline enable expression of
+ * the filter changes value, so that process_command() and is_disabled apply
+ * to all the frames of the batch.
+ *
+ * @note  May trigger process_command() and/or update is_disabled.
+ * @param frames      array of at least max_frames elements filled with the
+ *                    frames taken
+ * @param max_frames  maximum number of frames to take
+ * @return  the number of frames taken, 0 if no frame is available,
+ *          or AVERROR code
+ */
+int ff_inlink_consume_frames(AVFilterLink *link, AVFrame **frames,
+                             unsigned max_frames);
+
 /**
  * Access a frame in the link fifo without consuming it.
  * The first frame is numbered 0; the designated frame must exist.
@@ -45,10 +45,31 @@ struct FFFramePool {
     int align;
     int linesize[4];
     AVBufferPool *pools[4];
+    AVBufferArena *arena;
+    int sizes[4];
 
 };
 
+static int frame_pool_add_buffer(FFFramePool *pool, int i, int size,
+                                 AVBufferRef* (*alloc)(int size))
+{
+    pool->sizes[i] = size;
+    if (pool->arena)
+        return 0;
+
+    pool->pools[i] = av_buffer_pool_init(size, alloc);
+    return pool->pools[i] ? 0 : AVERROR(ENOMEM);
+}
+
+static AVBufferRef *frame_pool_get_buffer(FFFramePool *pool, int i)
+{
+    if (pool->arena)
+        return av_buffer_arena_get(pool->arena, pool->sizes[i]);
+    return av_buffer_pool_get(pool->pools[i]);
+}
+
 FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
+                                      AVBufferArena *arena,
                                       int width,
                                       int height,
                                       enum AVPixelFormat format,
@@ -66,6 +87,7 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
         return NULL;
 
     pool->type = AVMEDIA_TYPE_VIDEO;
+    pool->arena = arena;
     pool->width = width;
     pool->height = height;
     pool->format = format;
@@ -96,16 +118,14 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
         if (i == 1 || i == 2)
             h = AV_CEIL_RSHIFT(h, desc->log2_chroma_h);
 
-        pool->pools[i] = av_buffer_pool_init(pool->linesize[i] * h + 16 + 16 - 1,
-                                             alloc);
-        if (!pool->pools[i])
+        if (frame_pool_add_buffer(pool, i, pool->linesize[i] * h + 16 + 16 - 1,
+                                  alloc) < 0)
             goto fail;
     }
 
     if (desc->flags & AV_PIX_FMT_FLAG_PAL ||
         desc->flags & FF_PSEUDOPAL) {
-        pool->pools[1] = av_buffer_pool_init(AVPALETTE_SIZE, alloc);
-        if (!pool->pools[1])
+        if (frame_pool_add_buffer(pool, 1, AVPALETTE_SIZE, alloc) < 0)
             goto fail;
     }
 
@@ -117,6 +137,7 @@ fail:
 }
 
 FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
+                                      AVBufferArena *arena,
                                       int channels,
                                       int nb_samples,
                                       enum AVSampleFormat format,
@@ -132,6 +153,7 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
     planar = av_sample_fmt_is_planar(format);
 
     pool->type = AVMEDIA_TYPE_AUDIO;
+    pool->arena = arena;
     pool->planes = planar ? channels : 1;
     pool->channels = channels;
     pool->nb_samples = nb_samples;
@@ -143,8 +165,7 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
     if (ret < 0)
         goto fail;
 
-    pool->pools[0] = av_buffer_pool_init(pool->linesize[0], NULL);
-    if (!pool->pools[0])
+    if (frame_pool_add_buffer(pool, 0, pool->linesize[0], NULL) < 0)
         goto fail;
 
     return pool;
@@ -216,10 +237,10 @@ AVFrame *ff_frame_pool_get(FFFramePool *pool)
 
         for (i = 0; i < 4; i++) {
             frame->linesize[i] = pool->linesize[i];
-            if (!pool->pools[i])
+            if (!pool->sizes[i])
                 break;
 
-            frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+            frame->buf[i] = frame_pool_get_buffer(pool, i);
             if (!frame->buf[i])
                 goto fail;
 
@@ -258,13 +279,13 @@ AVFrame *ff_frame_pool_get(FFFramePool *pool)
         }
 
         for (i = 0; i < FFMIN(pool->planes, AV_NUM_DATA_POINTERS); i++) {
-            frame->buf[i] = av_buffer_pool_get(pool->pools[0]);
+            frame->buf[i] = frame_pool_get_buffer(pool, 0);
             if (!frame->buf[i])
                 goto fail;
             frame->extended_data[i] = frame->data[i] = frame->buf[i]->data;
         }
         for (i = 0; i < frame->nb_extended_buf; i++) {
-            frame->extended_buf[i] = av_buffer_pool_get(pool->pools[0]);
+            frame->extended_buf[i] = frame_pool_get_buffer(pool, 0);
             if (!frame->extended_buf[i])
                 goto fail;
             frame->extended_data[i + AV_NUM_DATA_POINTERS] = frame->extended_buf[i]->data;
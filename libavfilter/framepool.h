@@ -37,6 +37,8 @@ typedef struct FFFramePool FFFramePool;
  * @param alloc a function that will be used to allocate new frame buffers when
  * the pool is empty. May be NULL, then the default allocator will be used
  * (av_buffer_alloc()).
+ * @param arena if not NULL, frame buffers are taken from this arena instead of
+ * pools owned by the frame pool, and alloc is unused
  * @param width width of each frame in this pool
  * @param height height of each frame in this pool
  * @param format format of each frame in this pool
@@ -44,6 +46,7 @@ typedef struct FFFramePool FFFramePool;
  * @return newly created video frame pool on success, NULL on error.
  */
 FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
+                                      AVBufferArena *arena,
                                       int width,
                                       int height,
                                       enum AVPixelFormat format,
@@ -55,6 +58,8 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
  * @param alloc a function that will be used to allocate new frame buffers when
  * the pool is empty. May be NULL, then the default allocator will be used
  * (av_buffer_alloc()).
+ * @param arena if not NULL, frame buffers are taken from this arena instead of
+ * pools owned by the frame pool, and alloc is unused
  * @param channels channels of each frame in this pool
  * @param nb_samples number of samples of each frame in this pool
  * @param format format of each frame in this pool
@@ -62,6 +67,7 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
  * @return newly created audio frame pool on success, NULL on error.
  */
 FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
+                                      AVBufferArena *arena,
                                       int channels,
                                       int samples,
                                       enum AVSampleFormat format,
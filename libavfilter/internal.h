@@ -25,6 +25,7 @@
  */
 
 #include "libavutil/internal.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "framepool.h"
@@ -44,9 +45,10 @@ typedef struct AVFilterCommand {
 } AVFilterCommand;
 
 /**
- * Update the position of a link in the age heap.
+ * Set the current pts of a link and update its position in the age heap.
  */
-void ff_avfilter_graph_update_heap(AVFilterGraph *graph, AVFilterLink *link);
+void ff_avfilter_graph_update_heap(AVFilterGraph *graph, AVFilterLink *link,
+                                   int64_t pts);
 
 /**
  * A filter pad used for either input or output.
@@ -137,7 +139,27 @@ struct AVFilterPad {
 struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
+    /**
+     * Activate several filters concurrently, set if the graph runs
+     * independent filters in parallel (AVFILTER_THREAD_GRAPH).
+     */
+    int (*thread_activate)(AVFilterGraph *graph, AVFilterContext **filters,
+                           int nb_filters);
+    /**
+     * Protects the state that filters activated concurrently can share:
+     * the ready field of their common neighbours, the frame_blocked_in,
+     * frame_wanted_out and status fields of the links of those neighbours
+     * and the sink links heap. Only used when thread_activate is set.
+     */
+    AVMutex sched_lock;
+    AVFilterContext **batch;
+    unsigned batch_size;
     FFFrameQueueGlobal frame_queues;
+    /**
+     * Arena of the frame buffers of all the links of the graph, used when
+     * AVFilterGraph.frame_arena is not set.
+     */
+    AVBufferArena *frame_arena;
 };
 
 struct AVFilterInternal {
@@ -364,6 +386,21 @@ void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter_frame() callbacks of the filter can be called for all the
+ * frames queued on an input in one activation, instead of one frame per
+ * activation. Only meaningful for filters without an activate() callback.
+ */
+#define FF_FILTER_FLAG_FRAME_BATCH (1 << 1)
+
+/**
+ * Get the arena the default get_video_buffer() and get_audio_buffer()
+ * callbacks allocate frame buffers from.
+ *
+ * @return the arena of graph, NULL if graph is NULL
+ */
+AVBufferArena *ff_filter_graph_frame_arena(AVFilterGraph *graph);
+
 /**
  * Run one round of processing on a filter graph.
  */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2011 Roger Pau Monné <roger.pau@entel.upc.edu>
+ * Copyright (c) 2011 Stefano Sabatini
+ * Copyright (c) 2013 Paul B Mahol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * PSNR functions shared by the psnr and ssim filters
+ */
+
+#include <math.h>
+
+#include "config.h"
+#include "psnr.h"
+
+static inline unsigned pow_2(unsigned base)
+{
+    return base*base;
+}
+
+double ff_psnr_get(double mse, uint64_t nb_frames, int max)
+{
+    return 10.0 * log10(pow_2(max) / (mse / nb_frames));
+}
+
+static uint64_t sse_line_8bit(const uint8_t *main_line,  const uint8_t *ref_line, int outw)
+{
+    int j;
+    unsigned m2 = 0;
+
+    for (j = 0; j < outw; j++)
+        m2 += pow_2(main_line[j] - ref_line[j]);
+
+    return m2;
+}
+
+static uint64_t sse_line_16bit(const uint8_t *_main_line, const uint8_t *_ref_line, int outw)
+{
+    int j;
+    uint64_t m2 = 0;
+    const uint16_t *main_line = (const uint16_t *) _main_line;
+    const uint16_t *ref_line = (const uint16_t *) _ref_line;
+
+    for (j = 0; j < outw; j++)
+        m2 += pow_2(main_line[j] - ref_line[j]);
+
+    return m2;
+}
+
+uint64_t ff_psnr_sse_slice(const PSNRDSPContext *dsp,
+                           const uint8_t *main_data, int main_linesize,
+                           const uint8_t *ref_data, int ref_linesize,
+                           int w, int h, int jobnr, int nb_jobs)
+{
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
+    const uint8_t *main_line = main_data + slice_start * main_linesize;
+    const uint8_t *ref_line  = ref_data  + slice_start * ref_linesize;
+    uint64_t m = 0;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        m += dsp->sse_line(main_line, ref_line, w);
+        ref_line  += ref_linesize;
+        main_line += main_linesize;
+    }
+    return m;
+}
+
+double ff_psnr_mse(const uint64_t (*sse)[4], int nb_jobs, int comp, int w, int h)
+{
+    uint64_t m = 0;
+    int i;
+
+    /* the sums are integers, so the result does not depend on the number
+     * of jobs */
+    for (i = 0; i < nb_jobs; i++)
+        m += sse[i][comp];
+    return m / ((double)w * h);
+}
+
+void ff_psnr_init(PSNRDSPContext *dsp, int bpp)
+{
+    dsp->sse_line = bpp > 8 ? sse_line_16bit : sse_line_8bit;
+    if (ARCH_X86)
+        ff_psnr_init_x86(dsp, bpp);
+}
@@ -28,6 +28,28 @@ typedef struct PSNRDSPContext {
     uint64_t (*sse_line)(const uint8_t *buf, const uint8_t *ref, int w);
 } PSNRDSPContext;
 
+/**
+ * Return the PSNR in dB for the given mean squared error summed over
+ * nb_frames frames, with max the largest sample value.
+ */
+double ff_psnr_get(double mse, uint64_t nb_frames, int max);
+
+/**
+ * Return the sum of the squared errors over the band of rows of a w x h
+ * plane handled by job jobnr of nb_jobs.
+ */
+uint64_t ff_psnr_sse_slice(const PSNRDSPContext *dsp,
+                           const uint8_t *main_data, int main_linesize,
+                           const uint8_t *ref_data, int ref_linesize,
+                           int w, int h, int jobnr, int nb_jobs);
+
+/**
+ * Return the mean squared error of component comp of a w x h plane from
+ * the per-job sums of squared errors sse[0..nb_jobs-1][comp].
+ */
+double ff_psnr_mse(const uint64_t (*sse)[4], int nb_jobs, int comp, int w, int h);
+
+void ff_psnr_init(PSNRDSPContext *dsp, int bpp);
 void ff_psnr_init_x86(PSNRDSPContext *dsp, int bpp);
 
 #endif /* AVFILTER_PSNR_H */
@@ -42,6 +42,14 @@ typedef struct ThreadContext {
     AVFilterContext *ctx;
     void *arg;
     int   *rets;
+
+    /* graph level threading, filters activated concurrently share the slice
+     * threads, execute_lock serializes their execute() calls */
+    AVSliceThread *graph_thread;
+    AVMutex execute_lock;
+    AVFilterContext **activate_filters;
+    int *activate_rets;
+    unsigned activate_rets_size;
 } ThreadContext;
 
 static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
@@ -52,9 +60,22 @@ static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb
         c->rets[jobnr] = ret;
 }
 
+static void graph_worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    ThreadContext *c = priv;
+    c->activate_rets[jobnr] = ff_filter_activate(c->activate_filters[jobnr]);
+}
+
 static void slice_thread_uninit(ThreadContext *c)
 {
     avpriv_slicethread_free(&c->thread);
+    if (c->graph_thread) {
+        avpriv_slicethread_free(&c->graph_thread);
+        ff_mutex_destroy(&c->execute_lock);
+        ff_mutex_destroy(&c->graph->internal->sched_lock);
+        c->graph->internal->thread_activate = NULL;
+    }
+    av_freep(&c->activate_rets);
 }
 
 static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -64,12 +85,64 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
 
     if (nb_jobs <= 0)
         return 0;
+    if (c->graph_thread)
+        ff_mutex_lock(&c->execute_lock);
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    if (c->graph_thread)
+        ff_mutex_unlock(&c->execute_lock);
+    return 0;
+}
+
+static int thread_activate(AVFilterGraph *graph, AVFilterContext **filters,
+                           int nb_filters)
+{
+    ThreadContext *c = graph->internal->thread;
+    int i, ret = 0;
+
+    av_fast_malloc(&c->activate_rets, &c->activate_rets_size,
+                   nb_filters * sizeof(*c->activate_rets));
+    if (!c->activate_rets) {
+        for (i = 0; i < nb_filters && ret >= 0; i++)
+            ret = ff_filter_activate(filters[i]);
+        return ret;
+    }
+
+    c->activate_filters = filters;
+    avpriv_slicethread_execute(c->graph_thread, nb_filters, 0);
+
+    for (i = 0; i < nb_filters; i++)
+        if (c->activate_rets[i] < 0)
+            return c->activate_rets[i];
+    return 0;
+}
+
+static int graph_thread_init(ThreadContext *c, int nb_threads)
+{
+    int ret = avpriv_slicethread_create(&c->graph_thread, c, graph_worker_func,
+                                        NULL, nb_threads);
+    if (ret <= 1) {
+        avpriv_slicethread_free(&c->graph_thread);
+        return ret < 0 ? ret : 0;
+    }
+
+    ret = ff_mutex_init(&c->execute_lock, NULL);
+    if (ret) {
+        avpriv_slicethread_free(&c->graph_thread);
+        return AVERROR(ret);
+    }
+    ret = ff_mutex_init(&c->graph->internal->sched_lock, NULL);
+    if (ret) {
+        ff_mutex_destroy(&c->execute_lock);
+        avpriv_slicethread_free(&c->graph_thread);
+        return AVERROR(ret);
+    }
+
+    c->graph->internal->thread_activate = thread_activate;
     return 0;
 }
 
@@ -105,6 +178,16 @@ int ff_graph_thread_init(AVFilterGraph *graph)
 
     graph->internal->thread_execute = thread_execute;
 
+    if (graph->thread_type & AVFILTER_THREAD_GRAPH) {
+        ThreadContext *c = graph->internal->thread;
+
+        c->graph = graph;
+        ret = graph_thread_init(c, graph->nb_threads);
+        if (ret < 0)
+            av_log(graph, AV_LOG_WARNING, "Graph level threading is not "
+                   "available: %s.\n", av_err2str(ret));
+    }
+
     return 0;
 }
 
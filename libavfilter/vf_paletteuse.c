@@ -23,6 +23,8 @@
  * Use a palette to downsample an input video stream.
  */
 
+#include <stdatomic.h>
+
 #include "libavutil/bprint.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
@@ -75,16 +77,28 @@ struct cache_node {
     int nb_entries;
 };
 
+#define LUT_BITS 6
+#define LUT_SIZE (1<<(3*LUT_BITS))
+
+struct color_cache {
+    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+};
+
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct color_cache *cache,
+                              AVFrame *out, AVFrame *in,
                               int x_start, int y_start, int width, int height);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct color_cache *caches;             /* one per slice job */
+    int nb_caches;
+    atomic_short *lut;                      /* nearest color of whole LUT_BITS cells, shared by the jobs, see lut_get() */
+    int *job_ret;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
+    int nb_nodes;
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
     int trans_thresh;
@@ -332,13 +346,75 @@ end:
     search == COLOR_SEARCH_NNS_RECURSIVE ? colormap_nearest_recursive(root, target, trans_thresh) :      \
                                            colormap_nearest_bruteforce(palette, target, trans_thresh)
 
+/**
+ * Find the tree colors that may be the nearest to a color of the LUT cell
+ * starting at lo: a color is discarded when its distance to the closest point
+ * of the cell exceeds the distance of another color to the furthest point.
+ * Return the palette entry + 1 if only one remains, -1 otherwise.
+ */
+static av_noinline int lut_resolve(const PaletteUseContext *s, const uint8_t *lo)
+{
+    const int hi_off = (1<<(8-LUT_BITS)) - 1;
+    int i, c, best_max = INT_MAX, nb = 0, node_id = -1;
+    int min_dist[AVPALETTE_COUNT];
+
+    for (i = 0; i < s->nb_nodes; i++) {
+        const uint8_t *val = s->map[i].val;
+        int dmin = 0, dmax = 0;
+
+        for (c = 0; c < 3; c++) {
+            const int dlo = val[c+1] - lo[c];
+            const int dhi = val[c+1] - lo[c] - hi_off;
+            const int dnear = dlo < 0 ? dlo : dhi > 0 ? dhi : 0;
+            const int dfar  = FFMAX(FFABS(dlo), FFABS(dhi));
+            dmin += dnear*dnear;
+            dmax += dfar*dfar;
+        }
+        min_dist[i] = dmin;
+        best_max = FFMIN(best_max, dmax);
+    }
+
+    for (i = 0; i < s->nb_nodes; i++) {
+        if (min_dist[i] <= best_max) {
+            if (nb++)
+                return -1;
+            node_id = i;
+        }
+    }
+    return s->map[node_id].palette_id + 1;
+}
+
+/**
+ * Return the palette entry nearest to every color of the LUT cell of (r,g,b)
+ * if there is a single one, -1 otherwise. Cells are resolved the first time
+ * they are looked up. Only valid for opaque colors.
+ *
+ * The slice jobs share the LUT: a cell only depends on the palette, so jobs
+ * resolving it concurrently store the same value.
+ */
+static av_always_inline int lut_get(const PaletteUseContext *s,
+                                    uint8_t r, uint8_t g, uint8_t b)
+{
+    const int shift = 8 - LUT_BITS;
+    const unsigned idx = (r >> shift) << (2*LUT_BITS) | (g >> shift) << LUT_BITS | b >> shift;
+    int pal = atomic_load_explicit(&s->lut[idx], memory_order_relaxed);
+
+    if (!pal) {
+        const uint8_t lo[] = {r >> shift << shift, g >> shift << shift, b >> shift << shift};
+        pal = lut_resolve(s, lo);
+        atomic_store_explicit(&s->lut[idx], pal, memory_order_relaxed);
+    }
+    return pal > 0 ? pal - 1 : -1;
+}
+
 /**
  * Check if the requested color is in the cache already. If not, find it in the
  * color tree and cache it.
  * Note: a, r, g, and b are the components of color, but are passed as well to avoid
  * recomputing them (they are generally computed by the caller for other uses).
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
+static av_always_inline int color_get(PaletteUseContext *s, struct color_cache *cache,
+                                      uint32_t color,
                                       uint8_t a, uint8_t r, uint8_t g, uint8_t b,
                                       const enum color_search_method search_method)
 {
@@ -348,7 +424,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     const uint8_t ghash = g & ((1<<NBITS)-1);
     const uint8_t bhash = b & ((1<<NBITS)-1);
     const unsigned hash = rhash<<(NBITS*2) | ghash<<NBITS | bhash;
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache->cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -356,6 +432,13 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
         return s->transparency_index;
     }
 
+    // the LUT is built from the tree, which the brute-force search does not use
+    if (a >= s->trans_thresh && s->nb_nodes && search_method != COLOR_SEARCH_BRUTEFORCE) {
+        const int pal_id = lut_get(s, r, g, b);
+        if (pal_id >= 0)
+            return pal_id;
+    }
+
     for (i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color)
@@ -372,7 +455,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct color_cache *cache,
                                               uint32_t c, int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
 {
@@ -381,7 +464,7 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
     uint32_t dstc;
-    const int dstx = color_get(s, c, a, r, g, b, search_method);
+    const int dstx = color_get(s, cache, c, a, r, g, b, search_method);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -391,7 +474,8 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
+static av_always_inline int set_frame(PaletteUseContext *s, struct color_cache *cache,
+                                      AVFrame *out, AVFrame *in,
                                       int x_start, int y_start, int w, int h,
                                       enum dithering_mode dither,
                                       const enum color_search_method search_method)
@@ -418,7 +502,8 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const int color = color_get(s, src[x], a8, r, g, b, search_method);
+                const int color = color_get(s, cache, (unsigned)a8 << 24 | r << 16 | g << 8 | b,
+                                            a8, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -426,7 +511,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -438,7 +523,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -452,7 +537,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -471,7 +556,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -486,7 +571,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(s, src[x], a, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -765,6 +850,7 @@ static void load_colormap(PaletteUseContext *s)
     box.max[0] = box.max[1] = box.max[2] = 0xff;
 
     colormap_insert(s->map, color_used, &nb_used, s->palette, s->trans_thresh, &box);
+    s->nb_nodes = nb_used;
 
     if (s->dot_filename)
         disp_tree(s->map, s->dot_filename);
@@ -894,9 +980,25 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr     ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr + 1)) / nb_jobs;
+
+    return s->set_frame(s, &s->caches[jobnr], td->out, td->in,
+                        td->x, slice_start, td->w, slice_end - slice_start);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
-    int x, y, w, h, ret;
+    int i, x, y, w, h, ret = 0;
     AVFilterContext *ctx = inlink->dst;
     PaletteUseContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
@@ -923,7 +1025,17 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    if (s->dither == DITHERING_NONE || s->dither == DITHERING_BAYER) {
+        /* no error diffusion, the rows can be processed independently */
+        ThreadData td = { .in = in, .out = out, .x = x, .y = y, .w = w, .h = h };
+        const int nb_jobs = av_clip(h, 1, s->nb_caches);
+
+        ctx->internal->execute(ctx, set_frame_slice, &td, s->job_ret, nb_jobs);
+        for (i = 0; i < nb_jobs && ret >= 0; i++)
+            ret = s->job_ret[i];
+    } else {
+        ret = s->set_frame(s, &s->caches[0], out, in, x, y, w, h);
+    }
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -936,6 +1048,14 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     return 0;
 }
 
+static void reset_lut(PaletteUseContext *s)
+{
+    int i;
+
+    for (i = 0; i < LUT_SIZE; i++)
+        atomic_init(&s->lut[i], 0);
+}
+
 static int config_output(AVFilterLink *outlink)
 {
     int ret;
@@ -952,6 +1072,14 @@ static int config_output(AVFilterLink *outlink)
     outlink->w = ctx->inputs[0]->w;
     outlink->h = ctx->inputs[0]->h;
 
+    s->nb_caches = ff_filter_get_nb_threads(ctx);
+    s->caches  = av_calloc(s->nb_caches, sizeof(*s->caches));
+    s->job_ret = av_calloc(s->nb_caches, sizeof(*s->job_ret));
+    s->lut     = av_malloc_array(LUT_SIZE, sizeof(*s->lut));
+    if (!s->caches || !s->job_ret || !s->lut)
+        return AVERROR(ENOMEM);
+    reset_lut(s);
+
     outlink->time_base = ctx->inputs[0]->time_base;
     if ((ret = ff_framesync_configure(&s->fs)) < 0)
         return ret;
@@ -973,6 +1101,15 @@ static int config_input_palette(AVFilterLink *inlink)
     return 0;
 }
 
+static void free_caches(PaletteUseContext *s)
+{
+    int i, j;
+
+    for (j = 0; j < s->nb_caches; j++)
+        for (i = 0; i < CACHE_SIZE; i++)
+            av_freep(&s->caches[j].cache[i].entries);
+}
+
 static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
 {
     int i, x, y;
@@ -984,9 +1121,9 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
-            av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        free_caches(s);
+        memset(s->caches, 0, s->nb_caches * sizeof(*s->caches));
+        reset_lut(s);
     }
 
     i = 0;
@@ -1034,10 +1171,12 @@ static int load_apply_palette(FFFrameSync *fs)
 }
 
 #define DEFINE_SET_FRAME(color_search, name, value)                             \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
+static int set_frame_##name(PaletteUseContext *s, struct color_cache *cache,    \
+                            AVFrame *out, AVFrame *in,                          \
                             int x_start, int y_start, int w, int h)             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value, color_search);  \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h,                 \
+                     value, color_search);                                      \
 }
 
 #define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
@@ -1108,12 +1247,14 @@ static int activate(AVFilterContext *ctx)
 
 static av_cold void uninit(AVFilterContext *ctx)
 {
-    int i;
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    if (s->caches)
+        free_caches(s);
+    av_freep(&s->caches);
+    av_freep(&s->job_ret);
+    av_freep(&s->lut);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1150,4 +1291,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -54,6 +54,8 @@ typedef struct PSNRContext {
     int planewidth[4];
     int planeheight[4];
     double planeweight[4];
+    uint64_t (*score)[4];
+    int nb_threads;
     PSNRDSPContext dsp;
 } PSNRContext;
 
@@ -70,63 +72,45 @@ static const AVOption psnr_options[] = {
 
 FRAMESYNC_DEFINE_CLASS(psnr, PSNRContext, fs);
 
-static inline unsigned pow_2(unsigned base)
-{
-    return base*base;
-}
-
-static inline double get_psnr(double mse, uint64_t nb_frames, int max)
-{
-    return 10.0 * log10(pow_2(max) / (mse / nb_frames));
-}
+typedef struct ThreadData {
+    const uint8_t **main_data;
+    const uint8_t **ref_data;
+    const int *main_linesize;
+    const int *ref_linesize;
+} ThreadData;
 
-static uint64_t sse_line_8bit(const uint8_t *main_line,  const uint8_t *ref_line, int outw)
+static int compute_images_sse(AVFilterContext *ctx, void *arg,
+                              int jobnr, int nb_jobs)
 {
-    int j;
-    unsigned m2 = 0;
+    PSNRContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int c;
 
-    for (j = 0; j < outw; j++)
-        m2 += pow_2(main_line[j] - ref_line[j]);
+    for (c = 0; c < s->nb_components; c++)
+        s->score[jobnr][c] = ff_psnr_sse_slice(&s->dsp,
+                                               td->main_data[c], td->main_linesize[c],
+                                               td->ref_data[c], td->ref_linesize[c],
+                                               s->planewidth[c], s->planeheight[c],
+                                               jobnr, nb_jobs);
 
-    return m2;
+    return 0;
 }
 
-static uint64_t sse_line_16bit(const uint8_t *_main_line, const uint8_t *_ref_line, int outw)
+static void compute_images_mse(AVFilterContext *ctx,
+                               const uint8_t *main_data[4], const int main_linesizes[4],
+                               const uint8_t *ref_data[4], const int ref_linesizes[4],
+                               double mse[4])
 {
-    int j;
-    uint64_t m2 = 0;
-    const uint16_t *main_line = (const uint16_t *) _main_line;
-    const uint16_t *ref_line = (const uint16_t *) _ref_line;
+    PSNRContext *s = ctx->priv;
+    ThreadData td = { main_data, ref_data, main_linesizes, ref_linesizes };
+    int nb_jobs = FFMIN(s->planeheight[1], s->nb_threads);
+    int c;
 
-    for (j = 0; j < outw; j++)
-        m2 += pow_2(main_line[j] - ref_line[j]);
+    ctx->internal->execute(ctx, compute_images_sse, &td, NULL, nb_jobs);
 
-    return m2;
-}
-
-static inline
-void compute_images_mse(PSNRContext *s,
-                        const uint8_t *main_data[4], const int main_linesizes[4],
-                        const uint8_t *ref_data[4], const int ref_linesizes[4],
-                        int w, int h, double mse[4])
-{
-    int i, c;
-
-    for (c = 0; c < s->nb_components; c++) {
-        const int outw = s->planewidth[c];
-        const int outh = s->planeheight[c];
-        const uint8_t *main_line = main_data[c];
-        const uint8_t *ref_line = ref_data[c];
-        const int ref_linesize = ref_linesizes[c];
-        const int main_linesize = main_linesizes[c];
-        uint64_t m = 0;
-        for (i = 0; i < outh; i++) {
-            m += s->dsp.sse_line(main_line, ref_line, outw);
-            ref_line += ref_linesize;
-            main_line += main_linesize;
-        }
-        mse[c] = m / (double)(outw * outh);
-    }
+    for (c = 0; c < s->nb_components; c++)
+        mse[c] = ff_psnr_mse((const uint64_t (*)[4])s->score, nb_jobs, c,
+                             s->planewidth[c], s->planeheight[c]);
 }
 
 static void set_meta(AVDictionary **metadata, const char *key, char comp, float d)
@@ -158,9 +142,8 @@ static int do_psnr(FFFrameSync *fs)
         return ff_filter_frame(ctx->outputs[0], master);
     metadata = &master->metadata;
 
-    compute_images_mse(s, (const uint8_t **)master->data, master->linesize,
-                          (const uint8_t **)ref->data, ref->linesize,
-                          master->width, master->height, comp_mse);
+    compute_images_mse(ctx, (const uint8_t **)master->data, master->linesize,
+                            (const uint8_t **)ref->data, ref->linesize, comp_mse);
 
     for (j = 0; j < s->nb_components; j++)
         mse += comp_mse[j] * s->planeweight[j];
@@ -176,10 +159,10 @@ static int do_psnr(FFFrameSync *fs)
     for (j = 0; j < s->nb_components; j++) {
         c = s->is_rgb ? s->rgba_map[j] : j;
         set_meta(metadata, "lavfi.psnr.mse.", s->comps[j], comp_mse[c]);
-        set_meta(metadata, "lavfi.psnr.psnr.", s->comps[j], get_psnr(comp_mse[c], 1, s->max[c]));
+        set_meta(metadata, "lavfi.psnr.psnr.", s->comps[j], ff_psnr_get(comp_mse[c], 1, s->max[c]));
     }
     set_meta(metadata, "lavfi.psnr.mse_avg", 0, mse);
-    set_meta(metadata, "lavfi.psnr.psnr_avg", 0, get_psnr(mse, 1, s->average_max));
+    set_meta(metadata, "lavfi.psnr.psnr_avg", 0, ff_psnr_get(mse, 1, s->average_max));
 
     if (s->stats_file) {
         if (s->stats_version == 2 && !s->stats_header_written) {
@@ -206,11 +189,11 @@ static int do_psnr(FFFrameSync *fs)
             c = s->is_rgb ? s->rgba_map[j] : j;
             fprintf(s->stats_file, "mse_%c:%0.2f ", s->comps[j], comp_mse[c]);
         }
-        fprintf(s->stats_file, "psnr_avg:%0.2f ", get_psnr(mse, 1, s->average_max));
+        fprintf(s->stats_file, "psnr_avg:%0.2f ", ff_psnr_get(mse, 1, s->average_max));
         for (j = 0; j < s->nb_components; j++) {
             c = s->is_rgb ? s->rgba_map[j] : j;
             fprintf(s->stats_file, "psnr_%c:%0.2f ", s->comps[j],
-                    get_psnr(comp_mse[c], 1, s->max[c]));
+                    ff_psnr_get(comp_mse[c], 1, s->max[c]));
         }
         if (s->stats_version == 2 && s->stats_add_max) {
             fprintf(s->stats_file, "max_avg:%d ", s->average_max);
@@ -325,9 +308,12 @@ static int config_input_ref(AVFilterLink *inlink)
     }
     s->average_max = lrint(average_max);
 
-    s->dsp.sse_line = desc->comp[0].depth > 8 ? sse_line_16bit : sse_line_8bit;
-    if (ARCH_X86)
-        ff_psnr_init_x86(&s->dsp, desc->comp[0].depth);
+    ff_psnr_init(&s->dsp, desc->comp[0].depth);
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->score = av_calloc(s->nb_threads, sizeof(*s->score));
+    if (!s->score)
+        return AVERROR(ENOMEM);
 
     return 0;
 }
@@ -379,19 +365,21 @@ static av_cold void uninit(AVFilterContext *ctx)
         for (j = 0; j < s->nb_components; j++) {
             int c = s->is_rgb ? s->rgba_map[j] : j;
             av_strlcatf(buf, sizeof(buf), " %c:%f", s->comps[j],
-                        get_psnr(s->mse_comp[c], s->nb_frames, s->max[c]));
+                        ff_psnr_get(s->mse_comp[c], s->nb_frames, s->max[c]));
         }
         av_log(ctx, AV_LOG_INFO, "PSNR%s average:%f min:%f max:%f\n",
                buf,
-               get_psnr(s->mse, s->nb_frames, s->average_max),
-               get_psnr(s->max_mse, 1, s->average_max),
-               get_psnr(s->min_mse, 1, s->average_max));
+               ff_psnr_get(s->mse, s->nb_frames, s->average_max),
+               ff_psnr_get(s->max_mse, 1, s->average_max),
+               ff_psnr_get(s->min_mse, 1, s->average_max));
     }
 
     ff_framesync_uninit(&s->fs);
 
     if (s->stats_file && s->stats_file != stdout)
         fclose(s->stats_file);
+
+    av_freep(&s->score);
 }
 
 static const AVFilterPad psnr_inputs[] = {
@@ -427,4 +415,5 @@ AVFilter ff_vf_psnr = {
     .priv_class    = &psnr_class,
     .inputs        = psnr_inputs,
     .outputs       = psnr_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
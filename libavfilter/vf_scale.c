@@ -546,6 +546,10 @@ static int config_props(AVFilterLink *outlink)
             av_opt_set_int(*s, "sws_flags", scale->flags, 0);
             av_opt_set_int(*s, "param0", scale->param[0], 0);
             av_opt_set_int(*s, "param1", scale->param[1], 0);
+            /* the scaler runs its own threads, so they are only used
+             * when the filter is explicitly given a thread count */
+            if (ctx->nb_threads > 0)
+                av_opt_set_int(*s, "threads", ctx->nb_threads, 0);
             if (scale->in_range != AVCOL_RANGE_UNSPECIFIED)
                 av_opt_set_int(*s, "src_range",
                                scale->in_range == AVCOL_RANGE_JPEG, 0);
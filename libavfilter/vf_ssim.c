@@ -42,6 +42,7 @@
 #include "formats.h"
 #include "framesync.h"
 #include "internal.h"
+#include "psnr.h"
 #include "ssim.h"
 #include "video.h"
 
@@ -59,14 +60,23 @@ typedef struct SSIMContext {
     uint8_t rgba_map[4];
     int planewidth[4];
     int planeheight[4];
-    int *temp;
+    void **temp;
+    double *row_score[4];
+    int nb_threads;
     int is_rgb;
-    double (*ssim_plane)(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max);
+    void (*ssim_plane)(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int y_start, int y_end,
+                       void *temp, int max, double *row_score);
     SSIMDSPContext dsp;
+
+    /* PSNR computed alongside SSIM */
+    int psnr;
+    PSNRDSPContext psnr_dsp;
+    uint64_t (*sse)[4];
+    int psnr_max[4], psnr_average_max;
+    double mse, min_mse, max_mse, mse_comp[4];
 } SSIMContext;
 
 #define OFFSET(x) offsetof(SSIMContext, x)
@@ -75,6 +85,7 @@ typedef struct SSIMContext {
 static const AVOption ssim_options[] = {
     {"stats_file", "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
     {"f",          "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    {"psnr",       "Also compute the PSNR of each frame pair", OFFSET(psnr), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     { NULL }
 };
 
@@ -221,21 +232,23 @@ static double ssim_endn_8bit(const int (*sum0)[4], const int (*sum1)[4], int wid
 
 #define SUM_LEN(w) (((w) >> 2) + 3)
 
-static double ssim_plane_16bit(SSIMDSPContext *dsp,
-                              uint8_t *main, int main_stride,
-                              uint8_t *ref, int ref_stride,
-                              int width, int height, void *temp,
-                              int max)
+/*
+ * The plane functions compute the SSIM of the rows of 4x4 blocks y_start to
+ * y_end - 1 (y_start >= 1) into row_score[y].
+ */
+static void ssim_plane_16bit(SSIMDSPContext *dsp,
+                             uint8_t *main, int main_stride,
+                             uint8_t *ref, int ref_stride,
+                             int width, int y_start, int y_end,
+                             void *temp, int max, double *row_score)
 {
-    int z = 0, y;
-    double ssim = 0.0;
+    int z = y_start - 1, y;
     int64_t (*sum0)[4] = temp;
     int64_t (*sum1)[4] = sum0 + SUM_LEN(width);
 
     width >>= 2;
-    height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             ssim_4x4xn_16bit(&main[4 * z * main_stride], main_stride,
@@ -243,27 +256,23 @@ static double ssim_plane_16bit(SSIMDSPContext *dsp,
                              sum0, width);
         }
 
-        ssim += ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
+        row_score[y] = ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
     }
-
-    return ssim / ((height - 1) * (width - 1));
 }
 
-static double ssim_plane(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max)
+static void ssim_plane(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int y_start, int y_end,
+                       void *temp, int max, double *row_score)
 {
-    int z = 0, y;
-    double ssim = 0.0;
+    int z = y_start - 1, y;
     int (*sum0)[4] = temp;
     int (*sum1)[4] = sum0 + SUM_LEN(width);
 
     width >>= 2;
-    height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    for (y = y_start; y < y_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             dsp->ssim_4x4_line(&main[4 * z * main_stride], main_stride,
@@ -271,10 +280,40 @@ static double ssim_plane(SSIMDSPContext *dsp,
                                sum0, width);
         }
 
-        ssim += dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
+        row_score[y] = dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
+    }
+}
+
+typedef struct ThreadData {
+    AVFrame *main, *ref;
+} ThreadData;
+
+static int ssim_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SSIMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int i;
+
+    for (i = 0; i < s->nb_components; i++) {
+        const int rows = s->planeheight[i] >> 2;
+        const int y_start = 1 + ((rows - 1) *  jobnr     ) / nb_jobs;
+        const int y_end   = 1 + ((rows - 1) * (jobnr + 1)) / nb_jobs;
+
+        if (y_start < y_end)
+            s->ssim_plane(&s->dsp, td->main->data[i], td->main->linesize[i],
+                          td->ref->data[i], td->ref->linesize[i],
+                          s->planewidth[i], y_start, y_end, s->temp[jobnr],
+                          s->max, s->row_score[i]);
+
+        if (s->psnr)
+            s->sse[jobnr][i] = ff_psnr_sse_slice(&s->psnr_dsp,
+                                                 td->main->data[i], td->main->linesize[i],
+                                                 td->ref->data[i], td->ref->linesize[i],
+                                                 s->planewidth[i], s->planeheight[i],
+                                                 jobnr, nb_jobs);
     }
 
-    return ssim / ((height - 1) * (width - 1));
+    return 0;
 }
 
 static double ssim_db(double ssim, double weight)
@@ -282,14 +321,43 @@ static double ssim_db(double ssim, double weight)
     return (fabs(weight - ssim) > 1e-9) ? 10.0 * log10(weight / (weight - ssim)) : INFINITY;
 }
 
+static void compute_psnr(AVFilterContext *ctx, AVDictionary **metadata, int nb_jobs)
+{
+    SSIMContext *s = ctx->priv;
+    double comp_mse[4], mse = 0.0;
+    int i, c;
+
+    for (i = 0; i < s->nb_components; i++) {
+        comp_mse[i] = ff_psnr_mse((const uint64_t (*)[4])s->sse, nb_jobs, i,
+                                  s->planewidth[i], s->planeheight[i]);
+        mse += comp_mse[i] * s->coefs[i];
+    }
+
+    s->min_mse = FFMIN(s->min_mse, mse);
+    s->max_mse = FFMAX(s->max_mse, mse);
+    s->mse += mse;
+    for (i = 0; i < s->nb_components; i++)
+        s->mse_comp[i] += comp_mse[i];
+
+    for (i = 0; i < s->nb_components; i++) {
+        char comp = av_tolower(s->comps[i]);
+        c = s->is_rgb ? s->rgba_map[i] : i;
+        set_meta(metadata, "lavfi.psnr.mse.", comp, comp_mse[c]);
+        set_meta(metadata, "lavfi.psnr.psnr.", comp, ff_psnr_get(comp_mse[c], 1, s->max));
+    }
+    set_meta(metadata, "lavfi.psnr.mse_avg", 0, mse);
+    set_meta(metadata, "lavfi.psnr.psnr_avg", 0, ff_psnr_get(mse, 1, s->max));
+}
+
 static int do_ssim(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
     SSIMContext *s = ctx->priv;
     AVFrame *master, *ref;
     AVDictionary **metadata;
+    ThreadData td;
     double c[4] = { 0 }, ssimv = 0.0;
-    int ret, i;
+    int ret, i, y, nb_jobs;
 
     ret = ff_framesync_dualinput_get(fs, &master, &ref);
     if (ret < 0)
@@ -300,11 +368,19 @@ static int do_ssim(FFFrameSync *fs)
 
     s->nb_frames++;
 
+    td.main = master;
+    td.ref  = ref;
+    nb_jobs = FFMIN(s->planeheight[1] >> 2, s->nb_threads);
+    nb_jobs = FFMAX(nb_jobs, 1);
+    ctx->internal->execute(ctx, ssim_slice, &td, NULL, nb_jobs);
+
+    /* rows are summed in order, so the result does not depend on nb_jobs */
     for (i = 0; i < s->nb_components; i++) {
-        c[i] = s->ssim_plane(&s->dsp, master->data[i], master->linesize[i],
-                             ref->data[i], ref->linesize[i],
-                             s->planewidth[i], s->planeheight[i], s->temp,
-                             s->max);
+        const int w = s->planewidth[i] >> 2, h = s->planeheight[i] >> 2;
+
+        for (y = 1; y < h; y++)
+            c[i] += s->row_score[i][y];
+        c[i] /= (h - 1) * (w - 1);
         ssimv += s->coefs[i] * c[i];
         s->ssim[i] += c[i];
     }
@@ -317,6 +393,9 @@ static int do_ssim(FFFrameSync *fs)
     set_meta(metadata, "lavfi.ssim.All", 0, ssimv);
     set_meta(metadata, "lavfi.ssim.dB", 0, ssim_db(ssimv, 1.0));
 
+    if (s->psnr)
+        compute_psnr(ctx, metadata, nb_jobs);
+
     if (s->stats_file) {
         fprintf(s->stats_file, "n:%"PRId64" ", s->nb_frames);
 
@@ -410,11 +489,31 @@ static int config_input_ref(AVFilterLink *inlink)
     for (i = 0; i < s->nb_components; i++)
         s->coefs[i] = (double) s->planeheight[i] * s->planewidth[i] / sum;
 
-    s->temp = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
     if (!s->temp)
         return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < s->nb_components; i++) {
+        s->row_score[i] = av_malloc_array(s->planeheight[i] >> 2, sizeof(*s->row_score[i]));
+        if (!s->row_score[i])
+            return AVERROR(ENOMEM);
+    }
     s->max = (1 << desc->comp[0].depth) - 1;
 
+    if (s->psnr) {
+        s->sse = av_calloc(s->nb_threads, sizeof(*s->sse));
+        if (!s->sse)
+            return AVERROR(ENOMEM);
+        s->min_mse = +INFINITY;
+        s->max_mse = -INFINITY;
+        ff_psnr_init(&s->psnr_dsp, desc->comp[0].depth);
+    }
+
     s->ssim_plane = desc->comp[0].depth > 8 ? ssim_plane_16bit : ssim_plane;
     s->dsp.ssim_4x4_line = ssim_4x4xn_8bit;
     s->dsp.ssim_end_line = ssim_endn_8bit;
@@ -463,10 +562,10 @@ static int activate(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     SSIMContext *s = ctx->priv;
+    int i;
 
     if (s->nb_frames > 0) {
         char buf[256];
-        int i;
         buf[0] = 0;
         for (i = 0; i < s->nb_components; i++) {
             int c = s->is_rgb ? s->rgba_map[i] : i;
@@ -475,6 +574,20 @@ static av_cold void uninit(AVFilterContext *ctx)
         }
         av_log(ctx, AV_LOG_INFO, "SSIM%s All:%f (%f)\n", buf,
                s->ssim_total / s->nb_frames, ssim_db(s->ssim_total, s->nb_frames));
+
+        if (s->psnr) {
+            buf[0] = 0;
+            for (i = 0; i < s->nb_components; i++) {
+                int c = s->is_rgb ? s->rgba_map[i] : i;
+                av_strlcatf(buf, sizeof(buf), " %c:%f", av_tolower(s->comps[i]),
+                            ff_psnr_get(s->mse_comp[c], s->nb_frames, s->max));
+            }
+            av_log(ctx, AV_LOG_INFO, "PSNR%s average:%f min:%f max:%f\n",
+                   buf,
+                   ff_psnr_get(s->mse, s->nb_frames, s->max),
+                   ff_psnr_get(s->max_mse, 1, s->max),
+                   ff_psnr_get(s->min_mse, 1, s->max));
+        }
     }
 
     ff_framesync_uninit(&s->fs);
@@ -482,7 +595,12 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (s->stats_file && s->stats_file != stdout)
         fclose(s->stats_file);
 
+    for (i = 0; s->temp && i < s->nb_threads; i++)
+        av_freep(&s->temp[i]);
     av_freep(&s->temp);
+    for (i = 0; i < 4; i++)
+        av_freep(&s->row_score[i]);
+    av_freep(&s->sse);
 }
 
 static const AVFilterPad ssim_inputs[] = {
@@ -518,4 +636,5 @@ AVFilter ff_vf_ssim = {
     .priv_class    = &ssim_class,
     .inputs        = ssim_inputs,
     .outputs       = ssim_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -65,8 +65,9 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
     }
 
     if (!link->frame_pool) {
-        link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
-                                                    link->format, BUFFER_ALIGN);
+        link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz,
+                                                    ff_filter_graph_frame_arena(link->graph),
+                                                    w, h, link->format, BUFFER_ALIGN);
         if (!link->frame_pool)
             return NULL;
     } else {
@@ -80,8 +81,9 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
             pool_format != link->format || pool_align != BUFFER_ALIGN) {
 
             ff_frame_pool_uninit((FFFramePool **)&link->frame_pool);
-            link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
-                                                        link->format, BUFFER_ALIGN);
+            link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz,
+                                                        ff_filter_graph_frame_arena(link->graph),
+                                                        w, h, link->format, BUFFER_ALIGN);
             if (!link->frame_pool)
                 return NULL;
         }
@@ -1247,6 +1247,39 @@ void  av_stream_set_recommended_encoder_configuration(AVStream *s, char *configu
 
 struct AVCodecParserContext *av_stream_get_parser(const AVStream *s);
 
+/**
+ * Codec parameters for which avformat_find_stream_info() reports how they
+ * were determined.
+ */
+enum AVStreamParam {
+    AV_STREAM_PARAM_FORMAT,              ///< pixel or sample format
+    AV_STREAM_PARAM_DIMENSIONS,          ///< width and height
+    AV_STREAM_PARAM_SAMPLE_ASPECT_RATIO,
+    AV_STREAM_PARAM_FIELD_ORDER,
+    AV_STREAM_PARAM_SAMPLE_RATE,
+    AV_STREAM_PARAM_CHANNELS,
+    AV_STREAM_PARAM_CHANNEL_LAYOUT,
+    AV_STREAM_PARAM_FRAME_SIZE,
+    AV_STREAM_PARAM_NB,                  ///< Not part of ABI
+};
+
+enum AVProbeConfidence {
+    AV_PROBE_CONFIDENCE_NONE,    ///< not known
+    AV_PROBE_CONFIDENCE_GUESS,   ///< guessed, e.g. from the only format the decoder supports
+    AV_PROBE_CONFIDENCE_HEADER,  ///< read from the container, extradata or a parser
+    AV_PROBE_CONFIDENCE_DECODED, ///< set by a decoder that decoded data of the stream
+};
+
+/**
+ * Get how a codec parameter of the stream was determined by
+ * avformat_find_stream_info().
+ *
+ * @return AV_PROBE_CONFIDENCE_NONE if avformat_find_stream_info() was not
+ *         called or the parameter does not apply to the stream type
+ */
+enum AVProbeConfidence av_stream_get_probe_confidence(const AVStream *st,
+                                                      enum AVStreamParam param);
+
 /**
  * Returns the pts of the last muxed packet + its duration
  *
@@ -1500,6 +1533,13 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_SHORTEST   0x100000 ///< Stop muxing when the shortest stream stops.
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+/**
+ * In avformat_find_stream_info(), take the codec parameters from the
+ * container, extradata and parsers, and only decode streams for which these
+ * are not enough. Parameters that only decoders export may be left unset or
+ * guessed, see av_stream_get_probe_confidence().
+ */
+#define AVFMT_FLAG_FAST_PROBE 0x400000
 
     /**
      * Maximum size of the data read from input for determining
@@ -2338,6 +2378,9 @@ int av_demuxer_open(AVFormatContext *ic);
  * @note this function isn't guaranteed to open all the codecs, so
  *       options being non-empty at return is a perfectly normal behavior.
  *
+ * @note With AVFMT_FLAG_FAST_PROBE set, decoders are only opened for streams
+ *       whose parameters cannot be found without decoding.
+ *
  * @todo Let the user decide somehow what information is needed so that
  *       we do not waste time getting stuff the user does not need.
  */
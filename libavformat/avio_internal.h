@@ -149,6 +149,17 @@ int ffio_fdopen(AVIOContext **s, URLContext *h);
  */
 URLContext *ffio_geturlcontext(AVIOContext *s);
 
+/**
+ * Read size bytes without copying them, if the underlying protocol can
+ * reference its data directly (e.g. a memory mapped file).
+ *
+ * @param buf set to a new reference to the data on success; the data is
+ *            followed by AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes
+ * @return size on success, a negative AVERROR code if the data has to be
+ *         read with avio_read() instead; the position is unchanged then
+ */
+int ffio_read_buffer_ref(AVIOContext *s, int size, AVBufferRef **buf);
+
 /**
  * Open a write-only fake memory stream. The written data is not stored
  * anywhere - this is only used for measuring the amount of data
@@ -999,6 +999,43 @@ URLContext* ffio_geturlcontext(AVIOContext *s)
         return NULL;
 }
 
+int ffio_read_buffer_ref(AVIOContext *s, int size, AVBufferRef **buf)
+{
+    URLContext *h = ffio_geturlcontext(s);
+    int64_t pos;
+    int ret;
+
+    if (!h || !h->prot->url_get_buffer_ref || s->write_flag ||
+        s->update_checksum || !(s->seekable & AVIO_SEEKABLE_NORMAL))
+        return AVERROR(ENOSYS);
+
+    pos = avio_tell(s);
+    if (pos < 0)
+        return pos;
+    ret = h->prot->url_get_buffer_ref(h, pos, size, buf);
+    if (ret < 0)
+        return ret;
+
+    /* Skip the data without reading it: avio_skip() would read forward
+     * through the buffer for skips below the short seek threshold. */
+    pos += size;
+    if (pos <= s->pos && pos >= s->pos - (s->buf_end - s->buffer)) {
+        s->buf_ptr = s->buf_end - (s->pos - pos);
+    } else {
+        int64_t res = s->seek(s->opaque, pos, SEEK_SET);
+        if (res < 0) {
+            av_buffer_unref(buf);
+            return res;
+        }
+        s->seek_count++;
+        s->buf_end =
+        s->buf_ptr = s->buffer;
+        s->pos = pos;
+        s->eof_reached = 0;
+    }
+    return size;
+}
+
 int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
 {
     uint8_t *buffer;
@@ -23,16 +23,20 @@
 
 /**
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
+#define _GNU_SOURCE     /* Needed for F_OFD_SETLKW */
+
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
 #include "libavutil/internal.h"
+#include "libavutil/md5.h"
 #include "libavutil/opt.h"
 #include "libavutil/tree.h"
 #include "avformat.h"
+#include "internal.h"
 #include <fcntl.h>
 #if HAVE_IO_H
 #include <io.h>
@@ -40,17 +44,31 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+#if HAVE_FCNTL && HAVE_DIRENT_H && !defined(F_OFD_SETLKW)
+#include <sys/file.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
 
+#define HAVE_PERSISTENT_CACHE (HAVE_FCNTL && HAVE_DIRENT_H)
+#define INDEX_HEADER "ffcache 1"
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
     int size;
 } CacheEntry;
 
+typedef struct Extent {
+    int64_t pos;
+    int64_t size;
+} Extent;
+
 typedef struct Context {
     AVClass *class;
     int fd;
@@ -63,7 +81,17 @@ typedef struct Context {
     int is_true_eof;
     URLContext *inner;
     int64_t cache_hit, cache_miss;
+    int64_t cache_hit_bytes, cache_miss_bytes;
     int read_ahead_limit;
+
+    /* persistent cache */
+    char *cache_dir;
+    int64_t cache_max_size;
+    const char *url;
+    char *data_filename;        ///< data stored at its logical position
+    char *index_filename;       ///< cached extents of the data file
+    char *validator;            ///< identifies the version of the resource
+    int64_t size;               ///< size of the validated resource, if known
 } Context;
 
 static int cmp(const void *key, const void *node)
@@ -71,6 +99,406 @@ static int cmp(const void *key, const void *node)
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+static int enu_free(void *opaque, void *elem)
+{
+    av_free(elem);
+    return 0;
+}
+
+static int insert_entry(Context *c, int64_t logical_pos, int64_t physical_pos,
+                        int size)
+{
+    CacheEntry *entry, *entry_ret;
+    struct AVTreeNode *node;
+
+    entry = av_malloc(sizeof(*entry));
+    node = av_tree_node_alloc();
+    if (!entry || !node) {
+        av_free(entry);
+        av_free(node);
+        return AVERROR(ENOMEM);
+    }
+    entry->logical_pos = logical_pos;
+    entry->physical_pos = physical_pos;
+    entry->size = size;
+
+    entry_ret = av_tree_insert(&c->root, entry, cmp, &node);
+    if (entry_ret && entry_ret != entry) {
+        av_free(entry);
+        av_free(node);
+        return -1;
+    }
+    return 0;
+}
+
+#if HAVE_PERSISTENT_CACHE
+/**
+ * Lock or unlock the whole file. The locks belong to the open file
+ * description, so that they also exclude other users of the same resource
+ * within the process, and closing another descriptor of the file does not
+ * release them, unlike process-associated fcntl() locks.
+ *
+ * @param type F_RDLCK, F_WRLCK or F_UNLCK
+ */
+static int lock_file(int fd, int type)
+{
+#ifdef F_OFD_SETLKW
+    struct flock fl = { .l_type = type, .l_whence = SEEK_SET };
+
+    while (fcntl(fd, F_OFD_SETLKW, &fl) < 0) {
+#else
+    int op = type == F_RDLCK ? LOCK_SH : type == F_WRLCK ? LOCK_EX : LOCK_UN;
+
+    while (flock(fd, op) < 0) {
+#endif
+        if (errno != EINTR)
+            return AVERROR(errno);
+    }
+    return 0;
+}
+
+static int cmp_extent(const void *a, const void *b)
+{
+    return FFDIFFSIGN(((const Extent *)a)->pos, ((const Extent *)b)->pos);
+}
+
+static int add_extent(Extent **extents, int *nb_extents, int64_t pos, int64_t size)
+{
+    int ret = av_reallocp_array(extents, *nb_extents + 1, sizeof(**extents));
+    if (ret < 0) {
+        *nb_extents = 0;
+        return ret;
+    }
+    (*extents)[*nb_extents].pos  = pos;
+    (*extents)[*nb_extents].size = size;
+    (*nb_extents)++;
+    return 0;
+}
+
+static char *get_validator(Context *c)
+{
+    uint8_t *etag = NULL, *last_modified = NULL;
+    int64_t size = c->size;
+    char *validator = NULL;
+
+    av_opt_get(c->inner, "etag", AV_OPT_SEARCH_CHILDREN, &etag);
+    av_opt_get(c->inner, "last_modified", AV_OPT_SEARCH_CHILDREN, &last_modified);
+
+    /* The size alone does not tell versions of the resource apart. */
+    if ((etag && *etag) || (last_modified && *last_modified))
+        validator = av_asprintf("%"PRId64" %s %s", FFMAX(size, -1),
+                                etag && *etag ? (char *)etag : "-",
+                                last_modified && *last_modified ? (char *)last_modified : "-");
+    av_free(etag);
+    av_free(last_modified);
+    return validator;
+}
+
+/**
+ * Read the extents listed in the index file.
+ *
+ * @return 1 if the index describes the current version of the resource,
+ *         0 if it is stale, AVERROR(ENOENT) if there is no index
+ */
+static int read_index(URLContext *h, Extent **extents, int *nb_extents)
+{
+    Context *c = h->priv_data;
+    char *buf = NULL, *line, *next;
+    struct stat st;
+    int fd, ret = 0;
+
+    *extents = NULL;
+    *nb_extents = 0;
+
+    fd = avpriv_open(c->index_filename, O_RDONLY);
+    if (fd < 0)
+        return AVERROR(errno);
+    if (fstat(fd, &st) < 0 || st.st_size > INT_MAX - 1) {
+        close(fd);
+        return 0;
+    }
+    buf = av_malloc(st.st_size + 1);
+    if (!buf) {
+        close(fd);
+        return AVERROR(ENOMEM);
+    }
+    if (read(fd, buf, st.st_size) != st.st_size)
+        goto end;
+    buf[st.st_size] = 0;
+
+    line = av_strtok(buf, "\n", &next);
+    if (!line || strcmp(line, INDEX_HEADER))
+        goto end;
+    line = av_strtok(NULL, "\n", &next);
+    if (!line || !av_strstart(line, "url ", (const char **)&line) ||
+        strcmp(line, c->url))
+        goto end;
+    line = av_strtok(NULL, "\n", &next);
+    if (!line || !av_strstart(line, "validator ", (const char **)&line) ||
+        strcmp(line, c->validator))
+        goto end;
+
+    while ((line = av_strtok(NULL, "\n", &next))) {
+        int64_t pos, size;
+        if (sscanf(line, "%"SCNd64" %"SCNd64, &pos, &size) != 2 ||
+            pos < 0 || size <= 0 || size > INT_MAX || pos > INT64_MAX - size) {
+            av_log(h, AV_LOG_WARNING, "Invalid entry in %s\n", c->index_filename);
+            av_freep(extents);
+            *nb_extents = 0;
+            goto end;
+        }
+        if ((ret = add_extent(extents, nb_extents, pos, size)) < 0)
+            goto end;
+    }
+    ret = 1;
+
+end:
+    close(fd);
+    av_free(buf);
+    return ret;
+}
+
+/* Check whether the data file was replaced since c->fd was opened. */
+static int data_file_replaced(Context *c)
+{
+    struct stat st_fd, st_path;
+
+    return fstat(c->fd, &st_fd) < 0 || stat(c->data_filename, &st_path) < 0 ||
+           st_fd.st_ino != st_path.st_ino || st_fd.st_dev != st_path.st_dev;
+}
+
+static int load_index(URLContext *h)
+{
+    Context *c = h->priv_data;
+    Extent *extents;
+    int i, nb_extents, ret;
+
+    if ((ret = lock_file(c->fd, F_RDLCK)) < 0)
+        return ret;
+    /* Another user may have discarded the files between opening and locking
+     * them: the index then belongs to the new data file. */
+    while (data_file_replaced(c)) {
+        close(c->fd);
+        c->fd = avpriv_open(c->data_filename, O_RDWR | O_CREAT, 0666);
+        if (c->fd < 0)
+            return AVERROR(errno);
+        if ((ret = lock_file(c->fd, F_RDLCK)) < 0)
+            return ret;
+    }
+    ret = read_index(h, &extents, &nb_extents);
+    lock_file(c->fd, F_UNLCK);
+
+    if (ret == 0) {
+        /* The resource changed: start over with new files, users of the
+         * old version keep reading the unlinked ones. */
+        av_log(h, AV_LOG_VERBOSE, "Discarding stale cache of %s\n", c->url);
+        if ((ret = lock_file(c->fd, F_WRLCK)) < 0)
+            return ret;
+        unlink(c->index_filename);
+        unlink(c->data_filename);
+        close(c->fd);
+        c->fd = avpriv_open(c->data_filename, O_RDWR | O_CREAT, 0666);
+        return c->fd < 0 ? AVERROR(errno) : 0;
+    }
+    if (ret < 0)
+        return ret == AVERROR(ENOENT) ? 0 : ret;
+
+    for (i = 0; i < nb_extents; i++) {
+        /* extents are sorted and disjoint */
+        if ((ret = insert_entry(c, extents[i].pos, extents[i].pos, extents[i].size)) < 0)
+            break;
+        c->end = FFMAX(c->end, extents[i].pos + extents[i].size);
+    }
+    av_free(extents);
+    return ret;
+}
+
+static int collect_extent(void *opaque, void *elem)
+{
+    void **ctx = opaque;
+    CacheEntry *entry = elem;
+
+    add_extent(ctx[0], ctx[1], entry->logical_pos, entry->size);
+    return 0;
+}
+
+static int write_index(URLContext *h)
+{
+    Context *c = h->priv_data;
+    Extent *extents = NULL;
+    void *ctx[2];
+    char *tmp_filename = NULL;
+    AVBPrint bp;
+    int i, j, nb_extents = 0, fd = -1, ret;
+
+    if ((ret = lock_file(c->fd, F_WRLCK)) < 0)
+        return ret;
+
+    /* The data file was replaced by a newer version of the resource. */
+    if (data_file_replaced(c))
+        goto end;
+
+    /* Merge with the extents cached concurrently by other users. */
+    if (read_index(h, &extents, &nb_extents) != 1) {
+        av_freep(&extents);
+        nb_extents = 0;
+    }
+    ctx[0] = &extents;
+    ctx[1] = &nb_extents;
+    av_tree_enumerate(c->root, ctx, NULL, collect_extent);
+    if (!extents)
+        goto end;
+
+    qsort(extents, nb_extents, sizeof(*extents), cmp_extent);
+    for (i = 1, j = 0; i < nb_extents; i++) {
+        int64_t end = extents[j].pos + extents[j].size;
+        if (extents[i].pos <= end && extents[i].pos + extents[i].size - extents[j].pos <= INT_MAX)
+            extents[j].size = FFMAX(end, extents[i].pos + extents[i].size) - extents[j].pos;
+        else
+            extents[++j] = extents[i];
+    }
+    nb_extents = j + 1;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, INDEX_HEADER "\nurl %s\nvalidator %s\n", c->url, c->validator);
+    for (i = 0; i < nb_extents; i++)
+        av_bprintf(&bp, "%"PRId64" %"PRId64"\n", extents[i].pos, extents[i].size);
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto end_bprint;
+    }
+
+    tmp_filename = av_asprintf("%s.tmp", c->index_filename);
+    if (!tmp_filename) {
+        ret = AVERROR(ENOMEM);
+        goto end_bprint;
+    }
+    fd = avpriv_open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0 || write(fd, bp.str, bp.len) != bp.len ||
+        rename(tmp_filename, c->index_filename) < 0) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Failed to write %s\n", c->index_filename);
+        unlink(tmp_filename);
+    }
+
+end_bprint:
+    av_bprint_finalize(&bp, NULL);
+end:
+    if (fd >= 0)
+        close(fd);
+    av_free(tmp_filename);
+    av_free(extents);
+    lock_file(c->fd, F_UNLCK);
+    return ret;
+}
+
+typedef struct IndexFile {
+    char *name;
+    time_t mtime;
+    int64_t size;
+} IndexFile;
+
+static int cmp_index_file(const void *a, const void *b)
+{
+    return FFDIFFSIGN(((const IndexFile *)a)->mtime, ((const IndexFile *)b)->mtime);
+}
+
+/**
+ * Remove the least recently used resources until the data kept in the
+ * cache directory fits in cache_max_size.
+ */
+static void evict(URLContext *h)
+{
+    Context *c = h->priv_data;
+    IndexFile *files = NULL;
+    int i, nb_files = 0;
+    int64_t total = 0;
+    struct dirent *de;
+    DIR *dir;
+
+    dir = opendir(c->cache_dir);
+    if (!dir)
+        return;
+    while ((de = readdir(dir))) {
+        struct stat st_index, st_data;
+        char *index_filename, *data_filename;
+        size_t len = strlen(de->d_name);
+        IndexFile *tmp;
+
+        if (len <= 4 || strcmp(de->d_name + len - 4, ".idx"))
+            continue;
+        index_filename = av_asprintf("%s/%s", c->cache_dir, de->d_name);
+        data_filename  = av_asprintf("%s/%.*s.data", c->cache_dir, (int)len - 4, de->d_name);
+        tmp = av_realloc_array(files, nb_files + 1, sizeof(*files));
+        if (tmp)
+            files = tmp;
+        if (tmp && index_filename && data_filename &&
+            !stat(index_filename, &st_index) && !stat(data_filename, &st_data)) {
+            files[nb_files].name  = index_filename;
+            files[nb_files].mtime = st_index.st_mtime;
+            files[nb_files].size  = st_index.st_size + (int64_t)st_data.st_blocks * 512;
+            total += files[nb_files++].size;
+            index_filename = NULL;
+        }
+        av_free(index_filename);
+        av_free(data_filename);
+    }
+    closedir(dir);
+
+    qsort(files, nb_files, sizeof(*files), cmp_index_file);
+    for (i = 0; i < nb_files && total > c->cache_max_size; i++) {
+        char *data_filename;
+
+        if (!strcmp(files[i].name, c->index_filename))
+            continue;
+        data_filename = av_asprintf("%.*s.data", (int)strlen(files[i].name) - 4, files[i].name);
+        if (!data_filename)
+            break;
+        av_log(h, AV_LOG_VERBOSE, "Evicting %s\n", data_filename);
+        unlink(files[i].name);
+        unlink(data_filename);
+        av_free(data_filename);
+        total -= files[i].size;
+    }
+
+    for (i = 0; i < nb_files; i++)
+        av_free(files[i].name);
+    av_free(files);
+}
+
+static int open_persistent(URLContext *h)
+{
+    Context *c = h->priv_data;
+    uint8_t md5[16];
+    char hash[33];
+
+    c->size = ffurl_size(c->inner);
+    c->validator = get_validator(c);
+    if (!c->validator) {
+        av_log(h, AV_LOG_WARNING, "%s cannot be validated, not caching it in %s\n",
+               c->url, c->cache_dir);
+        return AVERROR(ENOSYS);
+    }
+
+    av_md5_sum(md5, (const uint8_t *)c->url, strlen(c->url));
+    ff_data_to_hex(hash, md5, sizeof(md5), 1);
+    hash[32] = 0;
+    c->data_filename  = av_asprintf("%s/%s.data", c->cache_dir, hash);
+    c->index_filename = av_asprintf("%s/%s.idx",  c->cache_dir, hash);
+    if (!c->data_filename || !c->index_filename)
+        return AVERROR(ENOMEM);
+
+    c->fd = avpriv_open(c->data_filename, O_RDWR | O_CREAT, 0666);
+    if (c->fd < 0) {
+        int ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Failed to open %s\n", c->data_filename);
+        return ret;
+    }
+
+    return load_index(h);
+}
+#endif
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     int ret;
@@ -79,6 +507,36 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
+    c->fd = -1;
+    if (c->cache_dir) {
+#if HAVE_PERSISTENT_CACHE
+        c->url = arg;
+        ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                                   options, h->protocol_whitelist, h->protocol_blacklist, h);
+        if (ret < 0)
+            return ret;
+        ret = open_persistent(h);
+        if (ret >= 0)
+            return 0;
+        if (c->fd >= 0)
+            close(c->fd);
+        av_freep(&c->data_filename);
+        av_freep(&c->index_filename);
+        av_freep(&c->validator);
+        av_tree_enumerate(c->root, NULL, NULL, enu_free);
+        av_tree_destroy(c->root);
+        c->root = NULL;
+        c->end = 0;
+        c->size = 0;
+        if (ret != AVERROR(ENOSYS)) {
+            ffurl_closep(&c->inner);
+            return ret;
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "'cache_dir' option is not supported on this build\n");
+#endif
+    }
+
     c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
     if (c->fd < 0){
         av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
@@ -92,6 +550,8 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
     else
         c->filename = buffername;
 
+    if (c->inner)
+        return 0;
     return ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
                                 options, h->protocol_whitelist, h->protocol_blacklist, h);
 }
@@ -102,11 +562,14 @@ static int add_entry(URLContext *h, const unsigned char *buf, int size)
     int64_t pos = -1;
     int ret;
     CacheEntry *entry = NULL, *next[2] = {NULL, NULL};
-    CacheEntry *entry_ret;
-    struct AVTreeNode *node = NULL;
 
     //FIXME avoid lseek
-    pos = lseek(c->fd, 0, SEEK_END);
+    /* a persistent cache stores the data at its logical position, so that
+     * it can be shared with other users */
+    if (c->data_filename)
+        pos = lseek(c->fd, c->logical_pos, SEEK_SET);
+    else
+        pos = lseek(c->fd, 0, SEEK_END);
     if (pos < 0) {
         ret = AVERROR(errno);
         av_log(h, AV_LOG_ERROR, "seek in cache failed\n");
@@ -129,21 +592,11 @@ static int add_entry(URLContext *h, const unsigned char *buf, int size)
 
     if (!entry ||
         entry->logical_pos  + entry->size != c->logical_pos ||
-        entry->physical_pos + entry->size != pos
+        entry->physical_pos + entry->size != pos ||
+        entry->size > INT_MAX - ret
     ) {
-        entry = av_malloc(sizeof(*entry));
-        node = av_tree_node_alloc();
-        if (!entry || !node) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-        entry->logical_pos = c->logical_pos;
-        entry->physical_pos = pos;
-        entry->size = ret;
-
-        entry_ret = av_tree_insert(&c->root, entry, cmp, &node);
-        if (entry_ret && entry_ret != entry) {
-            ret = -1;
+        ret = insert_entry(c, c->logical_pos, pos, ret);
+        if (ret < 0) {
             av_log(h, AV_LOG_ERROR, "av_tree_insert failed\n");
             goto fail;
         }
@@ -154,8 +607,6 @@ static int add_entry(URLContext *h, const unsigned char *buf, int size)
 fail:
     //we could truncate the file to pos here if pos >=0 but ftruncate isn't available in VS so
     //for simplicty we just leave the file a bit larger
-    av_free(entry);
-    av_free(node);
     return ret;
 }
 
@@ -190,12 +641,15 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
                 c->cache_pos += r;
                 c->logical_pos += r;
                 c->cache_hit ++;
+                c->cache_hit_bytes += r;
                 return r;
             }
         }
     }
 
     // Cache miss or some kind of fault with the cache
+    if (c->size > 0 && c->logical_pos >= c->size && size > 0)
+        return AVERROR_EOF;
 
     if (c->logical_pos != c->inner_pos) {
         r = ffurl_seek(c->inner, c->logical_pos, SEEK_SET);
@@ -216,6 +670,7 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
     c->inner_pos += r;
 
     c->cache_miss ++;
+    c->cache_miss_bytes += r;
 
     add_entry(h, buf, r);
     c->logical_pos += r;
@@ -289,20 +744,27 @@ resolve_eof:
     return ret;
 }
 
-static int enu_free(void *opaque, void *elem)
-{
-    av_free(elem);
-    return 0;
-}
-
 static int cache_close(URLContext *h)
 {
     Context *c= h->priv_data;
     int ret;
 
-    av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64"\n",
-           c->cache_hit, c->cache_miss);
-
+    av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64
+           " (%"PRId64" bytes read from cache, %"PRId64" bytes from %s)\n",
+           c->cache_hit, c->cache_miss, c->cache_hit_bytes, c->cache_miss_bytes,
+           c->inner->prot->name);
+
+#if HAVE_PERSISTENT_CACHE
+    if (c->data_filename) {
+        write_index(h);
+        close(c->fd);
+        if (c->cache_max_size > 0)
+            evict(h);
+        av_freep(&c->data_filename);
+        av_freep(&c->index_filename);
+        av_freep(&c->validator);
+    } else
+#endif
     close(c->fd);
     if (c->filename) {
         ret = unlink(c->filename);
@@ -322,6 +784,8 @@ static int cache_close(URLContext *h)
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Directory in which cached data is kept and shared across users", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_max_size", "Maximum size in bytes of the data kept in cache_dir, 0 for unlimited", OFFSET(cache_max_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     {NULL},
 };
 
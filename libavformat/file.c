@@ -35,6 +35,9 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include "os_support.h"
 #include "url.h"
 
@@ -65,8 +68,19 @@
 #  endif
 #endif
 
+/* packets smaller than this are cheaper to copy than to map */
+#define MMAP_MIN_PACKET_SIZE (64 << 10)
+/* size of the mappings that consecutive packets share */
+#define MMAP_WINDOW_SIZE (32 << 20)
+
 /* standard file protocol */
 
+typedef struct FileMapping {
+    AVBufferRef *buf;   ///< the mapping, NULL if unused
+    int64_t start;      ///< file offset of the mapping
+    int64_t dirty_end;  ///< end of the last packet padding zeroed in the mapping
+} FileMapping;
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -74,6 +88,8 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int use_mmap;
+    FileMapping maps[2];
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -84,6 +100,7 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Return large packets as references to a mapping of the file", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -205,6 +222,102 @@ static int file_move(URLContext *h_src, URLContext *h_dst)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+/*
+ * Packets read one after the other share a mapping, and only the page holding
+ * the padding of each of them is copied when it is zeroed. A packet can be
+ * returned from a mapping if it starts after the last padding zeroed in it,
+ * so that no packet still in use gets its data overwritten. Packets directly
+ * following each other therefore alternate between two mappings. A mapping is
+ * unmapped once it is replaced and all its packets are freed.
+ */
+static int file_get_buffer_ref(URLContext *h, int64_t offset, int size,
+                               AVBufferRef **buf)
+{
+    FileContext *c = h->priv_data;
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start, end, map_end;
+    FileMapping *m = NULL;
+    size_t map_size;
+    struct stat st;
+    uint8_t *data;
+    int i;
+
+    if (!c->use_mmap || size < MMAP_MIN_PACKET_SIZE || offset < 0 ||
+        page_size <= 0)
+        return AVERROR(ENOSYS);
+
+    /* Pages entirely past the end of the file cannot be accessed, so the
+     * padding has to lie within the last page. Checking the current size
+     * also turns a file truncated before the read into an error instead
+     * of a fault. */
+    if (fstat(c->fd, &st) < 0)
+        return AVERROR(errno);
+    end = offset + size + AV_INPUT_BUFFER_PADDING_SIZE;
+    map_end = FFALIGN(st.st_size, page_size);
+    if (offset + size > st.st_size || end > map_end)
+        return AVERROR(EINVAL);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(c->maps); i++) {
+        FileMapping *map = &c->maps[i];
+        if (map->buf && offset >= map->dirty_end &&
+            end <= map->start + map->buf->size) {
+            m = map;
+            break;
+        }
+    }
+
+    if (!m) {
+        /* replace the mapping that has been used the longest ago */
+        m = &c->maps[0];
+        for (i = 1; i < FF_ARRAY_ELEMS(c->maps); i++)
+            if (!c->maps[i].buf ||
+                (m->buf && c->maps[i].dirty_end < m->dirty_end))
+                m = &c->maps[i];
+        av_buffer_unref(&m->buf);
+
+        start    = offset & ~(page_size - 1);
+        map_size = FFMIN(map_end, FFMAX(start + MMAP_WINDOW_SIZE, end)) - start;
+        /* private and writable, so that the padding and demuxers patching
+         * the data in place only get copies of the pages they touch */
+        data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    c->fd, start);
+        if (data == MAP_FAILED)
+            return AVERROR(errno);
+        /* read the mapping in and fill its page tables at once, which saves
+         * a page fault per page; older kernels only get a readahead hint */
+#ifdef MADV_POPULATE_READ
+        if (madvise(data, map_size, MADV_POPULATE_READ) < 0)
+            madvise(data, map_size, MADV_WILLNEED);
+#elif defined(MADV_WILLNEED)
+        madvise(data, map_size, MADV_WILLNEED);
+#endif
+        m->buf = av_buffer_create(data, map_size, file_unmap,
+                                  (void *)(uintptr_t)map_size, 0);
+        if (!m->buf) {
+            munmap(data, map_size);
+            return AVERROR(ENOMEM);
+        }
+        m->start     = start;
+        m->dirty_end = start;
+    }
+
+    *buf = av_buffer_ref(m->buf);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    (*buf)->data += offset - m->start;
+    (*buf)->size  = size;
+    memset((*buf)->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    m->dirty_end = end;
+    return 0;
+}
+#endif /* HAVE_MMAP */
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -243,6 +356,18 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->use_mmap) {
+#if HAVE_MMAP
+        if (flags & AVIO_FLAG_WRITE || c->follow || h->is_streamed ||
+            fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+            c->use_mmap = 0;
+#else
+        c->use_mmap = 0;
+#endif
+        if (!c->use_mmap)
+            av_log(h, AV_LOG_VERBOSE, "Not mapping the file\n");
+    }
+
     return 0;
 }
 
@@ -266,6 +391,10 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(c->maps); i++)
+        av_buffer_unref(&c->maps[i].buf);
     return close(c->fd);
 }
 
@@ -369,6 +498,9 @@ const URLProtocol ff_file_protocol = {
     .url_open_dir        = file_open_dir,
     .url_read_dir        = file_read_dir,
     .url_close_dir       = file_close_dir,
+#if HAVE_MMAP
+    .url_get_buffer_ref  = file_get_buffer_ref,
+#endif
     .default_whitelist   = "file,crypto,data"
 };
 
@@ -33,6 +33,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "internal.h"
@@ -40,6 +41,7 @@
 #include "id3v2.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define PREFETCH_CHUNK_SIZE (256 * 1024)
 
 #define MAX_FIELD_LEN 64
 #define MAX_CHARACTERISTICS_LEN 512
@@ -79,6 +81,26 @@ struct segment {
 
 struct rendition;
 
+enum PrefetchState {
+    PREFETCH_EMPTY,
+    PREFETCH_REQUESTED,     /* waiting for the prefetch thread */
+    PREFETCH_FETCHING,
+    PREFETCH_DONE,
+    PREFETCH_IN_USE,        /* currently being demuxed */
+};
+
+/* A media segment downloaded ahead of time by the prefetch thread */
+struct prefetch_entry {
+    enum PrefetchState state;
+    int seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    uint8_t *data;
+    int data_len;
+    int ret;
+};
+
 enum PlaylistType {
     PLS_TYPE_UNSPECIFIED,
     PLS_TYPE_EVENT,
@@ -160,6 +182,22 @@ struct playlist {
      * playlist, if any. */
     int n_init_sections;
     struct segment **init_sections;
+
+    /* Segment prefetching. The entries and prefetch_abort are shared with
+     * the prefetch thread and protected by prefetch_mutex, except for the
+     * entry in use by the demuxer (cur_prefetch). */
+    struct prefetch_entry *prefetch;
+    int n_prefetch;
+    struct prefetch_entry *cur_prefetch;
+    AVDictionary *prefetch_opts;
+    AVIOContext *prefetch_pb;   /* kept open by the thread for keep-alive */
+    int prefetch_started;   /* 1: thread running, -1: failed to start */
+    int prefetch_abort;
+#if HAVE_THREADS
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+#endif
 };
 
 /*
@@ -212,6 +250,7 @@ typedef struct HLSContext {
     int http_persistent;
     int http_multiple;
     int http_seekable;
+    int prefetch_segments;
     AVIOContext *playlist_pb;
 } HLSContext;
 
@@ -243,11 +282,45 @@ static void free_init_section_list(struct playlist *pls)
     pls->n_init_sections = 0;
 }
 
+static void prefetch_entry_reset(struct prefetch_entry *e)
+{
+    av_freep(&e->url);
+    av_freep(&e->data);
+    e->data_len = 0;
+    e->state    = PREFETCH_EMPTY;
+}
+
+static void prefetch_stop(struct playlist *pls)
+{
+    int i;
+
+#if HAVE_THREADS
+    if (pls->prefetch_started > 0) {
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        pls->prefetch_abort = 1;
+        pthread_cond_broadcast(&pls->prefetch_cond);
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+        pthread_join(pls->prefetch_thread, NULL);
+        pthread_cond_destroy(&pls->prefetch_cond);
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+    }
+#endif
+    pls->prefetch_started = 0;
+    pls->prefetch_abort   = 0;
+    pls->cur_prefetch     = NULL;
+    for (i = 0; i < pls->n_prefetch; i++)
+        prefetch_entry_reset(&pls->prefetch[i]);
+    av_freep(&pls->prefetch);
+    pls->n_prefetch = 0;
+    av_dict_free(&pls->prefetch_opts);
+}
+
 static void free_playlist_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        prefetch_stop(pls);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -619,14 +692,16 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary *opts, AVDictionary *opts2, int *is_http_out)
+/**
+ * Check that the URL uses one of the protocols allowed for playlists and
+ * segments.
+ */
+static int check_url(AVFormatContext *s, const char *url, int *is_http)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
-    int is_http = 0;
+
+    *is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
         if (url[6] == '+' || url[6] == ':')
@@ -652,7 +727,7 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
             return AVERROR_INVALIDDATA;
         }
     } else if (av_strstart(proto_name, "http", NULL)) {
-        is_http = 1;
+        *is_http = 1;
     } else if (av_strstart(proto_name, "data", NULL)) {
         ;
     } else
@@ -667,6 +742,21 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary *opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http = 0;
+
+    ret = check_url(s, url, &is_http);
+    if (ret < 0)
+        return ret;
+
     av_dict_copy(&tmp, opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -987,7 +1077,16 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->cur_prefetch) {
+        const struct prefetch_entry *e = pls->cur_prefetch;
+
+        ret = FFMIN(buf_size, e->data_len - pls->cur_seg_offset);
+        if (ret <= 0)
+            return AVERROR_EOF;
+        memcpy(buf, e->data + pls->cur_seg_offset, ret);
+    } else {
+        ret = avio_read(pls->input, buf, buf_size);
+    }
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1279,6 +1378,350 @@ cleanup:
     return ret;
 }
 
+#if HAVE_THREADS
+static int prefetch_aborted(struct playlist *pls)
+{
+    int ret;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    ret = pls->prefetch_abort;
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+    return ret;
+}
+
+/**
+ * Open a segment for the prefetch thread. The thread never calls the
+ * callbacks of the parent context: the segment is opened directly through
+ * the protocols, like the default io_open() does, and only with the options
+ * private to the thread. For HTTP, the connection of the previous segment
+ * is reused if keepalive is set.
+ */
+static int prefetch_open(struct playlist *pls, const char *url,
+                         AVDictionary **opts, int keepalive, int *is_http)
+{
+    AVFormatContext *s = pls->parent;
+    char *new_cookies = NULL;
+    int ret, reused = 0;
+
+    ret = check_url(s, url, is_http);
+    if (ret < 0)
+        return ret;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (*is_http && keepalive && pls->prefetch_pb) {
+        pls->prefetch_pb->eof_reached = 0;
+        ret = ff_http_do_new_request2(ffio_geturlcontext(pls->prefetch_pb),
+                                      url, opts);
+        if (ret == AVERROR_EXIT)
+            return ret;
+        if (ret < 0 && ret != AVERROR_EOF)
+            av_log(s, AV_LOG_VERBOSE,
+                   "keepalive request failed for '%s' with error: '%s' when "
+                   "prefetching, retrying with new connection\n",
+                   url, av_err2str(ret));
+        reused = ret >= 0;
+    }
+#endif
+    if (!reused) {
+        avio_closep(&pls->prefetch_pb);
+        ret = ffio_open_whitelist(&pls->prefetch_pb, url, AVIO_FLAG_READ,
+                                  &s->interrupt_callback, opts,
+                                  s->protocol_whitelist, s->protocol_blacklist);
+        if (ret < 0)
+            return ret;
+    }
+
+    // update cookies on http response with setcookies.
+    av_opt_get(pls->prefetch_pb, "cookies", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&new_cookies);
+    if (new_cookies)
+        av_dict_set(&pls->prefetch_opts, "cookies", new_cookies, AV_DICT_DONT_STRDUP_VAL);
+    return 0;
+}
+
+/**
+ * Download a whole segment into memory. Runs in the prefetch thread, so it
+ * only uses the options private to it and no state of the playlist that the
+ * demuxer modifies.
+ */
+static int fetch_segment(struct playlist *pls, const char *url,
+                         int64_t url_offset, int64_t size,
+                         uint8_t **data, int *data_len)
+{
+    HLSContext *c = pls->parent->priv_data;
+    AVDictionary *opts = NULL;
+    AVIOContext *in;
+    uint8_t *buf = NULL;
+    int len = 0, buf_size = 0;
+    int is_http = 0;
+    int ret;
+
+    av_dict_copy(&opts, pls->prefetch_opts, 0);
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    if (size >= 0) {
+        av_dict_set_int(&opts, "offset", url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", url_offset + size, 0);
+    }
+    ret = prefetch_open(pls, url, &opts, c->http_persistent, &is_http);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto fail;
+    in = pls->prefetch_pb;
+
+    /* see open_input() */
+    if (!is_http && url_offset) {
+        int64_t seekret = avio_seek(in, url_offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            goto fail;
+        }
+    }
+
+    while (size < 0 || len < size) {
+        int to_read;
+
+        if (prefetch_aborted(pls)) {
+            ret = AVERROR_EXIT;
+            goto fail;
+        }
+        if (buf_size - len < PREFETCH_CHUNK_SIZE) {
+            int new_size;
+
+            if (buf_size > INT_MAX / 2 - AV_INPUT_BUFFER_PADDING_SIZE) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            new_size = FFMAX(2 * buf_size, len + PREFETCH_CHUNK_SIZE);
+            ret = av_reallocp(&buf, new_size);
+            if (ret < 0)
+                goto fail;
+            buf_size = new_size;
+        }
+
+        to_read = buf_size - len;
+        if (size >= 0)
+            to_read = FFMIN(to_read, size - len);
+        ret = avio_read(in, buf + len, to_read);
+        if (ret == AVERROR_EOF || !ret)
+            break;
+        if (ret < 0)
+            goto fail;
+        len += ret;
+    }
+
+    if (!is_http || !c->http_persistent)
+        avio_closep(&pls->prefetch_pb);
+    *data     = buf;
+    *data_len = len;
+    return 0;
+
+fail:
+    avio_closep(&pls->prefetch_pb);
+    av_free(buf);
+    return ret;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct playlist *pls = arg;
+    int i;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    while (!pls->prefetch_abort) {
+        struct prefetch_entry *e = NULL;
+        uint8_t *data = NULL;
+        int data_len = 0, ret;
+
+        /* fetch the segment needed first */
+        for (i = 0; i < pls->n_prefetch; i++) {
+            struct prefetch_entry *cur = &pls->prefetch[i];
+            if (cur->state == PREFETCH_REQUESTED && (!e || cur->seq_no < e->seq_no))
+                e = cur;
+        }
+        if (!e) {
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+            continue;
+        }
+
+        /* the demuxer does not touch the entry while it is being fetched */
+        e->state = PREFETCH_FETCHING;
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+
+        ret = fetch_segment(pls, e->url, e->url_offset, e->size, &data, &data_len);
+        if (ret < 0 && ret != AVERROR_EXIT)
+            av_log(pls->parent, AV_LOG_VERBOSE,
+                   "Prefetching segment %d of playlist %d failed: %s\n",
+                   e->seq_no, pls->index, av_err2str(ret));
+
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        e->data     = data;
+        e->data_len = data_len;
+        e->ret      = ret;
+        e->state    = PREFETCH_DONE;
+        pthread_cond_broadcast(&pls->prefetch_cond);
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+    avio_closep(&pls->prefetch_pb);
+
+    return NULL;
+}
+
+static int prefetch_start(HLSContext *c, struct playlist *pls)
+{
+    int ret;
+
+    pls->prefetch = av_mallocz_array(c->prefetch_segments + 1, sizeof(*pls->prefetch));
+    if (!pls->prefetch)
+        return AVERROR(ENOMEM);
+    pls->n_prefetch = c->prefetch_segments + 1;
+
+    ret = av_dict_copy(&pls->prefetch_opts, c->avio_opts, 0);
+    if (ret < 0)
+        return ret;
+
+    if ((ret = pthread_mutex_init(&pls->prefetch_mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&pls->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_create(&pls->prefetch_thread, NULL, prefetch_thread, pls))) {
+        pthread_cond_destroy(&pls->prefetch_cond);
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+    pls->prefetch_started = 1;
+
+    return 0;
+}
+
+static struct prefetch_entry *prefetch_find(struct playlist *pls, int seq_no)
+{
+    int i;
+
+    for (i = 0; i < pls->n_prefetch; i++)
+        if (pls->prefetch[i].state != PREFETCH_EMPTY &&
+            pls->prefetch[i].seq_no == seq_no)
+            return &pls->prefetch[i];
+    return NULL;
+}
+#endif /* HAVE_THREADS */
+
+/**
+ * Request the segments following the current one from the prefetch thread.
+ */
+static void prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+#if HAVE_THREADS
+    int i, j;
+
+    if (!c->prefetch_segments || pls->prefetch_started < 0)
+        return;
+    if (!pls->prefetch_started) {
+        int ret;
+
+        /* the application expects all resources to be opened through
+         * its callbacks, which the prefetch thread must not call */
+        if (!ff_format_io_is_default(pls->parent)) {
+            av_log(pls->parent, AV_LOG_WARNING, "Segment prefetching is not "
+                   "supported with custom I/O callbacks, disabling it\n");
+            pls->prefetch_started = -1;
+            return;
+        }
+        ret = prefetch_start(c, pls);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to start prefetching for playlist %d: %s\n",
+                   pls->index, av_err2str(ret));
+            prefetch_stop(pls);
+            pls->prefetch_started = -1;
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (i = 1; i <= c->prefetch_segments; i++) {
+        int seq_no = pls->cur_seq_no + i;
+        struct prefetch_entry *e = NULL;
+        struct segment *seg;
+
+        if (seq_no - pls->start_seq_no >= pls->n_segments)
+            break;
+        seg = pls->segments[seq_no - pls->start_seq_no];
+        /* decrypting needs the key state of the playlist */
+        if (seg->key_type != KEY_NONE)
+            break;
+        if (prefetch_find(pls, seq_no))
+            continue;
+
+        /* reuse an entry outside of the prefetch window */
+        for (j = 0; j < pls->n_prefetch && !e; j++) {
+            struct prefetch_entry *cur = &pls->prefetch[j];
+            if (cur->state == PREFETCH_EMPTY ||
+                ((cur->state == PREFETCH_REQUESTED || cur->state == PREFETCH_DONE) &&
+                 (cur->seq_no < pls->cur_seq_no ||
+                  cur->seq_no > pls->cur_seq_no + c->prefetch_segments)))
+                e = cur;
+        }
+        if (!e)
+            break;
+
+        prefetch_entry_reset(e);
+        e->url = av_strdup(seg->url);
+        if (!e->url)
+            break;
+        e->seq_no     = seq_no;
+        e->url_offset = seg->url_offset;
+        e->size       = seg->size;
+        e->state      = PREFETCH_REQUESTED;
+    }
+    pthread_cond_signal(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+#endif
+}
+
+/**
+ * Take the segment with the given sequence number from the prefetched ones,
+ * waiting for it if it is still being downloaded.
+ *
+ * @return the entry, or NULL if the segment has to be opened directly
+ */
+static struct prefetch_entry *prefetch_get(struct playlist *pls, int seq_no)
+{
+    struct prefetch_entry *e = NULL;
+#if HAVE_THREADS
+    if (pls->prefetch_started <= 0)
+        return NULL;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    e = prefetch_find(pls, seq_no);
+    while (e && (e->state == PREFETCH_REQUESTED || e->state == PREFETCH_FETCHING))
+        pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+    if (e && e->state == PREFETCH_DONE && e->ret >= 0) {
+        e->state = PREFETCH_IN_USE;
+    } else {
+        /* let open_input() retry and report the error */
+        if (e)
+            prefetch_entry_reset(e);
+        e = NULL;
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+#endif
+    return e;
+}
+
+static void prefetch_release(struct playlist *pls)
+{
+#if HAVE_THREADS
+    if (!pls->cur_prefetch)
+        return;
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    prefetch_entry_reset(pls->cur_prefetch);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+    pls->cur_prefetch = NULL;
+#endif
+}
+
 static int update_init_section(struct playlist *pls, struct segment *seg)
 {
     static const int max_init_section_size = 1024*1024;
@@ -1402,7 +1845,8 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if (!v->cur_prefetch &&
+        (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1478,6 +1922,11 @@ reload:
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
+        } else if ((v->cur_prefetch = prefetch_get(v, v->cur_seq_no))) {
+            /* a kept alive connection stays unused */
+            v->input_read_done = 1;
+            v->cur_seg_offset = 0;
+            ret = 0;
         } else {
             ret = open_input(c, v, seg, &v->input);
         }
@@ -1491,9 +1940,10 @@ reload:
             goto reload;
         }
         just_opened = 1;
+        prefetch_schedule(c, v);
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1503,7 +1953,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !c->prefetch_segments && !v->input_next_requested &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1536,7 +1986,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch) {
+        prefetch_release(v);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -2043,6 +2495,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             }
             av_log(s, AV_LOG_INFO, "Now receiving playlist %d, segment %d\n", i, pls->cur_seq_no);
         } else if (first && !cur_needed && pls->needed) {
+            prefetch_release(pls);
             ff_format_io_close(pls->parent, &pls->input);
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
@@ -2285,6 +2738,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
     for (i = 0; i < c->n_playlists; i++) {
         /* Reset reading */
         struct playlist *pls = c->playlists[i];
+        prefetch_release(pls);
         ff_format_io_close(pls->parent, &pls->input);
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
@@ -2350,6 +2804,8 @@ static const AVOption hls_options[] = {
         OFFSET(http_multiple), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, FLAGS},
     {"http_seekable", "Use HTTP partial requests, 0 = disable, 1 = enable, -1 = auto",
         OFFSET(http_seekable), AV_OPT_TYPE_BOOL, { .i64 = -1}, -1, 1, FLAGS},
+    {"prefetch_segments", "Number of segments to download in advance in a background thread per playlist",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1024, FLAGS},
     {NULL}
 };
 
@@ -28,6 +28,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 
@@ -51,6 +52,11 @@
 #define HTTP_MUTLI    2
 #define MAX_EXPIRY    19
 #define WHITESPACES " \n\t\r"
+
+/* Idle persistent connections shared by all HTTP contexts */
+#define POOL_SIZE         16
+#define POOL_IDLE_TIMEOUT (30 * 1000000)
+#define POOL_MAX_DRAIN    (64 * 1024)
 typedef enum {
     LOWER_PROTO,
     READ_HEADERS,
@@ -68,6 +74,9 @@ typedef struct HTTPContext {
     uint64_t chunksize;
     int chunkend;
     uint64_t off, end_off, filesize;
+    /* Length and end offset of the body of the current response. */
+    uint64_t content_length, response_end;
+    int64_t request_size;
     char *location;
     HTTPAuthState auth_state;
     HTTPAuthState proxy_auth_state;
@@ -75,6 +84,8 @@ typedef struct HTTPContext {
     char *headers;
     char *mime_type;
     char *http_version;
+    char *etag;
+    char *last_modified;
     char *user_agent;
     char *referer;
 #if FF_API_HTTP_USER_AGENT
@@ -148,6 +159,8 @@ static const AVOption options[] = {
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the entity tag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the last modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
     { "icy_metadata_headers", "return ICY metadata headers", OFFSET(icy_metadata_headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT },
@@ -160,6 +173,7 @@ static const AVOption options[] = {
     { "location", "The actual location of the data received", OFFSET(location), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D | E },
     { "offset", "initial byte offset", OFFSET(off), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     { "end_offset", "try to limit the request to bytes preceding this offset", OFFSET(end_off), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
+    { "request_size", "request the resource in ranges of this size, 0 for a single request", OFFSET(request_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     { "method", "Override the HTTP method or set the expected HTTP method from a client", OFFSET(method), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D | E },
     { "reconnect", "auto reconnect after disconnect before EOF", OFFSET(reconnect), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
     { "reconnect_at_eof", "auto reconnect at EOF", OFFSET(reconnect_at_eof), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
@@ -176,6 +190,179 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *proxyauth, int *new_location);
 static int http_read_header(URLContext *h, int *new_location);
 static int http_shutdown(URLContext *h, int flags);
+static int http_buf_read(URLContext *h, uint8_t *buf, int size);
+
+/**
+ * State attached to a persistent connection, which outlives the context
+ * that opened it. The lower protocol contexts are opened with an interrupt
+ * callback forwarding to the current user of the connection.
+ */
+typedef struct HTTPConnection {
+    AVIOInterruptCB interrupt_callback;
+    char *key;                  ///< lower protocol URL and options
+} HTTPConnection;
+
+typedef struct HTTPPoolEntry {
+    URLContext *hd;
+    int64_t idle_since;
+} HTTPPoolEntry;
+
+static AVMutex pool_mutex = AV_MUTEX_INITIALIZER;
+static HTTPPoolEntry pool[POOL_SIZE];
+static int nb_pool;
+
+static int connection_interrupt_cb(void *opaque)
+{
+    HTTPConnection *conn = opaque;
+    return ff_check_interrupt(&conn->interrupt_callback);
+}
+
+static HTTPConnection *get_connection(URLContext *hd)
+{
+    if (hd && hd->interrupt_callback.callback == connection_interrupt_cb)
+        return hd->interrupt_callback.opaque;
+    return NULL;
+}
+
+static void close_cnx(URLContext **hd)
+{
+    HTTPConnection *conn = get_connection(*hd);
+
+    ffurl_closep(hd);
+    if (conn)
+        av_free(conn->key);
+    av_free(conn);
+}
+
+/**
+ * Build the pool key of a connection from the lower protocol URL and the
+ * options it is opened with, so that connections opened with different
+ * settings, e.g. TLS certificates or verification, are never shared.
+ */
+static char *connection_key(const char *url, AVDictionary *options)
+{
+    char *opts = NULL, *key;
+
+    if (av_dict_get_string(options, &opts, '=', ',') < 0)
+        return NULL;
+    key = av_asprintf("%s %s", url, opts);
+    av_free(opts);
+    return key;
+}
+
+/**
+ * Take an idle connection to the given lower protocol URL from the pool.
+ */
+static URLContext *pool_get(URLContext *h, const char *key)
+{
+    URLContext *hd = NULL, *expired[POOL_SIZE];
+    int64_t now = av_gettime_relative();
+    int i, nb_expired = 0;
+
+    ff_mutex_lock(&pool_mutex);
+    for (i = nb_pool - 1; i >= 0; i--) {
+        URLContext *cur = pool[i].hd;
+        if (now - pool[i].idle_since > POOL_IDLE_TIMEOUT)
+            expired[nb_expired++] = cur;
+        else if (!hd && !strcmp(get_connection(cur)->key, key))
+            hd = cur;
+        else
+            continue;
+        pool[i] = pool[--nb_pool];
+    }
+    ff_mutex_unlock(&pool_mutex);
+
+    for (i = 0; i < nb_expired; i++)
+        close_cnx(&expired[i]);
+
+    if (hd) {
+        get_connection(hd)->interrupt_callback = h->interrupt_callback;
+        av_log(h, AV_LOG_DEBUG, "Reusing connection to %s\n", key);
+    }
+    return hd;
+}
+
+static void pool_put(URLContext *hd)
+{
+    URLContext *evicted = NULL;
+    int i, oldest = 0;
+
+    get_connection(hd)->interrupt_callback = (AVIOInterruptCB){ NULL, NULL };
+
+    ff_mutex_lock(&pool_mutex);
+    if (nb_pool == POOL_SIZE) {
+        for (i = 1; i < nb_pool; i++)
+            if (pool[i].idle_since < pool[oldest].idle_since)
+                oldest = i;
+        evicted = pool[oldest].hd;
+        pool[oldest] = pool[--nb_pool];
+    }
+    pool[nb_pool].hd         = hd;
+    pool[nb_pool].idle_since = av_gettime_relative();
+    nb_pool++;
+    ff_mutex_unlock(&pool_mutex);
+
+    if (evicted)
+        close_cnx(&evicted);
+}
+
+void ff_http_deinit(void)
+{
+    URLContext *idle[POOL_SIZE];
+    int i, nb_idle;
+
+    ff_mutex_lock(&pool_mutex);
+    nb_idle = nb_pool;
+    for (i = 0; i < nb_pool; i++)
+        idle[i] = pool[i].hd;
+    nb_pool = 0;
+    ff_mutex_unlock(&pool_mutex);
+
+    for (i = 0; i < nb_idle; i++)
+        close_cnx(&idle[i]);
+}
+
+/**
+ * Return the connection to the pool if the current response has been
+ * received completely.
+ *
+ * @param drain if set, a small remainder of the response is read and
+ *              discarded first; otherwise the connection is only released
+ *              if nothing is left to read
+ * @return 1 if the connection was returned to the pool, 0 otherwise
+ */
+static int release_cnx(URLContext *h, int drain)
+{
+    HTTPContext *s = h->priv_data;
+
+    if (!get_connection(s->hd) || s->willclose || !s->end_header ||
+        (h->flags & AVIO_FLAG_WRITE) || s->post_data || s->listen ||
+        (s->method && strcmp(s->method, "GET")) ||
+        !s->http_version || strcmp(s->http_version, "1.1"))
+        return 0;
+
+    if (s->chunksize != UINT64_MAX) {
+        if (!s->chunkend)
+            return 0;
+    } else {
+        uint8_t buf[4096];
+
+        if (s->response_end == UINT64_MAX || s->off > s->response_end ||
+            s->response_end - s->off > (drain ? POOL_MAX_DRAIN : 0))
+            return 0;
+        while (s->off < s->response_end) {
+            int ret = http_buf_read(h, buf, FFMIN(sizeof(buf), s->response_end - s->off));
+            if (ret <= 0)
+                return 0;
+        }
+    }
+    if (s->buf_ptr != s->buf_end)
+        return 0;
+
+    pool_put(s->hd);
+    s->hd = NULL;
+    return 1;
+}
 
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
@@ -194,8 +381,9 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char auth[1024], proxyauth[1024] = "";
     char path1[MAX_URL_SIZE];
     char buf[1024], urlbuf[MAX_URL_SIZE];
-    int port, use_proxy, err, location_changed = 0;
+    int port, use_proxy, err, location_changed = 0, reused = 0;
     HTTPContext *s = h->priv_data;
+    char *key = NULL;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
                  hostname, sizeof(hostname), &port,
@@ -232,16 +420,51 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
-    if (!s->hd) {
-        err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
-                                   &h->interrupt_callback, options,
-                                   h->protocol_whitelist, h->protocol_blacklist, h);
-        if (err < 0)
-            return err;
+    if (!s->hd && s->multiple_requests) {
+        key = connection_key(buf, *options);
+        if (!key)
+            return AVERROR(ENOMEM);
+        reused = !!(s->hd = pool_get(h, key));
     }
 
-    err = http_connect(h, path, local_path, hoststr,
-                       auth, proxyauth, &location_changed);
+    for (;;) {
+        if (!s->hd) {
+            HTTPConnection *conn = NULL;
+            AVIOInterruptCB int_cb = h->interrupt_callback;
+
+            if (key) {
+                conn = av_mallocz(sizeof(*conn));
+                if (!conn) {
+                    av_free(key);
+                    return AVERROR(ENOMEM);
+                }
+                conn->interrupt_callback = h->interrupt_callback;
+                conn->key = key;
+                key = NULL;
+                int_cb = (AVIOInterruptCB){ connection_interrupt_cb, conn };
+            }
+            err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
+                                       &int_cb, options,
+                                       h->protocol_whitelist, h->protocol_blacklist, h);
+            if (err < 0) {
+                if (conn)
+                    av_free(conn->key);
+                av_free(conn);
+                return err;
+            }
+        }
+
+        err = http_connect(h, path, local_path, hoststr,
+                           auth, proxyauth, &location_changed);
+        /* the server may have closed the idle connection in the meantime */
+        if (err < 0 && reused && !s->end_header) {
+            close_cnx(&s->hd);
+            reused = 0;
+            continue;
+        }
+        break;
+    }
+    av_free(key);
     if (err < 0)
         return err;
 
@@ -268,7 +491,7 @@ redo:
     if (s->http_code == 401) {
         if ((cur_auth_type == HTTP_AUTH_NONE || s->auth_state.stale) &&
             s->auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_closep(&s->hd);
+            close_cnx(&s->hd);
             goto redo;
         } else
             goto fail;
@@ -276,7 +499,7 @@ redo:
     if (s->http_code == 407) {
         if ((cur_proxy_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
             s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_closep(&s->hd);
+            close_cnx(&s->hd);
             goto redo;
         } else
             goto fail;
@@ -285,7 +508,7 @@ redo:
          s->http_code == 303 || s->http_code == 307) &&
         location_changed == 1) {
         /* url moved, get next */
-        ffurl_closep(&s->hd);
+        close_cnx(&s->hd);
         if (redirects++ >= MAX_REDIRECTS)
             return AVERROR(EIO);
         /* Restart the authentication process with the new target, which
@@ -299,7 +522,7 @@ redo:
 
 fail:
     if (s->hd)
-        ffurl_closep(&s->hd);
+        close_cnx(&s->hd);
     if (location_changed < 0)
         return location_changed;
     return ff_http_averror(s->http_code, AVERROR(EIO));
@@ -992,9 +1215,10 @@ static int process_line(URLContext *h, char *line, int line_count,
             if ((ret = parse_location(s, p)) < 0)
                 return ret;
             *new_location = 1;
-        } else if (!av_strcasecmp(tag, "Content-Length") &&
-                   s->filesize == UINT64_MAX) {
-            s->filesize = strtoull(p, NULL, 10);
+        } else if (!av_strcasecmp(tag, "Content-Length")) {
+            s->content_length = strtoull(p, NULL, 10);
+            if (s->filesize == UINT64_MAX)
+                s->filesize = s->content_length;
         } else if (!av_strcasecmp(tag, "Content-Range")) {
             parse_content_range(h, p);
         } else if (!av_strcasecmp(tag, "Accept-Ranges") &&
@@ -1023,6 +1247,12 @@ static int process_line(URLContext *h, char *line, int line_count,
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1143,7 +1373,8 @@ static int http_read_header(URLContext *h, int *new_location)
     char line[MAX_URL_SIZE];
     int err = 0;
 
-    s->chunksize = UINT64_MAX;
+    s->chunksize      = UINT64_MAX;
+    s->content_length = UINT64_MAX;
 
     for (;;) {
         if ((err = http_get_line(s, line, sizeof(line))) < 0)
@@ -1162,6 +1393,11 @@ static int http_read_header(URLContext *h, int *new_location)
     if (s->seekable == -1 && s->is_mediagateway && s->filesize == 2000000000)
         h->is_streamed = 1; /* we can in fact _not_ seek */
 
+    if (s->chunksize == UINT64_MAX && s->content_length != UINT64_MAX)
+        s->response_end = s->off + s->content_length;
+    else
+        s->response_end = UINT64_MAX;
+
     // add any new cookies into the existing cookie string
     cookie_string(s->cookie_dict, &s->cookies);
     av_dict_free(&s->cookie_dict);
@@ -1240,12 +1476,16 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
     // Note: we send this on purpose even when s->off is 0 when we're probing,
     // since it allows us to detect more reliably if a (non-conforming)
     // server supports seeking by analysing the reply headers.
-    if (!has_header(s->headers, "\r\nRange: ") && !post && (s->off > 0 || s->end_off || s->seekable == -1)) {
+    if (!has_header(s->headers, "\r\nRange: ") && !post &&
+        (s->off > 0 || s->end_off || s->seekable == -1 || s->request_size)) {
+        uint64_t end_off = s->end_off;
+        if (s->request_size && (!end_off || end_off - s->off > s->request_size))
+            end_off = s->off + s->request_size;
         len += av_strlcatf(headers + len, sizeof(headers) - len,
                            "Range: bytes=%"PRIu64"-", s->off);
-        if (s->end_off)
+        if (end_off)
             len += av_strlcatf(headers + len, sizeof(headers) - len,
-                               "%"PRId64, s->end_off - 1);
+                               "%"PRId64, end_off - 1);
         len += av_strlcpy(headers + len, "\r\n",
                           sizeof(headers) - len);
     }
@@ -1387,7 +1627,7 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
             }
             else if (!s->chunksize) {
                 av_log(h, AV_LOG_DEBUG, "Last chunk received, closing conn\n");
-                ffurl_closep(&s->hd);
+                close_cnx(&s->hd);
                 return 0;
             }
             else if (s->chunksize == UINT64_MAX) {
@@ -1480,6 +1720,14 @@ static int http_read_stream(URLContext *h, uint8_t *buf, int size)
             return err;
     }
 
+    /* request the next range once the current one has been read */
+    if (s->request_size && s->off >= s->response_end &&
+        s->off < (s->end_off ? s->end_off : s->filesize)) {
+        seek_ret = http_seek_internal(h, s->off, SEEK_SET, 1);
+        if (seek_ret < 0)
+            return seek_ret;
+    }
+
 #if CONFIG_ZLIB
     if (s->compressed)
         return http_buf_read_compressed(h, buf, size);
@@ -1684,8 +1932,8 @@ static int http_close(URLContext *h)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
-    if (s->hd)
-        ffurl_closep(&s->hd);
+    if (s->hd && !release_cnx(h, 1))
+        close_cnx(&s->hd);
     av_dict_free(&s->chained_options);
     return ret;
 }
@@ -1695,6 +1943,8 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
     HTTPContext *s = h->priv_data;
     URLContext *old_hd = s->hd;
     uint64_t old_off = s->off;
+    uint64_t old_chunksize = s->chunksize, old_response_end = s->response_end;
+    int old_chunkend = s->chunkend, old_willclose = s->willclose;
     uint8_t old_buf[BUFFER_SIZE];
     int old_buf_size, ret;
     AVDictionary *options = NULL;
@@ -1724,10 +1974,21 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
     /* do not try to make a new connection if seeking past the end of the file */
     if (s->end_off || s->filesize != UINT64_MAX) {
         uint64_t end_pos = s->end_off ? s->end_off : s->filesize;
-        if (s->off >= end_pos)
+        if (s->off >= end_pos) {
+            /* data buffered at the old position is not valid anymore */
+            s->buf_ptr = s->buf_end;
             return s->off;
+        }
     }
 
+    /* Reuse the connection for the new request if nothing is left to read
+     * from it. Otherwise it is kept untouched, so that reading can go on
+     * from the old position if the new request fails. */
+    s->off = old_off;
+    if (release_cnx(h, 0))
+        old_hd = NULL;
+    s->off = off;
+
     /* we save the old context in case the seek fails */
     old_buf_size = s->buf_end - s->buf_ptr;
     memcpy(old_buf, s->buf_ptr, old_buf_size);
@@ -1739,12 +2000,17 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         memcpy(s->buffer, old_buf, old_buf_size);
         s->buf_ptr = s->buffer;
         s->buf_end = s->buffer + old_buf_size;
-        s->hd      = old_hd;
-        s->off     = old_off;
+        s->hd           = old_hd;
+        s->off          = old_off;
+        s->chunksize    = old_chunksize;
+        s->chunkend     = old_chunkend;
+        s->response_end = old_response_end;
+        s->willclose    = old_willclose;
         return ret;
     }
     av_dict_free(&options);
-    ffurl_close(old_hd);
+    if (old_hd)
+        close_cnx(&old_hd);
     return off;
 }
 
@@ -71,4 +71,9 @@ int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **optio
 
 int ff_http_averror(int status_code, int default_averror);
 
+/**
+ * Close the idle persistent connections kept for reuse by later requests.
+ */
+void ff_http_deinit(void);
+
 #endif /* AVFORMAT_HTTP_H */
@@ -76,6 +76,13 @@ struct AVFormatInternal {
     struct AVPacketList *packet_buffer;
     struct AVPacketList *packet_buffer_end;
 
+    /**
+     * Unused packet_buffer entries, recycled by the interleaving code to
+     * avoid an allocation per packet.
+     * Muxing only.
+     */
+    struct AVPacketList *packet_buffer_free;
+
     /* av_seek_frame() support */
     int64_t data_offset; /**< offset of the first packet */
 
@@ -190,6 +197,23 @@ struct AVStreamInternal {
     int need_context_update;
 
     FFFrac *priv_pts;
+
+    /**
+     * Parser used to read codec headers in fast probe mode, if the stream
+     * is not parsed while demuxing.
+     */
+    struct AVCodecParserContext *probe_parser;
+
+    /**
+     * Mask of the AVStreamParam guessed in fast probe mode.
+     */
+    int probe_guessed;
+
+    /**
+     * How the codec parameters were found by avformat_find_stream_info(),
+     * indexed by enum AVStreamParam.
+     */
+    uint8_t probe_confidence[AV_STREAM_PARAM_NB];
 };
 
 #ifdef __GNUC__
@@ -397,6 +421,18 @@ int ff_add_index_entry(AVIndexEntry **index_entries,
 
 void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance);
 
+/**
+ * Check whether the buffers of s->pb are configured for the way the streams
+ * are interleaved, which is only done for network protocols.
+ */
+int ff_need_configure_buffers(AVFormatContext *s);
+
+/**
+ * Configure the buffers of s->pb for streams whose packets with close
+ * timestamps are up to pos_delta bytes apart, and packets of up to skip bytes.
+ */
+void ff_configure_buffers(AVFormatContext *s, int64_t pos_delta, int64_t skip);
+
 /**
  * Add a new chapter.
  *
@@ -658,6 +694,12 @@ int ff_format_output_open(AVFormatContext *s, const char *url, AVDictionary **op
  */
 void ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether the context opens and closes resources with the default
+ * callbacks, i.e. directly through the protocols.
+ */
+int ff_format_io_is_default(AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
@@ -154,6 +154,44 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Position reached in the sample tables while building the index, so that
+ * the index can be built incrementally.
+ */
+typedef struct MOVIndexState {
+    int incremental;            ///< index entries are added on demand
+    int done;                   ///< all samples have been added to the index
+    unsigned int chunk;
+    unsigned int chunk_sample;
+    unsigned int sample;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stsc_index;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int distance;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    int64_t offset;
+    int64_t dts;
+    int64_t last_dts;
+    int64_t dts_correction;
+    uint64_t stream_size;
+    int stsz_sample_size;
+    /* edit list applied while building the index, see mov_init_lazy_edit() */
+    int edit;
+    unsigned int nb_entries;    ///< index entries read, including the ones dropped
+    unsigned int edit_skip;     ///< number of index entries dropped before the edit
+    int64_t edit_media_time;
+    int64_t edit_duration;
+    int64_t edit_end;
+    int64_t edit_ts_offset;     ///< added to the timestamps of the index entries
+    unsigned int ctts_index;
+    unsigned int ctts_sample;
+    int edit_keyframe_found;    ///< a keyframe was found past the end of the edit
+    int edit_done;              ///< no more index entries after the end of the edit
+} MOVIndexState;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -192,6 +230,8 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVIndexState index_state;
+    MOVIndexState index_start;  ///< index_state before the first index entry
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -266,6 +306,7 @@ typedef struct MOVContext {
     int use_absolute_path;
     int ignore_editlist;
     int advanced_editlist;
+    int lazy_index;
     int ignore_chapters;
     int seek_individually;
     int64_t next_root_atom; ///< offset of the next root atom
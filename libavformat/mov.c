@@ -3339,15 +3339,243 @@ static int64_t add_ctts_entry(MOVStts** ctts_data, unsigned int* ctts_count, uns
     return *ctts_count;
 }
 
+/**
+ * Read the next sample of the sample tables of a track, starting where the
+ * previous call stopped.
+ *
+ * @param is    position in the sample tables
+ * @param quiet do not log, for scanning the tables again
+ * @return 1 if e was set, 0 if the sample belongs to another sample
+ *         description, AVERROR_EOF after the last sample, another negative
+ *         AVERROR if the sample tables are invalid
+ */
+static int mov_index_next_sample(MOVContext *mov, AVStream *st, MOVIndexState *is,
+                                 AVIndexEntry *e, int quiet)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int sample_size;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+    int keyframe = 0, duration, ret = 0;
+
+    for (;;) {
+        if (is->chunk >= sc->chunk_count)
+            return AVERROR_EOF;
+        if (!is->chunk_sample) {
+            int64_t next_offset = is->chunk + 1 < sc->chunk_count ? sc->chunk_offsets[is->chunk + 1] : INT64_MAX;
+            is->offset = sc->chunk_offsets[is->chunk];
+            while (mov_stsc_index_valid(is->stsc_index, sc->stsc_count) &&
+                is->chunk + 1 == sc->stsc_data[is->stsc_index + 1].first)
+                is->stsc_index++;
+
+            if (next_offset > is->offset && sc->sample_size>0 && sc->sample_size < is->stsz_sample_size &&
+                sc->stsc_data[is->stsc_index].count * (int64_t)is->stsz_sample_size > next_offset - is->offset) {
+                if (!quiet)
+                    av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", is->stsz_sample_size);
+                is->stsz_sample_size = sc->sample_size;
+            }
+            if (is->stsz_sample_size>0 && is->stsz_sample_size < sc->sample_size) {
+                if (!quiet)
+                    av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", is->stsz_sample_size);
+                is->stsz_sample_size = sc->sample_size;
+            }
+        }
+        if (is->chunk_sample < sc->stsc_data[is->stsc_index].count)
+            break;
+        is->chunk++;
+        is->chunk_sample = 0;
+    }
+
+    if (is->sample >= sc->sample_count) {
+        if (!quiet)
+            av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (!sc->keyframe_absent && (!sc->keyframe_count || is->sample+key_off == sc->keyframes[is->stss_index])) {
+        keyframe = 1;
+        if (is->stss_index + 1 < sc->keyframe_count)
+            is->stss_index++;
+    } else if (sc->stps_count && is->sample+key_off == sc->stps_data[is->stps_index]) {
+        keyframe = 1;
+        if (is->stps_index + 1 < sc->stps_count)
+            is->stps_index++;
+    }
+    if (rap_group_present && is->rap_group_index < sc->rap_group_count) {
+        if (sc->rap_group[is->rap_group_index].index > 0)
+            keyframe = 1;
+        if (++is->rap_group_sample == sc->rap_group[is->rap_group_index].count) {
+            is->rap_group_sample = 0;
+            is->rap_group_index++;
+        }
+    }
+    if (sc->keyframe_absent
+        && !sc->stps_count
+        && !rap_group_present
+        && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (is->chunk==0 && is->chunk_sample==0)))
+         keyframe = 1;
+    if (keyframe)
+        is->distance = 0;
+    sample_size = is->stsz_sample_size > 0 ? is->stsz_sample_size : sc->sample_sizes[is->sample];
+    if (sc->pseudo_stream_id == -1 ||
+       sc->stsc_data[is->stsc_index].id - 1 == sc->pseudo_stream_id) {
+        if (sample_size > 0x3FFFFFFF) {
+            if (!quiet)
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+            return AVERROR_INVALIDDATA;
+        }
+        e->pos = is->offset;
+        e->timestamp = is->dts;
+        e->size = sample_size;
+        e->min_distance = is->distance;
+        e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+        if (!quiet)
+            av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                    "size %u, distance %u, keyframe %d\n", st->index, is->sample,
+                    is->offset, is->dts, sample_size, is->distance, keyframe);
+        ret = 1;
+    }
+
+    is->offset += sample_size;
+    is->stream_size += sample_size;
+
+    /* A negative sample duration is invalid based on the spec,
+     * but some samples need it to correct the DTS. The correction is
+     * applied once per stts entry, whose next samples last 1. */
+    duration = sc->stts_data[is->stts_index].duration;
+    if (duration < 0) {
+        if (!is->stts_sample) {
+            if (!quiet)
+                av_log(mov->fc, AV_LOG_WARNING,
+                       "Invalid SampleDelta %d in STTS, at %d st:%d\n",
+                       duration, is->stts_index, st->index);
+            is->dts_correction += duration - 1;
+        }
+        duration = 1;
+    }
+    is->dts += duration;
+    if (!is->dts_correction || is->dts + is->dts_correction > is->last_dts) {
+        is->dts += is->dts_correction;
+        is->dts_correction = 0;
+    } else {
+        /* Avoid creating non-monotonous DTS */
+        is->dts_correction += is->dts - is->last_dts - 1;
+        is->dts = is->last_dts + 1;
+    }
+    is->last_dts = is->dts;
+    is->distance++;
+    is->stts_sample++;
+    is->sample++;
+    is->chunk_sample++;
+    if (is->stts_index + 1 < sc->stts_count && is->stts_sample == sc->stts_data[is->stts_index].count) {
+        is->stts_sample = 0;
+        is->stts_index++;
+    }
+    return ret;
+}
+
+/**
+ * Read the next index entry of a track, with its edit list applied if it is
+ * applied while building the index.
+ *
+ * @return 1 if e was set, AVERROR_EOF after the last entry, another negative
+ *         AVERROR if the sample tables are invalid
+ */
+static int mov_index_next_entry(MOVContext *mov, AVStream *st, MOVIndexState *is,
+                                AVIndexEntry *e, int quiet)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int audio = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+    int64_t cts, frame_duration;
+    int ret;
+
+    for (;;) {
+        if (is->edit_done)
+            return AVERROR_EOF;
+        ret = mov_index_next_sample(mov, st, is, e, quiet);
+        if (ret < 0)
+            return ret;
+        if (!ret)
+            continue;
+        if (!is->edit)
+            return 1;
+        if (is->nb_entries++ >= is->edit_skip)
+            break;
+    }
+
+    /* what mov_fix_index() does with the entries of a single edit */
+    frame_duration = is->sample < sc->sample_count ? is->dts - e->timestamp :
+                                                     is->edit_duration;
+    cts = e->timestamp + sc->dts_shift;
+    if (sc->ctts_data && is->ctts_index < sc->ctts_count) {
+        cts += sc->ctts_data[is->ctts_index].duration;
+        if (++is->ctts_sample == sc->ctts_data[is->ctts_index].count) {
+            is->ctts_index++;
+            is->ctts_sample = 0;
+        }
+    }
+    if ((cts < is->edit_media_time || cts >= is->edit_end) &&
+        !(audio && st->codecpar->codec_id != AV_CODEC_ID_VORBIS &&
+          cts < is->edit_media_time && cts + frame_duration > is->edit_media_time))
+        e->flags |= AVINDEX_DISCARD_FRAME;
+    e->timestamp += is->edit_ts_offset;
+
+    /* the entries stop at the first keyframe past the end of the edit, or at
+     * the second one for video with composition offsets */
+    if (cts + frame_duration >= is->edit_end &&
+        (e->flags & AVINDEX_KEYFRAME || audio)) {
+        if (sc->ctts_data && !audio && !is->edit_keyframe_found)
+            is->edit_keyframe_found = 1;
+        else
+            is->edit_done = 1;
+    }
+    return 1;
+}
+
+/**
+ * Sequential access to the index entries of a track, including the ones not
+ * added yet to an index built incrementally.
+ */
+typedef struct MOVIndexCursor {
+    AVStream *st;
+    MOVIndexState scan;
+    int index;
+    AVIndexEntry entry;
+} MOVIndexCursor;
+
+static void mov_index_cursor_init(MOVIndexCursor *c, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    c->st    = st;
+    c->scan  = sc->index_start;
+    c->index = 0;
+}
+
+/**
+ * @return 1 if c->entry was set to the next index entry, 0 after the last one
+ */
+static int mov_index_cursor_next(MOVContext *mov, MOVIndexCursor *c)
+{
+    MOVStreamContext *sc = c->st->priv_data;
+
+    if (sc->index_state.incremental)
+        return mov_index_next_entry(mov, c->st, &c->scan, &c->entry, 1) > 0;
+    if (c->index >= c->st->nb_index_entries)
+        return 0;
+    c->entry = c->st->index_entries[c->index++];
+    return 1;
+}
+
 #define MAX_REORDER_DELAY 16
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st) {
     MOVStreamContext *msc = st->priv_data;
-    int ind;
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
     int buf_start = 0;
     int j, r, num_swaps;
+    MOVIndexCursor cur;
 
     for (j = 0; j < MAX_REORDER_DELAY + 1; j++)
         pts_buf[j] = INT64_MIN;
@@ -3355,14 +3583,15 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st) {
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for(ind = 0; ind < st->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        mov_index_cursor_init(&cur, st);
+        while (ctts_ind < msc->ctts_count && mov_index_cursor_next(c, &cur)) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = st->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = cur.entry.timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -3751,19 +3980,273 @@ static void mov_fix_index(MOVContext *mov, AVStream *st)
     msc->current_index = msc->index_ranges[0].start;
 }
 
+/**
+ * Expand ctts entries such that we have a 1-1 mapping with samples.
+ */
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVStts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i, j;
+
+    if (!ctts_data_old)
+        return 0;
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR_INVALIDDATA;
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+    return 0;
+}
+
+/* number of index entries added at once to incrementally built indexes */
+#define MOV_INDEX_BATCH_SIZE 1024
+
+/**
+ * Add index entries for the next samples of the sample tables, starting
+ * where the previous call stopped.
+ *
+ * @param nb_entries maximum number of index entries to add
+ * @return 0 on success, negative AVERROR if the sample tables are invalid
+ */
+static int mov_build_index_entries(MOVContext *mov, AVStream *st, unsigned int nb_entries)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVIndexState *is = &sc->index_state;
+    AVIndexEntry *entries;
+    unsigned int end;
+    int ret = 0;
+
+    if (is->done)
+        return 0;
+
+    end = st->nb_index_entries + FFMIN(nb_entries, sc->sample_count - is->sample);
+    entries = av_fast_realloc(st->index_entries,
+                              &st->index_entries_allocated_size,
+                              end * sizeof(*st->index_entries));
+    if (!entries) {
+        is->done = 1;
+        return AVERROR(ENOMEM);
+    }
+    st->index_entries = entries;
+
+    while (st->nb_index_entries < end) {
+        AVIndexEntry *e = &st->index_entries[st->nb_index_entries];
+        if ((ret = mov_index_next_entry(mov, st, is, e, 0)) < 0)
+            break;
+        st->nb_index_entries++;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && st->nb_index_entries < 100)
+            ff_rfps_add_frame(mov->fc, st, e->timestamp);
+    }
+    sc->stsz_sample_size = is->stsz_sample_size;
+    if (ret < 0 || is->edit_done || is->sample >= sc->sample_count)
+        is->done = 1;
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+/**
+ * Add the index entries of a track indexed incrementally that have not been
+ * added yet, for code that needs the complete index.
+ *
+ * @return 0 on success, negative AVERROR if the sample tables are invalid
+ */
+static int mov_finish_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int ret;
+
+    if (!sc->index_state.incremental)
+        return 0;
+
+    ret = mov_build_index_entries(mov, st, sc->sample_count);
+    sc->index_state.incremental = 0;
+
+    if (sc->ctts_data && mov_expand_ctts(sc) >= 0) {
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stps_data);
+    av_freep(&sc->rap_group);
+    return ret;
+}
+
+/**
+ * Prepare applying the edit list of a track while its index is built
+ * incrementally, so that the index is the one mov_fix_index() makes out of
+ * the complete index. This is done for edit lists with a single edit, after
+ * any empty ones, whose start is found in the first index entries.
+ *
+ * @return 1 if the edit list is applied while building the index, 0 if the
+ *         complete index has to be built and fixed instead
+ */
+static int mov_init_lazy_edit(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVIndexState *is = &sc->index_state;
+    MOVIndexState scan = *is;
+    AVIndexEntry *head = NULL, e;
+    unsigned int nb_head = 0, head_size = 0;
+    int audio = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+    int skip_audio = audio && st->codecpar->codec_id != AV_CODEC_ID_VORBIS;
+    int64_t media_time = -1, duration = 0, empty_duration = 0, edit_start;
+    int64_t search_timestamp, index, ctts_index = 0, ctts_sample = 0;
+    int64_t skip_samples = 0, packet_skip_samples = 0, min_pts = -1;
+    int64_t ts_offset, end, cts, first = -1, i;
+    int64_t ci, cs;
+    unsigned int edit;
+    int ret = 0;
+
+    for (edit = 0; get_edit_list_entry(mov, sc, edit, &media_time, &duration,
+                                       mov->time_scale); edit++) {
+        if (media_time != -1)
+            break;
+        empty_duration += duration;
+    }
+    if (edit + 1 != sc->elst_count || media_time < 0)
+        return 0;
+    end = media_time + duration;
+
+    /* index the samples up to a while after the start of the edit */
+    while ((ret = mov_index_next_entry(mov, st, &scan, &e, 1)) >= 0) {
+        AVIndexEntry *entries = av_fast_realloc(head, &head_size,
+                                                (nb_head + 1) * sizeof(*head));
+        if (!entries)
+            goto end;
+        head = entries;
+        head[nb_head++] = e;
+        if (nb_head >= MOV_INDEX_BATCH_SIZE &&
+            e.timestamp > media_time + sc->time_scale)
+            break;
+    }
+    /* short tracks are indexed completely anyway */
+    if (ret < 0)
+        goto end;
+
+    search_timestamp = media_time;
+    if (audio)
+        search_timestamp = FFMAX(search_timestamp - sc->time_scale, head[0].timestamp);
+    if (find_prev_closest_index(st, head, nb_head, sc->ctts_data, sc->ctts_count,
+                                search_timestamp, 0, &index, &ctts_index, &ctts_sample) < 0 &&
+        find_prev_closest_index(st, head, nb_head, sc->ctts_data, sc->ctts_count,
+                                search_timestamp, AVSEEK_FLAG_ANY, &index, &ctts_index, &ctts_sample) < 0) {
+        index       = 0;
+        ctts_index  = 0;
+        ctts_sample = 0;
+    }
+
+    /* find the first entry of the edit, its timestamp gives the offset of all
+     * the timestamps, and the amount of audio to skip before it */
+    edit_start = empty_duration - FFMAX(sc->dts_shift, 0);
+    ts_offset  = 0;
+    ci = ctts_index;
+    cs = ctts_sample;
+    for (i = index; i + 1 < nb_head; i++) {
+        int64_t frame_duration = head[i + 1].timestamp - head[i].timestamp;
+        int64_t ctts = 0;
+
+        if (sc->ctts_data && ci < sc->ctts_count) {
+            ctts = sc->ctts_data[ci].duration;
+            if (++cs == sc->ctts_data[ci].count) {
+                ci++;
+                cs = 0;
+            }
+        }
+        cts = head[i].timestamp + sc->dts_shift + ctts;
+
+        if (first < 0) {
+            if (cts >= media_time && cts < end) {
+                first = i;
+            } else if (skip_audio && cts < media_time && cts + frame_duration > media_time) {
+                packet_skip_samples = media_time - cts;
+                skip_samples += packet_skip_samples;
+                first = i;
+            } else {
+                if (skip_audio)
+                    skip_samples += frame_duration;
+                continue;
+            }
+            ts_offset = edit_start - packet_skip_samples - head[first].timestamp;
+        }
+        /* the end of the edit must be past the first entries */
+        if (cts + frame_duration >= end)
+            goto end;
+        if (cts >= media_time && cts < end) {
+            int64_t pts = head[i].timestamp + ts_offset + ctts + sc->dts_shift;
+            min_pts = min_pts < 0 ? pts : FFMIN(min_pts, pts);
+        }
+    }
+    if (first < 0)
+        goto end;
+
+    min_pts -= empty_duration;
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && min_pts > 0)
+        ts_offset -= min_pts;
+
+    sc->index_ranges = av_malloc(2 * sizeof(*sc->index_ranges));
+    if (!sc->index_ranges)
+        goto end;
+    sc->index_ranges[0].start = index;
+    sc->index_ranges[0].end   = index + sc->sample_count;
+    sc->index_ranges[1].start = 0;
+    sc->index_ranges[1].end   = 0;
+    sc->current_index_range   = sc->index_ranges;
+    sc->current_index         = index;
+
+    /* the composition offsets of the dropped entries are dropped as well */
+    if (sc->ctts_data && ctts_index < sc->ctts_count) {
+        sc->ctts_count -= ctts_index;
+        memmove(sc->ctts_data, sc->ctts_data + ctts_index,
+                sc->ctts_count * sizeof(*sc->ctts_data));
+        sc->ctts_data[0].count -= ctts_sample;
+    }
+
+    if (audio)
+        st->skip_samples = skip_samples;
+    sc->start_pad         = st->skip_samples;
+    sc->min_corrected_pts = min_pts;
+    st->start_time        = empty_duration;
+
+    is->edit            = 1;
+    is->edit_skip       = index;
+    is->edit_media_time = media_time;
+    is->edit_duration   = duration;
+    is->edit_end        = end;
+    is->edit_ts_offset  = ts_offset;
+    ret = 1;
+
+end:
+    av_free(head);
+    return ret > 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     int64_t current_offset;
     int64_t current_dts = 0;
-    unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
-    unsigned int stss_index = 0;
-    unsigned int stps_index = 0;
-    unsigned int i, j;
-    uint64_t stream_size = 0;
-    MOVStts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i;
 
     if (sc->elst_count) {
         int i, edit_start_index = 0, multiple_edits = 0;
@@ -3807,160 +4290,44 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int64_t last_dts = 0;
-        int64_t dts_correction = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        MOVIndexState *is = &sc->index_state;
 
         current_dts -= sc->dts_shift;
-        last_dts     = current_dts;
 
         if (!sc->sample_count || st->nb_index_entries)
             return;
         if (sc->sample_count >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
             return;
-        if (av_reallocp_array(&st->index_entries,
-                              st->nb_index_entries + sc->sample_count,
-                              sizeof(*st->index_entries)) < 0) {
-            st->nb_index_entries = 0;
-            return;
-        }
-        st->index_entries_allocated_size = (st->nb_index_entries + sc->sample_count) * sizeof(*st->index_entries);
-
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
-                return;
-            }
-
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
-        }
-
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
 
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
+        is->dts      = current_dts;
+        is->last_dts = current_dts;
+        is->stsz_sample_size = sc->stsz_sample_size;
 
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
+        /* The edit list processing below needs the complete index, unless
+         * the edit list can be applied while building it. */
+        is->incremental = mov->lazy_index;
+        if (is->incremental && sc->elst_count &&
+            !mov->ignore_editlist && mov->advanced_editlist)
+            is->incremental = mov_init_lazy_edit(mov, st);
+        sc->index_start = *is;
 
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &st->index_entries[st->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && st->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
-
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                /* A negative sample duration is invalid based on the spec,
-                 * but some samples need it to correct the DTS. */
-                if (sc->stts_data[stts_index].duration < 0) {
-                    av_log(mov->fc, AV_LOG_WARNING,
-                           "Invalid SampleDelta %d in STTS, at %d st:%d\n",
-                           sc->stts_data[stts_index].duration, stts_index,
-                           st->index);
-                    dts_correction += sc->stts_data[stts_index].duration - 1;
-                    sc->stts_data[stts_index].duration = 1;
-                }
-                current_dts += sc->stts_data[stts_index].duration;
-                if (!dts_correction || current_dts + dts_correction > last_dts) {
-                    current_dts += dts_correction;
-                    dts_correction = 0;
-                } else {
-                    /* Avoid creating non-monotonous DTS */
-                    dts_correction += current_dts - last_dts - 1;
-                    current_dts = last_dts + 1;
-                }
-                last_dts = current_dts;
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
+        if (is->incremental) {
+            if (mov_build_index_entries(mov, st, MOV_INDEX_BATCH_SIZE) < 0)
+                return;
+            if (sc->stsz_sample_size > 0) {
+                is->stream_size = (uint64_t)sc->stsz_sample_size * sc->sample_count;
+            } else {
+                is->stream_size = 0;
+                for (i = 0; i < sc->sample_count; i++)
+                    is->stream_size += sc->sample_sizes[i];
             }
+        } else {
+            if (mov_expand_ctts(sc) < 0 ||
+                mov_build_index_entries(mov, st, sc->sample_count) < 0)
+                return;
         }
         if (st->duration > 0)
-            st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+            st->codecpar->bit_rate = is->stream_size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -4063,7 +4430,10 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
     }
 
-    if (!mov->ignore_editlist && mov->advanced_editlist) {
+    if (sc->index_state.edit) {
+        // The edit list is applied while building the index.
+        st->duration = FFMIN(st->duration, st->start_time + sc->index_state.edit_duration);
+    } else if (!mov->ignore_editlist && mov->advanced_editlist) {
         // Fix index according to edit lists.
         mov_fix_index(mov, st);
     }
@@ -4273,7 +4643,7 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 #if FF_API_R_FRAME_RATE
         if (sc->stts_count == 1 || (sc->stts_count == 2 && sc->stts_data[1].count == 1))
             av_reduce(&st->r_frame_rate.num, &st->r_frame_rate.den,
-                      sc->time_scale, sc->stts_data[0].duration, INT_MAX);
+                      sc->time_scale, FFMAX(sc->stts_data[0].duration, 1), INT_MAX);
 #endif
     }
 
@@ -4307,14 +4677,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             st->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is built incrementally. */
     av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
+    if (!sc->index_state.incremental) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
 
     return 0;
 }
@@ -4729,7 +5101,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     unsigned entries, first_sample_flags = frag->flags;
     int flags, distance, i;
     int64_t prev_dts = AV_NOPTS_VALUE;
-    int next_frag_index = -1, index_entry_pos;
+    int next_frag_index = -1, index_entry_pos, ret;
     size_t requested_size;
     size_t old_ctts_allocated_size;
     AVIndexEntry *new_entries;
@@ -4754,6 +5126,9 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    if ((ret = mov_finish_index(c, st)) < 0)
+        return ret;
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -7080,6 +7455,11 @@ static void mov_read_chapters(AVFormatContext *s)
             continue;
         }
 
+        if (mov_finish_index(mov, st) < 0) {
+            av_log(s, AV_LOG_ERROR, "Invalid sample tables in QT chapter track\n");
+            continue;
+        }
+
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
 
@@ -7455,6 +7835,59 @@ fail:
     return ret;
 }
 
+/**
+ * Same as ff_configure_buffers_for_index(), also taking into account the
+ * index entries not added yet to the tracks indexed incrementally.
+ */
+static void mov_configure_buffers(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    int64_t pos_delta = 0;
+    int64_t skip = 0;
+    int ist1, ist2, incremental = 0;
+
+    for (ist1 = 0; ist1 < s->nb_streams; ist1++) {
+        MOVStreamContext *sc = s->streams[ist1]->priv_data;
+        incremental |= sc->index_state.incremental;
+    }
+    if (!incremental) {
+        ff_configure_buffers_for_index(s, AV_TIME_BASE);
+        return;
+    }
+    if (!ff_need_configure_buffers(s))
+        return;
+
+    for (ist1 = 0; ist1 < s->nb_streams; ist1++) {
+        AVStream *st1 = s->streams[ist1];
+        for (ist2 = 0; ist2 < s->nb_streams; ist2++) {
+            AVStream *st2 = s->streams[ist2];
+            MOVIndexCursor c1, c2;
+            int has_e2;
+
+            if (ist1 == ist2)
+                continue;
+
+            mov_index_cursor_init(&c1, st1);
+            mov_index_cursor_init(&c2, st2);
+            has_e2 = mov_index_cursor_next(mov, &c2);
+            while (mov_index_cursor_next(mov, &c1)) {
+                int64_t e1_pts = av_rescale_q(c1.entry.timestamp, st1->time_base, AV_TIME_BASE_Q);
+
+                skip = FFMAX(skip, c1.entry.size);
+                for (; has_e2; has_e2 = mov_index_cursor_next(mov, &c2)) {
+                    int64_t e2_pts = av_rescale_q(c2.entry.timestamp, st2->time_base, AV_TIME_BASE_Q);
+                    if (e2_pts - e1_pts < AV_TIME_BASE)
+                        continue;
+                    pos_delta = FFMAX(pos_delta, c1.entry.pos - c2.entry.pos);
+                    break;
+                }
+            }
+        }
+    }
+
+    ff_configure_buffers(s, pos_delta, skip);
+}
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -7656,7 +8089,7 @@ static int mov_read_header(AVFormatContext *s)
             break;
         }
     }
-    ff_configure_buffers_for_index(s, AV_TIME_BASE);
+    mov_configure_buffers(s);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
         if (mov->frag_index.item[i].moof_offset <= mov->fragment.moof_offset)
@@ -7665,14 +8098,24 @@ static int mov_read_header(AVFormatContext *s)
     return 0;
 }
 
-static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
+/**
+ * Find the sample to read next, adding the index entries it needs.
+ *
+ * @param[out] psample the sample, NULL if all samples were read
+ * @return 0 on success, negative AVERROR if the sample tables are invalid
+ */
+static int mov_find_next_sample(AVFormatContext *s, AVStream **st,
+                                AVIndexEntry **psample)
 {
     AVIndexEntry *sample = NULL;
     int64_t best_dts = INT64_MAX;
-    int i;
+    int i, ret;
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
+        if (msc->index_state.incremental && msc->current_sample + 1 >= avst->nb_index_entries &&
+            (ret = mov_build_index_entries(s->priv_data, avst, MOV_INDEX_BATCH_SIZE)) < 0)
+            return ret;
         if (msc->pb && msc->current_sample < avst->nb_index_entries) {
             AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
@@ -7688,7 +8131,8 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
             }
         }
     }
-    return sample;
+    *psample = sample;
+    return 0;
 }
 
 static int should_retry(AVIOContext *pb, int error_code) {
@@ -7766,7 +8210,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     int ret;
     mov->fc = s;
  retry:
-    sample = mov_find_next_sample(s, &st);
+    if ((ret = mov_find_next_sample(s, &st, &sample)) < 0)
+        return ret;
     if (!sample || (mov->next_root_atom && sample->pos > mov->next_root_atom)) {
         if (!mov->next_root_atom)
             return AVERROR_EOF;
@@ -7930,7 +8375,22 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     if (ret < 0)
         return ret;
 
+    if (sc->index_state.incremental) {
+        MOVIndexState *is = &sc->index_state;
+        while (!is->done && (!st->nb_index_entries ||
+               st->index_entries[st->nb_index_entries - 1].timestamp <= timestamp))
+            if ((ret = mov_build_index_entries(s->priv_data, st, MOV_INDEX_BATCH_SIZE)) < 0)
+                return ret;
+    }
+
     sample = av_index_search_timestamp(st, timestamp, flags);
+    /* the next keyframe may not be indexed yet */
+    while (sample < 0 && !(flags & AVSEEK_FLAG_BACKWARD) &&
+           sc->index_state.incremental && !sc->index_state.done) {
+        if ((ret = mov_build_index_entries(s->priv_data, st, MOV_INDEX_BATCH_SIZE)) < 0)
+            return ret;
+        sample = av_index_search_timestamp(st, timestamp, flags);
+    }
     av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
     if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
         sample = 0;
@@ -7974,7 +8434,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 {
     MOVContext *mc = s->priv_data;
     AVStream *st;
-    int sample;
+    int sample, ret;
     int i;
 
     if (stream_index >= s->nb_streams)
@@ -8010,7 +8470,9 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
         }
         while (1) {
             MOVStreamContext *sc;
-            AVIndexEntry *entry = mov_find_next_sample(s, &st);
+            AVIndexEntry *entry;
+            if ((ret = mov_find_next_sample(s, &st, &entry)) < 0)
+                return ret;
             if (!entry)
                 return AVERROR_INVALIDDATA;
             sc = st->priv_data;
@@ -8041,6 +8503,10 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Build the sample index incrementally while reading and seeking instead of at open time.",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"use_mfra_for",
         "use mfra for fragment timestamps",
         OFFSET(use_mfra_for), AV_OPT_TYPE_INT, {.i64 = FF_MOV_FLAG_MFRA_AUTO},
@@ -4691,8 +4691,10 @@ static int mov_write_moof_tag(AVIOContext *pb, MOVMuxContext *mov, int tracks,
 
     if ((ret = ffio_open_null_buf(&avio_buf)) < 0)
         return ret;
-    mov_write_moof_tag_internal(avio_buf, mov, tracks, 0);
+    ret = mov_write_moof_tag_internal(avio_buf, mov, tracks, 0);
     moof_size = ffio_close_null_buf(avio_buf);
+    if (ret < 0)
+        return ret;
 
     if (mov->flags & FF_MOV_FLAG_DASH &&
         !(mov->flags & (FF_MOV_FLAG_GLOBAL_SIDX | FF_MOV_FLAG_SKIP_SIDX)))
@@ -5280,7 +5282,8 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
         if (write_moof) {
             avio_write_marker(s->pb, AV_NOPTS_VALUE, AVIO_DATA_MARKER_FLUSH_POINT);
 
-            mov_write_moof_tag(s->pb, mov, moof_tracks, mdat_size);
+            if ((ret = mov_write_moof_tag(s->pb, mov, moof_tracks, mdat_size)) < 0)
+                return ret;
             mov->fragments++;
 
             avio_wb32(s->pb, mdat_size + 8);
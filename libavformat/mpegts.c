@@ -410,6 +410,31 @@ static int discard_pid(MpegTSContext *ts, unsigned int pid)
     return !used && discarded;
 }
 
+/**
+ * @brief discard_pes() decides if the pid of a PES filter can be discarded
+ *                      because its streams are not wanted by the caller
+ * @return 1 if all streams fed by the filter have .discard=AVDISCARD_ALL and
+ *         the pid does not carry the PCR of a used program, 0 otherwise
+ */
+static int discard_pes(MpegTSContext *ts, MpegTSFilter *tss)
+{
+    PESContext *pes = tss->u.pes_filter.opaque;
+    int k;
+
+    if (tss->type != MPEGTS_PES || !pes || !pes->st ||
+        pes->st->discard != AVDISCARD_ALL ||
+        (pes->sub_st && pes->sub_st->discard != AVDISCARD_ALL))
+        return 0;
+
+    for (k = 0; k < ts->stream->nb_programs; k++) {
+        AVProgram *program = ts->stream->programs[k];
+        if (program->pcr_pid == tss->pid && program->discard != AVDISCARD_ALL)
+            return 0;
+    }
+
+    return 1;
+}
+
 /**
  *  Assemble PES packets out of TS packets, and then call the "section_cb"
  *  function when they are complete.
@@ -2661,7 +2686,7 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     if (!tss)
         return 0;
     if (is_start)
-        tss->discard = discard_pid(ts, pid);
+        tss->discard = discard_pid(ts, pid) || discard_pes(ts, tss);
     if (tss->discard)
         return 0;
     ts->current_pid = pid;
@@ -2883,6 +2908,37 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Skip, directly in the I/O buffer, the run of packets which handle_packet()
+ * would ignore: packets of pids without a filter and continuation packets of
+ * discarded pids.
+ * @return the number of skipped packets
+ */
+static int skip_ignored_packets(MpegTSContext *ts, int max_packets)
+{
+    AVIOContext *pb = ts->stream->pb;
+    const uint8_t *p = pb->buf_ptr;
+    int stride = ts->raw_packet_size;
+    int n;
+
+    for (n = 0; n < max_packets && pb->buf_end - p >= stride; n++, p += stride) {
+        MpegTSFilter *tss;
+        int pid, is_start;
+
+        if (p[0] != 0x47)
+            break;
+        pid      = AV_RB16(p + 1) & 0x1fff;
+        is_start = p[1] & 0x40;
+        tss      = ts->pids[pid];
+        if (tss ? !tss->discard || is_start : ts->auto_guess && is_start)
+            break;
+    }
+
+    if (n)
+        avio_skip(pb, p - pb->buf_ptr);
+    return n;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
@@ -2924,6 +2980,8 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        packet_num += skip_ignored_packets(ts, nb_packets ? FFMIN(nb_packets - packet_num - 1, INT_MAX) : INT_MAX);
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -923,6 +923,22 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
 
 #define CHUNK_START 0x1000
 
+static AVPacketList *interleave_get_entry(AVFormatContext *s)
+{
+    AVPacketList *pktl = s->internal->packet_buffer_free;
+
+    if (!pktl)
+        return av_malloc(sizeof(AVPacketList));
+    s->internal->packet_buffer_free = pktl->next;
+    return pktl;
+}
+
+static void interleave_release_entry(AVFormatContext *s, AVPacketList *pktl)
+{
+    pktl->next = s->internal->packet_buffer_free;
+    s->internal->packet_buffer_free = pktl;
+}
+
 int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
                              int (*compare)(AVFormatContext *, const AVPacket *, const AVPacket *))
 {
@@ -931,7 +947,7 @@ int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
     AVStream *st   = s->streams[pkt->stream_index];
     int chunked    = s->max_chunk_size || s->max_chunk_duration;
 
-    this_pktl      = av_malloc(sizeof(AVPacketList));
+    this_pktl      = interleave_get_entry(s);
     if (!this_pktl)
         return AVERROR(ENOMEM);
     if ((pkt->flags & AV_PKT_FLAG_UNCODED_FRAME)) {
@@ -939,7 +955,7 @@ int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
         av_assert0(((AVFrame *)pkt->data)->buf);
     } else {
         if ((ret = av_packet_make_refcounted(pkt)) < 0) {
-            av_free(this_pktl);
+            interleave_release_entry(s, this_pktl);
             return ret;
         }
     }
@@ -1121,7 +1137,7 @@ int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
                 st->last_in_packet_buffer = NULL;
 
             av_packet_unref(&pktl->pkt);
-            av_freep(&pktl);
+            interleave_release_entry(s, pktl);
             flush = 0;
         }
     }
@@ -1138,7 +1154,7 @@ int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
 
         if (st->last_in_packet_buffer == pktl)
             st->last_in_packet_buffer = NULL;
-        av_freep(&pktl);
+        interleave_release_entry(s, pktl);
 
         return 1;
     } else {
@@ -0,0 +1,312 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Persistent cache test, reading resources of a minimal HTTP server on the
+ * loopback interface through the cache protocol with a cache directory.
+ * The server can change the body without changing the validators, which
+ * tells whether the data was served from the cache.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/thread.h"
+#include "libavformat/avformat.h"
+#include "libavformat/network.h"
+#include "libavformat/url.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define RESOURCE_SIZE 100000
+#define MAX_CONNECTIONS 32
+
+typedef struct Server {
+    int fd;
+    int port;
+    volatile int stop;
+    pthread_t thread;
+    pthread_t conn_threads[MAX_CONNECTIONS];
+    int nb_conns;
+    /* what is served, only changed while no connection is open */
+    int version;                ///< selects the body
+    const char *headers;        ///< validators sent with the response
+} Server;
+
+typedef struct Connection {
+    Server *server;
+    int fd;
+} Connection;
+
+/* the two versions of the resource have no byte in common */
+static uint8_t resource_byte(int version, int64_t pos)
+{
+    return (pos * 7 + (pos >> 10)) ^ (version ? 0xff : 0);
+}
+
+static int send_all(int fd, const uint8_t *buf, int size)
+{
+    while (size > 0) {
+        /* the client may close the connection with data left to read */
+        int ret = send(fd, buf, size, MSG_NOSIGNAL);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static void *connection_thread(void *arg)
+{
+    Connection *conn = arg;
+    Server *server = conn->server;
+    char request[4096], header[512];
+    const char *range;
+    int64_t start = 0;
+    int len = 0;
+
+    request[0] = '\0';
+    while (!strstr(request, "\r\n\r\n")) {
+        int ret = recv(conn->fd, request + len, sizeof(request) - 1 - len, 0);
+        if (ret <= 0 || len + ret == sizeof(request) - 1)
+            goto end;
+        len += ret;
+        request[len] = '\0';
+    }
+    range = av_stristr(request, "\r\nRange: bytes=");
+    if (range)
+        start = FFMIN(strtoll(range + 15, NULL, 10), RESOURCE_SIZE);
+
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 206 Partial Content\r\n"
+             "Content-Length: %"PRId64"\r\n"
+             "Content-Range: bytes %"PRId64"-%d/%d\r\n"
+             "%s"
+             "Connection: close\r\n\r\n",
+             RESOURCE_SIZE - start, start, RESOURCE_SIZE - 1, RESOURCE_SIZE,
+             server->headers);
+    if (send_all(conn->fd, header, strlen(header)) < 0)
+        goto end;
+    while (start < RESOURCE_SIZE) {
+        uint8_t body[4096];
+        int size = FFMIN(sizeof(body), RESOURCE_SIZE - start);
+        for (int i = 0; i < size; i++)
+            body[i] = resource_byte(server->version, start + i);
+        if (send_all(conn->fd, body, size) < 0)
+            break;
+        start += size;
+    }
+end:
+    closesocket(conn->fd);
+    av_free(conn);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *server = arg;
+
+    while (!server->stop) {
+        struct pollfd p = { server->fd, POLLIN, 0 };
+        Connection *conn;
+        int fd;
+
+        if (poll(&p, 1, 100) <= 0)
+            continue;
+        fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        conn = av_mallocz(sizeof(*conn));
+        if (!conn || server->nb_conns == MAX_CONNECTIONS) {
+            av_free(conn);
+            closesocket(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->fd     = fd;
+        if (pthread_create(&server->conn_threads[server->nb_conns], NULL,
+                           connection_thread, conn)) {
+            av_free(conn);
+            closesocket(fd);
+            continue;
+        }
+        server->nb_conns++;
+    }
+    for (int i = 0; i < server->nb_conns; i++)
+        pthread_join(server->conn_threads[i], NULL);
+    return NULL;
+}
+
+static int server_start(Server *server)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->fd < 0)
+        return -1;
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(server->fd, MAX_CONNECTIONS) ||
+        getsockname(server->fd, (struct sockaddr *)&addr, &addr_len))
+        return -1;
+    server->port = ntohs(addr.sin_port);
+    return pthread_create(&server->thread, NULL, server_thread, server) ? -1 : 0;
+}
+
+static int count_files(const char *dirname)
+{
+    struct dirent *de;
+    DIR *dir = opendir(dirname);
+    int count = 0;
+
+    if (!dir)
+        return -1;
+    while ((de = readdir(dir)))
+        count += de->d_name[0] != '.';
+    closedir(dir);
+    return count;
+}
+
+static void remove_files(const char *dirname)
+{
+    struct dirent *de;
+    DIR *dir = opendir(dirname);
+
+    if (!dir)
+        return;
+    while ((de = readdir(dir))) {
+        char *name = av_asprintf("%s/%s", dirname, de->d_name);
+        if (name && de->d_name[0] != '.')
+            unlink(name);
+        av_free(name);
+    }
+    closedir(dir);
+}
+
+/**
+ * Read a range of the resource at path through the cache and print which
+ * parts of it came from which version of the resource.
+ */
+static void read_range(const char *step, const Server *server,
+                       const char *cache_dir, const char *path,
+                       int64_t start, int size)
+{
+    AVDictionary *opts = NULL;
+    URLContext *h = NULL;
+    uint8_t *buf = av_malloc(size);
+    char url[256];
+    int ret;
+
+    snprintf(url, sizeof(url), "cache:http://127.0.0.1:%d/%s",
+             server->port, path);
+    av_dict_set(&opts, "cache_dir", cache_dir, 0);
+    ret = ffurl_open_whitelist(&h, url, AVIO_FLAG_READ, NULL, &opts,
+                               NULL, NULL, NULL);
+    av_dict_free(&opts);
+    if (!buf || ret < 0 || ffurl_seek(h, start, SEEK_SET) != start ||
+        ffurl_read_complete(h, buf, size) != size) {
+        printf("%s: read failed\n", step);
+        goto end;
+    }
+
+    printf("%s:", step);
+    for (int i = 0, run_start = 0, version = -1; i <= size; i++) {
+        int match = -1;
+        if (i < size) {
+            if (version >= 0 && buf[i] == resource_byte(version, start + i))
+                continue;
+            for (int v = 0; v < 2; v++)
+                if (buf[i] == resource_byte(v, start + i))
+                    match = v;
+        }
+        if (i > run_start)
+            printf(" %"PRId64"-%"PRId64" %s", start + run_start, start + i - 1,
+                   version < 0 ? "corrupt" : version ? "v1" : "v0");
+        run_start = i;
+        version   = match;
+    }
+    ffurl_closep(&h);
+    printf(", %d file(s) in the cache\n", count_files(cache_dir));
+
+end:
+    ffurl_closep(&h);
+    av_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    Server server = { 0 };
+    const char *dir;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <cache directory>\n", argv[0]);
+        return 1;
+    }
+    dir = argv[1];
+    mkdir(dir, 0777);
+    remove_files(dir);
+
+    ff_network_init();
+    server.headers = "ETag: \"1\"\r\n";
+    if (server_start(&server) < 0) {
+        fprintf(stderr, "Could not start the server\n");
+        return 1;
+    }
+
+    /* the cache keeps serving the data as long as the validators match */
+    read_range("first read", &server, dir, "resource", 0, 30000);
+    server.version = 1;
+    read_range("cached range", &server, dir, "resource", 1000, 20000);
+    read_range("partly cached range", &server, dir, "resource", 20000, 20000);
+    server.version = 0;
+    read_range("newly cached range", &server, dir, "resource", 30000, 10000);
+
+    /* a new version of the resource replaces the cached one */
+    server.version = 1;
+    server.headers = "ETag: \"2\"\r\n";
+    read_range("changed entity tag", &server, dir, "resource", 0, 10000);
+    server.version = 0;
+    read_range("cached new version", &server, dir, "resource", 0, 10000);
+    server.headers = "ETag: \"2\"\r\nLast-Modified: Sun, 18 Oct 2026 10:00:00 GMT\r\n";
+    read_range("changed modification date", &server, dir, "resource", 0, 10000);
+
+    /* a resource with only a size cannot be told apart from a new version
+     * of the same size, so it is not kept in the cache */
+    server.version = 1;
+    server.headers = "";
+    read_range("no validator", &server, dir, "other", 0, 10000);
+    server.version = 0;
+    read_range("no validator again", &server, dir, "other", 0, 10000);
+
+    server.stop = 1;
+    pthread_join(server.thread, NULL);
+    closesocket(server.fd);
+    ff_network_close();
+    remove_files(dir);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "libavutil/dict.h"
+#include "libavformat/avformat.h"
+
+#define FILE_SIZE (4 * 65536 - 200)
+
+static uint8_t file_byte(int64_t pos)
+{
+    return pos * 7 + (pos >> 11);
+}
+
+static int check_data(const uint8_t *data, int64_t pos, int size)
+{
+    for (int i = 0; i < size; i++)
+        if (data[i] != file_byte(pos + i))
+            return 0;
+    return 1;
+}
+
+static int print_packet(const AVPacket *pkt, int64_t pos)
+{
+    int padding_ok = 1;
+
+    for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++)
+        padding_ok &= !pkt->data[pkt->size + i];
+
+    /* none of the positions is a multiple of 16, so a copy in an av_malloc()ed
+     * buffer never has the same offset within a page as the file data */
+    printf("packet at %"PRId64" size %d: %s, data %s, padding %s\n",
+           pos, pkt->size,
+           ((uintptr_t)pkt->data & 4095) == (pos & 4095) ? "mapped" : "copied",
+           check_data(pkt->data, pos, pkt->size) ? "ok" : "corrupt",
+           padding_ok ? "zeroed" : "not zeroed");
+    return padding_ok && check_data(pkt->data, pos, pkt->size);
+}
+
+static int get_packet(AVIOContext *pb, int64_t pos, int size)
+{
+    AVPacket pkt;
+    int ret, ok;
+
+    if (avio_tell(pb) != pos && avio_seek(pb, pos, SEEK_SET) < 0) {
+        printf("seek to %"PRId64" failed\n", pos);
+        return 1;
+    }
+    av_init_packet(&pkt);
+    ret = av_get_packet(pb, &pkt, size);
+    if (ret < 0) {
+        printf("packet at %"PRId64": error %d\n", pos, ret);
+        return 1;
+    }
+    ok = print_packet(&pkt, pos);
+    av_packet_unref(&pkt);
+
+    if (avio_tell(pb) != pos + ret) {
+        printf("position %"PRId64" after the packet, expected %"PRId64"\n",
+               avio_tell(pb), pos + ret);
+        return 1;
+    }
+    if (pos + ret < avio_size(pb) && avio_r8(pb) != file_byte(pos + ret)) {
+        printf("wrong data after the packet\n");
+        return 1;
+    }
+    return !ok;
+}
+
+/* read packets following each other and check them once all are read */
+static int get_adjacent_packets(AVIOContext *pb, int64_t pos, int size)
+{
+    AVPacket pkt[3];
+    int ret = 0;
+
+    if (avio_seek(pb, pos, SEEK_SET) < 0) {
+        printf("seek to %"PRId64" failed\n", pos);
+        return 1;
+    }
+    for (int i = 0; i < FF_ARRAY_ELEMS(pkt); i++) {
+        av_init_packet(&pkt[i]);
+        if (av_get_packet(pb, &pkt[i], size) != size) {
+            printf("packet at %"PRId64": read failed\n", pos + i * size);
+            ret = 1;
+        }
+    }
+    for (int i = 0; i < FF_ARRAY_ELEMS(pkt); i++) {
+        if (pkt[i].data)
+            ret |= !print_packet(&pkt[i], pos + i * size);
+        av_packet_unref(&pkt[i]);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    uint8_t buf[13];
+    FILE *f;
+    int ret = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <temporary file>\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[1], "wb");
+    if (!f)
+        return 1;
+    for (int64_t i = 0; i < FILE_SIZE; i++)
+        fputc(file_byte(i), f);
+    fclose(f);
+
+    av_dict_set(&opts, "mmap", "1", 0);
+    if (avio_open2(&pb, argv[1], AVIO_FLAG_READ, NULL, &opts) < 0) {
+        av_dict_free(&opts);
+        return 1;
+    }
+    av_dict_free(&opts);
+
+    /* a header read through the buffer, then packets following each other */
+    avio_read(pb, buf, sizeof(buf));
+    ret |= get_packet(pb, 13, 100000);
+    ret |= get_packet(pb, 100014, 1000);
+    /* the padding of the last packet lies within the last page */
+    ret |= get_packet(pb, 101014, FILE_SIZE - 101014);
+    /* the padding of a packet must not overwrite the next one in use */
+    ret |= get_adjacent_packets(pb, 1001, 70001);
+
+    /* the padding after a file size multiple of the page size cannot be
+     * mapped, and a file truncated before the read gives a short packet */
+    if (truncate(argv[1], 3 * 65536) < 0) {
+        printf("truncate failed\n");
+        ret = 1;
+    }
+    ret |= get_packet(pb, 3 * 65536 - 70001, 70001);
+    ret |= get_packet(pb, 150001, 70000);
+
+    avio_closep(&pb);
+    unlink(argv[1]);
+    return ret;
+}
@@ -0,0 +1,335 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Persistent HTTP connection test, against a minimal keep-alive server
+ * serving a single resource with byte ranges on the loopback interface.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+#include "libavformat/network.h"
+#include "libavformat/url.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define RESOURCE_SIZE 200000
+#define MAX_CONNECTIONS 16
+/* requests for ranges starting here are answered with an error */
+#define FAILING_OFFSET 123456
+
+typedef struct Server {
+    int fd;
+    int port;
+    volatile int stop;
+    pthread_t thread;
+    pthread_t conn_threads[MAX_CONNECTIONS];
+    int conn_fds[MAX_CONNECTIONS];
+    pthread_mutex_t lock;
+    int nb_accepted;
+    int nb_open;
+} Server;
+
+typedef struct Connection {
+    Server *server;
+    int fd;
+} Connection;
+
+static uint8_t resource_byte(int64_t pos)
+{
+    return pos * 13 + (pos >> 9);
+}
+
+static int send_all(int fd, const uint8_t *buf, int size)
+{
+    while (size > 0) {
+        /* the client may close connections with data left to read */
+        int ret = send(fd, buf, size, MSG_NOSIGNAL);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static int serve_request(int fd, const char *request)
+{
+    const char *range = av_stristr(request, "\r\nRange: bytes=");
+    int64_t start = 0, end = RESOURCE_SIZE - 1;
+    char header[256];
+    uint8_t body[4096];
+
+    if (range) {
+        char *ptr;
+        start = strtoll(range + 15, &ptr, 10);
+        if (*ptr == '-' && ptr[1] >= '0' && ptr[1] <= '9')
+            end = FFMIN(strtoll(ptr + 1, NULL, 10), end);
+    }
+    if (start == FAILING_OFFSET || start > end) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+        return send_all(fd, header, strlen(header));
+    }
+
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 206 Partial Content\r\n"
+             "Content-Length: %"PRId64"\r\n"
+             "Content-Range: bytes %"PRId64"-%"PRId64"/%d\r\n\r\n",
+             end - start + 1, start, end, RESOURCE_SIZE);
+    if (send_all(fd, header, strlen(header)) < 0)
+        return -1;
+    while (start <= end) {
+        int size = FFMIN(sizeof(body), end - start + 1);
+        for (int i = 0; i < size; i++)
+            body[i] = resource_byte(start + i);
+        if (send_all(fd, body, size) < 0)
+            return -1;
+        start += size;
+    }
+    return 0;
+}
+
+static void *connection_thread(void *arg)
+{
+    Connection *conn = arg;
+    char request[4096];
+    int len = 0;
+
+    for (;;) {
+        char *end;
+        int ret = recv(conn->fd, request + len, sizeof(request) - 1 - len, 0);
+        if (ret <= 0)
+            break;
+        len += ret;
+        request[len] = '\0';
+        while ((end = strstr(request, "\r\n\r\n"))) {
+            end += 4;
+            if (serve_request(conn->fd, request) < 0)
+                goto end;
+            len -= end - request;
+            memmove(request, end, len + 1);
+        }
+        if (len == sizeof(request) - 1)
+            break;
+    }
+end:
+    pthread_mutex_lock(&conn->server->lock);
+    conn->server->nb_open--;
+    pthread_mutex_unlock(&conn->server->lock);
+    av_free(conn);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *server = arg;
+
+    while (!server->stop) {
+        struct pollfd p = { server->fd, POLLIN, 0 };
+        Connection *conn;
+        int fd;
+
+        if (poll(&p, 1, 100) <= 0)
+            continue;
+        fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        conn = av_mallocz(sizeof(*conn));
+        if (!conn || server->nb_accepted == MAX_CONNECTIONS) {
+            av_free(conn);
+            closesocket(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->fd     = fd;
+        pthread_mutex_lock(&server->lock);
+        server->conn_fds[server->nb_accepted] = fd;
+        if (pthread_create(&server->conn_threads[server->nb_accepted], NULL,
+                           connection_thread, conn)) {
+            av_free(conn);
+            closesocket(fd);
+        } else {
+            server->nb_accepted++;
+            server->nb_open++;
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+    return NULL;
+}
+
+static int server_start(Server *server)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->fd < 0)
+        return -1;
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(server->fd, MAX_CONNECTIONS) ||
+        getsockname(server->fd, (struct sockaddr *)&addr, &addr_len))
+        return -1;
+    server->port = ntohs(addr.sin_port);
+    pthread_mutex_init(&server->lock, NULL);
+    return pthread_create(&server->thread, NULL, server_thread, server) ? -1 : 0;
+}
+
+static void server_stop(Server *server)
+{
+    server->stop = 1;
+    pthread_join(server->thread, NULL);
+    for (int i = 0; i < server->nb_accepted; i++) {
+        /* unblock connections still kept open by the client */
+        shutdown(server->conn_fds[i], SHUT_RDWR);
+        pthread_join(server->conn_threads[i], NULL);
+        closesocket(server->conn_fds[i]);
+    }
+    closesocket(server->fd);
+    pthread_mutex_destroy(&server->lock);
+}
+
+/* connections closed by the client are noticed asynchronously, so wait a
+ * little for the server to reach the expected state before printing it */
+static void print_connections(Server *server, const char *step, int nb_open)
+{
+    for (int i = 0; i < 200; i++) {
+        int done;
+        pthread_mutex_lock(&server->lock);
+        done = server->nb_open <= nb_open;
+        pthread_mutex_unlock(&server->lock);
+        if (done)
+            break;
+        av_usleep(10000);
+    }
+    pthread_mutex_lock(&server->lock);
+    printf("%s: %d connection(s) accepted, %d open\n",
+           step, server->nb_accepted, server->nb_open);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static int open_resource(URLContext **h, const Server *server,
+                         const char *option, const char *value)
+{
+    AVDictionary *opts = NULL;
+    char url[64];
+    int ret;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/resource", server->port);
+    av_dict_set(&opts, "multiple_requests", "1", 0);
+    if (option)
+        av_dict_set(&opts, option, value, 0);
+    ret = ffurl_open_whitelist(h, url, AVIO_FLAG_READ, NULL, &opts,
+                               NULL, NULL, NULL);
+    av_dict_free(&opts);
+    return ret;
+}
+
+/* read size bytes and check them against the resource at pos */
+static int check_read(URLContext *h, int64_t pos, int size)
+{
+    uint8_t buf[4096];
+
+    while (size > 0) {
+        int ret = ffurl_read(h, buf, FFMIN(size, sizeof(buf)));
+        if (ret <= 0) {
+            printf("read at %"PRId64" failed\n", pos);
+            return -1;
+        }
+        for (int i = 0; i < ret; i++) {
+            if (buf[i] != resource_byte(pos + i)) {
+                printf("wrong data at %"PRId64"\n", pos + i);
+                return -1;
+            }
+        }
+        pos  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    Server server = { 0 };
+    URLContext *h = NULL;
+    int ret = 0;
+
+    avformat_network_init();
+    if (server_start(&server) < 0) {
+        fprintf(stderr, "Could not start the server\n");
+        return 1;
+    }
+
+    /* a resource read to the end hands its connection to the next request */
+    if (open_resource(&h, &server, NULL, NULL) < 0 ||
+        check_read(h, 0, RESOURCE_SIZE) < 0)
+        ret = 1;
+    ffurl_closep(&h);
+    if (open_resource(&h, &server, NULL, NULL) < 0 ||
+        check_read(h, 0, 1000) < 0)
+        ret = 1;
+    print_connections(&server, "second request", 1);
+
+    /* a seek with data left to read keeps the old connection, which the
+     * reading goes on with when the new request fails */
+    if (ffurl_seek(h, FAILING_OFFSET, SEEK_SET) >= 0) {
+        printf("seek to the failing offset succeeded\n");
+        ret = 1;
+    }
+    if (check_read(h, 1000, 1000) < 0)
+        ret = 1;
+    print_connections(&server, "failed seek", 1);
+
+    if (ffurl_seek(h, 150000, SEEK_SET) != 150000 ||
+        check_read(h, 150000, RESOURCE_SIZE - 150000) < 0)
+        ret = 1;
+    /* nothing is left to read, so this reuses the connection */
+    if (ffurl_seek(h, 100, SEEK_SET) != 100 || check_read(h, 100, 100) < 0)
+        ret = 1;
+    print_connections(&server, "seeks", 1);
+    ffurl_closep(&h);
+
+    /* connections opened with different lower protocol options, such as
+     * TLS settings, are not shared */
+    if (open_resource(&h, &server, NULL, NULL) < 0 ||
+        check_read(h, 0, RESOURCE_SIZE) < 0)
+        ret = 1;
+    ffurl_closep(&h);
+    if (open_resource(&h, &server, "recv_buffer_size", "65536") < 0 ||
+        check_read(h, 0, RESOURCE_SIZE) < 0)
+        ret = 1;
+    ffurl_closep(&h);
+    print_connections(&server, "other options", 2);
+
+    /* the idle connections are closed by the network deinit */
+    avformat_network_deinit();
+    print_connections(&server, "deinit", 0);
+    server_stop(&server);
+
+    return ret;
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Batched UDP output test: the datagrams written must arrive unchanged and
+ * in order, whether the batch is sent with segmentation offload or not,
+ * when the batch is full, when the batch delay expires and when closing.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+#include "libavformat/network.h"
+#include "libavformat/url.h"
+
+static int recv_fd;
+static int port;
+static int nb_sent;     ///< datagrams written so far
+static int nb_received; ///< datagrams received so far
+
+static int datagram_size(int index)
+{
+    /* runs of equally sized datagrams, some ending with a shorter one */
+    return index < 16 ? 1000 - (index == 15) * 300 : 100 + index * 10;
+}
+
+static uint8_t datagram_byte(int index, int pos)
+{
+    return index * 29 + pos;
+}
+
+static int send_datagrams(URLContext *h, int nb)
+{
+    uint8_t buf[2048];
+
+    for (int i = 0; i < nb; i++, nb_sent++) {
+        int size = datagram_size(nb_sent);
+        for (int j = 0; j < size; j++)
+            buf[j] = datagram_byte(nb_sent, j);
+        if (ffurl_write(h, buf, size) != size) {
+            printf("write failed\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* receive all pending datagrams, waiting up to timeout ms for each */
+static void receive(const char *step, int timeout)
+{
+    int count = 0, ok = 1;
+
+    for (;;) {
+        struct pollfd p = { recv_fd, POLLIN, 0 };
+        uint8_t buf[2048];
+        int size;
+
+        if (poll(&p, 1, timeout) <= 0)
+            break;
+        size = recv(recv_fd, buf, sizeof(buf), 0);
+        if (size < 0)
+            break;
+        if (size != datagram_size(nb_received))
+            ok = 0;
+        for (int j = 0; j < size && ok; j++)
+            ok = buf[j] == datagram_byte(nb_received, j);
+        nb_received++;
+        count++;
+        if (nb_received == nb_sent)
+            timeout = 50;
+    }
+    printf("%s: %d datagram(s) received%s\n", step, count,
+           ok ? "" : ", wrong data");
+}
+
+static int open_sender(URLContext **h, int batch_size, int batch_delay)
+{
+    char url[128];
+
+    snprintf(url, sizeof(url),
+             "udp://127.0.0.1:%d?pkt_size=1500&batch_size=%d&batch_delay=%d",
+             port, batch_size, batch_delay);
+    return ffurl_open_whitelist(h, url, AVIO_FLAG_WRITE, NULL, NULL,
+                                NULL, NULL, NULL);
+}
+
+int main(void)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+    int buffer_size = 1 << 20;
+    URLContext *h = NULL;
+
+    ff_network_init();
+    recv_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (recv_fd < 0)
+        return 1;
+    setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(recv_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        getsockname(recv_fd, (struct sockaddr *)&addr, &addr_len))
+        return 1;
+    port = ntohs(addr.sin_port);
+
+    /* nothing is sent until the batch is full */
+    if (open_sender(&h, 8, 60000000) < 0)
+        return 1;
+    if (send_datagrams(h, 7) < 0)
+        return 1;
+    receive("7 of 8 queued", 50);
+    if (send_datagrams(h, 1) < 0)
+        return 1;
+    receive("8 of 8 queued", 1000);
+    /* equally sized datagrams ending with a shorter one, then sizes
+     * which all differ */
+    if (send_datagrams(h, 16) < 0)
+        return 1;
+    receive("16 more queued", 1000);
+
+    /* the datagrams left are sent on closing */
+    if (send_datagrams(h, 3) < 0)
+        return 1;
+    receive("3 queued", 50);
+    ffurl_closep(&h);
+    receive("closed", 1000);
+
+    /* and on the first write after the delay */
+    if (open_sender(&h, 8, 20000) < 0)
+        return 1;
+    if (send_datagrams(h, 2) < 0)
+        return 1;
+    receive("2 queued", 0);
+    av_usleep(30000);
+    if (send_datagrams(h, 1) < 0)
+        return 1;
+    receive("1 more queued after the delay", 1000);
+    ffurl_closep(&h);
+
+    closesocket(recv_fd);
+    ff_network_close();
+    return nb_received != nb_sent;
+}
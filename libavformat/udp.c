@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "avio_internal.h"
@@ -57,6 +58,13 @@
 #define UDPLITE_RECV_CSCOV                               11
 #endif
 
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+/* Older C libraries lack the UDP segmentation offload definitions, which
+ * does not mean the running kernel does not support it. */
+#define SOL_UDP                                          17
+#define UDP_SEGMENT                                      103
+#endif
+
 #ifndef IPPROTO_UDPLITE
 #define IPPROTO_UDPLITE                                  136
 #endif
@@ -65,6 +73,10 @@
 #include <pthread.h>
 #endif
 
+#if HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
 #define IPV6_DROP_MEMBERSHIP IPV6_LEAVE_GROUP
@@ -74,6 +86,8 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_MAX_BATCH_SIZE 1024
+#define UDP_MAX_GSO_SEGMENTS 64
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -112,6 +126,21 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+
+    /* Batched I/O with recvmmsg()/sendmmsg() */
+    int batch_size;
+    int64_t batch_delay;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    struct mmsghdr *batch_msgs;
+    struct iovec *batch_iov;
+    struct sockaddr_storage *batch_addr;
+    uint8_t *batch_buf;
+    int batch_slot_size;
+    int batch_count;        ///< datagrams received or queued for sending
+    int batch_pos;          ///< next datagram to read, or bytes queued for sending
+    int gso;                ///< send equally sized datagrams with UDP_SEGMENT
+    int64_t batch_start;    ///< time the first queued datagram was written
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -136,6 +165,8 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout (only in read mode)",     OFFSET(timeout),        AV_OPT_TYPE_INT,    { .i64 = 0 },      0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch_size",     "Number of datagrams received or sent per system call", OFFSET(batch_size), AV_OPT_TYPE_INT, { .i64 = 1 },   1, UDP_MAX_BATCH_SIZE, D|E },
+    { "batch_delay",    "Maximum time queued datagrams wait before being sent (in microseconds)", OFFSET(batch_delay), AV_OPT_TYPE_INT64, { .i64 = 1000 }, 0, INT64_MAX, E },
     { NULL }
 };
 
@@ -454,7 +485,200 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+static void udp_batch_free(UDPContext *s)
+{
+    av_freep(&s->batch_msgs);
+    av_freep(&s->batch_iov);
+    av_freep(&s->batch_addr);
+    av_freep(&s->batch_buf);
+}
+
+static int udp_batch_alloc(UDPContext *s, int slot_size)
+{
+    s->batch_msgs = av_mallocz_array(s->batch_size, sizeof(*s->batch_msgs));
+    s->batch_iov  = av_mallocz_array(s->batch_size, sizeof(*s->batch_iov));
+    s->batch_addr = av_mallocz_array(s->batch_size, sizeof(*s->batch_addr));
+    s->batch_buf  = av_malloc_array(s->batch_size, slot_size);
+    if (!s->batch_msgs || !s->batch_iov || !s->batch_addr || !s->batch_buf) {
+        udp_batch_free(s);
+        return AVERROR(ENOMEM);
+    }
+    s->batch_slot_size = slot_size;
+    s->batch_count = s->batch_pos = 0;
+    return 0;
+}
+#endif
+
+#if HAVE_RECVMMSG
+/**
+ * Receive up to batch_size datagrams with a single system call.
+ * @return the number of datagrams received or a negative AVERROR code
+ */
+static int udp_recv_batch(UDPContext *s, int flags)
+{
+    int i, ret;
+
+    for (i = 0; i < s->batch_size; i++) {
+        struct msghdr *hdr = &s->batch_msgs[i].msg_hdr;
+
+        s->batch_iov[i].iov_base = s->batch_buf + i * s->batch_slot_size;
+        s->batch_iov[i].iov_len  = s->batch_slot_size;
+        hdr->msg_name       = &s->batch_addr[i];
+        hdr->msg_namelen    = sizeof(s->batch_addr[i]);
+        hdr->msg_iov        = &s->batch_iov[i];
+        hdr->msg_iovlen     = 1;
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+        hdr->msg_flags      = 0;
+    }
+
+    ret = recvmmsg(s->udp_fd, s->batch_msgs, s->batch_size, flags, NULL);
+    return ret < 0 ? ff_neterrno() : ret;
+}
+#endif
+
+#if HAVE_SENDMMSG
+#ifdef UDP_SEGMENT
+/**
+ * Send the queued datagrams as a single buffer segmented by the kernel,
+ * if they all have the size of the first one (the last may be shorter).
+ * @return 1 if sent, 0 if not applicable, or a negative AVERROR code
+ */
+static int udp_send_gso(UDPContext *s)
+{
+    char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+    struct iovec iov = { s->batch_buf, s->batch_pos };
+    struct msghdr hdr = { 0 };
+    struct cmsghdr *cm;
+    int seg_size = s->batch_iov[0].iov_len;
+    int i, ret;
+
+    if (s->batch_count < 2 || s->batch_count > UDP_MAX_GSO_SEGMENTS ||
+        s->batch_pos > UDP_MAX_PKT_SIZE - 1 - 20 - UDP_HEADER_SIZE)
+        return 0;
+    for (i = 1; i < s->batch_count; i++)
+        if (s->batch_iov[i].iov_len != seg_size &&
+            (i < s->batch_count - 1 || s->batch_iov[i].iov_len > seg_size))
+            return 0;
+
+    if (!s->is_connected) {
+        hdr.msg_name    = &s->dest_addr;
+        hdr.msg_namelen = s->dest_addr_len;
+    }
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = control;
+    hdr.msg_controllen = sizeof(control);
+    cm = CMSG_FIRSTHDR(&hdr);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type  = UDP_SEGMENT;
+    cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+    *(uint16_t *)CMSG_DATA(cm) = seg_size;
+
+    while ((ret = sendmsg(s->udp_fd, &hdr, 0)) < 0) {
+        ret = ff_neterrno();
+        if (ret == AVERROR(EAGAIN))
+            ret = ff_network_wait_fd(s->udp_fd, 1);
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+            return ret;
+    }
+
+    return 1;
+}
+#endif
+
+/**
+ * Send all queued datagrams, with as few system calls as possible.
+ */
+static int udp_send_batch(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int i, ret = 0, sent = 0;
+
+#ifdef UDP_SEGMENT
+    if (s->gso) {
+        ret = udp_send_gso(s);
+        if (ret < 0 && ret != AVERROR(EIO) && ret != AVERROR(EINVAL) &&
+            ret != AVERROR(ENOPROTOOPT))
+            goto end;
+        if (ret < 0) {
+            av_log(h, AV_LOG_VERBOSE, "UDP segmentation offload not available, "
+                   "falling back to sendmmsg()\n");
+            s->gso = 0;
+        }
+        if (ret > 0) {
+            ret = 0;
+            goto end;
+        }
+    }
+#endif
+
+    for (i = 0; i < s->batch_count; i++) {
+        struct msghdr *hdr = &s->batch_msgs[i].msg_hdr;
+
+        memset(hdr, 0, sizeof(*hdr));
+        if (!s->is_connected) {
+            hdr->msg_name    = &s->dest_addr;
+            hdr->msg_namelen = s->dest_addr_len;
+        }
+        hdr->msg_iov    = &s->batch_iov[i];
+        hdr->msg_iovlen = 1;
+    }
+
+    while (sent < s->batch_count) {
+        ret = sendmmsg(s->udp_fd, s->batch_msgs + sent, s->batch_count - sent, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret == AVERROR(EAGAIN))
+                ret = ff_network_wait_fd(s->udp_fd, 1);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                goto end;
+            continue;
+        }
+        sent += ret;
+    }
+    ret = 0;
+
+end:
+    s->batch_count = s->batch_pos = 0;
+    return ret;
+}
+#endif
+
 #if HAVE_PTHREAD_CANCEL
+/**
+ * Append a received datagram to the circular buffer, must be called with
+ * the mutex held.
+ */
+static int circular_buffer_put(URLContext *h, const uint8_t *buf, int len,
+                               struct sockaddr_storage *addr)
+{
+    UDPContext *s = h->priv_data;
+    uint8_t tmp[4];
+
+    if (ff_ip_check_source_lists(addr, &s->filters))
+        return 0;
+
+    if(av_fifo_space(s->fifo) < len + 4) {
+        /* No Space left */
+        if (s->overrun_nonfatal) {
+            av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                    "Surviving due to overrun_nonfatal option\n");
+            return 0;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    AV_WL32(tmp, len);
+    av_fifo_generic_write(s->fifo, tmp, 4, NULL);
+    av_fifo_generic_write(s->fifo, (uint8_t *)buf, len, NULL);
+    return 0;
+}
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -469,7 +693,7 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
-        int len;
+        int len, ret;
         struct sockaddr_storage addr;
         socklen_t addr_len = sizeof(addr);
 
@@ -478,7 +702,12 @@ static void *circular_buffer_task_rx( void *_URLContext)
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
+#if HAVE_RECVMMSG
+        if (s->batch_msgs)
+            len = udp_recv_batch(s, MSG_WAITFORONE);
+        else
+#endif
+        len = recvfrom(s->udp_fd, s->tmp, sizeof(s->tmp) - 4, 0, (struct sockaddr *)&addr, &addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
         if (len < 0) {
@@ -488,25 +717,21 @@ static void *circular_buffer_task_rx( void *_URLContext)
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
-
-        if(av_fifo_space(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
-                continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
+#if HAVE_RECVMMSG
+        if (s->batch_msgs) {
+            int i;
+
+            for (i = 0, ret = 0; i < len && !ret; i++) {
+                ret = circular_buffer_put(h, s->batch_iov[i].iov_base,
+                                          s->batch_msgs[i].msg_len, &s->batch_addr[i]);
             }
+        } else
+#endif
+        ret = circular_buffer_put(h, s->tmp, len, &addr);
+        if (ret < 0) {
+            s->circular_buffer_error = ret;
+            goto end;
         }
-        av_fifo_generic_write(s->fifo, s->tmp, len+4, NULL);
         pthread_cond_signal(&s->cond);
     }
 
@@ -717,6 +942,15 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             if (ff_ip_parse_blocks(h, buf, &s->filters) < 0)
                 goto fail;
         }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_size", p)) {
+            s->batch_size = av_clip(strtol(buf, NULL, 10), 1, UDP_MAX_BATCH_SIZE);
+            if (!HAVE_RECVMMSG && !HAVE_SENDMMSG)
+                av_log(h, AV_LOG_WARNING,
+                       "'batch_size' option was set but it is not supported "
+                       "on this build (recvmmsg/sendmmsg support is required)\n");
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_delay", p))
+            s->batch_delay = strtoll(buf, NULL, 10);
         if (!is_output && av_find_info_tag(buf, sizeof(buf), "timeout", p))
             s->timeout = strtol(buf, NULL, 10);
         if (is_output && av_find_info_tag(buf, sizeof(buf), "broadcast", p))
@@ -873,6 +1107,34 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     s->udp_fd = udp_fd;
 
+    /* Batching is only done for blocking I/O, so that callers polling
+     * the file handle never miss datagrams already read into the batch. */
+    if (s->batch_size > 1 && !(flags & AVIO_FLAG_NONBLOCK)) {
+#if HAVE_SENDMMSG
+        if (is_output && !(s->bitrate && s->circular_buffer_size)) {
+            if (udp_batch_alloc(s, h->max_packet_size) < 0)
+                goto fail;
+#ifdef UDP_SEGMENT
+            /* Probe the kernel support for segmentation offload, setting
+             * the default segment size of the socket to none. */
+            if (!s->udplite_coverage) {
+                int seg_size = 0;
+                s->gso = !setsockopt(udp_fd, SOL_UDP, UDP_SEGMENT,
+                                     &seg_size, sizeof(seg_size));
+                if (!s->gso)
+                    av_log(h, AV_LOG_VERBOSE, "UDP segmentation offload not "
+                           "supported, sending the datagrams of a batch "
+                           "separately\n");
+            }
+#endif
+        }
+#endif
+#if HAVE_RECVMMSG
+        if (!is_output && udp_batch_alloc(s, UDP_MAX_PKT_SIZE) < 0)
+            goto fail;
+#endif
+    }
+
 #if HAVE_PTHREAD_CANCEL
     /*
       Create thread in case of:
@@ -920,6 +1182,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return AVERROR(EIO);
 }
@@ -986,6 +1251,33 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     }
 #endif
 
+#if HAVE_RECVMMSG
+    if (s->batch_msgs) {
+        int i;
+
+        if (s->batch_pos >= s->batch_count) {
+            s->batch_pos = s->batch_count = 0;
+            ret = ff_network_wait_fd(s->udp_fd, 0);
+            if (ret < 0)
+                return ret;
+            ret = udp_recv_batch(s, MSG_DONTWAIT);
+            if (ret < 0)
+                return ret;
+            s->batch_count = ret;
+        }
+        i = s->batch_pos++;
+        if (ff_ip_check_source_lists(&s->batch_addr[i], &s->filters))
+            return AVERROR(EINTR);
+        ret = s->batch_msgs[i].msg_len;
+        if (ret > size) {
+            av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+            ret = size;
+        }
+        memcpy(buf, s->batch_iov[i].iov_base, ret);
+        return ret;
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -1032,6 +1324,36 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
         pthread_mutex_unlock(&s->mutex);
         return size;
     }
+#endif
+#if HAVE_SENDMMSG
+    if (s->batch_msgs) {
+        if (s->batch_count == s->batch_size ||
+            s->batch_pos + size > s->batch_size * s->batch_slot_size) {
+            ret = udp_send_batch(h);
+            if (ret < 0)
+                return ret;
+        }
+        if (size <= s->batch_slot_size) {
+            uint8_t *dst = s->batch_buf + s->batch_pos;
+
+            memcpy(dst, buf, size);
+            s->batch_iov[s->batch_count].iov_base = dst;
+            s->batch_iov[s->batch_count].iov_len  = size;
+            if (!s->batch_count++)
+                s->batch_start = av_gettime_relative();
+            s->batch_pos += size;
+            /* Without a timer, the delay is only checked on writes, so
+             * that the last datagrams of a burst wait until the next one
+             * or the closing of the connection. */
+            if (s->batch_count == s->batch_size ||
+                av_gettime_relative() - s->batch_start >= s->batch_delay) {
+                ret = udp_send_batch(h);
+                if (ret < 0)
+                    return ret;
+            }
+            return size;
+        }
+    }
 #endif
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
@@ -1063,6 +1385,11 @@ static int udp_close(URLContext *h)
     }
 #endif
 
+#if HAVE_SENDMMSG
+    if (s->batch_msgs && !(h->flags & AVIO_FLAG_READ) && s->batch_count)
+        udp_send_batch(h);
+#endif
+
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr,(struct sockaddr *)&s->local_addr_storage);
 #if HAVE_PTHREAD_CANCEL
@@ -1089,6 +1416,9 @@ static int udp_close(URLContext *h)
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return 0;
 }
@@ -27,6 +27,7 @@
 #include "avio.h"
 #include "libavformat/version.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -96,6 +97,14 @@ typedef struct URLProtocol {
     int (*url_close_dir)(URLContext *h);
     int (*url_delete)(URLContext *h);
     int (*url_move)(URLContext *h_src, URLContext *h_dst);
+    /**
+     * Return a reference to size bytes of the resource starting at offset,
+     * without copying them. The data must be followed by
+     * AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes.
+     * Does not change the position used by url_read.
+     */
+    int (*url_get_buffer_ref)(URLContext *h, int64_t offset, int size,
+                              AVBufferRef **buf);
     const char *default_whitelist;
 } URLProtocol;
 
@@ -44,6 +44,7 @@
 #include "audiointerleave.h"
 #include "avformat.h"
 #include "avio_internal.h"
+#include "http.h"
 #include "id3v2.h"
 #include "internal.h"
 #include "metadata.h"
@@ -151,6 +152,14 @@ struct AVCodecParserContext *av_stream_get_parser(const AVStream *st)
     return st->parser;
 }
 
+enum AVProbeConfidence av_stream_get_probe_confidence(const AVStream *st,
+                                                      enum AVStreamParam param)
+{
+    if ((unsigned)param >= AV_STREAM_PARAM_NB)
+        return AV_PROBE_CONFIDENCE_NONE;
+    return st->internal->probe_confidence[param];
+}
+
 void av_format_inject_global_side_data(AVFormatContext *s)
 {
     int i;
@@ -312,6 +321,12 @@ int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
     pkt->size = 0;
     pkt->pos  = avio_tell(s);
 
+    if (size > 0 && ffio_read_buffer_ref(s, size, &pkt->buf) >= 0) {
+        pkt->data = pkt->buf->data;
+        pkt->size = size;
+        return size;
+    }
+
     return append_packet_chunked(s, pkt, size);
 }
 
@@ -2100,11 +2115,8 @@ int ff_index_search_timestamp(const AVIndexEntry *entries, int nb_entries,
     return m;
 }
 
-void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
+int ff_need_configure_buffers(AVFormatContext *s)
 {
-    int ist1, ist2;
-    int64_t pos_delta = 0;
-    int64_t skip = 0;
     //We could use URLProtocol flags here but as many user applications do not use URLProtocols this would be unreliable
     const char *proto = avio_find_protocol_name(s->url);
 
@@ -2115,7 +2127,16 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
                "optimally without knowing the protocol\n");
     }
 
-    if (proto && !(strcmp(proto, "file") && strcmp(proto, "pipe") && strcmp(proto, "cache")))
+    return !proto || (strcmp(proto, "file") && strcmp(proto, "pipe") && strcmp(proto, "cache"));
+}
+
+void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
+{
+    int ist1, ist2;
+    int64_t pos_delta = 0;
+    int64_t skip = 0;
+
+    if (!ff_need_configure_buffers(s))
         return;
 
     for (ist1 = 0; ist1 < s->nb_streams; ist1++) {
@@ -2144,6 +2165,11 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
         }
     }
 
+    ff_configure_buffers(s, pos_delta, skip);
+}
+
+void ff_configure_buffers(AVFormatContext *s, int64_t pos_delta, int64_t skip)
+{
     pos_delta *= 2;
     /* XXX This could be adjusted depending on protocol*/
     if (s->pb->buffer_size < pos_delta && pos_delta < (1<<24)) {
@@ -3599,6 +3625,134 @@ static int extract_extradata(AVStream *st, const AVPacket *pkt)
     return 0;
 }
 
+/**
+ * Fill in the codec parameters that can be found without decoding: those
+ * a parser exports and the format of decoders that support a single one.
+ * Used in fast probe mode before falling back to try_decode_frame().
+ */
+static void fast_probe_packet(AVFormatContext *s, AVStream *st, const AVPacket *pkt)
+{
+    AVCodecContext *avctx = st->internal->avctx;
+    AVCodecParserContext *pc = st->parser;
+    const AVCodec *codec;
+
+    if (!pc || !st->need_parsing) {
+        uint8_t *data;
+        int size;
+
+        pc = NULL;
+        if (!st->internal->probe_parser && !(s->flags & AVFMT_FLAG_NOPARSE)) {
+            st->internal->probe_parser = av_parser_init(st->codecpar->codec_id);
+            if (st->internal->probe_parser)
+                st->internal->probe_parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+        }
+        if (st->internal->probe_parser) {
+            pc = st->internal->probe_parser;
+            av_parser_parse2(pc, avctx, &data, &size, pkt->data, pkt->size,
+                             pkt->pts, pkt->dts, pkt->pos);
+        }
+    }
+
+    if (pc) {
+        switch (avctx->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            if (!avctx->width && pc->width > 0 && pc->height > 0) {
+                avctx->width  = pc->width;
+                avctx->height = pc->height;
+            }
+            if (!avctx->coded_width && pc->coded_width > 0 && pc->coded_height > 0) {
+                avctx->coded_width  = pc->coded_width;
+                avctx->coded_height = pc->coded_height;
+            }
+            if (avctx->pix_fmt == AV_PIX_FMT_NONE && pc->format >= 0)
+                avctx->pix_fmt = pc->format;
+            if (avctx->field_order == AV_FIELD_UNKNOWN && pc->field_order != AV_FIELD_UNKNOWN)
+                avctx->field_order = pc->field_order;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (avctx->sample_fmt == AV_SAMPLE_FMT_NONE && pc->format >= 0)
+                avctx->sample_fmt = pc->format;
+            break;
+        }
+    }
+
+    /* A decoder that supports a single format will output that format. */
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO && avctx->pix_fmt == AV_PIX_FMT_NONE) {
+        codec = find_probe_decoder(s, st, avctx->codec_id);
+        if (codec && codec->pix_fmts &&
+            codec->pix_fmts[0] != AV_PIX_FMT_NONE &&
+            codec->pix_fmts[1] == AV_PIX_FMT_NONE) {
+            avctx->pix_fmt = codec->pix_fmts[0];
+            st->internal->probe_guessed |= 1 << AV_STREAM_PARAM_FORMAT;
+        }
+    } else if (avctx->codec_type == AVMEDIA_TYPE_AUDIO && avctx->sample_fmt == AV_SAMPLE_FMT_NONE) {
+        codec = find_probe_decoder(s, st, avctx->codec_id);
+        if (codec && codec->sample_fmts &&
+            codec->sample_fmts[0] != AV_SAMPLE_FMT_NONE &&
+            codec->sample_fmts[1] == AV_SAMPLE_FMT_NONE) {
+            avctx->sample_fmt = codec->sample_fmts[0];
+            st->internal->probe_guessed |= 1 << AV_STREAM_PARAM_FORMAT;
+        }
+    }
+
+    /* Opening the decoder would set the bit rate of constant bit rate codecs. */
+    if (avctx->codec_type == AVMEDIA_TYPE_AUDIO && !avctx->bit_rate) {
+        int bits_per_sample = av_get_bits_per_sample(avctx->codec_id);
+        if (bits_per_sample)
+            avctx->bit_rate = avctx->sample_rate * (int64_t)avctx->channels * bits_per_sample;
+    }
+}
+
+/**
+ * Check whether a stream needs to be decoded in fast probe mode: some
+ * parameters are still missing, or timestamps show reordering the headers
+ * did not announce.
+ */
+static int fast_probe_needs_decoding(AVStream *st)
+{
+    return st->info->found_decoder == 1 ||
+           !has_codec_parameters(st, NULL) ||
+           (st->info->frame_delay_evidence && !st->internal->avctx->has_b_frames);
+}
+
+static void update_probe_confidence(AVStream *st)
+{
+    AVCodecContext *avctx = st->internal->avctx;
+    int known[AV_STREAM_PARAM_NB] = { 0 };
+    int i;
+
+    switch (avctx->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        known[AV_STREAM_PARAM_FORMAT]              = avctx->pix_fmt != AV_PIX_FMT_NONE;
+        known[AV_STREAM_PARAM_DIMENSIONS]          = avctx->width > 0 && avctx->height > 0;
+        known[AV_STREAM_PARAM_SAMPLE_ASPECT_RATIO] = avctx->sample_aspect_ratio.num ||
+                                                     st->sample_aspect_ratio.num;
+        known[AV_STREAM_PARAM_FIELD_ORDER]         = avctx->field_order != AV_FIELD_UNKNOWN;
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        known[AV_STREAM_PARAM_FORMAT]              = avctx->sample_fmt != AV_SAMPLE_FMT_NONE;
+        known[AV_STREAM_PARAM_SAMPLE_RATE]         = avctx->sample_rate > 0;
+        known[AV_STREAM_PARAM_CHANNELS]            = avctx->channels > 0;
+        known[AV_STREAM_PARAM_CHANNEL_LAYOUT]      = avctx->channel_layout != 0;
+        known[AV_STREAM_PARAM_FRAME_SIZE]          = avctx->frame_size > 0;
+        break;
+    case AVMEDIA_TYPE_SUBTITLE:
+        known[AV_STREAM_PARAM_DIMENSIONS]          = avctx->width > 0 && avctx->height > 0;
+        break;
+    }
+
+    for (i = 0; i < AV_STREAM_PARAM_NB; i++) {
+        if (!known[i])
+            st->internal->probe_confidence[i] = AV_PROBE_CONFIDENCE_NONE;
+        else if (st->nb_decoded_frames > 0)
+            st->internal->probe_confidence[i] = AV_PROBE_CONFIDENCE_DECODED;
+        else if (st->internal->probe_guessed & (1 << i))
+            st->internal->probe_confidence[i] = AV_PROBE_CONFIDENCE_GUESS;
+        else
+            st->internal->probe_confidence[i] = AV_PROBE_CONFIDENCE_HEADER;
+    }
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     int i, count = 0, ret = 0, j;
@@ -3615,6 +3769,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t max_subtitle_analyze_duration;
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
+    int fast_probe = ic->flags & AVFMT_FLAG_FAST_PROBE;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
 
     flush_codecs = probesize > 0;
@@ -3696,7 +3851,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
             av_dict_set(options ? &options[i] : &thread_opt, "codec_whitelist", ic->codec_whitelist, 0);
 
         /* Ensure that subtitle_header is properly set. */
-        if (st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE
+        if (!fast_probe && st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE
             && codec && !avctx->codec) {
             if (avcodec_open2(avctx, codec, options ? &options[i] : &thread_opt) < 0)
                 av_log(ic, AV_LOG_WARNING,
@@ -3704,7 +3859,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
 
         // Try to just open decoders, in case this is enough to get parameters.
-        if (!has_codec_parameters(st, NULL) && st->request_probe <= 0) {
+        // In fast probe mode, they are only opened once parsing is not enough.
+        if (!fast_probe && !has_codec_parameters(st, NULL) && st->request_probe <= 0) {
             if (codec && !avctx->codec)
                 if (avcodec_open2(avctx, codec, options ? &options[i] : &thread_opt) < 0)
                     av_log(ic, AV_LOG_WARNING,
@@ -3938,8 +4094,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
          * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+        if (fast_probe)
+            fast_probe_packet(ic, st, pkt);
+        if (!fast_probe || fast_probe_needs_decoding(st))
+            try_decode_frame(ic, st, pkt,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(&pkt1);
@@ -4113,6 +4272,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
             ret = avcodec_parameters_to_context(st->internal->avctx, st->codecpar);
             if (ret < 0)
                 goto find_stream_info_err;
+        } else {
+            update_probe_confidence(st);
         }
         if (!has_codec_parameters(st, &errmsg)) {
             char buf[256];
@@ -4197,6 +4358,8 @@ find_stream_info_err:
         av_freep(&ic->streams[i]->info);
         av_bsf_free(&ic->streams[i]->internal->extract_extradata.bsf);
         av_packet_free(&ic->streams[i]->internal->extract_extradata.pkt);
+        av_parser_close(ic->streams[i]->internal->probe_parser);
+        ic->streams[i]->internal->probe_parser = NULL;
     }
     if (ic->pb)
         av_log(ic, AV_LOG_DEBUG, "After avformat_find_stream_info() pos: %"PRId64" bytes read:%"PRId64" seeks:%d frames:%d\n",
@@ -4468,6 +4631,11 @@ void avformat_free_context(AVFormatContext *s)
     av_dict_free(&s->internal->id3v2_meta);
     av_freep(&s->streams);
     flush_packet_queue(s);
+    while (s->internal->packet_buffer_free) {
+        AVPacketList *pktl = s->internal->packet_buffer_free;
+        s->internal->packet_buffer_free = pktl->next;
+        av_free(pktl);
+    }
     av_freep(&s->internal);
     av_freep(&s->url);
     av_free(s);
@@ -5054,6 +5222,10 @@ int avformat_network_init(void)
 int avformat_network_deinit(void)
 {
 #if CONFIG_NETWORK
+#if CONFIG_HTTP_PROTOCOL || CONFIG_HTTPPROXY_PROTOCOL || CONFIG_HTTPS_PROTOCOL
+    /* pooled connections may be TLS ones */
+    ff_http_deinit();
+#endif
     ff_network_close();
     ff_tls_deinit();
 #endif
@@ -26,16 +26,11 @@
 #include "mem.h"
 #include "thread.h"
 
-AVBufferRef *av_buffer_create(uint8_t *data, int size,
-                              void (*free)(void *opaque, uint8_t *data),
-                              void *opaque, int flags)
+static AVBufferRef *buffer_create(AVBuffer *buf, uint8_t *data, int size,
+                                  void (*free)(void *opaque, uint8_t *data),
+                                  void *opaque, int flags)
 {
     AVBufferRef *ref = NULL;
-    AVBuffer    *buf = NULL;
-
-    buf = av_mallocz(sizeof(*buf));
-    if (!buf)
-        return NULL;
 
     buf->data     = data;
     buf->size     = size;
@@ -48,10 +43,8 @@ AVBufferRef *av_buffer_create(uint8_t *data, int size,
         buf->flags |= BUFFER_FLAG_READONLY;
 
     ref = av_mallocz(sizeof(*ref));
-    if (!ref) {
-        av_freep(&buf);
+    if (!ref)
         return NULL;
-    }
 
     ref->buffer = buf;
     ref->data   = data;
@@ -60,6 +53,23 @@ AVBufferRef *av_buffer_create(uint8_t *data, int size,
     return ref;
 }
 
+AVBufferRef *av_buffer_create(uint8_t *data, int size,
+                              void (*free)(void *opaque, uint8_t *data),
+                              void *opaque, int flags)
+{
+    AVBufferRef *ret;
+    AVBuffer    *buf = av_mallocz(sizeof(*buf));
+    if (!buf)
+        return NULL;
+
+    ret = buffer_create(buf, data, size, free, opaque, flags);
+    if (!ret) {
+        av_free(buf);
+        return NULL;
+    }
+    return ret;
+}
+
 void av_buffer_default_free(void *opaque, uint8_t *data)
 {
     av_free(data);
@@ -118,8 +128,12 @@ static void buffer_replace(AVBufferRef **dst, AVBufferRef **src)
         av_freep(dst);
 
     if (atomic_fetch_sub_explicit(&b->refcount, 1, memory_order_acq_rel) == 1) {
+        /* b->free() may hand the structure containing b over to another
+         * thread, so the flag has to be read before calling it */
+        int free_avbuffer = !(b->flags & BUFFER_FLAG_NO_FREE);
         b->free(b->opaque, b->data);
-        av_freep(&b);
+        if (free_avbuffer)
+            av_free(b);
     }
 }
 
@@ -246,6 +260,8 @@ AVBufferPool *av_buffer_pool_init(int size, AVBufferRef* (*alloc)(int size))
 
     pool->size     = size;
     pool->alloc    = alloc ? alloc : av_buffer_alloc;
+    pool->unlocked_alloc = pool->alloc == av_buffer_alloc ||
+                           pool->alloc == av_buffer_allocz;
 
     atomic_init(&pool->refcount, 1);
 
@@ -297,6 +313,7 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     ff_mutex_lock(&pool->mutex);
     buf->next = pool->pool;
     pool->pool = buf;
+    pool->nb_outstanding--;
     ff_mutex_unlock(&pool->mutex);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
@@ -332,34 +349,169 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
     return ret;
 }
 
+/* the lock only covers the list operations and the statistics; buffers of
+ * pools using the default allocators are also allocated outside of it */
 AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
 {
-    AVBufferRef *ret;
+    AVBufferRef *ret = NULL;
     BufferPoolEntry *buf;
 
     ff_mutex_lock(&pool->mutex);
     buf = pool->pool;
     if (buf) {
-        ret = av_buffer_create(buf->data, pool->size, pool_release_buffer,
-                               buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
-        }
+        pool->pool = buf->next;
+        pool->nb_hits++;
     } else {
-        ret = pool_alloc_buffer(pool);
+        pool->nb_misses++;
     }
+    pool->nb_outstanding++;
+    pool->max_outstanding = FFMAX(pool->max_outstanding, pool->nb_outstanding);
+    /* user allocators may rely on the pool lock to serialize their own state,
+     * e.g. the surface counters of the hwcontext pools */
+    if (!buf && !pool->unlocked_alloc)
+        ret = pool_alloc_buffer(pool);
     ff_mutex_unlock(&pool->mutex);
 
-    if (ret)
-        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    if (buf) {
+        /* reuse the AVBuffer embedded in the entry */
+        buf->next = NULL;
+        memset(&buf->buffer, 0, sizeof(buf->buffer));
+        ret = buffer_create(&buf->buffer, buf->data, pool->size,
+                            pool_release_buffer, buf, 0);
+        if (ret)
+            buf->buffer.flags |= BUFFER_FLAG_NO_FREE;
+    } else if (pool->unlocked_alloc) {
+        ret = pool_alloc_buffer(pool);
+    }
+
+    if (!ret) {
+        ff_mutex_lock(&pool->mutex);
+        if (buf) {
+            buf->next  = pool->pool;
+            pool->pool = buf;
+        }
+        pool->nb_outstanding--;
+        ff_mutex_unlock(&pool->mutex);
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
 
     return ret;
 }
 
+void av_buffer_pool_get_stats(AVBufferPool *pool, uint64_t *hits,
+                              uint64_t *misses, int *outstanding,
+                              int *max_outstanding)
+{
+    ff_mutex_lock(&pool->mutex);
+    if (hits)
+        *hits = pool->nb_hits;
+    if (misses)
+        *misses = pool->nb_misses;
+    if (outstanding)
+        *outstanding = pool->nb_outstanding;
+    if (max_outstanding)
+        *max_outstanding = pool->max_outstanding;
+    ff_mutex_unlock(&pool->mutex);
+}
+
 void *av_buffer_pool_buffer_get_opaque(AVBufferRef *ref)
 {
     BufferPoolEntry *buf = ref->buffer->opaque;
     av_assert0(buf);
     return buf->opaque;
 }
+
+AVBufferArena *av_buffer_arena_init(AVBufferRef* (*alloc)(int size))
+{
+    AVBufferArena *arena = av_mallocz(sizeof(*arena));
+    if (!arena)
+        return NULL;
+
+    if (ff_mutex_init(&arena->mutex, NULL)) {
+        av_free(arena);
+        return NULL;
+    }
+
+    arena->alloc = alloc ? alloc : av_buffer_alloc;
+
+    return arena;
+}
+
+void av_buffer_arena_uninit(AVBufferArena **parena)
+{
+    AVBufferArena *arena = *parena;
+    int i;
+
+    if (!arena)
+        return;
+
+    for (i = 0; i < BUFFER_ARENA_NB_CLASSES; i++)
+        av_buffer_pool_uninit(&arena->pools[i]);
+
+    ff_mutex_destroy(&arena->mutex);
+    av_freep(parena);
+}
+
+/* free the pools of the size classes that were not used for a while, must be
+ * called with the arena lock held */
+static void arena_trim(AVBufferArena *arena)
+{
+    int i;
+
+    for (i = 0; i < BUFFER_ARENA_NB_CLASSES; i++)
+        if (arena->pools[i] &&
+            arena->nb_gets - arena->last_get[i] >= BUFFER_ARENA_TRIM_INTERVAL)
+            av_buffer_pool_uninit(&arena->pools[i]);
+}
+
+AVBufferRef *av_buffer_arena_get(AVBufferArena *arena, int size)
+{
+    AVBufferPool *pool;
+    AVBufferRef *ret;
+    int idx, class_size;
+
+    if (size <= 0)
+        return NULL;
+
+    if (size <= 1 << BUFFER_ARENA_MIN_LOG2) {
+        idx        = 0;
+        class_size = 1 << BUFFER_ARENA_MIN_LOG2;
+    } else {
+        int log2  = av_log2(size - 1);
+        int shift = log2 - BUFFER_ARENA_CLASS_BITS;
+        int mant  = (size - 1) >> shift;
+
+        if (log2 >= BUFFER_ARENA_MAX_LOG2)
+            return arena->alloc(size);
+
+        idx        = ((log2 - BUFFER_ARENA_MIN_LOG2) << BUFFER_ARENA_CLASS_BITS) +
+                     mant - (1 << BUFFER_ARENA_CLASS_BITS) + 1;
+        class_size = (mant + 1) << shift;
+    }
+
+    ff_mutex_lock(&arena->mutex);
+    arena->last_get[idx] = ++arena->nb_gets;
+    if (!(arena->nb_gets % BUFFER_ARENA_TRIM_INTERVAL))
+        arena_trim(arena);
+    pool = arena->pools[idx];
+    if (!pool)
+        pool = arena->pools[idx] = av_buffer_pool_init(class_size, arena->alloc);
+    /* keep the pool alive while getting the buffer, another thread may
+     * trim it as soon as the lock is released */
+    if (pool)
+        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    ff_mutex_unlock(&arena->mutex);
+    if (!pool)
+        return NULL;
+
+    ret = av_buffer_pool_get(pool);
+    if (ret)
+        ret->size = size;
+
+    if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
+        buffer_pool_free(pool);
+
+    return ret;
+}
@@ -297,6 +297,80 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool);
  */
 void *av_buffer_pool_buffer_get_opaque(AVBufferRef *ref);
 
+/**
+ * Get usage statistics of a buffer pool.
+ * This function may be called simultaneously from multiple threads.
+ *
+ * @param pool the buffer pool
+ * @param hits if non-NULL, set to the number of av_buffer_pool_get() calls
+ *             that reused a buffer from the pool
+ * @param misses if non-NULL, set to the number of av_buffer_pool_get() calls
+ *               that had to allocate a new buffer
+ * @param outstanding if non-NULL, set to the number of buffers currently
+ *                    handed out by the pool
+ * @param max_outstanding if non-NULL, set to the largest number of buffers
+ *                        that were handed out at the same time
+ */
+void av_buffer_pool_get_stats(AVBufferPool *pool, uint64_t *hits,
+                              uint64_t *misses, int *outstanding,
+                              int *max_outstanding);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup lavu_bufferarena AVBufferArena
+ * @ingroup lavu_data
+ *
+ * @{
+ * AVBufferArena is a thread-safe set of buffer pools for buffers of any size.
+ *
+ * Requested sizes are rounded up to a size class, with four classes per power
+ * of two, and each class is served by its own AVBufferPool. Unlike a single
+ * AVBufferPool, one arena can be shared by users that need buffers of
+ * different sizes, or whose buffer sizes change over time, e.g. all the
+ * decoders and filters of a transcoding process: a buffer released by one of
+ * them can be reused by any other one asking for a buffer of the same size
+ * class. The buffers of size classes that are no longer asked for are freed
+ * after a while.
+ */
+
+/**
+ * The buffer arena. This structure is opaque and not meant to be accessed
+ * directly. It is allocated with av_buffer_arena_init() and freed with
+ * av_buffer_arena_uninit().
+ */
+typedef struct AVBufferArena AVBufferArena;
+
+/**
+ * Allocate and initialize a buffer arena.
+ *
+ * @param alloc a function that will be used to allocate new buffers when the
+ * pool of a size class is empty. May be NULL, then the default allocator will
+ * be used (av_buffer_alloc()).
+ * @return newly created buffer arena on success, NULL on error.
+ */
+AVBufferArena *av_buffer_arena_init(AVBufferRef* (*alloc)(int size));
+
+/**
+ * Free a buffer arena. The buffers it handed out remain valid; they are freed
+ * once they are released.
+ *
+ * @param arena pointer to the arena to be freed. It will be set to NULL.
+ */
+void av_buffer_arena_uninit(AVBufferArena **arena);
+
+/**
+ * Allocate a new AVBuffer of at least size bytes, reusing an old buffer of the
+ * same size class when available.
+ * This function may be called simultaneously from multiple threads.
+ *
+ * @return a reference to the new buffer on success, NULL on error. The size of
+ *         the reference is set to size, the underlying buffer may be larger.
+ */
+AVBufferRef *av_buffer_arena_get(AVBufferArena *arena, int size);
+
 /**
  * @}
  */
@@ -33,6 +33,11 @@
  * The buffer was av_realloc()ed, so it is reallocatable.
  */
 #define BUFFER_FLAG_REALLOCATABLE (1 << 1)
+/**
+ * The AVBuffer structure is part of a larger structure
+ * and must not be freed.
+ */
+#define BUFFER_FLAG_NO_FREE       (1 << 2)
 
 struct AVBuffer {
     uint8_t *data; /**< data described by this buffer */
@@ -62,6 +67,12 @@ struct AVBuffer {
 typedef struct BufferPoolEntry {
     uint8_t *data;
 
+    /*
+     * AVBuffer used for the references handed out by av_buffer_pool_get(),
+     * so that getting a buffer from the pool needs no allocation for it.
+     */
+    AVBuffer buffer;
+
     /*
      * Backups of the original opaque/free of the AVBuffer corresponding to
      * data. They will be used to free the buffer when the pool is freed.
@@ -88,11 +99,53 @@ struct AVBufferPool {
      */
     atomic_uint refcount;
 
+    /* statistics, protected by mutex */
+    uint64_t nb_hits;
+    uint64_t nb_misses;
+    int      nb_outstanding;
+    int      max_outstanding;
+
     int size;
     void *opaque;
     AVBufferRef* (*alloc)(int size);
     AVBufferRef* (*alloc2)(void *opaque, int size);
     void         (*pool_free)(void *opaque);
+
+    /* the allocator does not need to be serialized by mutex, which is only
+     * the case of av_buffer_alloc() and av_buffer_allocz() */
+    int unlocked_alloc;
+};
+
+/*
+ * Size classes of an AVBufferArena: sizes up to 1 << BUFFER_ARENA_MIN_LOG2
+ * share the first class, larger ones are rounded up to one of
+ * 1 << BUFFER_ARENA_CLASS_BITS classes per power of two. Sizes too large for
+ * the last class are not pooled.
+ */
+#define BUFFER_ARENA_MIN_LOG2   8
+#define BUFFER_ARENA_MAX_LOG2   30
+#define BUFFER_ARENA_CLASS_BITS 2
+#define BUFFER_ARENA_NB_CLASSES \
+    (((BUFFER_ARENA_MAX_LOG2 - BUFFER_ARENA_MIN_LOG2) << BUFFER_ARENA_CLASS_BITS) + 1)
+
+/*
+ * The pool of a size class that was not asked for during the last
+ * BUFFER_ARENA_TRIM_INTERVAL requests to the arena is freed, together with
+ * the buffers it holds, so that classes only used before e.g. a change of
+ * resolution do not keep their memory until the arena is freed.
+ */
+#define BUFFER_ARENA_TRIM_INTERVAL 1024
+
+struct AVBufferArena {
+    AVMutex mutex;
+    AVBufferRef* (*alloc)(int size);
+    /* the fields below are protected by mutex */
+    /* pools of the size classes, created on first use */
+    AVBufferPool *pools[BUFFER_ARENA_NB_CLASSES];
+    /* number of requests to the arena, and its value at the last request
+     * to each size class */
+    unsigned nb_gets;
+    unsigned last_get[BUFFER_ARENA_NB_CLASSES];
 };
 
 #endif /* AVUTIL_BUFFER_INTERNAL_H */
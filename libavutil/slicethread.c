@@ -20,6 +20,7 @@
 #include "slicethread.h"
 #include "mem.h"
 #include "thread.h"
+#include "threadpool_internal.h"
 #include "avassert.h"
 
 #if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
@@ -29,11 +30,13 @@ typedef struct WorkerContext {
     pthread_mutex_t mutex;
     pthread_cond_t  cond;
     pthread_t       thread;
+    AVThreadPoolWorker *pool_worker;
     int             done;
 } WorkerContext;
 
 struct AVSliceThread {
     WorkerContext   *workers;
+    AVThreadPool    *pool;
     int             nb_threads;
     int             nb_active_threads;
     int             nb_jobs;
@@ -95,6 +98,14 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
                               void (*main_func)(void *priv),
                               int nb_threads)
+{
+    return avpriv_slicethread_create_pool(pctx, priv, worker_func, main_func, nb_threads, NULL);
+}
+
+int avpriv_slicethread_create_pool(AVSliceThread **pctx, void *priv,
+                                   void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                   void (*main_func)(void *priv),
+                                   int nb_threads, AVThreadPool *pool)
 {
     AVSliceThread *ctx;
     int nb_workers, i;
@@ -112,15 +123,26 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     if (!main_func)
         nb_workers--;
 
+    if (pool) {
+        nb_workers = avpriv_thread_pool_reserve(pool, nb_workers);
+        nb_threads = main_func ? nb_workers : nb_workers + 1;
+    }
+
     *pctx = ctx = av_mallocz(sizeof(*ctx));
-    if (!ctx)
+    if (!ctx) {
+        if (pool)
+            avpriv_thread_pool_release(pool, nb_workers);
         return AVERROR(ENOMEM);
+    }
 
     if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
+        if (pool)
+            avpriv_thread_pool_release(pool, nb_workers);
         av_freep(pctx);
         return AVERROR(ENOMEM);
     }
 
+    ctx->pool        = pool;
     ctx->priv        = priv;
     ctx->worker_func = worker_func;
     ctx->main_func   = main_func;
@@ -144,13 +166,19 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
         pthread_mutex_lock(&w->mutex);
         w->done = 0;
 
-        if (ret = pthread_create(&w->thread, NULL, thread_worker, w)) {
+        if (pool)
+            ret = avpriv_thread_pool_start(pool, &w->pool_worker, thread_worker, w);
+        else
+            ret = AVERROR(pthread_create(&w->thread, NULL, thread_worker, w));
+        if (ret) {
+            if (pool)
+                avpriv_thread_pool_release(pool, nb_workers - i);
             ctx->nb_threads = main_func ? i : i + 1;
             pthread_mutex_unlock(&w->mutex);
             pthread_cond_destroy(&w->cond);
             pthread_mutex_destroy(&w->mutex);
             avpriv_slicethread_free(pctx);
-            return AVERROR(ret);
+            return ret;
         }
 
         while (!w->done)
@@ -220,11 +248,17 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
 
     for (i = 0; i < nb_workers; i++) {
         WorkerContext *w = &ctx->workers[i];
-        pthread_join(w->thread, NULL);
+        if (ctx->pool)
+            avpriv_thread_pool_join(ctx->pool, &w->pool_worker);
+        else
+            pthread_join(w->thread, NULL);
         pthread_cond_destroy(&w->cond);
         pthread_mutex_destroy(&w->mutex);
     }
 
+    if (ctx->pool)
+        avpriv_thread_pool_release(ctx->pool, nb_workers);
+
     pthread_cond_destroy(&ctx->done_cond);
     pthread_mutex_destroy(&ctx->done_mutex);
     av_freep(&ctx->workers);
@@ -242,6 +276,15 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     return AVERROR(EINVAL);
 }
 
+int avpriv_slicethread_create_pool(AVSliceThread **pctx, void *priv,
+                                   void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                                   void (*main_func)(void *priv),
+                                   int nb_threads, AVThreadPool *pool)
+{
+    *pctx = NULL;
+    return AVERROR(EINVAL);
+}
+
 void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_main)
 {
     av_assert0(0);
@@ -0,0 +1,91 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/buffer_internal.h"
+#include "libavutil/internal.h"
+
+static int nb_pools(const AVBufferArena *arena)
+{
+    int i, nb = 0;
+
+    for (i = 0; i < BUFFER_ARENA_NB_CLASSES; i++)
+        nb += !!arena->pools[i];
+    return nb;
+}
+
+int main(void)
+{
+    static const int sizes[] = {
+        1, 256, 257, 320, 321, 1000, 1024, 1025, 100000, 1 << 20,
+    };
+    AVBufferArena *arena = av_buffer_arena_init(NULL);
+    AVBufferRef *buf, *kept;
+    uint8_t *data;
+    int i;
+
+    if (!arena)
+        return 1;
+
+    /* sizes are rounded up to one of four classes per power of two */
+    for (i = 0; i < FF_ARRAY_ELEMS(sizes); i++) {
+        buf = av_buffer_arena_get(arena, sizes[i]);
+        if (!buf)
+            return 1;
+        printf("size %d: class size %d%s\n", sizes[i], buf->buffer->size,
+               buf->size == sizes[i] ? "" : ", wrong reference size");
+        av_buffer_unref(&buf);
+    }
+    printf("size 0: %s\n", av_buffer_arena_get(arena, 0) ? "buffer" : "no buffer");
+    printf("%d classes used\n", nb_pools(arena));
+
+    /* a released buffer is reused for any size of its class */
+    buf  = av_buffer_arena_get(arena, 1000);
+    data = buf->data;
+    av_buffer_unref(&buf);
+    buf  = av_buffer_arena_get(arena, 900);
+    printf("size 900 after 1000: %s buffer\n", buf->data == data ? "reused" : "new");
+    av_buffer_unref(&buf);
+    buf  = av_buffer_arena_get(arena, 1100);
+    printf("size 1100 after 900: %s buffer\n", buf->data == data ? "reused" : "new");
+    av_buffer_unref(&buf);
+
+    /* the classes no longer asked for are freed, the buffers in use stay
+     * valid */
+    kept = av_buffer_arena_get(arena, 5000);
+    if (!kept)
+        return 1;
+    for (i = 0; i < 2 * BUFFER_ARENA_TRIM_INTERVAL; i++) {
+        buf = av_buffer_arena_get(arena, 100);
+        if (!buf)
+            return 1;
+        av_buffer_unref(&buf);
+    }
+    printf("%d classes used after trimming\n", nb_pools(arena));
+    memset(kept->data, 0, kept->size);
+    av_buffer_unref(&kept);
+    buf = av_buffer_arena_get(arena, 1000);
+    printf("%d classes used after a new request\n", nb_pools(arena));
+    av_buffer_unref(&buf);
+
+    av_buffer_arena_uninit(&arena);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "libavutil/buffer.h"
+
+static void print_stats(const char *when, AVBufferPool *pool)
+{
+    uint64_t hits, misses;
+    int outstanding, max_outstanding;
+
+    av_buffer_pool_get_stats(pool, &hits, &misses, &outstanding, &max_outstanding);
+    printf("%s: hits %"PRIu64" misses %"PRIu64" outstanding %d peak %d\n",
+           when, hits, misses, outstanding, max_outstanding);
+}
+
+int main(void)
+{
+    AVBufferPool *pool = av_buffer_pool_init(1024, NULL);
+    AVBufferRef *bufs[3], *ref;
+    int i, outstanding;
+
+    if (!pool)
+        return 1;
+    print_stats("new pool", pool);
+
+    /* an empty pool allocates every buffer */
+    for (i = 0; i < 3; i++)
+        if (!(bufs[i] = av_buffer_pool_get(pool)))
+            return 1;
+    print_stats("3 buffers taken", pool);
+
+    /* only the last reference returns a buffer to the pool */
+    ref = av_buffer_ref(bufs[0]);
+    av_buffer_unref(&bufs[0]);
+    print_stats("1 buffer still referenced", pool);
+    av_buffer_unref(&ref);
+    av_buffer_unref(&bufs[1]);
+    print_stats("2 buffers returned", pool);
+
+    /* returned buffers are reused first, the peak is kept */
+    for (i = 0; i < 3; i++)
+        if (i != 2 && !(bufs[i] = av_buffer_pool_get(pool)))
+            return 1;
+    print_stats("2 buffers taken again", pool);
+    if (!(ref = av_buffer_pool_get(pool)))
+        return 1;
+    print_stats("1 more buffer taken", pool);
+
+    av_buffer_unref(&ref);
+    for (i = 0; i < 3; i++)
+        av_buffer_unref(&bufs[i]);
+    print_stats("all buffers returned", pool);
+
+    /* the counters can be read selectively */
+    av_buffer_pool_get_stats(pool, NULL, NULL, &outstanding, NULL);
+    printf("outstanding only: %d\n", outstanding);
+
+    av_buffer_pool_uninit(&pool);
+    return 0;
+}
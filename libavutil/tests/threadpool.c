@@ -0,0 +1,105 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+#include "libavutil/threadpool_internal.h"
+
+#define NB_THREADS 4
+
+typedef struct Job {
+    AVThreadPoolWorker *worker;
+    pthread_t thread;
+    int ran;
+} Job;
+
+static void *job_func(void *arg)
+{
+    Job *job = arg;
+
+    job->thread = pthread_self();
+    job->ran    = 1;
+    return NULL;
+}
+
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    if (level <= AV_LOG_ERROR)
+        vprintf(fmt, vl);
+}
+
+static int run_jobs(AVThreadPool *pool, Job *jobs)
+{
+    int i, nb_ran = 0;
+
+    for (i = 0; i < NB_THREADS; i++) {
+        jobs[i].ran = 0;
+        if (avpriv_thread_pool_start(pool, &jobs[i].worker, job_func, &jobs[i]) < 0)
+            return -1;
+    }
+    for (i = 0; i < NB_THREADS; i++) {
+        avpriv_thread_pool_join(pool, &jobs[i].worker);
+        nb_ran += jobs[i].ran;
+    }
+    return nb_ran;
+}
+
+int main(void)
+{
+    AVThreadPool *pool = NULL;
+    Job jobs[NB_THREADS], first[NB_THREADS];
+    int i, j, nb_reused = 0;
+
+    av_log_set_callback(log_callback);
+
+    if (av_thread_pool_alloc(&pool, NB_THREADS) < 0)
+        return 1;
+
+    /* the reservations are bounded by the size of the pool */
+    printf("reserved %d of %d threads\n",
+           avpriv_thread_pool_reserve(pool, NB_THREADS), NB_THREADS);
+    printf("reserved %d of 2 threads\n", avpriv_thread_pool_reserve(pool, 2));
+    avpriv_thread_pool_release(pool, 1);
+    printf("reserved %d of 2 threads after releasing 1\n",
+           avpriv_thread_pool_reserve(pool, 2));
+
+    /* the threads are parked after a job and run the next ones */
+    printf("first run: %d jobs ran\n", run_jobs(pool, first));
+    printf("second run: %d jobs ran\n", run_jobs(pool, jobs));
+    for (i = 0; i < NB_THREADS; i++) {
+        for (j = 0; j < NB_THREADS; j++) {
+            if (pthread_equal(jobs[i].thread, first[j].thread)) {
+                nb_reused++;
+                break;
+            }
+        }
+    }
+    printf("%d threads reused\n", nb_reused);
+
+    /* a pool with reserved threads is not freed */
+    av_thread_pool_free(&pool);
+    printf("pool %s\n", pool ? "kept" : "freed");
+    avpriv_thread_pool_release(pool, NB_THREADS);
+    av_thread_pool_free(&pool);
+    printf("pool %s\n", pool ? "kept" : "freed");
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "avassert.h"
+#include "common.h"
+#include "cpu.h"
+#include "error.h"
+#include "log.h"
+#include "mem.h"
+#include "thread.h"
+#include "threadpool.h"
+#include "threadpool_internal.h"
+
+#if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
+
+struct AVThreadPoolWorker {
+    AVThreadPool       *pool;
+    pthread_t           thread;
+    pthread_cond_t      cond;
+    void             *(*func)(void *arg);
+    void               *arg;
+    int                 done;
+    AVThreadPoolWorker *next_idle;
+    AVThreadPoolWorker *next;
+};
+
+struct AVThreadPool {
+    pthread_mutex_t     mutex;
+    AVThreadPoolWorker *workers;    ///< all threads created by the pool
+    AVThreadPoolWorker *idle;       ///< parked threads
+    int                 max_threads;
+    int                 nb_reserved;
+    int                 finished;
+};
+
+static void *attribute_align_arg pool_worker(void *v)
+{
+    AVThreadPoolWorker *w = v;
+    AVThreadPool *pool = w->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        void *(*func)(void *arg);
+
+        while (!w->func && !pool->finished)
+            pthread_cond_wait(&w->cond, &pool->mutex);
+        if (!w->func)
+            break;
+
+        func = w->func;
+        pthread_mutex_unlock(&pool->mutex);
+        func(w->arg);
+        pthread_mutex_lock(&pool->mutex);
+
+        w->func = NULL;
+        w->done = 1;
+        pthread_cond_signal(&w->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+int av_thread_pool_alloc(AVThreadPool **ppool, int max_threads)
+{
+    AVThreadPool *pool;
+    int ret;
+
+    if (max_threads < 0)
+        return AVERROR(EINVAL);
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    ret = pthread_mutex_init(&pool->mutex, NULL);
+    if (ret) {
+        av_free(pool);
+        return AVERROR(ret);
+    }
+    pool->max_threads = max_threads ? max_threads : av_cpu_count();
+
+    *ppool = pool;
+    return 0;
+}
+
+void av_thread_pool_free(AVThreadPool **ppool)
+{
+    AVThreadPool *pool = *ppool;
+    AVThreadPoolWorker *w, *next;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->nb_reserved) {
+        av_log(NULL, AV_LOG_ERROR, "Thread pool freed while %d of its threads "
+               "are still reserved, not freeing it.\n", pool->nb_reserved);
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+    pool->finished = 1;
+    for (w = pool->workers; w; w = w->next)
+        pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (w = pool->workers; w; w = next) {
+        next = w->next;
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cond);
+        av_free(w);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    av_freep(ppool);
+}
+
+int avpriv_thread_pool_reserve(AVThreadPool *pool, int nb_threads)
+{
+    pthread_mutex_lock(&pool->mutex);
+    nb_threads = av_clip(nb_threads, 0, pool->max_threads - pool->nb_reserved);
+    pool->nb_reserved += nb_threads;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return nb_threads;
+}
+
+void avpriv_thread_pool_release(AVThreadPool *pool, int nb_threads)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->nb_reserved -= nb_threads;
+    av_assert0(pool->nb_reserved >= 0);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int avpriv_thread_pool_start(AVThreadPool *pool, AVThreadPoolWorker **pworker,
+                             void *(*func)(void *arg), void *arg)
+{
+    AVThreadPoolWorker *w;
+    int ret;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (w = pool->idle) {
+        pool->idle = w->next_idle;
+        w->func    = func;
+        w->arg     = arg;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&pool->mutex);
+        *pworker = w;
+        return 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    w = av_mallocz(sizeof(*w));
+    if (!w)
+        return AVERROR(ENOMEM);
+    w->pool = pool;
+    w->func = func;
+    w->arg  = arg;
+
+    ret = pthread_cond_init(&w->cond, NULL);
+    if (ret) {
+        av_free(w);
+        return AVERROR(ret);
+    }
+    ret = pthread_create(&w->thread, NULL, pool_worker, w);
+    if (ret) {
+        pthread_cond_destroy(&w->cond);
+        av_free(w);
+        return AVERROR(ret);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    w->next       = pool->workers;
+    pool->workers = w;
+    pthread_mutex_unlock(&pool->mutex);
+
+    *pworker = w;
+    return 0;
+}
+
+void avpriv_thread_pool_join(AVThreadPool *pool, AVThreadPoolWorker **pworker)
+{
+    AVThreadPoolWorker *w = *pworker;
+
+    if (!w)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!w->done)
+        pthread_cond_wait(&w->cond, &pool->mutex);
+    w->done      = 0;
+    w->next_idle = pool->idle;
+    pool->idle   = w;
+    pthread_mutex_unlock(&pool->mutex);
+
+    *pworker = NULL;
+}
+
+#else /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS */
+
+int av_thread_pool_alloc(AVThreadPool **pool, int max_threads)
+{
+    *pool = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void av_thread_pool_free(AVThreadPool **pool)
+{
+}
+
+int avpriv_thread_pool_reserve(AVThreadPool *pool, int nb_threads)
+{
+    return 0;
+}
+
+void avpriv_thread_pool_release(AVThreadPool *pool, int nb_threads)
+{
+    av_assert0(!nb_threads);
+}
+
+int avpriv_thread_pool_start(AVThreadPool *pool, AVThreadPoolWorker **worker,
+                             void *(*func)(void *arg), void *arg)
+{
+    return AVERROR(ENOSYS);
+}
+
+void avpriv_thread_pool_join(AVThreadPool *pool, AVThreadPoolWorker **worker)
+{
+    av_assert0(!*worker);
+}
+
+#endif /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS */
@@ -0,0 +1,54 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+/**
+ * A pool of worker threads that can be shared by several contexts, e.g. by
+ * setting AVCodecContext.thread_pool on every codec context of a process.
+ *
+ * Threads are created on demand and parked instead of being destroyed when
+ * a context no longer needs them, so opening and closing contexts does not
+ * create and join threads each time. The total number of threads handed out
+ * is bounded; a context that cannot get all the threads it asked for runs
+ * with fewer threads.
+ */
+typedef struct AVThreadPool AVThreadPool;
+
+/**
+ * Allocate a thread pool.
+ *
+ * @param pool        pointer to the thread pool
+ * @param max_threads maximum number of threads the pool hands out at the
+ *                    same time, 0 for the number of CPUs
+ * @return  >=0 for success; <0 for error, in particular AVERROR(ENOSYS) if
+ *          lavu was built without thread support
+ */
+int av_thread_pool_alloc(AVThreadPool **pool, int max_threads);
+
+/**
+ * Free a thread pool and join its threads.
+ *
+ * All contexts using the pool must have been closed before. If threads of
+ * the pool are still reserved by a context, an error is logged and the pool
+ * is left untouched.
+ */
+void av_thread_pool_free(AVThreadPool **pool);
+
+#endif /* AVUTIL_THREADPOOL_H */
@@ -0,0 +1,55 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_INTERNAL_H
+#define AVUTIL_THREADPOOL_INTERNAL_H
+
+#include "threadpool.h"
+
+typedef struct AVThreadPoolWorker AVThreadPoolWorker;
+
+/**
+ * Reserve threads from the pool.
+ * @param pool       thread pool
+ * @param nb_threads number of threads wanted
+ * @return number of threads actually reserved, between 0 and nb_threads
+ */
+int avpriv_thread_pool_reserve(AVThreadPool *pool, int nb_threads);
+
+/**
+ * Give back threads reserved with avpriv_thread_pool_reserve().
+ */
+void avpriv_thread_pool_release(AVThreadPool *pool, int nb_threads);
+
+/**
+ * Run func(arg) on a thread of the pool, like pthread_create().
+ * The caller must hold a reservation for the thread.
+ * @param pool   thread pool
+ * @param worker handle of the running thread returned here
+ * @return 0 on success, negative AVERROR on failure
+ */
+int avpriv_thread_pool_start(AVThreadPool *pool, AVThreadPoolWorker **worker,
+                             void *(*func)(void *arg), void *arg);
+
+/**
+ * Wait for func() passed to avpriv_thread_pool_start() to return, like
+ * pthread_join(), and park the thread for later reuse.
+ */
+void avpriv_thread_pool_join(AVThreadPool *pool, AVThreadPoolWorker **worker);
+
+#endif /* AVUTIL_THREADPOOL_INTERNAL_H */
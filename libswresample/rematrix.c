@@ -494,14 +494,26 @@ av_cold void swri_rematrix_free(SwrContext *s){
     av_freep(&s->native_simd_one);
 }
 
-int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
-    int out_i, in_i, i, j;
+/**
+ * Rematrix samples start to start + len - 1 of output channel out_i, or of
+ * all the output channels if s->mix_any_f is set.
+ */
+static void rematrix_channel(SwrContext *s, AudioData *out, AudioData *in,
+                             int out_i, int start, int len, int mustcopy){
+    int in_i, i, j;
     int len1 = 0;
     int off = 0;
+    const int so = start * out->bps;
 
     if(s->mix_any_f) {
-        s->mix_any_f(out->ch, (const uint8_t **)in->ch, s->native_matrix, len);
-        return 0;
+        uint8_t *outp[SWR_CH_MAX];
+        const uint8_t *inp[SWR_CH_MAX];
+        for(i=0; i<out->ch_count; i++)
+            outp[i] = out->ch[i] + so;
+        for(i=0; i<in->ch_count; i++)
+            inp[i] = in->ch[i] + so;
+        s->mix_any_f(outp, inp, s->native_matrix, len);
+        return;
     }
 
     if(s->mix_2_1_simd || s->mix_1_1_simd){
@@ -509,68 +521,106 @@ int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mus
         off = len1 * out->bps;
     }
 
-    av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
-    av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
-
-    for(out_i=0; out_i<out->ch_count; out_i++){
-        switch(s->matrix_ch[out_i][0]){
-        case 0:
-            if(mustcopy)
-                memset(out->ch[out_i], 0, len * av_get_bytes_per_sample(s->int_sample_fmt));
-            break;
-        case 1:
-            in_i= s->matrix_ch[out_i][1];
-            if(s->matrix[out_i][in_i]!=1.0){
-                if(s->mix_1_1_simd && len1)
-                    s->mix_1_1_simd(out->ch[out_i]    , in->ch[in_i]    , s->native_simd_matrix, in->ch_count*out_i + in_i, len1);
-                if(len != len1)
-                    s->mix_1_1_f   (out->ch[out_i]+off, in->ch[in_i]+off, s->native_matrix, in->ch_count*out_i + in_i, len-len1);
-            }else if(mustcopy){
-                memcpy(out->ch[out_i], in->ch[in_i], len*out->bps);
-            }else{
-                out->ch[out_i]= in->ch[in_i];
-            }
-            break;
-        case 2: {
-            int in_i1 = s->matrix_ch[out_i][1];
-            int in_i2 = s->matrix_ch[out_i][2];
-            if(s->mix_2_1_simd && len1)
-                s->mix_2_1_simd(out->ch[out_i]    , in->ch[in_i1]    , in->ch[in_i2]    , s->native_simd_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len1);
-            else
-                s->mix_2_1_f   (out->ch[out_i]    , in->ch[in_i1]    , in->ch[in_i2]    , s->native_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len1);
+    switch(s->matrix_ch[out_i][0]){
+    case 0:
+        if(mustcopy)
+            memset(out->ch[out_i] + so, 0, len * av_get_bytes_per_sample(s->int_sample_fmt));
+        break;
+    case 1:
+        in_i= s->matrix_ch[out_i][1];
+        if(s->matrix[out_i][in_i]!=1.0){
+            if(s->mix_1_1_simd && len1)
+                s->mix_1_1_simd(out->ch[out_i]+so    , in->ch[in_i]+so    , s->native_simd_matrix, in->ch_count*out_i + in_i, len1);
             if(len != len1)
-                s->mix_2_1_f   (out->ch[out_i]+off, in->ch[in_i1]+off, in->ch[in_i2]+off, s->native_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len-len1);
-            break;}
-        default:
-            if(s->int_sample_fmt == AV_SAMPLE_FMT_FLTP){
-                for(i=0; i<len; i++){
-                    float v=0;
-                    for(j=0; j<s->matrix_ch[out_i][0]; j++){
-                        in_i= s->matrix_ch[out_i][1+j];
-                        v+= ((float*)in->ch[in_i])[i] * s->matrix_flt[out_i][in_i];
-                    }
-                    ((float*)out->ch[out_i])[i]= v;
+                s->mix_1_1_f   (out->ch[out_i]+so+off, in->ch[in_i]+so+off, s->native_matrix, in->ch_count*out_i + in_i, len-len1);
+        }else if(mustcopy){
+            memcpy(out->ch[out_i] + so, in->ch[in_i] + so, len*out->bps);
+        }else if(!start){
+            /* the first band sets the pointer for the whole channel */
+            out->ch[out_i]= in->ch[in_i];
+        }
+        break;
+    case 2: {
+        int in_i1 = s->matrix_ch[out_i][1];
+        int in_i2 = s->matrix_ch[out_i][2];
+        if(s->mix_2_1_simd && len1)
+            s->mix_2_1_simd(out->ch[out_i]+so    , in->ch[in_i1]+so    , in->ch[in_i2]+so    , s->native_simd_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len1);
+        else
+            s->mix_2_1_f   (out->ch[out_i]+so    , in->ch[in_i1]+so    , in->ch[in_i2]+so    , s->native_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len1);
+        if(len != len1)
+            s->mix_2_1_f   (out->ch[out_i]+so+off, in->ch[in_i1]+so+off, in->ch[in_i2]+so+off, s->native_matrix, in->ch_count*out_i + in_i1, in->ch_count*out_i + in_i2, len-len1);
+        break;}
+    default:
+        if(s->int_sample_fmt == AV_SAMPLE_FMT_FLTP){
+            for(i=start; i<start+len; i++){
+                float v=0;
+                for(j=0; j<s->matrix_ch[out_i][0]; j++){
+                    in_i= s->matrix_ch[out_i][1+j];
+                    v+= ((float*)in->ch[in_i])[i] * s->matrix_flt[out_i][in_i];
                 }
-            }else if(s->int_sample_fmt == AV_SAMPLE_FMT_DBLP){
-                for(i=0; i<len; i++){
-                    double v=0;
-                    for(j=0; j<s->matrix_ch[out_i][0]; j++){
-                        in_i= s->matrix_ch[out_i][1+j];
-                        v+= ((double*)in->ch[in_i])[i] * s->matrix[out_i][in_i];
-                    }
-                    ((double*)out->ch[out_i])[i]= v;
+                ((float*)out->ch[out_i])[i]= v;
+            }
+        }else if(s->int_sample_fmt == AV_SAMPLE_FMT_DBLP){
+            for(i=start; i<start+len; i++){
+                double v=0;
+                for(j=0; j<s->matrix_ch[out_i][0]; j++){
+                    in_i= s->matrix_ch[out_i][1+j];
+                    v+= ((double*)in->ch[in_i])[i] * s->matrix[out_i][in_i];
                 }
-            }else{
-                for(i=0; i<len; i++){
-                    int v=0;
-                    for(j=0; j<s->matrix_ch[out_i][0]; j++){
-                        in_i= s->matrix_ch[out_i][1+j];
-                        v+= ((int16_t*)in->ch[in_i])[i] * s->matrix32[out_i][in_i];
-                    }
-                    ((int16_t*)out->ch[out_i])[i]= (v + 16384)>>15;
+                ((double*)out->ch[out_i])[i]= v;
+            }
+        }else{
+            for(i=start; i<start+len; i++){
+                int v=0;
+                for(j=0; j<s->matrix_ch[out_i][0]; j++){
+                    in_i= s->matrix_ch[out_i][1+j];
+                    v+= ((int16_t*)in->ch[in_i])[i] * s->matrix32[out_i][in_i];
                 }
+                ((int16_t*)out->ch[out_i])[i]= (v + 16384)>>15;
             }
         }
     }
+}
+
+/* smallest band of samples worth handing to another thread */
+#define REMATRIX_MIN_BAND 256
+
+typedef struct RematrixThreadData {
+    SwrContext *s;
+    AudioData *out, *in;
+    int len, mustcopy;
+    int nb_channels, nb_bands;
+} RematrixThreadData;
+
+static void rematrix_job(void *arg, int jobnr, int nb_jobs){
+    RematrixThreadData *td = arg;
+    int out_i = jobnr % td->nb_channels;
+    int band  = jobnr / td->nb_channels;
+    /* the bands start on multiples of 16 samples, like the SIMD functions */
+    int start = td->len / 16 *  band      / td->nb_bands * 16;
+    int end   = band + 1 == td->nb_bands ? td->len :
+                td->len / 16 * (band + 1) / td->nb_bands * 16;
+
+    if(end > start)
+        rematrix_channel(td->s, td->out, td->in, out_i, start, end - start, td->mustcopy);
+}
+
+int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
+    RematrixThreadData td = { s, out, in, len, mustcopy };
+
+    if(!s->mix_any_f) {
+        av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
+        av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
+    }
+
+    /* with fewer output channels than threads, the channels are also split
+     * into bands of samples */
+    td.nb_channels = s->mix_any_f ? 1 : out->ch_count;
+    td.nb_bands    = 1;
+    if(s->slicethread)
+        td.nb_bands = av_clip((s->nb_slice_threads + td.nb_channels - 1) / td.nb_channels,
+                              1, FFMAX(len / REMATRIX_MIN_BAND, 1));
+
+    swri_execute(s, rematrix_job, &td, td.nb_channels * td.nb_bands);
     return 0;
 }
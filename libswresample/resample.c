@@ -449,12 +449,45 @@ static int set_compensation(ResampleContext *c, int sample_delta, int compensati
     return 0;
 }
 
-static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
-    int i;
+typedef struct ResampleThreadData {
+    ResampleContext *c;
+    AudioData *dst, *src;
+    int dst_size;
+    int need_emms;
+    int64_t index2, incr;               ///< position and step for resample_one()
+    int (*resample_func)(struct ResampleContext *c, void *dst,
+                         const void *src, int n, int update_ctx);
+    int consumed, index, frac;          ///< state after the last channel
+} ResampleThreadData;
+
+static void resample_channel(void *arg, int i, int nb_jobs)
+{
+    ResampleThreadData *td = arg;
+    ResampleContext *c = td->c;
+
+    if (!td->resample_func) {
+        c->dsp.resample_one(td->dst->ch[i], td->src->ch[i], td->dst_size, td->index2, td->incr);
+    } else if (i + 1 < nb_jobs) {
+        td->resample_func(c, td->dst->ch[i], td->src->ch[i], td->dst_size, 0);
+    } else {
+        /* the other channels may still be reading the position, so the
+         * last one advances it on a copy of the context */
+        ResampleContext last = *c;
+        td->consumed = td->resample_func(&last, td->dst->ch[i], td->src->ch[i], td->dst_size, 1);
+        td->index    = last.index;
+        td->frac     = last.frac;
+    }
+
+    if (td->need_emms)
+        emms_c();
+}
+
+static int multiple_resample(SwrContext *s, ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
     int av_unused mm_flags = av_get_cpu_flags();
     int need_emms = c->format == AV_SAMPLE_FMT_S16P && ARCH_X86_32 &&
                     (mm_flags & (AV_CPU_FLAG_MMX2 | AV_CPU_FLAG_SSE2)) == AV_CPU_FLAG_MMX2;
     int64_t max_src_size = (INT64_MAX/2 / c->phase_count) / c->src_incr;
+    ResampleThreadData td = { .c = c, .dst = dst, .src = src, .need_emms = need_emms };
 
     if (c->compensation_distance)
         dst_size = FFMIN(dst_size, c->compensation_distance);
@@ -469,39 +502,38 @@ static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, A
 
         dst_size = FFMAX(FFMIN(dst_size, new_size), 0);
         if (dst_size > 0) {
-            for (i = 0; i < dst->ch_count; i++) {
-                c->dsp.resample_one(dst->ch[i], src->ch[i], dst_size, index2, incr);
-                if (i+1 == dst->ch_count) {
-                    c->index += dst_size * c->dst_incr_div;
-                    c->index += (c->frac + dst_size * (int64_t)c->dst_incr_mod) / c->src_incr;
-                    av_assert2(c->index >= 0);
-                    *consumed = c->index;
-                    c->frac   = (c->frac + dst_size * (int64_t)c->dst_incr_mod) % c->src_incr;
-                    c->index = 0;
-                }
-            }
+            td.dst_size = dst_size;
+            td.index2   = index2;
+            td.incr     = incr;
+            swri_execute(s, resample_channel, &td, dst->ch_count);
+
+            c->index += dst_size * c->dst_incr_div;
+            c->index += (c->frac + dst_size * (int64_t)c->dst_incr_mod) / c->src_incr;
+            av_assert2(c->index >= 0);
+            *consumed = c->index;
+            c->frac   = (c->frac + dst_size * (int64_t)c->dst_incr_mod) % c->src_incr;
+            c->index = 0;
         }
     } else {
         int64_t end_index = (1LL + src_size - c->filter_length) * c->phase_count;
         int64_t delta_frac = (end_index - c->index) * c->src_incr - c->frac;
         int delta_n = (delta_frac + c->dst_incr - 1) / c->dst_incr;
-        int (*resample_func)(struct ResampleContext *c, void *dst,
-                             const void *src, int n, int update_ctx);
 
         dst_size = FFMAX(FFMIN(dst_size, delta_n), 0);
         if (dst_size > 0) {
             /* resample_linear and resample_common should have same behavior
              * when frac and dst_incr_mod are zero */
-            resample_func = (c->linear && (c->frac || c->dst_incr_mod)) ?
-                            c->dsp.resample_linear : c->dsp.resample_common;
-            for (i = 0; i < dst->ch_count; i++)
-                *consumed = resample_func(c, dst->ch[i], src->ch[i], dst_size, i+1 == dst->ch_count);
+            td.resample_func = (c->linear && (c->frac || c->dst_incr_mod)) ?
+                               c->dsp.resample_linear : c->dsp.resample_common;
+            td.dst_size = dst_size;
+            swri_execute(s, resample_channel, &td, dst->ch_count);
+
+            *consumed = td.consumed;
+            c->index  = td.index;
+            c->frac   = td.frac;
         }
     }
 
-    if(need_emms)
-        emms_c();
-
     if (c->compensation_distance) {
         c->compensation_distance -= dst_size;
         if (!c->compensation_distance) {
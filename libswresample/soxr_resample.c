@@ -81,7 +81,7 @@ static int flush(struct SwrContext *s){
     return 0;
 }
 
-static int process(
+static int process(struct SwrContext *s,
         struct ResampleContext * c, AudioData *dst, int dst_size,
         AudioData *src, int src_size, int *consumed){
     size_t idone, odone;
@@ -129,6 +129,8 @@ static void clear_context(SwrContext *s){
     swri_audio_convert_free(&s->out_convert);
     swri_audio_convert_free(&s->full_convert);
     swri_rematrix_free(s);
+    avpriv_slicethread_free(&s->slicethread);
+    s->nb_slice_threads = 0;
 
     s->delayed_samples_fixup = 0;
     s->flushed = 0;
@@ -149,6 +151,28 @@ av_cold void swr_close(SwrContext *s){
     clear_context(s);
 }
 
+static void slice_worker(void *priv, int jobnr, int threadnr,
+                         int nb_jobs, int nb_threads)
+{
+    SwrContext *s = priv;
+    s->job_func(s->job_arg, jobnr, nb_jobs);
+}
+
+void swri_execute(SwrContext *s, void (*func)(void *arg, int jobnr, int nb_jobs),
+                  void *arg, int nb_jobs)
+{
+    int i;
+
+    if (s->slicethread && nb_jobs > 1) {
+        s->job_func = func;
+        s->job_arg  = arg;
+        avpriv_slicethread_execute(s->slicethread, nb_jobs, 0);
+    } else {
+        for (i = 0; i < nb_jobs; i++)
+            func(arg, i, nb_jobs);
+    }
+}
+
 av_cold int swr_init(struct SwrContext *s){
     int ret;
     char l1[1024], l2[1024];
@@ -390,6 +414,18 @@ av_assert0(s->out.ch_count);
             goto fail;
     }
 
+    if (s->nb_threads != 1 && FFMAX(s->used_ch_count, s->out.ch_count) > 1) {
+        ret = avpriv_slicethread_create(&s->slicethread, s, slice_worker,
+                                        NULL, s->nb_threads);
+        if (ret == AVERROR(ENOSYS) || ret == 1) {
+            /* no threading support in this build, or a single CPU */
+            avpriv_slicethread_free(&s->slicethread);
+        } else if (ret < 0) {
+            goto fail;
+        } else
+            s->nb_slice_threads = ret;
+    }
+
     return 0;
 fail:
     swr_close(s);
@@ -514,7 +550,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
         int ret, size, consumed;
         if(!s->resample_in_constraint && s->in_buffer_count){
             buf_set(&tmp, &s->in_buffer, s->in_buffer_index);
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &tmp, s->in_buffer_count, &consumed);
+            ret= s->resampler->multiple_resample(s, s->resample, &out, out_count, &tmp, s->in_buffer_count, &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -534,7 +570,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
 
         if((s->flushed || in_count > padless) && !s->in_buffer_count){
             s->in_buffer_index=0;
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
+            ret= s->resampler->multiple_resample(s, s->resample, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -23,6 +23,7 @@
 
 #include "swresample.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/slicethread.h"
 #include "config.h"
 
 #define SWR_CH_MAX 64
@@ -71,7 +72,7 @@ struct DitherContext {
 typedef struct ResampleContext * (* resample_init_func)(struct ResampleContext *c, int out_rate, int in_rate, int filter_size, int phase_shift, int linear,
                                     double cutoff, enum AVSampleFormat format, enum SwrFilterType filter_type, double kaiser_beta, double precision, int cheby, int exact_rational);
 typedef void    (* resample_free_func)(struct ResampleContext **c);
-typedef int     (* multiple_resample_func)(struct ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
+typedef int     (* multiple_resample_func)(struct SwrContext *s, struct ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
 typedef int     (* resample_flush_func)(struct SwrContext *c);
 typedef int     (* set_compensation_func)(struct ResampleContext *c, int sample_delta, int compensation_distance);
 typedef int64_t (* get_delay_func)(struct SwrContext *s, int64_t base);
@@ -184,12 +185,28 @@ struct SwrContext {
 
     mix_any_func_type *mix_any_f;
 
+    /* Slice threading: channels, or bands of samples of a channel, are
+     * resampled and rematrixed in parallel.
+     */
+    int nb_threads;                                 ///< number of threads requested, 0 for automatic
+    AVSliceThread *slicethread;
+    int nb_slice_threads;                           ///< number of threads of slicethread
+    void (*job_func)(void *arg, int jobnr, int nb_jobs);    ///< arguments of the running swri_execute()
+    void *job_arg;
+
     /* TODO: callbacks for ASM optimizations */
 };
 
 av_warn_unused_result
 int swri_realloc_audio(AudioData *a, int count);
 
+/**
+ * Call func(arg, jobnr, nb_jobs) for every jobnr from 0 to nb_jobs - 1, in
+ * parallel on the slice threads of s if it has some, in order otherwise.
+ */
+void swri_execute(SwrContext *s, void (*func)(void *arg, int jobnr, int nb_jobs),
+                  void *arg, int nb_jobs);
+
 void swri_noise_shaping_int16 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
 void swri_noise_shaping_int32 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
 void swri_noise_shaping_float (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
@@ -234,14 +234,20 @@ static void lumRangeFromJpeg16_c(int16_t *_dst, int width)
     if (DEBUG_SWSCALE_BUFFERS)                  \
         av_log(c, AV_LOG_DEBUG, __VA_ARGS__)
 
-static int swscale(SwsContext *c, const uint8_t *src[],
-                   int srcStride[], int srcSliceY,
-                   int srcSliceH, uint8_t *dst[], int dstStride[])
+/**
+ * Scale the output lines dstSliceY to dstSliceY + dstSliceH - 1. Rendering
+ * only a part of the output requires the whole input to be available, i.e.
+ * srcSliceY == 0 and srcSliceH == c->srcH.
+ */
+static int swscale_dst_slice(SwsContext *c, const uint8_t *src[],
+                             int srcStride[], int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[],
+                             int dstSliceY, int dstSliceH)
 {
     /* load a few things into local vars to make the code more readable?
      * and faster */
     const int dstW                   = c->dstW;
-    const int dstH                   = c->dstH;
+    const int dstH                   = dstSliceY + dstSliceH;
 
     const enum AVPixelFormat dstFormat = c->dstFormat;
     const int flags                  = c->flags;
@@ -338,7 +344,7 @@ static int swscale(SwsContext *c, const uint8_t *src[],
     if (srcSliceY == 0) {
         lumBufIndex  = -1;
         chrBufIndex  = -1;
-        dstY         = 0;
+        dstY         = dstSliceY;
         lastInLumBuf = -1;
         lastInChrBuf = -1;
     }
@@ -355,8 +361,8 @@ static int swscale(SwsContext *c, const uint8_t *src[],
             srcSliceY, srcSliceH, chrSrcSliceY, chrSrcSliceH, 1);
 
     ff_init_slice_from_src(vout_slice, (uint8_t**)dst, dstStride, c->dstW,
-            dstY, dstH, dstY >> c->chrDstVSubSample,
-            AV_CEIL_RSHIFT(dstH, c->chrDstVSubSample), 0);
+            dstY, dstH - dstY, dstY >> c->chrDstVSubSample,
+            AV_CEIL_RSHIFT(dstH, c->chrDstVSubSample) - (dstY >> c->chrDstVSubSample), 0);
     if (srcSliceY == 0) {
         hout_slice->plane[0].sliceY = lastInLumBuf + 1;
         hout_slice->plane[1].sliceY = lastInChrBuf + 1;
@@ -488,7 +494,7 @@ static int swscale(SwsContext *c, const uint8_t *src[],
             c->chrDither8 = ff_dither_8x8_128[chrDstY & 7];
             c->lumDither8 = ff_dither_8x8_128[dstY    & 7];
         }
-        if (dstY >= dstH - 2) {
+        if (dstY >= c->dstH - 2) {
             /* hmm looks like we can't use MMX here without overwriting
              * this array's tail */
             ff_sws_init_output_funcs(c, &yuv2plane1, &yuv2planeX, &yuv2nv12cX,
@@ -532,6 +538,14 @@ static int swscale(SwsContext *c, const uint8_t *src[],
     return dstY - lastDstY;
 }
 
+static int swscale(SwsContext *c, const uint8_t *src[],
+                   int srcStride[], int srcSliceY,
+                   int srcSliceH, uint8_t *dst[], int dstStride[])
+{
+    return swscale_dst_slice(c, src, srcStride, srcSliceY, srcSliceH,
+                             dst, dstStride, 0, c->dstH);
+}
+
 av_cold void ff_sws_init_range_convert(SwsContext *c)
 {
     c->lumConvertRange = NULL;
@@ -746,6 +760,82 @@ static void rgb48Toxyz12(struct SwsContext *c, uint16_t *dst,
     }
 }
 
+static int scale_internal(SwsContext *c,
+                          const uint8_t * const srcSlice[],
+                          const int srcStride[], int srcSliceY,
+                          int srcSliceH, uint8_t *const dst[],
+                          const int dstStride[], int dstSliceY, int dstSliceH);
+
+static int scale_threaded(SwsContext *c, const uint8_t * const srcSlice[],
+                          const int srcStride[], uint8_t *const dst[],
+                          const int dstStride[])
+{
+    int i;
+
+    c->frame_src        = srcSlice;
+    c->frame_src_stride = srcStride;
+    c->frame_dst        = dst;
+    c->frame_dst_stride = dstStride;
+
+    avpriv_slicethread_execute(c->slicethread, c->nb_slice_ctx, 0);
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        if (c->slice_err[i] < 0)
+            return c->slice_err[i];
+
+    return c->dstH;
+}
+
+void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
+                         int nb_jobs, int nb_threads)
+{
+    SwsContext *parent = priv;
+    SwsContext *c      = parent->slice_ctx[jobnr];
+    int err;
+
+    if (c->swscale == swscale) {
+        /* split the output, each band is rendered from the whole input */
+        const int align = 1 << c->chrDstVSubSample;
+        int start = (c->dstH *  jobnr     / nb_jobs) & ~(align - 1);
+        int end   = jobnr == nb_jobs - 1 ? c->dstH :
+                    (c->dstH * (jobnr + 1) / nb_jobs) & ~(align - 1);
+
+        err = end == start ? 0 :
+              scale_internal(c, parent->frame_src, parent->frame_src_stride,
+                             0, c->srcH, parent->frame_dst,
+                             parent->frame_dst_stride, start, end - start);
+    } else {
+        /* unscaled conversions map input lines to output lines 1:1,
+         * so the input is split instead; the bands are aligned on the
+         * 8 lines of the ordered dither, which is indexed relative to
+         * the slice by some of them */
+        const int align = 8;
+        const int *src_stride = parent->frame_src_stride;
+        const uint8_t *src[4];
+        int start = (c->srcH *  jobnr     / nb_jobs) & ~(align - 1);
+        int end   = jobnr == nb_jobs - 1 ? c->srcH :
+                    (c->srcH * (jobnr + 1) / nb_jobs) & ~(align - 1);
+
+        /* the source pointers of a slice point to its first line */
+        memcpy(src, parent->frame_src, sizeof(src));
+        src[0] += start * src_stride[0];
+        if (src[1] && !usePal(c->srcFormat))
+            src[1] += (start >> c->chrSrcVSubSample) * src_stride[1];
+        if (src[2])
+            src[2] += (start >> c->chrSrcVSubSample) * src_stride[2];
+        if (src[3])
+            src[3] += start * src_stride[3];
+
+        c->sliceDir = 1;
+        err = end == start ? 0 :
+              scale_internal(c, src, src_stride,
+                             start, end - start, parent->frame_dst,
+                             parent->frame_dst_stride, 0, c->dstH);
+    }
+
+    parent->slice_err[jobnr] = err;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -756,26 +846,14 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
                                   int srcSliceH, uint8_t *const dst[],
                                   const int dstStride[])
 {
-    int i, ret;
-    const uint8_t *src2[4];
-    uint8_t *dst2[4];
-    uint8_t *rgb0_tmp = NULL;
+    int ret;
     int macro_height = isBayer(c->srcFormat) ? 2 : (1 << c->chrSrcVSubSample);
-    // copy strides, so they can safely be modified
-    int srcStride2[4];
-    int dstStride2[4];
-    int srcSliceY_internal = srcSliceY;
 
     if (!srcStride || !dstStride || !dst || !srcSlice) {
         av_log(c, AV_LOG_ERROR, "One of the input parameters to sws_scale() is NULL, please check the calling code\n");
         return 0;
     }
 
-    for (i=0; i<4; i++) {
-        srcStride2[i] = srcStride[i];
-        dstStride2[i] = dstStride[i];
-    }
-
     if ((srcSliceY & (macro_height-1)) ||
         ((srcSliceH& (macro_height-1)) && srcSliceY + srcSliceH != c->srcH) ||
         srcSliceY + srcSliceH > c->srcH) {
@@ -819,6 +897,33 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
         return ret;
     }
 
+    if (c->slicethread && !c->sliceDir && srcSliceY == 0 && srcSliceH == c->srcH)
+        return scale_threaded(c, srcSlice, srcStride, dst, dstStride);
+
+    return scale_internal(c, srcSlice, srcStride, srcSliceY, srcSliceH,
+                          dst, dstStride, 0, c->dstH);
+}
+
+static int scale_internal(SwsContext *c,
+                          const uint8_t * const srcSlice[],
+                          const int srcStride[], int srcSliceY,
+                          int srcSliceH, uint8_t *const dst[],
+                          const int dstStride[], int dstSliceY, int dstSliceH)
+{
+    int i, ret;
+    const uint8_t *src2[4];
+    uint8_t *dst2[4];
+    uint8_t *rgb0_tmp = NULL;
+    // copy strides, so they can safely be modified
+    int srcStride2[4];
+    int dstStride2[4];
+    int srcSliceY_internal = srcSliceY;
+
+    for (i=0; i<4; i++) {
+        srcStride2[i] = srcStride[i];
+        dstStride2[i] = dstStride[i];
+    }
+
     memcpy(src2, srcSlice, sizeof(src2));
     memcpy(dst2, dst, sizeof(dst2));
 
@@ -975,7 +1080,12 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
     /* reset slice direction at end of frame */
     if (srcSliceY_internal + srcSliceH == c->srcH)
         c->sliceDir = 0;
-    ret = c->swscale(c, src2, srcStride2, srcSliceY_internal, srcSliceH, dst2, dstStride2);
+    if (dstSliceY || dstSliceH != c->dstH) {
+        av_assert1(c->swscale == swscale && srcSliceY == 0 && srcSliceH == c->srcH);
+        ret = swscale_dst_slice(c, src2, srcStride2, srcSliceY_internal, srcSliceH,
+                                dst2, dstStride2, dstSliceY, dstSliceH);
+    } else
+        ret = c->swscale(c, src2, srcStride2, srcSliceY_internal, srcSliceH, dst2, dstStride2);
 
     if (c->dstXYZ && !(c->srcXYZ && c->srcW==c->dstW && c->srcH==c->dstH)) {
         int dstY = c->dstY ? c->dstY : srcSliceY + srcSliceH;
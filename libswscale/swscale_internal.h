@@ -32,6 +32,7 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/ppc/util_altivec.h"
+#include "libavutil/slicethread.h"
 
 #define STR(s) AV_TOSTRING(s) // AV_STRINGIFY is too long
 
@@ -321,6 +322,21 @@ typedef struct SwsContext {
     uint8_t *cascaded1_tmp[4];
     int cascaded_mainindex;
 
+    /* Slice threading: when a whole frame is passed to sws_scale(), it is
+     * split into horizontal bands, each one rendered by its own fully
+     * initialized copy of this context.
+     */
+    int nb_threads;
+    AVSliceThread *slicethread;
+    struct SwsContext **slice_ctx;
+    int *slice_err;
+    int nb_slice_ctx;
+    const uint8_t *const *frame_src;    ///< arguments of the threaded sws_scale() call
+    const int *frame_src_stride;
+    uint8_t *const *frame_dst;
+    const int *frame_dst_stride;
+    int colorspace_details_set;         ///< sws_setColorspaceDetails() was called
+
     double gamma_value;
     int gamma_flag;
     int is_internal_gamma;
@@ -858,6 +874,13 @@ void ff_get_unscaled_swscale_aarch64(SwsContext *c);
  */
 SwsFunc ff_getSwsFunc(SwsContext *c);
 
+/**
+ * Slice thread worker, scales band jobnr of the frame set in the parent
+ * context priv using priv->slice_ctx[jobnr].
+ */
+void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
+                         int nb_jobs, int nb_threads);
+
 void ff_sws_init_input_funcs(SwsContext *c);
 void ff_sws_init_output_funcs(SwsContext *c,
                               yuv2planar1_fn *yuv2plane1,
@@ -0,0 +1,159 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Check that slice threaded conversions give the same output as
+ * single-threaded ones. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+static const struct {
+    enum AVPixelFormat src_fmt, dst_fmt;
+    int src_w, src_h, dst_w, dst_h;
+    int flags;
+    int contrast;       ///< if set, passed to sws_setColorspaceDetails()
+} tests[] = {
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_YUV420P,  352, 288, 176, 144, SWS_BICUBIC },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_YUV420P,  176, 144, 353, 291, SWS_LANCZOS },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_RGB24,    352, 287, 352, 287, SWS_BILINEAR },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_RGB565,   320, 241, 320, 241, SWS_BILINEAR },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_BGR8,     320, 240, 320, 240, SWS_POINT },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_YUV422P,  352, 288, 352, 288, SWS_BILINEAR },
+    { AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV420P,  352, 289, 352, 289, SWS_BILINEAR },
+    { AV_PIX_FMT_NV12,      AV_PIX_FMT_YUV420P,  352, 288, 352, 288, SWS_BILINEAR },
+    { AV_PIX_FMT_RGB24,     AV_PIX_FMT_YUV420P,  352, 288, 640, 480, SWS_BICUBIC },
+    { AV_PIX_FMT_YUYV422,   AV_PIX_FMT_NV12,     352, 288, 300, 200, SWS_AREA },
+    { AV_PIX_FMT_YUVA420P,  AV_PIX_FMT_RGBA,     352, 288, 352, 288, SWS_BILINEAR },
+    { AV_PIX_FMT_GRAY8,     AV_PIX_FMT_GRAY16LE, 355, 123, 355, 123, SWS_BILINEAR },
+    { AV_PIX_FMT_PAL8,      AV_PIX_FMT_YUV420P,  352, 288, 352, 288, SWS_BILINEAR },
+    { AV_PIX_FMT_YUV420P,   AV_PIX_FMT_RGB24,    352, 288, 320, 240, SWS_BICUBIC, 3 << 15 },
+};
+
+static AVFrame *alloc_frame(enum AVPixelFormat fmt, int w, int h)
+{
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+    frame->format = fmt;
+    frame->width  = w;
+    frame->height = h;
+    if (av_frame_get_buffer(frame, 0) < 0)
+        av_frame_free(&frame);
+    return frame;
+}
+
+static int scale(AVFrame *dst, const AVFrame *src, int flags, int contrast,
+                 int threads)
+{
+    struct SwsContext *sws = sws_alloc_context();
+    int ret;
+
+    if (!sws)
+        return AVERROR(ENOMEM);
+    av_opt_set_int(sws, "srcw",       src->width,  0);
+    av_opt_set_int(sws, "srch",       src->height, 0);
+    av_opt_set_int(sws, "src_format", src->format, 0);
+    av_opt_set_int(sws, "dstw",       dst->width,  0);
+    av_opt_set_int(sws, "dsth",       dst->height, 0);
+    av_opt_set_int(sws, "dst_format", dst->format, 0);
+    av_opt_set_int(sws, "sws_flags",  flags | SWS_BITEXACT | SWS_ACCURATE_RND, 0);
+    av_opt_set_int(sws, "threads",    threads, 0);
+    if (contrast)
+        sws_setColorspaceDetails(sws, sws_getCoefficients(SWS_CS_ITU601), 0,
+                                 sws_getCoefficients(SWS_CS_ITU601), 0,
+                                 0, contrast, 1 << 16);
+
+    ret = sws_init_context(sws, NULL, NULL);
+    if (ret >= 0)
+        ret = sws_scale(sws, (const uint8_t * const *)src->data, src->linesize,
+                        0, src->height, dst->data, dst->linesize);
+    sws_freeContext(sws);
+    return ret;
+}
+
+static int frames_equal(const AVFrame *a, const AVFrame *b)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+    int nb_planes = av_pix_fmt_count_planes(a->format);
+
+    for (int p = 0; p < nb_planes; p++) {
+        int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(a->height, desc->log2_chroma_h)
+                                 : a->height;
+        int w = av_image_get_linesize(a->format, a->width, p);
+        for (int y = 0; y < h; y++)
+            if (memcmp(a->data[p] + y * a->linesize[p],
+                       b->data[p] + y * b->linesize[p], w))
+                return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    static const int nb_threads[] = { 2, 3, 4, 7 };
+    int ret = 0;
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 1);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        AVFrame *src = alloc_frame(tests[i].src_fmt, tests[i].src_w, tests[i].src_h);
+        AVFrame *ref = alloc_frame(tests[i].dst_fmt, tests[i].dst_w, tests[i].dst_h);
+        AVFrame *out = alloc_frame(tests[i].dst_fmt, tests[i].dst_w, tests[i].dst_h);
+        int err = 0;
+
+        if (!src || !ref || !out)
+            return 1;
+
+        for (int p = 0; p < FF_ARRAY_ELEMS(src->buf) && src->buf[p]; p++)
+            for (int j = 0; j < src->buf[p]->size; j++)
+                src->buf[p]->data[j] = av_lfg_get(&lfg);
+
+        printf("%s %dx%d -> %s %dx%d:",
+               av_get_pix_fmt_name(tests[i].src_fmt), tests[i].src_w, tests[i].src_h,
+               av_get_pix_fmt_name(tests[i].dst_fmt), tests[i].dst_w, tests[i].dst_h);
+
+        if (scale(ref, src, tests[i].flags, tests[i].contrast, 1) < 0) {
+            printf(" failed\n");
+            return 1;
+        }
+        for (int t = 0; t < FF_ARRAY_ELEMS(nb_threads); t++) {
+            if (scale(out, src, tests[i].flags, tests[i].contrast, nb_threads[t]) < 0 ||
+                !frames_equal(ref, out)) {
+                printf(" %d threads differ", nb_threads[t]);
+                err = 1;
+            }
+        }
+        printf("%s\n", err ? "" : " ok");
+        ret |= err;
+
+        av_frame_free(&src);
+        av_frame_free(&ref);
+        av_frame_free(&out);
+    }
+
+    return ret;
+}
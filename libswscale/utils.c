@@ -862,6 +862,16 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
     const AVPixFmtDescriptor *desc_dst;
     const AVPixFmtDescriptor *desc_src;
     int need_reinit = 0;
+    int i;
+
+    for (i = 0; i < c->nb_slice_ctx; i++) {
+        int ret = sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange,
+                                           table, dstRange, brightness,
+                                           contrast, saturation);
+        if (ret < 0)
+            return ret;
+    }
+    c->colorspace_details_set = 1;
 
     handle_formats(c);
     desc_dst = av_pix_fmt_desc_get(c->dstFormat);
@@ -1162,8 +1172,8 @@ static enum AVPixelFormat alphaless_fmt(enum AVPixelFormat fmt)
     }
 }
 
-av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
-                             SwsFilter *dstFilter)
+static av_cold int context_init_single(SwsContext *c, SwsFilter *srcFilter,
+                                       SwsFilter *dstFilter)
 {
     int i;
     int usesVFilter, usesHFilter;
@@ -1863,6 +1873,90 @@ fail: // FIXME replace things by appropriate error codes
     return -1;
 }
 
+static void free_slice_threads(SwsContext *c)
+{
+    int i;
+
+    avpriv_slicethread_free(&c->slicethread);
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+    av_freep(&c->slice_err);
+    c->nb_slice_ctx = 0;
+}
+
+static av_cold int context_init_threaded(SwsContext *c, SwsFilter *srcFilter,
+                                         SwsFilter *dstFilter)
+{
+    int i, ret;
+
+    ret = avpriv_slicethread_create(&c->slicethread, c, ff_sws_slice_worker,
+                                    NULL, c->nb_threads);
+    if (ret == AVERROR(ENOSYS) || ret == 1) {
+        /* no threading support in this build, or a single CPU */
+        avpriv_slicethread_free(&c->slicethread);
+        c->nb_threads = 1;
+        return 0;
+    } else if (ret < 0)
+        return ret;
+    c->nb_threads = ret;
+
+    c->slice_ctx = av_mallocz_array(c->nb_threads, sizeof(*c->slice_ctx));
+    c->slice_err = av_mallocz_array(c->nb_threads, sizeof(*c->slice_err));
+    if (!c->slice_ctx || !c->slice_err)
+        return AVERROR(ENOMEM);
+
+    /* the contexts are set up from the options as passed by the user, before
+     * context_init_single() adjusts them on the parent */
+    for (i = 0; i < c->nb_threads; i++) {
+        SwsContext *slice = sws_alloc_context();
+        if (!slice)
+            return AVERROR(ENOMEM);
+        c->slice_ctx[c->nb_slice_ctx++] = slice;
+
+        ret = av_opt_copy(slice, c);
+        if (ret < 0)
+            return ret;
+        slice->nb_threads = 1;
+
+        if (c->colorspace_details_set)
+            sws_setColorspaceDetails(slice, c->srcColorspaceTable, c->srcRange,
+                                     c->dstColorspaceTable, c->dstRange,
+                                     c->brightness, c->contrast, c->saturation);
+
+        ret = context_init_single(slice, srcFilter, dstFilter);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
+                             SwsFilter *dstFilter)
+{
+    int ret;
+
+    if (c->nb_threads != 1) {
+        ret = context_init_threaded(c, srcFilter, dstFilter);
+        if (ret < 0)
+            return ret;
+    }
+
+    ret = context_init_single(c, srcFilter, dstFilter);
+    if (ret < 0)
+        return ret;
+
+    /* Bands can only be scaled independently if nothing is carried over from
+     * one line to the next and the frame is not processed in several steps. */
+    if (c->slicethread &&
+        (c->cascaded_context[0] || c->dither == SWS_DITHER_ED ||
+         c->src0Alpha || c->srcXYZ || c->dstXYZ || isBayer(c->srcFormat)))
+        free_slice_threads(c);
+
+    return 0;
+}
+
 SwsContext *sws_alloc_set_opts(int srcW, int srcH, enum AVPixelFormat srcFormat,
                                int dstW, int dstH, enum AVPixelFormat dstFormat,
                                int flags, const double *param)
@@ -2363,6 +2457,8 @@ void sws_freeContext(SwsContext *c)
     av_freep(&c->gamma);
     av_freep(&c->inv_gamma);
 
+    free_slice_threads(c);
+
     ff_free_filters(c);
 
     av_free(c);
@@ -0,0 +1,189 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Audio filter batching test: the same input is fed to a graph of batchable
+ * filters one frame at a time and in groups of queued frames, and the
+ * outputs must be identical.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/frame.h"
+#include "libavutil/md5.h"
+#include "libavutil/samplefmt.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#define NB_FRAMES     100
+#define FRAME_SAMPLES 1024
+#define SAMPLE_RATE   44100
+
+/* the timeline and the queued command end batches in the middle of the
+ * input */
+static const char *graph_desc =
+    "volume=0.5:enable='gte(t,0.3)',"
+    "pan=stereo|c0=0.7*c0+0.3*c1|c1=c0,"
+    "asplit[a][b];"
+    "[b]volume=volume=1.5:precision=fixed[b2];"
+    "[a][b2]amix=inputs=2,"
+    "aresample=48000,"
+    "aformat=sample_fmts=s16:channel_layouts=stereo";
+
+static int drain(AVFilterContext *sink, struct AVMD5 *md5, int64_t *nb_samples)
+{
+    AVFrame *frame = av_frame_alloc();
+    int ret;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        av_md5_update(md5, frame->data[0], frame->nb_samples * 4);
+        *nb_samples += frame->nb_samples;
+        av_frame_unref(frame);
+    }
+    av_frame_free(&frame);
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int run(int group, char *digest)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterContext *src = NULL, *sink = NULL;
+    AVFilterInOut *inputs = NULL, *outputs = NULL;
+    struct AVMD5 *md5 = av_md5_alloc();
+    int64_t nb_samples = 0;
+    uint8_t hash[16];
+    char args[256];
+    int ret, i;
+
+    if (!graph || !md5) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_md5_init(md5);
+
+    snprintf(args, sizeof(args),
+             "sample_rate=%d:sample_fmt=s16:channel_layout=stereo:time_base=1/%d",
+             SAMPLE_RATE, SAMPLE_RATE);
+    ret = avfilter_graph_create_filter(&src, avfilter_get_by_name("abuffer"),
+                                       "in", args, NULL, graph);
+    if (ret < 0)
+        goto end;
+    ret = avfilter_graph_create_filter(&sink, avfilter_get_by_name("abuffersink"),
+                                       "out", NULL, NULL, graph);
+    if (ret < 0)
+        goto end;
+
+    outputs = avfilter_inout_alloc();
+    inputs  = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    outputs->name       = av_strdup("in");
+    outputs->filter_ctx = src;
+    inputs->name        = av_strdup("out");
+    inputs->filter_ctx  = sink;
+    ret = avfilter_graph_parse_ptr(graph, graph_desc, &inputs, &outputs, NULL);
+    if (ret < 0)
+        goto end;
+    ret = avfilter_graph_config(graph, NULL);
+    if (ret < 0)
+        goto end;
+    ret = avfilter_graph_queue_command(graph, "volume", "volume", "0.25", 0, 1.2);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i < NB_FRAMES; i++) {
+        AVFrame *frame = av_frame_alloc();
+        int16_t *samples;
+        int j;
+
+        if (!frame) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        frame->format         = AV_SAMPLE_FMT_S16;
+        frame->channel_layout = AV_CH_LAYOUT_STEREO;
+        frame->sample_rate    = SAMPLE_RATE;
+        frame->nb_samples     = FRAME_SAMPLES;
+        frame->pts            = i * FRAME_SAMPLES;
+        ret = av_frame_get_buffer(frame, 0);
+        if (ret < 0) {
+            av_frame_free(&frame);
+            goto end;
+        }
+        samples = (int16_t *)frame->data[0];
+        for (j = 0; j < FRAME_SAMPLES; j++) {
+            int t = i * FRAME_SAMPLES + j;
+            samples[2 * j]     = (t * 37 % 32768) - 16384;
+            samples[2 * j + 1] = (t * t % 65521) / 2 - 16384;
+        }
+
+        /* without the push flag, the frames stay queued on the first link
+         * until the graph is run from the sink */
+        ret = av_buffersrc_add_frame_flags(src, frame, 0);
+        av_frame_free(&frame);
+        if (ret < 0)
+            goto end;
+        if ((i + 1) % group == 0 && (ret = drain(sink, md5, &nb_samples)) < 0)
+            goto end;
+    }
+    ret = av_buffersrc_add_frame_flags(src, NULL, 0);
+    if (ret >= 0)
+        ret = drain(sink, md5, &nb_samples);
+    if (ret < 0)
+        goto end;
+
+    av_md5_final(md5, hash);
+    for (i = 0; i < 16; i++)
+        snprintf(digest + 2 * i, 3, "%02x", hash[i]);
+    printf("frames queued %3d: %"PRId64" samples, md5 %s\n",
+           group, nb_samples, digest);
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&graph);
+    av_free(md5);
+    return ret;
+}
+
+int main(void)
+{
+    static const int groups[] = { 1, 7, NB_FRAMES };
+    char ref[33], digest[33];
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(groups); i++) {
+        if (run(groups[i], i ? digest : ref) < 0) {
+            fprintf(stderr, "Filtering failed\n");
+            return 1;
+        }
+        if (i && strcmp(ref, digest)) {
+            fprintf(stderr, "Output differs from the unbatched run\n");
+            return 1;
+        }
+    }
+    return 0;
+}
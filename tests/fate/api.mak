@@ -34,6 +34,10 @@ fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
 fate-api-threadmessage: CMP = null
 
+FATE_API-$(call ALLYES, AMIX_FILTER ARESAMPLE_FILTER PAN_FILTER VOLUME_FILTER) += fate-api-audio-batch
+fate-api-audio-batch: $(APITESTSDIR)/api-audio-batch-test$(EXESUF)
+fate-api-audio-batch: CMD = run $(APITESTSDIR)/api-audio-batch-test$(EXESUF)
+
 FATE_API_SAMPLES-$(CONFIG_AVFORMAT) += $(FATE_API_SAMPLES_LIBAVFORMAT-yes)
 
 ifdef SAMPLES
@@ -38,9 +38,53 @@ FATE_SAMPLES_FFMPEG-$(CONFIG_COLORKEY_FILTER) += fate-ffmpeg-filter_colorkey
 fate-ffmpeg-filter_colorkey: tests/data/filtergraphs/colorkey
 fate-ffmpeg-filter_colorkey: CMD = framecrc -idct simple -fflags +bitexact -flags +bitexact  -sws_flags +accurate_rnd+bitexact -i $(TARGET_SAMPLES)/cavs/cavs.mpg -fflags +bitexact -flags +bitexact -sws_flags +accurate_rnd+bitexact -i $(TARGET_SAMPLES)/lena.pnm -an -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/colorkey -sws_flags +accurate_rnd+bitexact -fflags +bitexact -flags +bitexact -qscale 2 -frames:v 10
 
+FATE_FFMPEG-$(call ALLYES, COLOR_FILTER SPLIT_FILTER MPEG4_ENCODER) += fate-ffmpeg-thread_pipeline
+fate-ffmpeg-thread_pipeline: CMD = framecrc -thread_pipeline -filter_complex "color=d=1:r=5,split[a][b]" -map "[a]" -map "[b]" -c:v mpeg4 -bf 1 -fflags +bitexact -flags +bitexact
+
+# Decoding and filtering in separate threads must not change the output
+tests/data/thread_pipeline.nut: TAG = GEN
+tests/data/thread_pipeline.nut: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+		-f lavfi -i "testsrc=d=1:s=176x144:r=25" -f lavfi -i "sine=d=1" \
+		-c:v mpeg4 -bf 2 -c:a pcm_s16le -flags +bitexact -fflags +bitexact \
+		-y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_FFMPEG-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER HFLIP_FILTER MPEG4_ENCODER MPEG4_DECODER PCM_S16LE_ENCODER PCM_S16LE_DECODER NUT_MUXER NUT_DEMUXER) += fate-ffmpeg-thread_pipeline-decode fate-ffmpeg-thread_pipeline-serial
+fate-ffmpeg-thread_pipeline-decode fate-ffmpeg-thread_pipeline-serial: tests/data/thread_pipeline.nut
+fate-ffmpeg-thread_pipeline-decode: CMD = framecrc -thread_pipeline -i $(TARGET_PATH)/tests/data/thread_pipeline.nut -vf hflip -c:v mpeg4 -c:a pcm_s16le
+fate-ffmpeg-thread_pipeline-serial: CMD = framecrc -i $(TARGET_PATH)/tests/data/thread_pipeline.nut -vf hflip -c:v mpeg4 -c:a pcm_s16le
+fate-ffmpeg-thread_pipeline-serial: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-thread_pipeline-decode
+
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER SPLIT_FILTER HFLIP_FILTER VFLIP_FILTER) += fate-ffmpeg-filter_complex_parallel
+fate-ffmpeg-filter_complex_parallel: CMD = framecrc -filter_complex_threads 4 -filter_complex_parallel -filter_complex "testsrc=d=1:r=5:s=64x48,split[a][b];[a]hflip[o1];[b]vflip[o2]" -map "[o1]" -map "[o2]" -fflags +bitexact
+
+# Branches joined again by a filter, whose links are shared by both branches
+FATE_FFMPEG-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER SPLIT_FILTER HFLIP_FILTER VFLIP_FILTER HSTACK_FILTER) += fate-ffmpeg-filter_complex_parallel_join
+fate-ffmpeg-filter_complex_parallel_join: CMD = framecrc -filter_complex_threads 2 -filter_complex_parallel -filter_complex "testsrc2=d=1:r=5:s=64x48,format=yuv420p,split[a][b];[a]hflip[a1];[b]vflip[b1];[a1][b1]hstack" -fflags +bitexact
+
 FATE_FFMPEG-$(CONFIG_COLOR_FILTER) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+# Constant quantizer encodes of the mpegvideo encoders are frame threaded,
+# and must give the same packets as with a single thread.
+FATE_FRAME_THREAD_ENC-$(call ALLYES, TESTSRC_FILTER MPEG2VIDEO_ENCODER) += mpeg2video mpeg2video-bframes
+FATE_FRAME_THREAD_ENC-$(call ALLYES, TESTSRC_FILTER MPEG4_ENCODER)      += mpeg4 mpeg4-bframes
+FATE_FRAME_THREAD_ENC-$(call ALLYES, TESTSRC_FILTER H263P_ENCODER)      += h263p h263p-inter
+FATE_FRAME_THREAD_ENC = $(FATE_FRAME_THREAD_ENC-yes:%=fate-frame-thread-enc-%)
+FATE_FFMPEG += $(FATE_FRAME_THREAD_ENC) $(FATE_FRAME_THREAD_ENC:%=%-threads)
+
+fate-frame-thread-enc-mpeg2video fate-frame-thread-enc-mpeg2video-threads: CODECOPTS = -c:v mpeg2video -flags +bitexact+low_delay -g 1
+fate-frame-thread-enc-mpeg4 fate-frame-thread-enc-mpeg4-threads: CODECOPTS = -c:v mpeg4 -flags +bitexact+aic -g 1
+fate-frame-thread-enc-h263p fate-frame-thread-enc-h263p-threads: CODECOPTS = -c:v h263p -flags +bitexact+aic -g 1
+fate-frame-thread-enc-mpeg2video-bframes fate-frame-thread-enc-mpeg2video-bframes-threads: CODECOPTS = -c:v mpeg2video -flags +bitexact -g 12 -bf 2
+fate-frame-thread-enc-mpeg4-bframes fate-frame-thread-enc-mpeg4-bframes-threads: CODECOPTS = -c:v mpeg4 -flags +bitexact+mv4 -g 12 -bf 2
+fate-frame-thread-enc-h263p-inter fate-frame-thread-enc-h263p-inter-threads: CODECOPTS = -c:v h263p -flags +bitexact+aic+loop -g 12
+$(FATE_FRAME_THREAD_ENC): THREADOPTS = -threads 1
+fate-frame-thread-enc-%-threads: THREADOPTS = -threads 4 -thread_type frame
+fate-frame-thread-enc-%-threads: REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-%-threads=%)
+$(FATE_FRAME_THREAD_ENC) $(FATE_FRAME_THREAD_ENC:%=%-threads): CMD = framecrc -lavfi testsrc=d=2:r=10:s=176x144 $(CODECOPTS) -qscale 4 -fflags +bitexact $(THREADOPTS)
+fate-frame-thread-enc: $(FATE_FRAME_THREAD_ENC) $(FATE_FRAME_THREAD_ENC:%=%-threads)
+
 FATE_SAMPLES_FFMPEG-$(CONFIG_RAWVIDEO_DEMUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
@@ -29,6 +29,27 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_xml
 fate-ffprobe_xml: $(FFPROBE_TEST_FILE)
 fate-ffprobe_xml: CMD = run $(FFPROBE_COMMAND) -of xml
 
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_fastprobe
+fate-ffprobe_fastprobe: $(FFPROBE_TEST_FILE)
+fate-ffprobe_fastprobe: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -fflags fastprobe -show_streams -show_format -bitexact $(TARGET_PATH)/$(FFPROBE_TEST_FILE) -print_filename $(FFPROBE_TEST_FILE)
+
+# The essential parameters of MPEG-4 video with B-frames and AAC audio in MP4
+# found without decoding must match those found by decoding.
+tests/data/ffprobe-fastprobe.mp4: TAG = GEN
+tests/data/ffprobe-fastprobe.mp4: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+		-f lavfi -i "testsrc=d=1:s=176x144:r=25" -f lavfi -i "sine=d=1" \
+		-c:v mpeg4 -bf 2 -c:a aac -flags +bitexact -fflags +bitexact \
+		-y $(TARGET_PATH)/$@ 2>/dev/null
+
+FFPROBE_FASTPROBE_ENTRIES = stream=index,codec_name,codec_type,width,height,coded_width,coded_height,has_b_frames,sample_aspect_ratio,pix_fmt,level,field_order,sample_fmt,sample_rate,channels,r_frame_rate,time_base,start_pts,duration_ts
+
+FATE_FFPROBE-$(call ALLYES, AVDEVICE LAVFI_INDEV TESTSRC_FILTER SINE_FILTER MPEG4_ENCODER AAC_ENCODER MP4_MUXER MOV_DEMUXER MPEG4_DECODER AAC_DECODER) += fate-ffprobe_fastprobe-mp4 fate-ffprobe_fullprobe-mp4
+fate-ffprobe_fastprobe-mp4 fate-ffprobe_fullprobe-mp4: tests/data/ffprobe-fastprobe.mp4
+fate-ffprobe_fastprobe-mp4: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -fflags fastprobe -show_entries $(FFPROBE_FASTPROBE_ENTRIES) -bitexact $(TARGET_PATH)/tests/data/ffprobe-fastprobe.mp4
+fate-ffprobe_fullprobe-mp4: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries $(FFPROBE_FASTPROBE_ENTRIES) -bitexact $(TARGET_PATH)/tests/data/ffprobe-fastprobe.mp4
+fate-ffprobe_fullprobe-mp4: REF = $(SRC_PATH)/tests/ref/fate/ffprobe_fastprobe-mp4
+
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
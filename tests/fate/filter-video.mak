@@ -65,6 +65,25 @@ fate-filter-paletteuse-sierra2_4a: CMD = framecrc -i $(TARGET_SAMPLES)/filter/an
 fate-filter-paletteuse: $(FATE_FILTER_PALETTEUSE)
 FATE_FILTER_SAMPLES-$(call ALLYES, PALETTEUSE_FILTER MATROSKA_DEMUXER H264_DECODER IMAGE2_DEMUXER PNG_DECODER) += $(FATE_FILTER_PALETTEUSE)
 
+PALETTEUSE_GEN = testsrc2=d=1:r=5:s=160x120,split[a][b];[a]palettegen[p];[b][p]paletteuse
+
+FATE_FILTER_PALETTEUSE_GEN += fate-filter-paletteuse-gen-bayer0
+fate-filter-paletteuse-gen-bayer0: CMD = framecrc -lavfi "$(PALETTEUSE_GEN)=bayer:bayer_scale=0"
+
+FATE_FILTER_PALETTEUSE_GEN += fate-filter-paletteuse-gen-bayer0-threads
+fate-filter-paletteuse-gen-bayer0-threads: CMD = framecrc -filter_complex_threads 3 -lavfi "$(PALETTEUSE_GEN)=bayer:bayer_scale=0"
+fate-filter-paletteuse-gen-bayer0-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-paletteuse-gen-bayer0
+
+FATE_FILTER_PALETTEUSE_GEN += fate-filter-paletteuse-gen-nodither
+fate-filter-paletteuse-gen-nodither: CMD = framecrc -lavfi "$(PALETTEUSE_GEN)=none"
+
+FATE_FILTER_PALETTEUSE_GEN += fate-filter-paletteuse-gen-nodither-threads
+fate-filter-paletteuse-gen-nodither-threads: CMD = framecrc -filter_complex_threads 3 -lavfi "$(PALETTEUSE_GEN)=none"
+fate-filter-paletteuse-gen-nodither-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-paletteuse-gen-nodither
+
+fate-filter-paletteuse: $(FATE_FILTER_PALETTEUSE_GEN)
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER SPLIT_FILTER PALETTEGEN_FILTER PALETTEUSE_FILTER) += $(FATE_FILTER_PALETTEUSE_GEN)
+
 FATE_FILTER-$(call ALLYES, AVDEVICE LIFE_FILTER) += fate-filter-lavd-life
 fate-filter-lavd-life: CMD = framecrc -f lavfi -i life=s=40x40:r=5:seed=42:mold=64:ratio=0.1:death_color=red:life_color=green -t 2
 
@@ -122,6 +141,25 @@ FATE_FILTER-$(call ALLYES, FRAMERATE_FILTER TESTSRC2_FILTER FORMAT_FILTER) += fa
 fate-filter-framerate-12bit-up: CMD = framecrc -lavfi testsrc2=r=50:d=1,format=pix_fmts=yuv422p12le,framerate=fps=60 -t 1 -pix_fmt yuv422p12le
 fate-filter-framerate-12bit-down: CMD = framecrc -lavfi testsrc2=r=60:d=1,format=pix_fmts=yuv422p12le,framerate=fps=50 -t 1 -pix_fmt yuv422p12le
 
+MINTERPOLATE_GEN = testsrc2=r=5:d=2:s=176x144,format=yuv420p,minterpolate=fps=10:mi_mode=mci
+
+FATE_FILTER_MINTERPOLATE += fate-filter-minterpolate-epzs-aobmc
+fate-filter-minterpolate-epzs-aobmc: CMD = framecrc -lavfi $(MINTERPOLATE_GEN):me=epzs:mc_mode=aobmc
+
+FATE_FILTER_MINTERPOLATE += fate-filter-minterpolate-epzs-aobmc-threads
+fate-filter-minterpolate-epzs-aobmc-threads: CMD = framecrc -filter_complex_threads 3 -lavfi $(MINTERPOLATE_GEN):me=epzs:mc_mode=aobmc
+fate-filter-minterpolate-epzs-aobmc-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-minterpolate-epzs-aobmc
+
+FATE_FILTER_MINTERPOLATE += fate-filter-minterpolate-umh-obmc
+fate-filter-minterpolate-umh-obmc: CMD = framecrc -lavfi $(MINTERPOLATE_GEN):me=umh:mc_mode=obmc
+
+FATE_FILTER_MINTERPOLATE += fate-filter-minterpolate-umh-obmc-threads
+fate-filter-minterpolate-umh-obmc-threads: CMD = framecrc -filter_complex_threads 3 -lavfi $(MINTERPOLATE_GEN):me=umh:mc_mode=obmc
+fate-filter-minterpolate-umh-obmc-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-minterpolate-umh-obmc
+
+fate-filter-minterpolate: $(FATE_FILTER_MINTERPOLATE)
+FATE_FILTER-$(call ALLYES, MINTERPOLATE_FILTER TESTSRC2_FILTER FORMAT_FILTER) += $(FATE_FILTER_MINTERPOLATE)
+
 FATE_FILTER_VSYNTH-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
 
@@ -486,6 +524,11 @@ FATE_FILTER_VSYNTH-$(CONFIG_SCALE_FILTER) += fate-filter-scalechroma
 fate-filter-scalechroma: tests/data/vsynth1.yuv
 fate-filter-scalechroma: CMD = framecrc -flags bitexact -s 352x288 -pix_fmt yuv444p -i $(TARGET_PATH)/tests/data/vsynth1.yuv -pix_fmt yuv420p -sws_flags +bitexact -vf scale=out_v_chr_pos=33:out_h_chr_pos=151
 
+FATE_FILTER_VSYNTH-$(CONFIG_SCALE_FILTER) += fate-filter-scalechroma-threads
+fate-filter-scalechroma-threads: tests/data/vsynth1.yuv
+fate-filter-scalechroma-threads: CMD = framecrc -flags bitexact -s 352x288 -pix_fmt yuv444p -i $(TARGET_PATH)/tests/data/vsynth1.yuv -pix_fmt yuv420p -sws_flags +bitexact -vf scale=out_v_chr_pos=33:out_h_chr_pos=151:threads=4
+fate-filter-scalechroma-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-scalechroma
+
 FATE_FILTER_VSYNTH-$(CONFIG_VFLIP_FILTER) += fate-filter-vflip
 fate-filter-vflip: CMD = video_filter "vflip"
 
@@ -805,6 +848,12 @@ fate-filter-refcmp-ssim-rgb: CMD = refcmp_metadata ssim rgb24 0.015
 FATE_FILTER_SAMPLES-$(call ALLYES, $(REFCMP_DEPS) SSIM_FILTER) += fate-filter-refcmp-ssim-yuv
 fate-filter-refcmp-ssim-yuv: CMD = refcmp_metadata ssim yuv422p 0.015
 
+# The PSNR computed along with the SSIM, also split into slices
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) SSIM_FILTER) += fate-filter-refcmp-ssim-psnr-yuv fate-filter-refcmp-ssim-psnr-yuv-threads
+fate-filter-refcmp-ssim-psnr-yuv fate-filter-refcmp-ssim-psnr-yuv-threads: CMD = refcmp_metadata ssim=psnr=1 yuv422p 0.0015
+fate-filter-refcmp-ssim-psnr-yuv-threads: THREADS = 3
+fate-filter-refcmp-ssim-psnr-yuv-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-refcmp-ssim-psnr-yuv
+
 FATE_SAMPLES_FFPROBE += $(FATE_METADATA_FILTER-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_FILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_FILTER-yes)
@@ -188,12 +188,12 @@ HEVC_SAMPLES_444_12BIT =        \
 
 define FATE_HEVC_TEST
 FATE_HEVC += fate-hevc-conformance-$(1)
-fate-hevc-conformance-$(1): CMD = framecrc -flags unaligned -vsync drop -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p
+fate-hevc-conformance-$(1) fate-hevc-conformance-$(1)-wpp-threads: CMD = framecrc -flags unaligned -vsync drop $$(HEVC_WPP_OPTS) -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p
 endef
 
 define FATE_HEVC_TEST_10BIT
 FATE_HEVC += fate-hevc-conformance-$(1)
-fate-hevc-conformance-$(1): CMD = framecrc -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p10le
+fate-hevc-conformance-$(1) fate-hevc-conformance-$(1)-wpp-threads: CMD = framecrc -flags unaligned $$(HEVC_WPP_OPTS) -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p10le
 endef
 
 define FATE_HEVC_TEST_422_10BIT
@@ -223,6 +223,15 @@ $(foreach N,$(HEVC_SAMPLES_422_10BIN),$(eval $(call FATE_HEVC_TEST_422_10BIN,$(N
 $(foreach N,$(HEVC_SAMPLES_444_8BIT),$(eval $(call FATE_HEVC_TEST_444_8BIT,$(N))))
 $(foreach N,$(HEVC_SAMPLES_444_12BIT),$(eval $(call FATE_HEVC_TEST_444_12BIT,$(N))))
 
+# The streams with entry points decoded by frame threads that decode the rows
+# of their pictures in parallel, against the same references.
+FATE_HEVC_WPP_THREADS = $(patsubst %,fate-hevc-conformance-%-wpp-threads,$(filter WPP_% ENTP_%,$(HEVC_SAMPLES) $(HEVC_SAMPLES_10BIT)))
+$(FATE_HEVC_WPP_THREADS): THREADS = 3
+$(FATE_HEVC_WPP_THREADS): THREAD_TYPE = frame
+$(FATE_HEVC_WPP_THREADS): HEVC_WPP_OPTS = -wpp_threads 2
+$(FATE_HEVC_WPP_THREADS): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-%-wpp-threads=%)
+FATE_HEVC += $(FATE_HEVC_WPP_THREADS)
+
 fate-hevc-paramchange-yuv420p-yuv420p10: CMD = framecrc -vsync 0 -i $(TARGET_SAMPLES)/hevc/paramchange_yuv420p_yuv420p10.hevc -sws_flags area+accurate_rnd+bitexact
 FATE_HEVC += fate-hevc-paramchange-yuv420p-yuv420p10
 
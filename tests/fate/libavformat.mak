@@ -2,6 +2,12 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+ifeq ($(HAVE_THREADS),yes)
+FATE_LIBAVFORMAT-$(call ALLYES, CACHE_PROTOCOL HTTP_PROTOCOL) += fate-cache_dir
+endif
+fate-cache_dir: libavformat/tests/cache_dir$(EXESUF)
+fate-cache_dir: CMD = run libavformat/tests/cache_dir$(EXESUF) $(TARGET_PATH)/tests/data/fate/cache_dir.dir
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
@@ -14,10 +20,28 @@ FATE_LIBAVFORMAT-$(CONFIG_SRTP) += fate-srtp
 fate-srtp: libavformat/tests/srtp$(EXESUF)
 fate-srtp: CMD = run libavformat/tests/srtp$(EXESUF)
 
+ifeq ($(HAVE_SENDMMSG),yes)
+FATE_LIBAVFORMAT-$(CONFIG_UDP_PROTOCOL) += fate-udp_batch
+endif
+fate-udp_batch: libavformat/tests/udp_batch$(EXESUF)
+fate-udp_batch: CMD = run libavformat/tests/udp_batch$(EXESUF)
+
 FATE_LIBAVFORMAT-yes += fate-url
 fate-url: libavformat/tests/url$(EXESUF)
 fate-url: CMD = run libavformat/tests/url$(EXESUF)
 
+ifeq ($(HAVE_MMAP),yes)
+FATE_LIBAVFORMAT-$(CONFIG_FILE_PROTOCOL) += fate-file_mmap
+endif
+fate-file_mmap: libavformat/tests/file_mmap$(EXESUF)
+fate-file_mmap: CMD = run libavformat/tests/file_mmap$(EXESUF) $(TARGET_PATH)/tests/data/fate/file_mmap.bin
+
+ifeq ($(HAVE_THREADS),yes)
+FATE_LIBAVFORMAT-$(CONFIG_HTTP_PROTOCOL) += fate-http_pool
+endif
+fate-http_pool: libavformat/tests/http_pool$(EXESUF)
+fate-http_pool: CMD = run libavformat/tests/http_pool$(EXESUF)
+
 FATE_LIBAVFORMAT-$(CONFIG_MOV_MUXER) += fate-movenc
 fate-movenc: libavformat/tests/movenc$(EXESUF)
 fate-movenc: CMD = run libavformat/tests/movenc$(EXESUF)
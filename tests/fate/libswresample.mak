@@ -1082,6 +1082,23 @@ $(call CROSS_TEST,$(SAMPLERATES_LITE),ARESAMPLE_EXACT_LIN_ASYNC,s32p,s32le,s16)
 $(call CROSS_TEST,$(SAMPLERATES_LITE),ARESAMPLE_EXACT_LIN_ASYNC,fltp,f32le,s16)
 $(call CROSS_TEST,$(SAMPLERATES_LITE),ARESAMPLE_EXACT_LIN_ASYNC,dblp,f64le,s16)
 
+# same as ARESAMPLE, with the resampler running on four threads
+define ARESAMPLE_THREADS
+FATE_SWR_RESAMPLE += fate-swr-resample_threads-$(3)-$(1)-$(2)
+fate-swr-resample_threads-$(3)-$(1)-$(2): tests/data/asynth-$(1)-1.wav
+fate-swr-resample_threads-$(3)-$(1)-$(2): CMD = ffmpeg -i $(TARGET_PATH)/tests/data/asynth-$(1)-1.wav -af atrim=end_sample=10240,aresample=$(2):internal_sample_fmt=$(3):exact_rational=0:linear_interp=0:threads=4,aformat=$(3),aresample=$(1):internal_sample_fmt=$(3):exact_rational=0:linear_interp=0:threads=4 -f wav -c:a pcm_s16le -
+
+fate-swr-resample_threads-$(3)-$(1)-$(2): CMP = stddev
+fate-swr-resample_threads-$(3)-$(1)-$(2): CMP_UNIT = $(5)
+fate-swr-resample_threads-$(3)-$(1)-$(2): FUZZ = 0.1
+fate-swr-resample_threads-$(3)-$(1)-$(2): REF = tests/data/asynth-$(1)-1.wav
+fate-swr-resample_threads-$(3)-$(1)-$(2): CMP_TARGET = $(6)
+fate-swr-resample_threads-$(3)-$(1)-$(2): SIZE_TOLERANCE = $(7)
+endef
+
+$(eval $(call ARESAMPLE_THREADS,44100,48000,s16p,s16le,s16,9.71,529200 - 20482))
+$(eval $(call ARESAMPLE_THREADS,44100,48000,fltp,f32le,s16,9.69,529200 - 20482))
+
 FATE_SWR_RESAMPLE-$(call FILTERDEMDECENCMUX, ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += $(FATE_SWR_RESAMPLE)
 fate-swr-resample: $(FATE_SWR_RESAMPLE-yes)
 FATE_SWR += $(FATE_SWR_RESAMPLE-yes)
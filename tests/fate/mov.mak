@@ -124,3 +124,72 @@ fate-mov-faststart-4gb-overflow: CMP = oneline
 fate-mov-faststart-4gb-overflow: REF = bc875921f151871e787c4b4023269b29
 
 fate-mov-mp4-with-mov-in24-ver: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=codec_name -select_streams 1 $(TARGET_SAMPLES)/mov/mp4-with-mov-in24-ver.mp4
+
+# The same tests with the sample index built incrementally, against the same
+# references.
+FATE_MOV_LAZY_INDEX = fate-mov-3elist-lazy-index \
+                      fate-mov-3elist-1ctts-lazy-index \
+                      fate-mov-1elist-1ctts-lazy-index \
+                      fate-mov-1elist-noctts-lazy-index \
+                      fate-mov-elist-starts-ctts-2ndsample-lazy-index \
+                      fate-mov-1elist-ends-last-bframe-lazy-index \
+                      fate-mov-2elist-elist1-ends-bframe-lazy-index \
+                      fate-mov-3elist-encrypted-lazy-index \
+                      fate-mov-frag-encrypted-lazy-index \
+                      fate-mov-tenc-only-encrypted-lazy-index \
+                      fate-mov-invalid-elst-entry-count-lazy-index \
+                      fate-mov-440hz-10ms-lazy-index \
+                      fate-mov-ibi-elst-starts-b-lazy-index \
+                      fate-mov-elst-ends-betn-b-and-i-lazy-index \
+                      fate-mov-frag-overlap-lazy-index \
+                      fate-mov-bbi-elst-starts-b-lazy-index \
+                      fate-mov-neg-firstpts-discard-frames-lazy-index \
+                      fate-mov-stream-shorter-than-movie-lazy-index \
+
+FATE_MOV_FFPROBE_LAZY_INDEX = fate-mov-neg-firstpts-discard-lazy-index \
+                              fate-mov-neg-firstpts-discard-vorbis-lazy-index \
+                              fate-mov-aac-2048-priming-lazy-index \
+                              fate-mov-zombie-lazy-index \
+                              fate-mov-init-nonkeyframe-lazy-index \
+                              fate-mov-displaymatrix-lazy-index \
+                              fate-mov-spherical-mono-lazy-index \
+                              fate-mov-guess-delay-1-lazy-index \
+                              fate-mov-guess-delay-2-lazy-index \
+                              fate-mov-guess-delay-3-lazy-index \
+                              fate-mov-mp4-with-mov-in24-ver-lazy-index \
+
+FATE_SAMPLES_AVCONV += $(FATE_MOV_LAZY_INDEX)
+FATE_SAMPLES_FFPROBE += $(FATE_MOV_FFPROBE_LAZY_INDEX)
+
+fate-mov: $(FATE_MOV_LAZY_INDEX) $(FATE_MOV_FFPROBE_LAZY_INDEX)
+$(FATE_MOV_LAZY_INDEX) $(FATE_MOV_FFPROBE_LAZY_INDEX): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-%-lazy-index=%)
+
+fate-mov-3elist-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-3elist.mov
+fate-mov-3elist-1ctts-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-3elist-1ctts.mov
+fate-mov-1elist-1ctts-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-1elist-1ctts.mov
+fate-mov-1elist-noctts-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-1elist-noctts.mov
+fate-mov-elist-starts-ctts-2ndsample-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-elist-starts-ctts-2ndsample.mov
+fate-mov-1elist-ends-last-bframe-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-1elist-ends-last-bframe.mov
+fate-mov-2elist-elist1-ends-bframe-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-2elist-elist1-ends-bframe.mov
+fate-mov-3elist-encrypted-lazy-index: CMD = framemd5 -lazy_index 1 -decryption_key 12345678901234567890123456789012 -i $(TARGET_SAMPLES)/mov/mov-3elist-encrypted.mov
+fate-mov-frag-encrypted-lazy-index: CMD = framemd5 -lazy_index 1 -decryption_key 12345678901234567890123456789012 -i $(TARGET_SAMPLES)/mov/mov-frag-encrypted.mp4
+fate-mov-tenc-only-encrypted-lazy-index: CMD = framemd5 -lazy_index 1 -decryption_key 12345678901234567890123456789012 -i $(TARGET_SAMPLES)/mov/mov-tenc-only-encrypted.mp4
+fate-mov-invalid-elst-entry-count-lazy-index: CMD = framemd5 -lazy_index 1 -idct simple -flags +bitexact -i $(TARGET_SAMPLES)/mov/invalid_elst_entry_count.mov
+fate-mov-440hz-10ms-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/440hz-10ms.m4a
+fate-mov-ibi-elst-starts-b-lazy-index: CMD = framemd5 -lazy_index 1 -flags +bitexact -i $(TARGET_SAMPLES)/mov/mov_ibi_elst_starts_b.mov
+fate-mov-elst-ends-betn-b-and-i-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/elst_ends_betn_b_and_i.mp4
+fate-mov-frag-overlap-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/frag_overlap.mp4
+fate-mov-bbi-elst-starts-b-lazy-index: CMD = framemd5 -lazy_index 1 -flags +bitexact -acodec aac_fixed -i $(TARGET_SAMPLES)/h264/twofields_packet.mp4
+fate-mov-neg-firstpts-discard-frames-lazy-index: CMD = framemd5 -lazy_index 1 -flags +bitexact -i $(TARGET_SAMPLES)/mov/mov_neg_first_pts_discard.mov -vsync 1
+fate-mov-stream-shorter-than-movie-lazy-index: CMD = framemd5 -lazy_index 1 -flags +bitexact -i $(TARGET_SAMPLES)/mov/mov_stream_shorter_than_movie.mov -vf fps=fps=24 -an
+fate-mov-neg-firstpts-discard-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=start_time -bitexact -lazy_index 1 $(TARGET_SAMPLES)/mov/mov_neg_first_pts_discard.mov
+fate-mov-neg-firstpts-discard-vorbis-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=start_time -bitexact -lazy_index 1 $(TARGET_SAMPLES)/mov/mov_neg_first_pts_discard_vorbis.mp4
+fate-mov-aac-2048-priming-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_packets -print_format compact -lazy_index 1 $(TARGET_SAMPLES)/mov/aac-2048-priming.mov
+fate-mov-zombie-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_streams -show_packets -show_frames -bitexact -print_format compact -lazy_index 1 $(TARGET_SAMPLES)/mov/white_zombie_scrunch-part.mov
+fate-mov-init-nonkeyframe-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_packets -print_format compact -select_streams v -lazy_index 1 $(TARGET_SAMPLES)/mov/mp4-init-nonkeyframe.mp4
+fate-mov-displaymatrix-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=display_aspect_ratio,sample_aspect_ratio:stream_side_data_list -select_streams v -v 0 -lazy_index 1 $(TARGET_SAMPLES)/mov/displaymatrix.mov
+fate-mov-spherical-mono-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream_side_data_list -select_streams v -v 0 -lazy_index 1 $(TARGET_SAMPLES)/mov/spherical.mov
+fate-mov-guess-delay-1-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=has_b_frames -select_streams v -lazy_index 1 $(TARGET_SAMPLES)/h264/h264_3bf_nopyramid_nobsrestriction.mp4
+fate-mov-guess-delay-2-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=has_b_frames -select_streams v -lazy_index 1 $(TARGET_SAMPLES)/h264/h264_3bf_pyramid_nobsrestriction.mp4
+fate-mov-guess-delay-3-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=has_b_frames -select_streams v -lazy_index 1 $(TARGET_SAMPLES)/h264/h264_4bf_pyramid_nobsrestriction.mp4
+fate-mov-mp4-with-mov-in24-ver-lazy-index: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=codec_name -select_streams 1 -lazy_index 1 $(TARGET_SAMPLES)/mov/mp4-with-mov-in24-ver.mp4
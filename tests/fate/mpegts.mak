@@ -20,6 +20,26 @@ fate-mpegts-probe-pmt-merge: SRC = $(TARGET_SAMPLES)/mpegts/pmtchange.ts
 fate-mpegts-probe-pmt-merge: CMD = run $(PROBE_CODEC_NAME_COMMAND) -merge_pmt_versions 1 -i "$(SRC)"
 
 
+#
+# Test selecting streams of a multiprogram MPEGTS, unselected PIDs are skipped
+#
+tests/data/mpegts-multiprogram.ts: TAG = GEN
+tests/data/mpegts-multiprogram.ts: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+		-f lavfi -i "testsrc=d=2:r=10:s=160x120" -f lavfi -i "testsrc2=d=2:r=10:s=160x120" \
+		-f lavfi -i "sine=d=2:f=440" -f lavfi -i "sine=d=2:f=880" \
+		-map 0 -map 2 -map 1 -map 3 -c:v mpeg2video -c:a mp2 \
+		-program program_num=1:st=0:st=1 -program program_num=2:st=2:st=3 \
+		-flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MPEGTS_SELECT = fate-mpegts-select-all fate-mpegts-select-subset fate-mpegts-select-one
+$(FATE_MPEGTS_SELECT): tests/data/mpegts-multiprogram.ts
+fate-mpegts-select-all: CMD = framecrc -i $(TARGET_PATH)/tests/data/mpegts-multiprogram.ts -map 0 -c copy
+fate-mpegts-select-subset: CMD = framecrc -i $(TARGET_PATH)/tests/data/mpegts-multiprogram.ts -map 0:2 -map 0:1 -c copy
+fate-mpegts-select-one: CMD = framecrc -i $(TARGET_PATH)/tests/data/mpegts-multiprogram.ts -map 0:3 -c copy
+
+FATE_FFMPEG-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER TESTSRC2_FILTER SINE_FILTER MPEG2VIDEO_ENCODER MP2_ENCODER MPEGTS_MUXER MPEGTS_DEMUXER) += $(FATE_MPEGTS_SELECT)
+
 FATE_SAMPLES_FFPROBE += $(FATE_MPEGTS_PROBE-yes)
 
-fate-mpegts: $(FATE_MPEGTS_PROBE-yes)
+fate-mpegts: $(FATE_MPEGTS_PROBE-yes) $(FATE_MPEGTS_SELECT)
@@ -159,6 +159,13 @@ $(eval $(call FATE_VP9_SUITE,trac4359))
 endef
 
 $(eval $(call FATE_VP9_FULL))
+
+# Frame threads decoding the tile columns of their frames in parallel
+VP9_TILE_THREADS = 2pass-akiyo parallelmode-akiyo tiling-pedestrian 10-show-existing-frame
+$(foreach T,$(VP9_TILE_THREADS),$(eval $(call FATE_VP9_SUITE,$(T),-tile-threads,-tile_threads 2)))
+fate-vp9-tile-threads-%: THREADS = 3
+fate-vp9-tile-threads-%: THREAD_TYPE = frame
+
 FATE_VP9-$(CONFIG_IVF_DEMUXER) += fate-vp9-05-resize
 fate-vp9-05-resize: CMD = framemd5 -i $(TARGET_SAMPLES)/vp9-test-vectors/vp90-2-05-resize.ivf -s 352x288 -sws_flags bitexact+bilinear
 fate-vp9-05-resize: REF = $(SRC_PATH)/tests/ref/fate/vp9-05-resize